@@ -0,0 +1,195 @@
+#include "account_summary.h"
+
+#include <stdlib.h>  // free, realloc
+#include <string.h>  // memset
+
+#include "util.h"  // error_and_exit
+
+// A user's summary and whether it changed since the last checkpoint.
+typedef struct {
+  account_summary summary;
+  int dirty;
+} account_slot;
+
+// The summaries, each at its user's ID, which the database hands out in
+// order.
+static account_slot* slots;
+static int slot_count;
+
+// The users whose summaries changed since the last checkpoint.
+static int* dirty_users;
+static int dirty_count;
+static int dirty_capacity;
+
+// The ID of the latest execution counted.
+static int64_t latest_execution_id;
+
+// Find a user's slot, making room for it if the user is new.
+static account_slot* find_slot(int userID) {
+  if (userID >= slot_count) {
+    int count = slot_count > 0 ? slot_count : 64;
+    while (count <= userID) {
+      count *= 2;
+    }
+    account_slot* temp = realloc(slots, (size_t)count * sizeof(account_slot));
+    if (temp == NULL) {
+      error_and_exit("Can't allocate account summaries");
+    }
+    memset(temp + slot_count, 0,
+           (size_t)(count - slot_count) * sizeof(account_slot));
+    for (int i = slot_count; i < count; ++i) {
+      temp[i].summary.userID = i;
+      temp[i].summary.lastExecutionID = -1;
+    }
+    slots = temp;
+    slot_count = count;
+  }
+  return &slots[userID];
+}
+
+// Note that a user's summary needs checkpointing.
+static void mark_dirty(account_slot* slot) {
+  if (slot->dirty) {
+    return;
+  }
+  if (dirty_count == dirty_capacity) {
+    int capacity = dirty_capacity > 0 ? 2 * dirty_capacity : 64;
+    int* temp = realloc(dirty_users, (size_t)capacity * sizeof(int));
+    if (temp == NULL) {
+      error_and_exit("Can't allocate account summaries");
+    }
+    dirty_users = temp;
+    dirty_capacity = capacity;
+  }
+  dirty_users[dirty_count++] = slot->summary.userID;
+  slot->dirty = 1;
+}
+
+static void touch(account_summary* summary, int64_t now) {
+  if (now > summary->lastActiveAt) {
+    summary->lastActiveAt = now;
+  }
+}
+
+static void add_fill(account_summary* summary, const execution* fill) {
+  summary->filled[fill->item] += fill->quantity;
+  ++summary->tradeCount;
+  summary->notional += fill->price * fill->quantity;
+  touch(summary, fill->executedAt);
+}
+
+int load_account_summaries(sqlite3* database) {
+  free(slots);
+  free(dirty_users);
+  slots = NULL;
+  slot_count = 0;
+  dirty_users = NULL;
+  dirty_count = 0;
+  dirty_capacity = 0;
+  latest_execution_id = 0;
+
+  account_summary* stored = NULL;
+  int count = 0;
+  if (get_account_summaries(database, &stored, &count) != SQLITE_OK) {
+    return -1;
+  }
+  // A user without a checkpoint has only traded since the latest one, so
+  // counting again from the oldest checkpoint covers everyone.
+  int64_t oldest_checkpoint = -1;
+  for (int i = 0; i < count; ++i) {
+    find_slot(stored[i].userID)->summary = stored[i];
+    int64_t checkpoint = stored[i].lastExecutionID;
+    if (checkpoint > latest_execution_id) {
+      latest_execution_id = checkpoint;
+    }
+    if (checkpoint != -1 &&
+        (oldest_checkpoint == -1 || checkpoint < oldest_checkpoint)) {
+      oldest_checkpoint = checkpoint;
+    }
+  }
+  free(stored);
+
+  execution* fills = NULL;
+  if (get_executions_after(database, oldest_checkpoint, &fills, &count) !=
+      SQLITE_OK) {
+    return -1;
+  }
+  for (int i = 0; i < count; ++i) {
+    // Finding the seller may move the slots, so the buyer is done with first.
+    const execution* fill = &fills[i];
+    account_slot* buyer = find_slot(fill->buyerID);
+    if (fill->executionID > buyer->summary.lastExecutionID) {
+      add_fill(&buyer->summary, fill);
+      mark_dirty(buyer);
+    }
+    if (fill->sellerID != fill->buyerID) {
+      account_slot* seller = find_slot(fill->sellerID);
+      if (fill->executionID > seller->summary.lastExecutionID) {
+        add_fill(&seller->summary, fill);
+        mark_dirty(seller);
+      }
+    }
+    latest_execution_id = fill->executionID;
+  }
+  free(fills);
+  return 0;
+}
+
+void record_order_opened(int userID, int64_t now) {
+  account_slot* slot = find_slot(userID);
+  ++slot->summary.openOrders;
+  touch(&slot->summary, now);
+  mark_dirty(slot);
+}
+
+void record_order_closed(int userID, int64_t now) {
+  account_slot* slot = find_slot(userID);
+  if (slot->summary.openOrders > 0) {
+    --slot->summary.openOrders;
+  }
+  touch(&slot->summary, now);
+  mark_dirty(slot);
+}
+
+void record_account_fill(const execution* fill) {
+  account_slot* buyer = find_slot(fill->buyerID);
+  add_fill(&buyer->summary, fill);
+  mark_dirty(buyer);
+  if (fill->sellerID != fill->buyerID) {
+    account_slot* seller = find_slot(fill->sellerID);
+    add_fill(&seller->summary, fill);
+    mark_dirty(seller);
+  }
+  if (fill->executionID > latest_execution_id) {
+    latest_execution_id = fill->executionID;
+  }
+}
+
+void get_account_summary(int userID, account_summary* summary) {
+  if (userID < 0 || userID >= slot_count) {
+    memset(summary, 0, sizeof(*summary));
+    summary->userID = userID;
+    summary->lastExecutionID = -1;
+    return;
+  }
+  *summary = slots[userID].summary;
+}
+
+int checkpoint_account_summaries(sqlite3* database) {
+  int result = SQLITE_OK;
+  int kept = 0;
+  for (int i = 0; i < dirty_count; ++i) {
+    account_slot* slot = &slots[dirty_users[i]];
+    // Every execution so far is counted in the summary.
+    slot->summary.lastExecutionID = latest_execution_id;
+    int res = save_account_summary(database, &slot->summary);
+    if (res == SQLITE_OK) {
+      slot->dirty = 0;
+    } else {
+      result = res;
+      dirty_users[kept++] = dirty_users[i];
+    }
+  }
+  dirty_count = kept;
+  return result;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <sqlite3.h>  // sqlite3
+#include <stdint.h>   // int64_t
+
+#include "db.h"  // account_summary, execution
+
+// How often the summaries that changed are checkpointed, in seconds. After a
+// restart, the executions since the last checkpoint are counted again.
+enum { ACCOUNT_CHECKPOINT_SECONDS = 60 };
+
+// Like the market data, the summaries are shared by every session and may only
+// be used by one thread at a time, so call these functions while holding the
+// lock commands run under. Each update takes constant time.
+
+/**
+ * Rebuild every user's summary from the last checkpoint, the orders on the
+ * book and the executions since.
+ *
+ * Call this once at startup, before any client can trade.
+ *
+ * @param database The database holding the checkpoints.
+ * @return 0 on success, or -1 if the summaries couldn't be read.
+ */
+int load_account_summaries(sqlite3* database);
+
+/**
+ * Count an order put on the book.
+ *
+ * @param userID The owner of the order.
+ * @param now The current time in seconds since the Unix epoch.
+ */
+void record_order_opened(int userID, int64_t now);
+
+/**
+ * Count an order taken off the book, whether filled or cancelled.
+ *
+ * @param userID The owner of the order.
+ * @param now The current time in seconds since the Unix epoch.
+ */
+void record_order_closed(int userID, int64_t now);
+
+/**
+ * Count an execution for its buyer and its seller.
+ *
+ * @param fill The execution.
+ */
+void record_account_fill(const execution* fill);
+
+/**
+ * Get a user's summary.
+ *
+ * @param userID The user.
+ * @param summary Where to store the summary, all zeros if the user has done
+ * nothing yet.
+ */
+void get_account_summary(int userID, account_summary* summary);
+
+/**
+ * Store the summaries that changed since the last checkpoint.
+ *
+ * @param database The database to store them in.
+ * @return SQLITE_OK on success, or an SQLite error code if a summary couldn't
+ * be stored, in which case it is tried again at the next checkpoint.
+ */
+int checkpoint_account_summaries(sqlite3* database);
@@ -0,0 +1,87 @@
+/**
+ * Microbenchmark for the fixed-point price parser.
+ *
+ * Parse the same set of generated prices with parse_price and with strtod,
+ * and print the average time per call for each.
+ */
+#include <stdint.h>  // int64_t
+#include <stdio.h>   // printf, snprintf
+#include <stdlib.h>  // strtod, rand, srand
+#include <string.h>  // strlen
+#include <time.h>    // clock_gettime
+
+#include "fixed_point.h"
+
+enum {
+  // How many different prices to parse.
+  PRICE_COUNT = 4096,
+  // The longest price text generated, including its null terminator.
+  PRICE_TEXT_SIZE = 16,
+  // How many times to parse every price.
+  ROUNDS = 2000,
+};
+
+static char prices[PRICE_COUNT][PRICE_TEXT_SIZE];
+static size_t lengths[PRICE_COUNT];
+
+// Return the current time in nanoseconds.
+static double now_ns(void) {
+  struct timespec now;
+  (void)clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+int main(void) {
+  srand(4242);
+  for (size_t i = 0; i < PRICE_COUNT; ++i) {
+    // Mix whole prices with ones that have one or two decimal places.
+    int units = rand() % 100000;
+    int cents = rand() % 100;
+    int written = 0;
+    switch (i % 3) {
+      case 0:
+        written = snprintf(prices[i], PRICE_TEXT_SIZE, "%d", units);
+        break;
+      case 1:
+        written = snprintf(prices[i], PRICE_TEXT_SIZE, "%d.%d", units,
+                           cents % 10);
+        break;
+      default:
+        written = snprintf(prices[i], PRICE_TEXT_SIZE, "%d.%02d", units, cents);
+        break;
+    }
+    lengths[i] = (size_t)written;
+  }
+
+  int64_t tick_sum = 0;
+  double start = now_ns();
+  for (int round = 0; round < ROUNDS; ++round) {
+    for (size_t i = 0; i < PRICE_COUNT; ++i) {
+      int64_t ticks = 0;
+      if (parse_price(prices[i], lengths[i], &ticks) == PARSE_OK) {
+        tick_sum += ticks;
+      }
+    }
+  }
+  double parse_price_ns = (now_ns() - start) / ((double)ROUNDS * PRICE_COUNT);
+
+  double price_sum = 0;
+  start = now_ns();
+  for (int round = 0; round < ROUNDS; ++round) {
+    for (size_t i = 0; i < PRICE_COUNT; ++i) {
+      char* endptr = NULL;
+      double price = strtod(prices[i], &endptr);
+      if (endptr != prices[i]) {
+        price_sum += price;
+      }
+    }
+  }
+  double strtod_ns = (now_ns() - start) / ((double)ROUNDS * PRICE_COUNT);
+
+  // Print the sums so the compiler can't skip the work.
+  printf("parse_price: %6.2f ns/call (sum %lld)\n", parse_price_ns,
+         (long long)tick_sum);
+  printf("strtod:      %6.2f ns/call (sum %.2f)\n", strtod_ns, price_sum);
+  printf("speedup:     %6.2fx\n", strtod_ns / parse_price_ns);
+  return 0;
+}
@@ -0,0 +1,212 @@
+/**
+ * Benchmark for the server's I/O backends.
+ *
+ * Run the server in this process with the backend named on the command line,
+ * connect a number of clients over loopback, and have each of them place
+ * orders one at a time, waiting for every reply. Print the system calls the
+ * server made per order and the order latency percentiles.
+ *
+ * The benchmark resets database.db in the working directory, like the server.
+ */
+#include <arpa/inet.h>   // INADDR_LOOPBACK
+#include <pthread.h>     // pthread_create, pthread_join
+#include <sqlite3.h>     // sqlite3
+#include <stdio.h>       // fprintf, snprintf, fdopen, freopen
+#include <stdlib.h>      // qsort, malloc, free, EXIT_FAILURE
+#include <string.h>      // strcmp, strlen, memcmp, memmove
+#include <sys/socket.h>  // socket, connect, send, recv
+#include <time.h>        // clock_gettime, nanosleep
+#include <unistd.h>      // close, dup
+
+#include "command.h"   // open_db, init_db
+#include "io_stats.h"  // total_io_syscalls
+#include "server.h"    // echo_server, related functions
+#include "util.h"      // socket_address, error_and_exit
+
+enum {
+  // A port apart from the real server's, so both can run at once.
+  BENCH_PORT = 4343,
+  // The number of clients placing orders at the same time.
+  CLIENT_COUNT = 8,
+  // The number of orders each client places. Every order is a database
+  // transaction, so this is kept small.
+  ORDERS_PER_CLIENT = 100,
+  // The most bytes read from the server at once.
+  REPLY_SIZE = 4096,
+};
+
+// Group what one benchmark client needs.
+typedef struct {
+  /// The client's number, used to make its username unique.
+  int index;
+  /// The socket connected to the server.
+  int socket_descriptor;
+  /// How long each order took to be answered, in nanoseconds.
+  double* latencies;
+  /// Signals the order phase to start once every client has logged in.
+  pthread_barrier_t* start;
+} bench_client;
+
+static double now_ns(void) {
+  struct timespec now;
+  (void)clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+// Send a whole string to the server.
+static void send_all(int socket_descriptor, const char* text) {
+  size_t length = strlen(text);
+  while (length > 0) {
+    ssize_t sent = send(socket_descriptor, text, length, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      error_and_exit("Can't send to server");
+    }
+    text += sent;
+    length -= (size_t)sent;
+  }
+}
+
+// Read from the server until what was read ends with the given text.
+static void receive_until(int socket_descriptor, const char* ending) {
+  char reply[REPLY_SIZE];
+  size_t size = 0;
+  size_t ending_length = strlen(ending);
+  for (;;) {
+    ssize_t received =
+        recv(socket_descriptor, reply + size, sizeof(reply) - size, 0);
+    if (received <= 0) {
+      error_and_exit("Can't receive from server");
+    }
+    size += (size_t)received;
+    if (size >= ending_length &&
+        memcmp(reply + size - ending_length, ending, ending_length) == 0) {
+      return;
+    }
+    if (size == sizeof(reply)) {
+      // Only the end matters, so keep the tail and read on.
+      memmove(reply, reply + size - ending_length, ending_length);
+      size = ending_length;
+    }
+  }
+}
+
+static void* run_client(void* arg) {
+  bench_client* client = arg;
+  int socket_descriptor = client->socket_descriptor;
+  char line[128];
+
+  // Register and log in.
+  receive_until(socket_descriptor, "existing users \r\n");
+  (void)snprintf(line, sizeof(line), "r\nbench%d\nBench\npw\n", client->index);
+  send_all(socket_descriptor, line);
+  receive_until(socket_descriptor, "existing users \r\n");
+  (void)snprintf(line, sizeof(line), "u\nbench%d\npw\n", client->index);
+  send_all(socket_descriptor, line);
+  receive_until(socket_descriptor, "\\______/ \r\n");
+
+  (void)pthread_barrier_wait(client->start);
+  for (int i = 0; i < ORDERS_PER_CLIENT; ++i) {
+    // Alternate sides so orders keep matching against other clients.
+    const char* request = (i + client->index) % 2 ? "buy btc 1 1\n"
+                                                  : "sell btc 1 1\n";
+    double start = now_ns();
+    send_all(socket_descriptor, request);
+    receive_until(socket_descriptor, "order!\r\n");
+    client->latencies[i] = now_ns() - start;
+  }
+  (void)pthread_barrier_wait(client->start);
+  return NULL;
+}
+
+static void* run_server(void* arg) {
+  echo_server* server = arg;
+  sqlite3* database = NULL;
+  if (open_db(&database) == -1 || init_db(database) == -1) {
+    error_and_exit("Can't set up database");
+  }
+  serve_clients(server, database);
+  return NULL;
+}
+
+static int compare_doubles(const void* left, const void* right) {
+  double difference = *(const double*)left - *(const double*)right;
+  return (difference > 0) - (difference < 0);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 2 ||
+      (strcmp(argv[1], "epoll") != 0 && strcmp(argv[1], "uring") != 0)) {
+    (void)fprintf(stderr, "Usage: %s epoll|uring\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  // The server logs every command, which would drown out the results and
+  // the I/O cost, so keep the terminal for the results alone.
+  FILE* results = fdopen(dup(STDOUT_FILENO), "w");
+  if (results == NULL || freopen("/dev/null", "w", stdout) == NULL ||
+      freopen("/dev/null", "w", stderr) == NULL) {
+    error_and_exit("Can't silence server output");
+  }
+
+  echo_server* server = make_echo_server(
+      socket_address(INADDR_LOOPBACK, BENCH_PORT), DEFAULT_BACKLOG_SIZE, 1);
+  server->backend =
+      strcmp(argv[1], "uring") == 0 ? IO_BACKEND_URING : IO_BACKEND_EPOLL;
+  listen_for_connections(server);
+  pthread_t server_thread;
+  if (pthread_create(&server_thread, NULL, run_server, server) != 0) {
+    error_and_exit("Can't start server");
+  }
+  // Give the server time to set up the database before clients log in.
+  struct timespec pause = {.tv_sec = 0, .tv_nsec = 200000000};
+  (void)nanosleep(&pause, NULL);
+
+  pthread_barrier_t start;
+  (void)pthread_barrier_init(&start, NULL, CLIENT_COUNT + 1);
+  bench_client clients[CLIENT_COUNT];
+  pthread_t threads[CLIENT_COUNT];
+  double* latencies =
+      malloc(sizeof(double) * CLIENT_COUNT * ORDERS_PER_CLIENT);
+  if (latencies == NULL) {
+    error_and_exit("Can't allocate latencies");
+  }
+  for (int i = 0; i < CLIENT_COUNT; ++i) {
+    struct sockaddr_in addr = socket_address(INADDR_LOOPBACK, BENCH_PORT);
+    clients[i].index = i;
+    clients[i].socket_descriptor = open_tcp_socket();
+    if (connect(clients[i].socket_descriptor, (struct sockaddr*)&addr,
+                sizeof(addr)) == -1) {
+      error_and_exit("Can't connect to server");
+    }
+    clients[i].latencies = latencies + (size_t)i * ORDERS_PER_CLIENT;
+    clients[i].start = &start;
+    if (pthread_create(&threads[i], NULL, run_client, &clients[i]) != 0) {
+      error_and_exit("Can't start client");
+    }
+  }
+
+  (void)pthread_barrier_wait(&start);
+  unsigned long long syscalls_before = total_io_syscalls();
+  double started = now_ns();
+  (void)pthread_barrier_wait(&start);
+  double elapsed = now_ns() - started;
+  unsigned long long syscalls = total_io_syscalls() - syscalls_before;
+  for (int i = 0; i < CLIENT_COUNT; ++i) {
+    (void)pthread_join(threads[i], NULL);
+    (void)close(clients[i].socket_descriptor);
+  }
+
+  size_t order_count = (size_t)CLIENT_COUNT * ORDERS_PER_CLIENT;
+  qsort(latencies, order_count, sizeof(double), compare_doubles);
+  (void)fprintf(results,
+                "%s: %zu orders from %d clients in %.2f s\n"
+                "  server syscalls per order: %.2f\n"
+                "  latency p50: %.1f us, p99: %.1f us, max: %.1f us\n",
+                argv[1], order_count, CLIENT_COUNT, elapsed / 1e9,
+                (double)syscalls / (double)order_count,
+                latencies[order_count / 2] / 1e3,
+                latencies[order_count * 99 / 100] / 1e3,
+                latencies[order_count - 1] / 1e3);
+  free(latencies);
+  (void)fclose(results);
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include "candles.h"
+
+#include <stdlib.h>  // free
+#include <string.h>  // memcmp, memset
+
+#include "market_data.h"  // MARKET_COIN_COUNT
+
+// The latest candles of one coin at one interval.
+typedef struct {
+  /// The candles, each at its position modulo CANDLE_HISTORY.
+  candle candles[CANDLE_HISTORY];
+  /// The number of candles ever added. The latest one is still in progress.
+  size_t count;
+} candle_series;
+
+// The name clients use for each interval and its length.
+static const struct {
+  const char* name;
+  int seconds;
+} intervals[CANDLE_INTERVAL_COUNT] = {
+    [CANDLE_SECOND] = {"1s", 1},
+    [CANDLE_MINUTE] = {"1m", 60},
+    [CANDLE_HOUR] = {"1h", 60 * 60},
+};
+
+static candle_series series[MARKET_COIN_COUNT][CANDLE_INTERVAL_COUNT];
+
+int find_candle_interval(const char* text, size_t length) {
+  for (int interval = 0; interval < CANDLE_INTERVAL_COUNT; ++interval) {
+    const char* name = intervals[interval].name;
+    if (length == strlen(name) && memcmp(text, name, length) == 0) {
+      return interval;
+    }
+  }
+  return -1;
+}
+
+int candle_interval_seconds(candle_interval interval) {
+  return intervals[interval].seconds;
+}
+
+// Start a new candle at the end of a series.
+static candle* add_candle(candle_series* bars) {
+  candle* bar = &bars->candles[bars->count % CANDLE_HISTORY];
+  ++bars->count;
+  return bar;
+}
+
+int load_candles(sqlite3* database) {
+  memset(series, 0, sizeof(series));
+  for (int item = 0; item < MARKET_COIN_COUNT; ++item) {
+    for (int interval = 0; interval < CANDLE_INTERVAL_COUNT; ++interval) {
+      candle* stored = NULL;
+      int count = 0;
+      if (get_recent_candles(database, item, intervals[interval].seconds,
+                             CANDLE_HISTORY, &stored, &count) != SQLITE_OK) {
+        return -1;
+      }
+      for (int i = 0; i < count; ++i) {
+        *add_candle(&series[item][interval]) = stored[i];
+      }
+      free(stored);
+    }
+  }
+  return 0;
+}
+
+int record_candle_trade(sqlite3* database, int item, int64_t price,
+                        int quantity, int64_t now) {
+  int result = SQLITE_OK;
+  for (int interval = 0; interval < CANDLE_INTERVAL_COUNT; ++interval) {
+    candle_series* bars = &series[item][interval];
+    int seconds = intervals[interval].seconds;
+    int64_t start = now - now % seconds;
+    candle* latest =
+        bars->count > 0
+            ? &bars->candles[(bars->count - 1) % CANDLE_HISTORY]
+            : NULL;
+    // A clock stepping back keeps adding to the latest candle, so candles
+    // stay in order.
+    if (latest != NULL && start <= latest->startTime) {
+      latest->high = price > latest->high ? price : latest->high;
+      latest->low = price < latest->low ? price : latest->low;
+      latest->close = price;
+      latest->volume += quantity;
+    } else {
+      latest = add_candle(bars);
+      *latest = (candle){.item = item,
+                         .interval = seconds,
+                         .startTime = start,
+                         .open = price,
+                         .high = price,
+                         .low = price,
+                         .close = price,
+                         .volume = quantity};
+    }
+    // The candle in progress is stored with the fill, in the same batch, so a
+    // restart picks it up where it was rather than starting it over.
+    int saved = save_candle(database, latest);
+    if (saved != SQLITE_OK) {
+      result = saved;
+    }
+  }
+  return result;
+}
+
+size_t copy_candles(int item, candle_interval interval, candle* candles,
+                    size_t count) {
+  const candle_series* bars = &series[item][interval];
+  size_t kept = bars->count < CANDLE_HISTORY ? bars->count : CANDLE_HISTORY;
+  if (count > kept) {
+    count = kept;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    candles[i] =
+        bars->candles[(bars->count - count + i) % CANDLE_HISTORY];
+  }
+  return count;
+}
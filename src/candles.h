@@ -0,0 +1,90 @@
+#pragma once
+
+#include <sqlite3.h>  // sqlite3
+#include <stddef.h>   // size_t
+#include <stdint.h>   // int64_t
+
+#include "db.h"  // candle
+
+/**
+ * @enum candle_interval
+ * @brief The lengths of time candles are kept for.
+ *
+ * CANDLE_SECOND - One candle per second.
+ * CANDLE_MINUTE - One candle per minute.
+ * CANDLE_HOUR - One candle per hour.
+ */
+typedef enum {
+  CANDLE_SECOND,
+  CANDLE_MINUTE,
+  CANDLE_HOUR,
+  CANDLE_INTERVAL_COUNT,
+} candle_interval;
+
+// The number of latest candles kept in memory for each coin and interval.
+enum { CANDLE_HISTORY = 256 };
+
+// Like the market data, the candles are shared by every session and may only
+// be used by one thread at a time, so call these functions while holding the
+// lock commands run under.
+
+/**
+ * Look up an interval by the name clients use for it.
+ *
+ * @param text The name, such as "1s", "1m", or "1h". It does not need to be
+ * null-terminated.
+ * @param length The number of characters in the name.
+ * @return The interval, or -1 if there is none by that name.
+ */
+int find_candle_interval(const char* text, size_t length);
+
+/**
+ * Return the length of an interval in seconds.
+ *
+ * @param interval The interval.
+ * @return The number of seconds each of its candles covers.
+ */
+int candle_interval_seconds(candle_interval interval);
+
+/**
+ * Reload the latest candles stored in the database.
+ *
+ * Call this once at startup, before any client can trade.
+ *
+ * @param database The database holding the candles.
+ * @return 0 on success, or -1 if the candles couldn't be read.
+ */
+int load_candles(sqlite3* database);
+
+/**
+ * Add a trade to the current candle of every interval for a coin.
+ *
+ * This takes constant time. Each candle the trade changes is stored in the
+ * database straight away, one row write per interval, so the candles in
+ * progress survive a restart along with the trade.
+ *
+ * @param database The database to store the candles in.
+ * @param item The coin traded.
+ * @param price The price traded at, in ticks.
+ * @param quantity The number of coins traded.
+ * @param now The time of the trade in seconds since the Unix epoch.
+ * @return SQLITE_OK on success, or an SQLite error code if a candle couldn't be
+ * stored, in which case the trade is still counted.
+ */
+int record_candle_trade(sqlite3* database, int item, int64_t price,
+                        int quantity, int64_t now);
+
+/**
+ * Copy the latest candles of a coin, including the one still in progress.
+ *
+ * Intervals without trades have no candle.
+ *
+ * @param item The coin.
+ * @param interval The interval of the candles.
+ * @param candles Where to copy the candles, oldest first. It must have room
+ * for count candles.
+ * @param count The most candles to copy, at most CANDLE_HISTORY.
+ * @return The number of candles copied.
+ */
+size_t copy_candles(int item, candle_interval interval, candle* candles,
+                    size_t count);
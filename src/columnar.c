@@ -0,0 +1,371 @@
+#include "columnar.h"
+
+#include <stdlib.h>  // bsearch, calloc, free, qsort
+#include <string.h>  // memcmp, memcpy, strcmp, strlen
+
+// The bytes every columnar file starts with, followed by its format version.
+static const char MAGIC[4] = {'O', 'M', 'G', 'C'};
+enum { FORMAT_VERSION = 1 };
+
+// The most bytes a varint of 64 bits takes.
+enum { MAX_VARINT_SIZE = 10 };
+
+// The most bytes one column of a block takes: a dictionary as large as the
+// block followed by an index for every row.
+enum {
+  MAX_COLUMN_SIZE = MAX_VARINT_SIZE + 2 * COLUMNAR_BLOCK_ROWS * MAX_VARINT_SIZE
+};
+
+// The longest column name, which is stored after its length in one byte.
+enum { MAX_NAME_LENGTH = 255 };
+
+struct columnar_writer {
+  /// The file being written.
+  FILE* file;
+  /// The number of columns.
+  int column_count;
+  /// How each column is encoded.
+  column_encoding encodings[COLUMNAR_MAX_COLUMNS];
+  /// The number of rows waiting to be written as a block.
+  int row_count;
+  /// The rows waiting to be written, column by column.
+  int64_t values[COLUMNAR_MAX_COLUMNS][COLUMNAR_BLOCK_ROWS];
+  /// Room to build a column's dictionary.
+  int64_t dictionary[COLUMNAR_BLOCK_ROWS];
+  /// Room to encode a column.
+  uint8_t encoded[MAX_COLUMN_SIZE];
+};
+
+struct columnar_reader {
+  /// The file being read.
+  FILE* file;
+  /// The number of columns.
+  int column_count;
+  /// How each column is encoded.
+  column_encoding encodings[COLUMNAR_MAX_COLUMNS];
+  /// The name of each column.
+  char names[COLUMNAR_MAX_COLUMNS][MAX_NAME_LENGTH + 1];
+  /// The values of the block last decoded, column by column.
+  int64_t values[COLUMNAR_MAX_COLUMNS][COLUMNAR_BLOCK_ROWS];
+  /// Room for a column's dictionary.
+  int64_t dictionary[COLUMNAR_BLOCK_ROWS];
+  /// Room for a column's encoded bytes.
+  uint8_t encoded[MAX_COLUMN_SIZE];
+};
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Store a varint and return the number of bytes it took.
+static size_t put_varint(uint8_t* out, uint64_t value) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    out[size++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[size++] = (uint8_t)value;
+  return size;
+}
+
+// Read a varint from bytes, moving past it. Return -1 if it runs past the
+// end or is too long.
+static int get_varint(const uint8_t* data, size_t size, size_t* position,
+                      uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*position >= size) {
+      return -1;
+    }
+    uint8_t byte = data[(*position)++];
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int write_varint(FILE* file, uint64_t value) {
+  uint8_t bytes[MAX_VARINT_SIZE];
+  size_t size = put_varint(bytes, value);
+  return fwrite(bytes, 1, size, file) == size ? 0 : -1;
+}
+
+static int read_varint(FILE* file, uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = getc(file);
+    if (byte == EOF) {
+      return -1;
+    }
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int compare_values(const void* left, const void* right) {
+  int64_t a = *(const int64_t*)left;
+  int64_t b = *(const int64_t*)right;
+  return (a > b) - (a < b);
+}
+
+// Store values as the differences between them. The differences wrap around,
+// so any values come back exactly.
+static size_t put_deltas(uint8_t* out, const int64_t* values, size_t count) {
+  size_t size = 0;
+  uint64_t previous = 0;
+  for (size_t i = 0; i < count; ++i) {
+    size += put_varint(out + size, zigzag((int64_t)((uint64_t)values[i] -
+                                                    previous)));
+    previous = (uint64_t)values[i];
+  }
+  return size;
+}
+
+static int get_deltas(const uint8_t* data, size_t size, size_t* position,
+                      int64_t* values, size_t count) {
+  uint64_t previous = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t delta = 0;
+    if (get_varint(data, size, position, &delta) == -1) {
+      return -1;
+    }
+    previous += (uint64_t)unzigzag(delta);
+    values[i] = (int64_t)previous;
+  }
+  return 0;
+}
+
+// Encode one column of a block and return the number of bytes it took.
+static size_t encode_column(column_encoding encoding, const int64_t* values,
+                            int count, int64_t* dictionary, uint8_t* out) {
+  size_t size = 0;
+  switch (encoding) {
+    case COLUMN_DELTA:
+      size = put_deltas(out, values, (size_t)count);
+      break;
+    case COLUMN_VARINT:
+      for (int i = 0; i < count; ++i) {
+        size += put_varint(out + size, (uint64_t)values[i]);
+      }
+      break;
+    case COLUMN_DICTIONARY: {
+      memcpy(dictionary, values, (size_t)count * sizeof(int64_t));
+      qsort(dictionary, (size_t)count, sizeof(int64_t), compare_values);
+      size_t distinct = 0;
+      for (int i = 0; i < count; ++i) {
+        if (distinct == 0 || dictionary[i] != dictionary[distinct - 1]) {
+          dictionary[distinct++] = dictionary[i];
+        }
+      }
+      size = put_varint(out, distinct);
+      size += put_deltas(out + size, dictionary, distinct);
+      for (int i = 0; i < count; ++i) {
+        const int64_t* entry = bsearch(&values[i], dictionary, distinct,
+                                       sizeof(int64_t), compare_values);
+        size += put_varint(out + size, (uint64_t)(entry - dictionary));
+      }
+      break;
+    }
+  }
+  return size;
+}
+
+// Decode one column of a block. Return -1 if the bytes don't hold exactly
+// count values.
+static int decode_column(column_encoding encoding, const uint8_t* data,
+                         size_t size, int count, int64_t* dictionary,
+                         int64_t* values) {
+  size_t position = 0;
+  switch (encoding) {
+    case COLUMN_DELTA:
+      if (get_deltas(data, size, &position, values, (size_t)count) == -1) {
+        return -1;
+      }
+      break;
+    case COLUMN_VARINT:
+      for (int i = 0; i < count; ++i) {
+        uint64_t value = 0;
+        if (get_varint(data, size, &position, &value) == -1) {
+          return -1;
+        }
+        values[i] = (int64_t)value;
+      }
+      break;
+    case COLUMN_DICTIONARY: {
+      uint64_t distinct = 0;
+      if (get_varint(data, size, &position, &distinct) == -1 ||
+          distinct > (uint64_t)count ||
+          get_deltas(data, size, &position, dictionary, distinct) == -1) {
+        return -1;
+      }
+      for (int i = 0; i < count; ++i) {
+        uint64_t index = 0;
+        if (get_varint(data, size, &position, &index) == -1 ||
+            index >= distinct) {
+          return -1;
+        }
+        values[i] = dictionary[index];
+      }
+      break;
+    }
+  }
+  return position == size ? 0 : -1;
+}
+
+columnar_writer* make_columnar_writer(FILE* file, const column_spec* columns,
+                                      int column_count) {
+  if (column_count <= 0 || column_count > COLUMNAR_MAX_COLUMNS) {
+    return NULL;
+  }
+  columnar_writer* writer = calloc(1, sizeof(columnar_writer));
+  if (writer == NULL) {
+    return NULL;
+  }
+  writer->file = file;
+  writer->column_count = column_count;
+
+  int failed = fwrite(MAGIC, 1, sizeof(MAGIC), file) != sizeof(MAGIC) ||
+               putc(FORMAT_VERSION, file) == EOF ||
+               putc(column_count, file) == EOF;
+  for (int i = 0; i < column_count && !failed; ++i) {
+    size_t length = strlen(columns[i].name);
+    writer->encodings[i] = columns[i].encoding;
+    failed = length > MAX_NAME_LENGTH ||
+             putc((int)columns[i].encoding, file) == EOF ||
+             putc((int)length, file) == EOF ||
+             fwrite(columns[i].name, 1, length, file) != length;
+  }
+  if (failed) {
+    free(writer);
+    return NULL;
+  }
+  return writer;
+}
+
+// Write the rows waiting in a writer as a block.
+static int write_block(columnar_writer* writer) {
+  if (write_varint(writer->file, (uint64_t)writer->row_count) == -1) {
+    return -1;
+  }
+  for (int column = 0; column < writer->column_count; ++column) {
+    size_t size =
+        encode_column(writer->encodings[column], writer->values[column],
+                      writer->row_count, writer->dictionary, writer->encoded);
+    if (write_varint(writer->file, size) == -1 ||
+        fwrite(writer->encoded, 1, size, writer->file) != size) {
+      return -1;
+    }
+  }
+  writer->row_count = 0;
+  return 0;
+}
+
+int append_columnar_row(columnar_writer* writer, const int64_t* values) {
+  for (int column = 0; column < writer->column_count; ++column) {
+    writer->values[column][writer->row_count] = values[column];
+  }
+  ++writer->row_count;
+  if (writer->row_count == COLUMNAR_BLOCK_ROWS) {
+    return write_block(writer);
+  }
+  return 0;
+}
+
+int free_columnar_writer(columnar_writer* writer) {
+  int result = 0;
+  if (writer->row_count > 0) {
+    result = write_block(writer);
+  }
+  // A block of no rows ends the file.
+  if (result == 0) {
+    result = write_varint(writer->file, 0);
+  }
+  free(writer);
+  return result;
+}
+
+columnar_reader* make_columnar_reader(FILE* file) {
+  char magic[sizeof(MAGIC)];
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+      memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      getc(file) != FORMAT_VERSION) {
+    return NULL;
+  }
+  int column_count = getc(file);
+  if (column_count <= 0 || column_count > COLUMNAR_MAX_COLUMNS) {
+    return NULL;
+  }
+  columnar_reader* reader = calloc(1, sizeof(columnar_reader));
+  if (reader == NULL) {
+    return NULL;
+  }
+  reader->file = file;
+  reader->column_count = column_count;
+  for (int i = 0; i < column_count; ++i) {
+    int encoding = getc(file);
+    int length = getc(file);
+    if (encoding < COLUMN_DELTA || encoding > COLUMN_DICTIONARY ||
+        length == EOF ||
+        fread(reader->names[i], 1, (size_t)length, file) != (size_t)length) {
+      free(reader);
+      return NULL;
+    }
+    reader->encodings[i] = (column_encoding)encoding;
+  }
+  return reader;
+}
+
+int get_columnar_column_count(const columnar_reader* reader) {
+  return reader->column_count;
+}
+
+const char* get_columnar_column_name(const columnar_reader* reader,
+                                     int column) {
+  return reader->names[column];
+}
+
+int find_columnar_column(const columnar_reader* reader, const char* name) {
+  for (int column = 0; column < reader->column_count; ++column) {
+    if (strcmp(reader->names[column], name) == 0) {
+      return column;
+    }
+  }
+  return -1;
+}
+
+int read_columnar_block(columnar_reader* reader) {
+  uint64_t row_count = 0;
+  if (read_varint(reader->file, &row_count) == -1 ||
+      row_count > COLUMNAR_BLOCK_ROWS) {
+    return -1;
+  }
+  for (int column = 0; column < reader->column_count && row_count > 0;
+       ++column) {
+    uint64_t size = 0;
+    if (read_varint(reader->file, &size) == -1 || size > MAX_COLUMN_SIZE ||
+        fread(reader->encoded, 1, size, reader->file) != size ||
+        decode_column(reader->encodings[column], reader->encoded, size,
+                      (int)row_count, reader->dictionary,
+                      reader->values[column]) == -1) {
+      return -1;
+    }
+  }
+  return (int)row_count;
+}
+
+const int64_t* get_columnar_values(const columnar_reader* reader, int column) {
+  return reader->values[column];
+}
+
+void free_columnar_reader(columnar_reader* reader) { free(reader); }
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdint.h>  // int64_t
+#include <stdio.h>   // FILE
+
+// A columnar file holds rows of whole numbers, such as archived orders or
+// executions, for analysis away from the live database. It starts with a
+// header naming each column and how it is encoded, followed by blocks of up to
+// COLUMNAR_BLOCK_ROWS rows and a block of no rows that ends the file. Each
+// block stores its rows one column after another, so a reader decodes a
+// column into a flat array and scans it in a tight loop.
+//
+// Every number in the file is a base-128 varint, least significant group
+// first, and signed numbers are zigzag encoded so small negative ones stay
+// short.
+
+// The most rows in a block, and so the most values a reader decodes at once.
+enum { COLUMNAR_BLOCK_ROWS = 4096 };
+
+// The most columns in a file.
+enum { COLUMNAR_MAX_COLUMNS = 16 };
+
+// How the values of a column are stored within a block.
+typedef enum {
+  /// Each value as the difference from the one before it, which keeps
+  /// increasing IDs and timestamps to a byte or two.
+  COLUMN_DELTA = 0,
+  /// Each value as is. For small non-negative values such as quantities.
+  COLUMN_VARINT = 1,
+  /// The block's distinct values once, sorted and delta encoded, then each
+  /// value as its index among them. For values that repeat, such as users.
+  COLUMN_DICTIONARY = 2,
+} column_encoding;
+
+// The name and encoding of one column.
+typedef struct {
+  /// The column's name, at most 255 bytes.
+  const char* name;
+  /// How the column's values are stored.
+  column_encoding encoding;
+} column_spec;
+
+// Writes rows to a columnar file a block at a time.
+typedef struct columnar_writer columnar_writer;
+
+// Reads a columnar file a block at a time.
+typedef struct columnar_reader columnar_reader;
+
+/**
+ * Start a columnar file by writing its header.
+ *
+ * @param file The file to write to, open for writing.
+ * @param columns The columns of every row.
+ * @param column_count The number of columns, at most COLUMNAR_MAX_COLUMNS.
+ * @return A writer for the file, or NULL if the columns are invalid or the
+ * header couldn't be written.
+ */
+columnar_writer* make_columnar_writer(FILE* file, const column_spec* columns,
+                                      int column_count);
+
+/**
+ * Add a row to a columnar file. Rows are written once a block fills up.
+ *
+ * @param writer The writer to add the row to.
+ * @param values The row's value for each column, in order. Values in a
+ * COLUMN_VARINT column must not be negative.
+ * @return 0 on success, or -1 if a full block couldn't be written.
+ */
+int append_columnar_row(columnar_writer* writer, const int64_t* values);
+
+/**
+ * Write the rows not written yet and the end of the file, and free a writer.
+ *
+ * The file itself is left open.
+ *
+ * @param writer The writer to finish.
+ * @return 0 on success, or -1 if the file couldn't be written.
+ */
+int free_columnar_writer(columnar_writer* writer);
+
+/**
+ * Start reading a columnar file by reading its header.
+ *
+ * @param file The file to read, open for reading.
+ * @return A reader for the file, or NULL if it is not a columnar file.
+ */
+columnar_reader* make_columnar_reader(FILE* file);
+
+/**
+ * Get the number of columns of the file being read.
+ *
+ * @param reader The reader.
+ * @return The number of columns.
+ */
+int get_columnar_column_count(const columnar_reader* reader);
+
+/**
+ * Get the name of a column of the file being read.
+ *
+ * @param reader The reader.
+ * @param column The index of the column.
+ * @return The column's name, valid until the reader is freed.
+ */
+const char* get_columnar_column_name(const columnar_reader* reader,
+                                     int column);
+
+/**
+ * Look up a column of the file being read by name.
+ *
+ * @param reader The reader.
+ * @param name The name of the column.
+ * @return The index of the column, or -1 if there is none by that name.
+ */
+int find_columnar_column(const columnar_reader* reader, const char* name);
+
+/**
+ * Decode the next block of the file being read.
+ *
+ * @param reader The reader.
+ * @return The number of rows in the block, 0 at the end of the file, or -1 if
+ * the file is cut short or corrupt.
+ */
+int read_columnar_block(columnar_reader* reader);
+
+/**
+ * Get the values of a column in the block last decoded.
+ *
+ * @param reader The reader.
+ * @param column The index of the column.
+ * @return The column's value for each row of the block, valid until the next
+ * block is decoded.
+ */
+const int64_t* get_columnar_values(const columnar_reader* reader, int column);
+
+/**
+ * Free a reader. The file itself is left open.
+ *
+ * @param reader The reader to free.
+ */
+void free_columnar_reader(columnar_reader* reader);
@@ -5,6 +5,17 @@
 #include <stdlib.h>
 #include <string.h>  // Include for strlen and strcpy
 
+#include "account_summary.h"
+#include "candles.h"
+#include "fixed_point.h"
+#include "journal.h"
+#include "keywords.h"
+#include "market_data.h"
+#include "market_stats.h"
+#include "settlement.h"
+#include "state_snapshot.h"
+#include "trade_tape.h"
+
 int open_db(sqlite3** database) {
   *database = open_database();
   if (*database == NULL) {
@@ -23,7 +34,7 @@ int init_db(sqlite3* database) {
     }
     return -1;  // Return -1 on failure to drop tables
   }
-  if (create_tables(database) != 0) {
+  if (migrate_tables(database) != 0) {
     if (close_database(database) != 0) {
       fprintf(stderr,
               "Error: Failed to close the database after table creation "
@@ -36,51 +47,61 @@ int init_db(sqlite3* database) {
   return 0;  // Return 0 on success
 }
 
+int upgrade_db(sqlite3* database) {
+  if (migrate_tables(database) != SQLITE_OK) {
+    if (close_database(database) != 0) {
+      fprintf(stderr,
+              "Error: Failed to close the database after migration "
+              "failure.\n");
+    }
+    return -1;
+  }
+  // A cold cache only slows the first commands down, so carry on regardless.
+  (void)prewarm_tables(database);
+  return 0;
+}
+
 int close_db(sqlite3* database) {
   close_database(database);
   return 0;  // Return 0 on success
 }
 
-order* create_order_from_string(string_array* params, int userID) {
-  order* new_order = (order*)malloc(sizeof(order));
-  if (new_order == NULL) {
+order* create_order_from_string(const token_array* params, int userID,
+                                const char** error) {
+  const token_view* symbol = &params->tokens[1];
+  int item = find_asset(symbol->data, symbol->length);
+  if (item == -1) {
+    *error = "Invalid item type";
     return NULL;
   }
 
-  char* endptr;
-
-  // Parse unit price
-  new_order->unitPrice = strtod(params->strings[2], &endptr);
-  if (endptr == params->strings[2]) {
-    printf("Conversion failed for unitPrice\n");
+  const token_view* price = &params->tokens[2];
+  int64_t ticks = 0;
+  parse_status status = parse_price(price->data, price->length, &ticks);
+  if (status != PARSE_OK) {
+    *error = parse_status_message(status);
+    return NULL;
   }
 
-  if (strcasecmp(params->strings[1], "omg") == 0) {
-    new_order->item = COIN_OMG;
-  } else if (strcasecmp(params->strings[1], "doge") == 0) {
-    new_order->item = COIN_DOGE;
-  } else if (strcasecmp(params->strings[1], "btc") == 0) {
-    new_order->item = COIN_BTC;
-  } else if (strcasecmp(params->strings[1], "eth") == 0) {
-    new_order->item = COIN_ETH;
-  } else {
-    printf("Invalid item type: %s\n", params->strings[1]);
+  const token_view* quantity_token = &params->tokens[3];
+  int quantity = 0;
+  status = parse_quantity(quantity_token->data, quantity_token->length,
+                          &quantity);
+  if (status != PARSE_OK) {
+    *error = parse_status_message(status);
     return NULL;
   }
 
   // Determine buy or sell
-  new_order->buyOrSell = (strcasecmp(params->strings[0], "buy") == 0) ? 0 : 1;
+  const token_view* verb = &params->tokens[0];
+  int buyOrSell =
+      (find_command(verb->data, verb->length) == COMMAND_BUY) ? BUY : SELL;
 
-  // Parse quantity
-  endptr = NULL;
-  new_order->quantity = strtol(params->strings[3], &endptr, 10);
-  if (endptr == params->strings[3]) {
-    printf("Conversion failed for quantity\n");
+  order* new_order =
+      create_order(item, buyOrSell, quantity, ticks_to_price(ticks), userID);
+  if (new_order == NULL) {
+    *error = "Can't allocate order";
   }
-
-  // Assign user ID
-  new_order->userID = userID;
-
   return new_order;
 }
 
@@ -96,6 +117,7 @@ order* create_order(int item, int buyOrSell, int quantity, double unitPrice,
   new_order->quantity = quantity;
   new_order->unitPrice = unitPrice;
   new_order->userID = userID;
+  new_order->created_at = NULL;
 
   return new_order;
 }
@@ -104,6 +126,7 @@ int free_order(order* ord) {
   if (ord == NULL) {
     return -1;  // Return -1 if the order is NULL
   }
+  free(ord->created_at);
   free(ord);
   return 0;  // Return 0 on successful free
 }
@@ -157,9 +180,99 @@ int free_user(user* user_ptr) {
   return 0;
 }
 
-int buy(sqlite3* database, order* ord) {
+// When the account summaries that changed are next checkpointed.
+static int64_t next_account_checkpoint;
+
+static void checkpoint_accounts_if_due(sqlite3* database, int64_t now) {
+  if (now < next_account_checkpoint) {
+    return;
+  }
+  if (checkpoint_account_summaries(database) != SQLITE_OK) {
+    fprintf(stderr, "Error: Failed to checkpoint account summaries.\n");
+  }
+  next_account_checkpoint = now + ACCOUNT_CHECKPOINT_SECONDS;
+}
+
+// Put an order on the book and publish the change.
+static int rest_order(sqlite3* database, order* ord, int64_t now) {
+  // Inserting checks the balance the order is paid from.
+  int result = settle_user(database, ord->userID);
+  if (result != SQLITE_OK) {
+    return result;
+  }
+  result = insert_order(database, ord);
+  if (result == SQLITE_OK) {
+    record_book_change(ord->item, ord->buyOrSell, ord->unitPrice,
+                       ord->quantity, 1);
+    record_order_opened(ord->userID, now);
+    checkpoint_accounts_if_due(database, now);
+  }
+  return result;
+}
+
+// Record a trade between an incoming order and a resting one on the tape, in
+// the candles, in the statistics and in both users' summaries, and publish it
+// and what it took off the book. The resting order's quantity is what is left
+// of it, so 0 once it is filled.
+static void record_fill(sqlite3* database, const order* incoming_order,
+                        const order* resting_order, int quantity,
+                        int64_t now) {
+  const order* buyer = incoming_order;
+  const order* seller = resting_order;
+  if (incoming_order->buyOrSell == SELL) {
+    buyer = resting_order;
+    seller = incoming_order;
+  }
+  execution fill = {
+      .item = resting_order->item,
+      .price = price_to_ticks(resting_order->unitPrice),
+      .quantity = quantity,
+      .aggressor = incoming_order->buyOrSell,
+      .buyerID = buyer->userID,
+      .sellerID = seller->userID,
+      .executedAt = now,
+  };
+  if (record_execution(database, &fill) != SQLITE_OK) {
+    fprintf(stderr, "Error: Failed to store an execution.\n");
+  }
+  if (record_candle_trade(database, fill.item, fill.price, quantity,
+                          fill.executedAt) != SQLITE_OK) {
+    fprintf(stderr, "Error: Failed to store a candle.\n");
+  }
+  record_stats_trade(fill.item, fill.price, quantity, fill.executedAt);
+  record_account_fill(&fill);
+  if (resting_order->quantity == 0) {
+    record_order_closed(resting_order->userID, fill.executedAt);
+  }
+  checkpoint_accounts_if_due(database, fill.executedAt);
+  record_trade(resting_order->item, resting_order->unitPrice, quantity);
+  record_book_change(resting_order->item, resting_order->buyOrSell,
+                     resting_order->unitPrice, -quantity,
+                     resting_order->quantity == 0 ? -1 : 0);
+}
+
+// Move a fill's coins from its seller to its buyer and its price the other
+// way. A price that isn't a whole number of OMG costs the buyer the next whole
+// OMG up and pays the seller the whole OMG below, as balances always have.
+static int transfer_fill(sqlite3* database, int buyerID, int sellerID,
+                         int item, int quantity, double unitPrice) {
+  int64_t ticks = price_to_ticks(unitPrice) * quantity;
+  int64_t paid = (ticks + TICKS_PER_UNIT - 1) / TICKS_PER_UNIT;
+  int64_t received = ticks / TICKS_PER_UNIT;
+  if (add_balance_change(database, buyerID, COIN_OMG, -paid) != SQLITE_OK ||
+      add_balance_change(database, buyerID, item, quantity) != SQLITE_OK ||
+      add_balance_change(database, sellerID, COIN_OMG, received) !=
+          SQLITE_OK ||
+      add_balance_change(database, sellerID, item, -quantity) != SQLITE_OK) {
+    return -1;
+  }
+  return 0;
+}
+
+int buy(sqlite3* database, order* ord, int64_t now) {
   user current_user;
-  if (get_user(database, ord->userID, &current_user) != 0) {
+  if (settle_user(database, ord->userID) != SQLITE_OK ||
+      get_user(database, ord->userID, &current_user) != 0) {
     fprintf(stderr, "Error: Failed to retrieve user information.\n");
     return -1;
   }
@@ -170,9 +283,14 @@ int buy(sqlite3* database, order* ord) {
     return -1;
   }
 
+  if (assign_order_timestamp(database, ord, now) != 0) {
+    fprintf(stderr, "Error: Failed to assign timestamp to the order.\n");
+    return -1;
+  }
+
   int result = find_matching_sell(database, ord);
   if (result == -1) {
-    return insert_order(database, ord);
+    return rest_order(database, ord, now);
   }
   order matched_order;
   if (get_order(database, result, &matched_order) != 0) {
@@ -180,19 +298,14 @@ int buy(sqlite3* database, order* ord) {
     return -1;
   }
 
-  if (assign_order_timestamp(database, ord) != 0) {
-    fprintf(stderr, "Error: Failed to assign timestamp to the order.\n");
-    return -1;
-  }
-
   // Archive the matched order
-  if (archive_order(database, &matched_order) != 0) {
+  if (archive_order(database, &matched_order, now) != 0) {
     fprintf(stderr, "Error: Failed to archive matched order.\n");
     return -1;
   }
 
   // Archive the buy order
-  if (archive_order(database, ord) != 0) {
+  if (archive_order(database, ord, now) != 0) {
     fprintf(stderr, "Error: Failed to archive buy order.\n");
     return -1;
   }
@@ -201,47 +314,14 @@ int buy(sqlite3* database, order* ord) {
   int transaction_quantity = (ord->quantity > matched_order.quantity)
                                  ? matched_order.quantity
                                  : ord->quantity;
-  double transaction_cost = transaction_quantity * matched_order.unitPrice;
 
   ord->quantity -= transaction_quantity;
   matched_order.quantity -= transaction_quantity;
 
   // Update user balances
-  current_user.OMG -= transaction_cost;
-  if (ord->item == COIN_OMG) {
-    current_user.OMG += transaction_quantity;
-  } else if (ord->item == COIN_DOGE) {
-    current_user.DOGE += transaction_quantity;
-  } else if (ord->item == COIN_BTC) {
-    current_user.BTC += transaction_quantity;
-  } else if (ord->item == COIN_ETH) {
-    current_user.ETH += transaction_quantity;
-  }
-
-  if (update_user_balance(database, &current_user) != 0) {
-    fprintf(stderr, "Error: Failed to update buyer's balance.\n");
-    return -1;
-  }
-
-  user seller_user;
-  if (get_user(database, matched_order.userID, &seller_user) != 0) {
-    fprintf(stderr, "Error: Failed to retrieve seller information.\n");
-    return -1;
-  }
-
-  seller_user.OMG += transaction_cost;
-  if (matched_order.item == COIN_OMG) {
-    seller_user.OMG -= transaction_quantity;
-  } else if (matched_order.item == COIN_DOGE) {
-    seller_user.DOGE -= transaction_quantity;
-  } else if (matched_order.item == COIN_BTC) {
-    seller_user.BTC -= transaction_quantity;
-  } else if (matched_order.item == COIN_ETH) {
-    seller_user.ETH -= transaction_quantity;
-  }
-
-  if (update_user_balance(database, &seller_user) != 0) {
-    fprintf(stderr, "Error: Failed to update seller's balance.\n");
+  if (transfer_fill(database, ord->userID, matched_order.userID, ord->item,
+                    transaction_quantity, matched_order.unitPrice) != 0) {
+    fprintf(stderr, "Error: Failed to update the users' balances.\n");
     return -1;
   }
 
@@ -257,10 +337,11 @@ int buy(sqlite3* database, order* ord) {
       return -1;
     }
   }
+  record_fill(database, ord, &matched_order, transaction_quantity, now);
 
   // Insert the remaining order if not fully matched
   if (ord->quantity > 0) {
-    if (insert_order(database, ord) != 0) {
+    if (rest_order(database, ord, now) != 0) {
       fprintf(stderr, "Error: Failed to insert remaining order.\n");
       return -1;
     }
@@ -269,9 +350,10 @@ int buy(sqlite3* database, order* ord) {
   return 0;
 }
 
-int sell(sqlite3* database, order* ord) {
+int sell(sqlite3* database, order* ord, int64_t now) {
   user current_user;
-  if (get_user(database, ord->userID, &current_user) != 0) {
+  if (settle_user(database, ord->userID) != SQLITE_OK ||
+      get_user(database, ord->userID, &current_user) != 0) {
     fprintf(stderr, "Error: Failed to retrieve user information.\n");
     return -1;
   }
@@ -290,9 +372,14 @@ int sell(sqlite3* database, order* ord) {
     return -1;
   }
 
+  if (assign_order_timestamp(database, ord, now) != 0) {
+    fprintf(stderr, "Error: Failed to assign timestamp to the order.\n");
+    return -1;
+  }
+
   int result = find_matching_buy(database, ord);
   if (result == -1) {
-    return insert_order(database, ord);
+    return rest_order(database, ord, now);
   }
   order matched_order;
   if (get_order(database, result, &matched_order) != 0) {
@@ -300,19 +387,14 @@ int sell(sqlite3* database, order* ord) {
     return -1;
   }
 
-  if (assign_order_timestamp(database, ord) != 0) {
-    fprintf(stderr, "Error: Failed to assign timestamp to the order.\n");
-    return -1;
-  }
-
   // Archive the matched order
-  if (archive_order(database, &matched_order) != 0) {
+  if (archive_order(database, &matched_order, now) != 0) {
     fprintf(stderr, "Error: Failed to archive matched order.\n");
     return -1;
   }
 
   // Archive the sell order
-  if (archive_order(database, ord) != 0) {
+  if (archive_order(database, ord, now) != 0) {
     fprintf(stderr, "Error: Failed to archive sell order.\n");
     return -1;
   }
@@ -321,48 +403,14 @@ int sell(sqlite3* database, order* ord) {
   int transaction_quantity = (ord->quantity > matched_order.quantity)
                                  ? matched_order.quantity
                                  : ord->quantity;
-  double transaction_cost = transaction_quantity * matched_order.unitPrice;
 
   ord->quantity -= transaction_quantity;
   matched_order.quantity -= transaction_quantity;
 
   // Update user balances
-  if (ord->item == COIN_OMG) {
-    current_user.OMG -= transaction_quantity;
-  } else if (ord->item == COIN_DOGE) {
-    current_user.DOGE -= transaction_quantity;
-  } else if (ord->item == COIN_BTC) {
-    current_user.BTC -= transaction_quantity;
-  } else if (ord->item == COIN_ETH) {
-    current_user.ETH -= transaction_quantity;
-  }
-
-  current_user.OMG += transaction_cost;
-
-  if (update_user_balance(database, &current_user) != 0) {
-    fprintf(stderr, "Error: Failed to update seller's balance.\n");
-    return -1;
-  }
-
-  user buyer_user;
-  if (get_user(database, matched_order.userID, &buyer_user) != 0) {
-    fprintf(stderr, "Error: Failed to retrieve buyer information.\n");
-    return -1;
-  }
-
-  buyer_user.OMG -= transaction_cost;
-  if (matched_order.item == COIN_OMG) {
-    buyer_user.OMG += transaction_quantity;
-  } else if (matched_order.item == COIN_DOGE) {
-    buyer_user.DOGE += transaction_quantity;
-  } else if (matched_order.item == COIN_BTC) {
-    buyer_user.BTC += transaction_quantity;
-  } else if (matched_order.item == COIN_ETH) {
-    buyer_user.ETH += transaction_quantity;
-  }
-
-  if (update_user_balance(database, &buyer_user) != 0) {
-    fprintf(stderr, "Error: Failed to update buyer's balance.\n");
+  if (transfer_fill(database, matched_order.userID, ord->userID, ord->item,
+                    transaction_quantity, matched_order.unitPrice) != 0) {
+    fprintf(stderr, "Error: Failed to update the users' balances.\n");
     return -1;
   }
 
@@ -378,10 +426,11 @@ int sell(sqlite3* database, order* ord) {
       return -1;
     }
   }
+  record_fill(database, ord, &matched_order, transaction_quantity, now);
 
   // Insert the remaining order if not fully matched
   if (ord->quantity > 0) {
-    if (insert_order(database, ord) != 0) {
+    if (rest_order(database, ord, now) != 0) {
       fprintf(stderr, "Error: Failed to insert remaining order.\n");
       return -1;
     }
@@ -390,14 +439,15 @@ int sell(sqlite3* database, order* ord) {
   return 0;
 }
 
-void my_orders(sqlite3* database, int userID, order** orderList,
-               int* orderCount) {
-  int result = get_user_all_orders(database, userID, orderList, orderCount);
+void my_orders(sqlite3* database, int userID, int afterID, int limit,
+               order** orderList, int* orderCount) {
+  int result = get_user_orders_after(database, userID, afterID, limit,
+                                     orderList, orderCount);
   if (result != SQLITE_OK) {
     fprintf(stderr,
             "Error: Failed to retrieve user orders. SQLite error code: %d\n",
             result);
-    orderList = NULL;
+    *orderList = NULL;
     *orderCount = 0;
   }
 }
@@ -430,6 +480,10 @@ void view_item_orders(sqlite3* database, int itemID, order** buy_orders,
 }
 
 int get_user_inventory(sqlite3* database, user* usr) {
+  int res = settle_user(database, usr->userID);
+  if (res != SQLITE_OK) {
+    return res;
+  }
   return get_user_inventories(database, usr);
 }
 
@@ -437,14 +491,47 @@ int get_user_with_username(sqlite3* database, const char* username, user* usr) {
   return get_user_by_username(database, username, usr);
 }
 
-int archive_order(sqlite3* database, const order* archived_order) {
-  return insert_archive(database, archived_order);
+int archive_order(sqlite3* database, const order* archived_order,
+                  int64_t now) {
+  return insert_archive(database, archived_order, now);
+}
+
+// Get the open batch ready to be committed before the writer thread would,
+// which only happens between commands. The balance changes of its fills and
+// the journal position it has reached belong in the same commit.
+static int prepare_commit(sqlite3* database) {
+  int res = settle_balances(database);
+  if (res == SQLITE_OK) {
+    res = set_journal_position(database, get_journal_sequence());
+  }
+  return res;
+}
+
+// The start of the next archive period, when the archives of the ones before
+// it are moved to their partitions.
+static int64_t next_archive_rotation;
+
+void rotate_archives_if_due(sqlite3* database, int64_t now) {
+  if (now < next_archive_rotation) {
+    return;
+  }
+  // If this fails, the archives stay where they are until the next period.
+  if (prepare_commit(database) != SQLITE_OK ||
+      rotate_archives(database, now) != SQLITE_OK) {
+    fprintf(stderr, "Error: Failed to rotate the archives.\n");
+  }
+  next_archive_rotation =
+      now - now % ARCHIVE_PERIOD_SECONDS + ARCHIVE_PERIOD_SECONDS;
 }
 
-void get_archived_orders(sqlite3* database, int user_id, order** orders_out,
-                         int* count_out) {
-  int result =
-      get_user_archived_orders(database, user_id, orders_out, count_out);
+void get_archived_orders(sqlite3* database, int user_id, int afterID,
+                         int limit, order** orders_out, int* count_out) {
+  // Opening a partition commits the batch.
+  int result = prepare_commit(database);
+  if (result == SQLITE_OK) {
+    result = get_user_archived_orders(database, user_id, afterID, limit,
+                                      orders_out, count_out);
+  }
   if (result != SQLITE_OK) {
     fprintf(
         stderr,
@@ -455,7 +542,8 @@ void get_archived_orders(sqlite3* database, int user_id, order** orders_out,
   }
 }
 
-int cancel_order(sqlite3* database, int orderID, int currentUserID) {
+int cancel_order(sqlite3* database, int orderID, int currentUserID,
+                 int64_t now) {
   order ord;
   if (get_order(database, orderID, &ord) != 0) {
     fprintf(stderr, "Error: Failed to retrieve order with ID %d.\n", orderID);
@@ -469,28 +557,18 @@ int cancel_order(sqlite3* database, int orderID, int currentUserID) {
     return -1;
   }
 
-  user usr;
-  if (get_user(database, ord.userID, &usr) != 0) {
-    fprintf(stderr, "Error: Failed to retrieve user information.\n");
-    return -1;
-  }
-
+  // A buy order's refund is rounded down to a whole OMG, as balances always
+  // have been.
+  int res = SQLITE_OK;
   if (ord.buyOrSell == 0) {  // Buy order
-    double refund_amount = ord.quantity * ord.unitPrice;
-    usr.OMG += refund_amount;
+    int64_t refund_amount =
+        price_to_ticks(ord.unitPrice) * ord.quantity / TICKS_PER_UNIT;
+    res = add_balance_change(database, ord.userID, COIN_OMG, refund_amount);
   } else {  // Sell order
-    if (ord.item == COIN_OMG) {
-      usr.OMG += ord.quantity;
-    } else if (ord.item == COIN_DOGE) {
-      usr.DOGE += ord.quantity;
-    } else if (ord.item == COIN_BTC) {
-      usr.BTC += ord.quantity;
-    } else if (ord.item == COIN_ETH) {
-      usr.ETH += ord.quantity;
-    }
+    res = add_balance_change(database, ord.userID, ord.item, ord.quantity);
   }
 
-  if (update_user_balance(database, &usr) != 0) {
+  if (res != SQLITE_OK) {
     fprintf(stderr, "Error: Failed to update user balance.\n");
     return -1;
   }
@@ -499,6 +577,92 @@ int cancel_order(sqlite3* database, int orderID, int currentUserID) {
     fprintf(stderr, "Error: Failed to delete order with ID %d.\n", orderID);
     return -1;
   }
+  record_book_change(ord.item, ord.buyOrSell, ord.unitPrice, -ord.quantity,
+                     -1);
+  record_order_closed(ord.userID, now);
+  checkpoint_accounts_if_due(database, now);
 
   return 0;
 }
+
+int register_account(sqlite3* database, user* new_user, int* userID) {
+  new_user->BTC = DEFAULT_BTC;
+  new_user->DOGE = DEFAULT_DOGE;
+  new_user->ETH = DEFAULT_ETH;
+  new_user->OMG = DEFAULT_OMG;
+  return insert_user(database, new_user, userID);
+}
+
+// Apply a command read back from the journal the way the server did when it
+// accepted it. Commands that failed then fail again now.
+static void apply_journal_entry(const journal_entry* entry, void* context) {
+  sqlite3* database = context;
+  switch (entry->type) {
+    case JOURNAL_REGISTER: {
+      user new_user = {
+          .username = (char*)entry->username,
+          .name = (char*)entry->name,
+          .password = (char*)entry->password,
+      };
+      int userID = 0;
+      (void)register_account(database, &new_user, &userID);
+      break;
+    }
+    case JOURNAL_ORDER: {
+      order ord = {
+          .item = entry->item,
+          .buyOrSell = entry->buyOrSell,
+          .quantity = entry->quantity,
+          .unitPrice = ticks_to_price(entry->price),
+          .userID = entry->userID,
+      };
+      // At the time it was first placed, so everything it leaves behind is
+      // dated as it was.
+      (void)(ord.buyOrSell == BUY ? buy(database, &ord, entry->time)
+                                  : sell(database, &ord, entry->time));
+      free(ord.created_at);
+      break;
+    }
+    case JOURNAL_CANCEL:
+      (void)cancel_order(database, entry->orderID, entry->userID,
+                         entry->time);
+      break;
+  }
+}
+
+int64_t replay_commands(sqlite3* database, const char* path,
+                        uint64_t after) {
+  // One transaction for the whole journal, rather than one per statement.
+  if (sqlite3_exec(database, "BEGIN;", 0, 0, NULL) != SQLITE_OK) {
+    return -1;
+  }
+  int64_t replayed = replay_journal(path, after, apply_journal_entry, database);
+  if (replayed == -1 ||
+      set_journal_position(database, get_journal_sequence()) != SQLITE_OK ||
+      sqlite3_exec(database, "COMMIT;", 0, 0, NULL) != SQLITE_OK) {
+    (void)sqlite3_exec(database, "ROLLBACK;", 0, 0, NULL);
+    return -1;
+  }
+  return replayed;
+}
+
+int64_t recover_market(sqlite3* database, const char* journal_path,
+                       const char* snapshot_path) {
+  uint64_t position = 0;
+  if (get_journal_position(database, &position) != SQLITE_OK) {
+    return -1;
+  }
+  if (position == 0) {
+    // Nothing in the database came from the journal, so the market is rebuilt
+    // from it on empty tables. A snapshot only holds the live market, so this
+    // is the only time it is used.
+    if (init_db(database) != 0) {
+      return -1;
+    }
+    if (snapshot_path != NULL &&
+        restore_state_snapshot(database, snapshot_path, &position) == -1) {
+      return -1;
+    }
+  }
+  return replay_commands(database, journal_path, position);
+}
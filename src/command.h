@@ -20,7 +20,8 @@ int open_db(sqlite3** database);
 /**
  * @brief Initializes the SQLite database by creating necessary tables.
  *
- * This function creates the required tables in the provided SQLite database.
+ * This function drops every table and creates the required tables again in
+ * the provided SQLite database, at the current schema version.
  * If table creation fails, it attempts to close the database and returns an
  * error code.
  *
@@ -30,6 +31,19 @@ int open_db(sqlite3** database);
  */
 int init_db(sqlite3* database);
 
+/**
+ * @brief Opens the market kept in the database where the last run left it.
+ *
+ * Unlike init_db, this keeps every row. It brings the tables up to the
+ * current schema version, then reads the tables used by every command into
+ * the page cache. If the migration fails, it closes the database and returns
+ * an error code.
+ *
+ * @param[in] database A pointer to an open SQLite database connection.
+ * @return int Returns 0 on success, or -1 if the schema couldn't be migrated.
+ */
+int upgrade_db(sqlite3* database);
+
 /**
  * @brief Closes the database connection.
  *
@@ -39,26 +53,28 @@ int init_db(sqlite3* database);
 int close_db(sqlite3* database);
 
 /**
- * @brief Creates a new order from a string array of parameters.
+ * @brief Creates a new order from the tokens of a buy or sell command.
  *
  * This function allocates memory for a new order and initializes its fields
- * based on the provided string array of parameters and the user ID. It
- * parses the string values for unit price and quantity, determines whether
- * the order is a buy or sell order, and assigns the user ID. If memory
- * allocation fails, it returns NULL. If parsing fails for unit price or
- * quantity, a warning is printed to the console.
- *
- * @param params A pointer to a string_array containing the order
- * parameters.
- *               - params->strings[0]: "buy" or "sell" to indicate the order
+ * based on the provided command tokens and the user ID. It
+ * parses the unit price and quantity with the fixed-point parser, determines
+ * whether the order is a buy or sell order, and assigns the user ID. If any
+ * field is invalid or memory allocation fails, it returns NULL and sets error
+ * to a message for the client.
+ *
+ * @param params A pointer to the token array holding the order parameters.
+ *               - params->tokens[0]: "buy" or "sell" to indicate the order
  * type.
- *               - params->strings[2]: The unit price as a string.
- *               - params->strings[3]: The quantity as a string.
+ *               - params->tokens[1]: The coin symbol, such as "btc".
+ *               - params->tokens[2]: The unit price.
+ *               - params->tokens[3]: The quantity.
  * @param userID The identifier of the user creating the order.
- * @return A pointer to the newly created order, or NULL if memory
- * allocation fails.
+ * @param error Where to store why the order could not be created.
+ * @return A pointer to the newly created order, or NULL if a field is invalid
+ * or memory allocation fails.
  */
-order* create_order_from_string(string_array* params, int userID);
+order* create_order_from_string(const token_array* params, int userID,
+                                const char** error);
 
 /**
  * @brief Creates a new order with the specified parameters.
@@ -80,9 +96,10 @@ order* create_order(int item, int buyOrSell, int quantity, double unitPrice,
 /**
  * @brief Frees the memory allocated for an order.
  *
- * This function deallocates the memory associated with the given order. If
- * the provided order pointer is NULL, it returns -1 to indicate an error.
- * Otherwise, it frees the memory and returns 0 to indicate success.
+ * This function deallocates the memory associated with the given order,
+ * including its created_at. If the provided order pointer is NULL, it returns
+ * -1 to indicate an error. Otherwise, it frees the memory and returns 0 to
+ * indicate success.
  *
  * @param ord A pointer to the order to be freed.
  * @return 0 if the order was successfully freed, or -1 if the order pointer
@@ -123,32 +140,42 @@ int free_user(user* usr);  // Defined below
  * @brief Places a buy order in the database.
  *
  * @param database Pointer to the SQLite database connection.
- * @param ord Pointer to the order struct containing order details.
+ * @param ord Pointer to the order struct containing order details. Its
+ * created_at is set to now.
+ * @param now When the order was placed, in seconds since the epoch. The order,
+ * its archives and its fills are dated with it, so replaying the journal
+ * dates them as they were.
  * @return 0 on success, -1 on failure.
  */
-int buy(sqlite3* database, order* ord);
+int buy(sqlite3* database, order* ord, int64_t now);
 
 /**
  * @brief Places a sell order in the database.
  *
  * @param database Pointer to the SQLite database connection.
- * @param ord Pointer to the order struct containing order details.
+ * @param ord Pointer to the order struct containing order details. Its
+ * created_at is set to now.
+ * @param now When the order was placed, in seconds since the epoch, as for
+ * buy.
  * @return 0 on success, -1 on failure.
  */
-int sell(sqlite3* database, order* ord);
+int sell(sqlite3* database, order* ord, int64_t now);
 
 /**
- * @brief Retrieves all orders placed by a user.
+ * @brief Retrieves one page of the open orders placed by a user.
  *
  * @param database Pointer to the SQLite database connection.
  * @param userID The ID of the user.
+ * @param afterID Only orders with a greater ID are retrieved, 0 for the first
+ * page.
+ * @param limit The most orders to retrieve.
  * @param orderList Pointer to an array of order structs to store the retrieved
- * orders.
+ * orders, or NULL if there are none.
  * @param orderCount Pointer to an integer to store the number of retrieved
  * orders.
  */
-void my_orders(sqlite3* database, int userID, order** orderList,
-               int* orderCount);
+void my_orders(sqlite3* database, int userID, int afterID, int limit,
+               order** orderList, int* orderCount);
 
 /**
  * @brief Retrieves and displays all buy and sell orders for a specific item.
@@ -166,7 +193,8 @@ void view_item_orders(sqlite3* database, int itemID, order** buy_orders,
 /**
  * @brief Retrieves the inventory of a specific user from the database.
  *
- * This function fetches the inventory associated with the given user by
+ * This function writes the balance changes still held for the user (see
+ * settlement.h), then fetches the inventory associated with the given user by
  * delegating the operation to the `get_user_inventories` function.
  *
  * @param database A pointer to the SQLite3 database connection.
@@ -199,28 +227,44 @@ int get_user_with_username(sqlite3* database, const char* username, user* usr);
 /**
  * @brief Archives an order in the database.
  *
- * This function moves an order to the archive table in the database.
+ * This function moves an order to the archive table in the database. It
+ * stays there until rotate_archives_if_due moves it to its period's partition.
  *
  * @param database Pointer to the SQLite database connection.
  * @param archived_order Pointer to the order to be archived.
+ * @param now When the order is archived, in seconds since the epoch.
  * @return 0 on success, or an error code on failure.
  */
-int archive_order(sqlite3* database, const order* archived_order);
+int archive_order(sqlite3* database, const order* archived_order,
+                  int64_t now);
 
 /**
- * @brief Retrieves archived orders for a specific user.
+ * @brief Moves the archives of past periods to their partitions once a new
+ * period has started.
  *
- * This function fetches all archived orders associated with a given user ID.
+ * Rotating commits the open batch, so call this between commands, while
+ * holding the lock they run under, and never part way through one.
+ *
+ * @param database Pointer to the SQLite database connection.
+ * @param now The current time, in seconds since the epoch.
+ */
+void rotate_archives_if_due(sqlite3* database, int64_t now);
+
+/**
+ * @brief Retrieves one page of the archived orders of a specific user.
  *
  * @param database Pointer to the SQLite database connection.
  * @param userID The ID of the user whose archived orders are to be retrieved.
+ * @param afterID Only archived orders with a greater ID are retrieved, 0 for
+ * the first page.
+ * @param limit The most orders to retrieve.
  * @param orders_out Pointer to an array of order structs to store the retrieved
- * orders.
+ * orders, or NULL if there are none.
  * @param count_out Pointer to an integer to store the number of retrieved
  * orders.
  */
-void get_archived_orders(sqlite3* database, int userID, order** orders_out,
-                         int* count_out);
+void get_archived_orders(sqlite3* database, int userID, int afterID, int limit,
+                         order** orders_out, int* count_out);
 /**
  * Frees the memory allocated for an array of orders and their associated data.
  *
@@ -251,8 +295,60 @@ int free_order_list(order* orderList, int orderCount);
  * @param database A pointer to the SQLite database connection.
  * @param orderID The ID of the order to be canceled.
  * @param currentUserID The ID of the user attempting to cancel the order.
+ * @param now When the order was canceled, in seconds since the epoch.
  * @return 0 on success, or -1 if an error occurs (e.g., failure to retrieve
  * order/user, unauthorized access, update user balance, or delete the order).
  */
 
-int cancel_order(sqlite3* database, int orderID, int currentUserID);
+int cancel_order(sqlite3* database, int orderID, int currentUserID,
+                 int64_t now);
+
+/**
+ * @brief Registers a new user with the balances every user starts with.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param new_user The user's username, name and password. Its balances are
+ * set to the defaults.
+ * @param userID Pointer to an integer to receive the new user's ID.
+ * @return SQLITE_OK on success, or an SQLite error code on failure (e.g. the
+ * username is taken).
+ */
+int register_account(sqlite3* database, user* new_user, int* userID);
+
+/**
+ * @brief Rebuilds the market by applying the commands in a journal again.
+ *
+ * Call this at startup, before loading the market data, on a database that
+ * includes the journal up to after (see recover_market).
+ * The commands are applied in the order they were accepted and inside one
+ * transaction, so they reach the same users, balances and books as they did
+ * the first time, dated with the times they were first accepted.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param path The journal's file (see journal.h).
+ * @param after The last command the database already includes, or 0 for an
+ * empty database.
+ * @return The number of commands replayed, or -1 if the journal couldn't be
+ * read.
+ */
+int64_t replay_commands(sqlite3* database, const char* path, uint64_t after);
+
+/**
+ * @brief Brings the market up to date with its journal at startup.
+ *
+ * Every commit records how far into the journal the database is (see
+ * set_journal_position), so a database that was kept only replays the
+ * commands after that, and its archives, executions and other history stay
+ * as they are. Only a database with nothing from the journal in it is reset
+ * and rebuilt, from the snapshot if one is given (see state_snapshot.h). A
+ * snapshot holds only the live market, so it is the fallback for a database
+ * that was lost, not the usual way to restart.
+ *
+ * @param database A pointer to the SQLite database connection, upgraded to
+ * the current schema.
+ * @param journal_path The journal's file (see journal.h).
+ * @param snapshot_path The latest snapshot's file, or NULL for none.
+ * @return The number of commands replayed, or -1 on failure.
+ */
+int64_t recover_market(sqlite3* database, const char* journal_path,
+                       const char* snapshot_path);
@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+
+#include <errno.h>       // errno, EINTR
+#include <stdint.h>      // uint64_t
+#include <stdio.h>       // open_memstream, snprintf
+#include <stdlib.h>      // free
+#include <string.h>      // memchr
+#include <sys/epoll.h>   // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/socket.h>  // accept4, sendmmsg, setsockopt
+#include <sys/time.h>    // timeval
+#include <sys/uio.h>     // iovec
+#include <unistd.h>      // close, read, write
+
+#include "io_stats.h"
+#include "market_data.h"
+#include "util.h"
+#include "worker.h"
+
+enum {
+  /// The most ready descriptors handled per wait on the event queue.
+  MAX_EVENTS = 8,
+  /// The most bytes of lines in one datagram, so that with its header it fits
+  /// in an Ethernet frame without being fragmented.
+  DATAGRAM_PAYLOAD_SIZE = 1400,
+  /// The room for the `FEED <packet>` line starting each datagram.
+  DATAGRAM_HEADER_SIZE = 32,
+  /// The most datagrams handed to the kernel per system call.
+  DATAGRAM_BATCH_SIZE = 64,
+  /// How long a snapshot client may take to accept its snapshot before it is
+  /// dropped, so a stalled one can't hold up the feed.
+  SNAPSHOT_SEND_TIMEOUT_MS = 1000,
+};
+
+// The state of the thread publishing datagrams.
+typedef struct {
+  /// The worker this loop runs.
+  worker* self;
+  /// The event queue watching the snapshot listener and the feed eventfd.
+  int epoll_d;
+  /// What has been published as datagrams so far.
+  feed_subscription subscription;
+  /// The number of the last datagram sent, or 0 if none were.
+  uint64_t packet;
+  /// The next batch of datagrams to send.
+  struct mmsghdr messages[DATAGRAM_BATCH_SIZE];
+  /// The header line of each datagram in the batch.
+  char headers[DATAGRAM_BATCH_SIZE][DATAGRAM_HEADER_SIZE];
+  /// The header and lines of each datagram in the batch.
+  struct iovec pieces[DATAGRAM_BATCH_SIZE][2];
+  /// The number of datagrams in the batch.
+  unsigned batch_size;
+} datagram_loop;
+
+// Send every datagram in the batch. One that can't be sent is lost, which the
+// consumers see as a gap in the packet numbers.
+static void send_batch(datagram_loop* loop) {
+  unsigned sent = 0;
+  while (sent < loop->batch_size) {
+    count_io_syscalls(1);
+    int status = sendmmsg(loop->self->feed_socket, &loop->messages[sent],
+                          loop->batch_size - sent, 0);
+    if (status == -1 && errno == EINTR) {
+      continue;
+    }
+    // Skip the datagram the kernel refused.
+    sent += status > 0 ? (unsigned)status : 1;
+  }
+  loop->batch_size = 0;
+}
+
+// Add a datagram holding some of the lines to the batch, sending the batch
+// once it is full.
+static void queue_datagram(datagram_loop* loop, const char* lines,
+                           size_t size) {
+  unsigned index = loop->batch_size++;
+  int header_size = snprintf(loop->headers[index], DATAGRAM_HEADER_SIZE,
+                             "FEED %llu\r\n",
+                             (unsigned long long)++loop->packet);
+  loop->pieces[index][0] =
+      (struct iovec){loop->headers[index], (size_t)header_size};
+  loop->pieces[index][1] = (struct iovec){(void*)lines, size};
+  loop->messages[index] = (struct mmsghdr){
+      .msg_hdr = {.msg_name = &loop->self->feed_addr,
+                  .msg_namelen = sizeof(loop->self->feed_addr),
+                  .msg_iov = loop->pieces[index],
+                  .msg_iovlen = 2}};
+  if (loop->batch_size == DATAGRAM_BATCH_SIZE) {
+    send_batch(loop);
+  }
+}
+
+// Send lines as datagrams, packing as many whole lines into each as fit.
+static void publish_lines(datagram_loop* loop, const char* lines,
+                          size_t size) {
+  const char* end = lines + size;
+  const char* start = lines;
+  const char* cut = lines;
+  while (cut < end) {
+    const char* newline = memchr(cut, '\n', (size_t)(end - cut));
+    const char* line_end = newline != NULL ? newline + 1 : end;
+    if (line_end - start > DATAGRAM_PAYLOAD_SIZE && cut > start) {
+      queue_datagram(loop, start, (size_t)(cut - start));
+      start = cut;
+    }
+    cut = line_end;
+  }
+  if (cut > start) {
+    queue_datagram(loop, start, (size_t)(cut - start));
+  }
+  // The lines are freed after this returns, so nothing may stay queued.
+  if (loop->batch_size > 0) {
+    send_batch(loop);
+  }
+}
+
+// Publish everything written by copy, which is given the loop's subscription
+// and a stream to write to.
+static void publish(datagram_loop* loop,
+                    int (*copy)(feed_subscription*, FILE*)) {
+  char* lines = NULL;
+  size_t size = 0;
+  FILE* out = open_memstream(&lines, &size);
+  if (out == NULL) {
+    error_and_exit("Can't buffer market data");
+  }
+  if (copy(&loop->subscription, out) == -1 || fclose(out) == EOF) {
+    error_and_exit("Couldn't buffer market data");
+  }
+  publish_lines(loop, lines, size);
+  free(lines);
+}
+
+// Send a snapshot of every book to a client and hang up.
+static void send_snapshot(int client_d) {
+  struct timeval timeout = {
+      .tv_sec = SNAPSHOT_SEND_TIMEOUT_MS / 1000,
+      .tv_usec = (SNAPSHOT_SEND_TIMEOUT_MS % 1000) * 1000};
+  (void)setsockopt(client_d, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                   sizeof(timeout));
+  char* lines = NULL;
+  size_t size = 0;
+  FILE* out = open_memstream(&lines, &size);
+  if (out == NULL) {
+    error_and_exit("Can't buffer snapshot");
+  }
+  feed_subscription snapshot = {0};
+  if (copy_market_snapshot(&snapshot, out) == -1 || fclose(out) == EOF) {
+    error_and_exit("Couldn't buffer snapshot");
+  }
+  size_t written = 0;
+  while (written < size) {
+    count_io_syscalls(1);
+    ssize_t status = write(client_d, lines + written, size - written);
+    if (status == -1 && errno == EINTR) {
+      continue;
+    }
+    if (status <= 0) {
+      // Too slow or gone. It can ask again.
+      break;
+    }
+    written += (size_t)status;
+  }
+  free(lines);
+  (void)close(client_d);
+}
+
+// Serve every client waiting on the snapshot listener.
+static void serve_snapshots(datagram_loop* loop) {
+  for (;;) {
+    count_io_syscalls(1);
+    int client_d = accept4(loop->self->listener, NULL, NULL, SOCK_CLOEXEC);
+    if (client_d == -1) {
+      if (handle_accept_error(loop->self, errno) == -1) {
+        return;
+      }
+      continue;
+    }
+    send_snapshot(client_d);
+  }
+}
+
+void run_datagram_loop(worker* self) {
+  datagram_loop loop = {.self = self, .epoll_d = epoll_create1(EPOLL_CLOEXEC)};
+  if (loop.epoll_d == -1) {
+    error_and_exit("Can't create event queue");
+  }
+  // Each event points at the descriptor it is for.
+  struct epoll_event listener_event = {.events = EPOLLIN,
+                                       .data.ptr = &self->listener};
+  struct epoll_event feed_event = {.events = EPOLLIN,
+                                   .data.ptr = &self->feed_event};
+  if (epoll_ctl(loop.epoll_d, EPOLL_CTL_ADD, self->listener,
+                &listener_event) == -1 ||
+      epoll_ctl(loop.epoll_d, EPOLL_CTL_ADD, self->feed_event, &feed_event) ==
+          -1) {
+    error_and_exit("Can't watch market data");
+  }
+
+  // Start with every book, so a consumer listening from the start never needs
+  // to ask for a snapshot.
+  publish(&loop, copy_market_snapshot);
+
+  struct epoll_event events[MAX_EVENTS];
+  for (;;) {
+    count_io_syscalls(1);
+    int ready = epoll_wait(loop.epoll_d, events, MAX_EVENTS, -1);
+    if (ready == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error_and_exit("Can't wait for market data");
+    }
+    for (int i = 0; i < ready; ++i) {
+      if (events[i].data.ptr == &self->feed_event) {
+        uint64_t signals = 0;
+        count_io_syscalls(1);
+        (void)read(self->feed_event, &signals, sizeof(signals));
+        // Clear the flag first, so anything published from now on signals
+        // again.
+        atomic_store(&self->feed_pending, 0);
+        publish(&loop, copy_market_updates);
+      } else {
+        serve_snapshots(&loop);
+      }
+    }
+  }
+}
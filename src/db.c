@@ -4,13 +4,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "util.h"
 
 // Opens a database for use
 sqlite3* open_database(void) {
   sqlite3* database = NULL;
-  if (sqlite3_open(FILENAME, &database) != SQLITE_OK) {
+  // URIs let archive partitions be attached read-only.
+  if (sqlite3_open_v2(FILENAME, &database,
+                      SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                          SQLITE_OPEN_URI,
+                      NULL) != SQLITE_OK) {
     fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(database));
     return NULL;
   }
@@ -55,6 +60,9 @@ int create_tables(sqlite3* database) {
       "userID INTEGER NOT NULL, "
       "created_at DATETIME DEFAULT CURRENT_TIMESTAMP, "
       "FOREIGN KEY(userID) REFERENCES users(userID));"
+      // Pages of a user's orders are read in order of ID.
+      "CREATE INDEX IF NOT EXISTS orders_by_user "
+      "ON orders (userID, orderID);"
 
       "CREATE TABLE IF NOT EXISTS archives ("
       "orderID INTEGER PRIMARY KEY AUTOINCREMENT, "
@@ -64,7 +72,66 @@ int create_tables(sqlite3* database) {
       "unitPrice REAL NOT NULL, "
       "userID INTEGER NOT NULL, "
       "created_at DATETIME DEFAULT CURRENT_TIMESTAMP, "
-      "FOREIGN KEY(userID) REFERENCES users(userID));";
+      "archivedAt INTEGER NOT NULL "
+      "DEFAULT (CAST(strftime('%s', 'now') AS INTEGER)), "
+      "FOREIGN KEY(userID) REFERENCES users(userID));"
+      "CREATE INDEX IF NOT EXISTS archives_by_user "
+      "ON archives (userID, orderID);"
+
+      // The archives of past periods are moved to a file of their own, listed
+      // here with the range of IDs it holds.
+      "CREATE TABLE IF NOT EXISTS archive_partitions ("
+      "startTime INTEGER PRIMARY KEY, "
+      "path TEXT NOT NULL, "
+      "firstID INTEGER NOT NULL, "
+      "lastID INTEGER NOT NULL);"
+      // Which partitions hold each user's archives, so reading them only
+      // opens those.
+      "CREATE TABLE IF NOT EXISTS archive_partition_users ("
+      "userID INTEGER NOT NULL, "
+      "startTime INTEGER NOT NULL, "
+      "firstID INTEGER NOT NULL, "
+      "lastID INTEGER NOT NULL, "
+      "PRIMARY KEY(userID, startTime)) WITHOUT ROWID;"
+
+      // Prices are in ticks, and a candle is found by what it is for, so no
+      // rowid is needed.
+      "CREATE TABLE IF NOT EXISTS candles ("
+      "item INTEGER NOT NULL, "
+      "interval INTEGER NOT NULL, "
+      "startTime INTEGER NOT NULL, "
+      "open INTEGER NOT NULL, "
+      "high INTEGER NOT NULL, "
+      "low INTEGER NOT NULL, "
+      "close INTEGER NOT NULL, "
+      "volume INTEGER NOT NULL, "
+      "PRIMARY KEY(item, interval, startTime)) WITHOUT ROWID;"
+
+      // Only ever appended to, once per fill.
+      "CREATE TABLE IF NOT EXISTS executions ("
+      "executionID INTEGER PRIMARY KEY AUTOINCREMENT, "
+      "item INTEGER NOT NULL, "
+      "price INTEGER NOT NULL, "
+      "quantity INTEGER NOT NULL, "
+      "aggressor INTEGER NOT NULL, "
+      "buyerID INTEGER NOT NULL, "
+      "sellerID INTEGER NOT NULL, "
+      "executedAt INTEGER NOT NULL);"
+      "CREATE INDEX IF NOT EXISTS executions_by_item "
+      "ON executions (item, executionID);"
+
+      // Checkpoints of the summaries kept in memory by account_summary.c, each
+      // counting the executions up to lastExecutionID.
+      "CREATE TABLE IF NOT EXISTS account_summaries ("
+      "userID INTEGER PRIMARY KEY, "
+      "filledOMG INTEGER NOT NULL, "
+      "filledDOGE INTEGER NOT NULL, "
+      "filledBTC INTEGER NOT NULL, "
+      "filledETH INTEGER NOT NULL, "
+      "tradeCount INTEGER NOT NULL, "
+      "notional INTEGER NOT NULL, "
+      "lastActiveAt INTEGER NOT NULL, "
+      "lastExecutionID INTEGER NOT NULL);";
 
   char* errMsg = 0;
   int res = sqlite3_exec(database, create_tables_sql, 0, 0, &errMsg);
@@ -77,6 +144,223 @@ int create_tables(sqlite3* database) {
   return SQLITE_OK;
 }
 
+// Give archives from before partitioning the archivedAt they lack. The table
+// as created by create_tables already has it, so only older tables change.
+static int add_archived_at(sqlite3* database) {
+  sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(database,
+                               "SELECT COUNT(*) FROM pragma_table_info("
+                               "'archives') WHERE name = 'archivedAt';",
+                               -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to prepare the archives column check: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+  int has_column = 0;
+  res = sqlite3_step(stmt);
+  if (res == SQLITE_ROW) {
+    has_column = sqlite3_column_int(stmt, 0) > 0;
+    res = SQLITE_OK;
+  } else {
+    fprintf(stderr, "Failed to check the archives columns: %s\n",
+            sqlite3_errmsg(database));
+  }
+  sqlite3_finalize(stmt);
+  if (res != SQLITE_OK || has_column) {
+    return res;
+  }
+
+  // A column can't be added with a default that isn't constant, and when
+  // those orders were archived is lost, so date them by when they were
+  // placed. insert_archive always sets archivedAt, so the default isn't used.
+  char* errMsg = NULL;
+  res = sqlite3_exec(database,
+                     "ALTER TABLE archives "
+                     "ADD COLUMN archivedAt INTEGER NOT NULL DEFAULT 0;"
+                     "UPDATE archives SET archivedAt = COALESCE("
+                     "CAST(strftime('%s', created_at) AS INTEGER), 0);",
+                     0, 0, &errMsg);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Error adding archivedAt to archives: %s\n", errMsg);
+    sqlite3_free(errMsg);
+  }
+  return res;
+}
+
+// Keep the sequence number of the last journal entry the database holds the
+// effects of, starting from none.
+static int create_journal_position(sqlite3* database) {
+  char* errMsg = NULL;
+  int res = sqlite3_exec(database,
+                         "CREATE TABLE IF NOT EXISTS journal_position ("
+                         "sequence INTEGER NOT NULL);"
+                         "INSERT INTO journal_position (sequence) "
+                         "SELECT 0 WHERE NOT EXISTS "
+                         "(SELECT 1 FROM journal_position);",
+                         0, 0, &errMsg);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Error creating the journal position table: %s\n",
+            errMsg);
+    sqlite3_free(errMsg);
+  }
+  return res;
+}
+
+// Each step brings the schema from the version before it up to its own, and
+// is run once per database. When the schema changes, add a step rather than
+// changing create_tables or an earlier step.
+static int (*const migrations[SCHEMA_VERSION])(sqlite3*) = {
+    // 1: Every table as first versioned. Databases from before versioning were
+    // built by the same statements, so this only adds the tables they lack.
+    create_tables,
+    // 2: The archivedAt column, which archives from before partitioning lack.
+    add_archived_at,
+    // 3: Where in the journal the database is, so a restart keeps it.
+    create_journal_position,
+};
+
+// Read the version a database's schema is at, or 0 if it has none yet.
+static int get_schema_version(sqlite3* database, int* version) {
+  sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(
+      database, "SELECT COALESCE(MAX(version), 0) FROM schema_version;", -1,
+      &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to prepare the schema version statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+  res = sqlite3_step(stmt);
+  if (res == SQLITE_ROW) {
+    *version = sqlite3_column_int(stmt, 0);
+    res = SQLITE_OK;
+  } else {
+    fprintf(stderr, "Failed to read the schema version: %s\n",
+            sqlite3_errmsg(database));
+  }
+  sqlite3_finalize(stmt);
+  return res;
+}
+
+int migrate_tables(sqlite3* database) {
+  char* errMsg = NULL;
+  int res = sqlite3_exec(database,
+                         "CREATE TABLE IF NOT EXISTS schema_version ("
+                         "version INTEGER NOT NULL);",
+                         0, 0, &errMsg);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Error creating the schema version table: %s\n", errMsg);
+    sqlite3_free(errMsg);
+    return res;
+  }
+  int version = 0;
+  res = get_schema_version(database, &version);
+  if (res != SQLITE_OK) {
+    return res;
+  }
+  if (version > SCHEMA_VERSION) {
+    fprintf(stderr, "The database is at schema version %d, newer than %d.\n",
+            version, SCHEMA_VERSION);
+    return SQLITE_ERROR;
+  }
+
+  // Each step and its new version commit together, so a crash part way
+  // through leaves the database at the version before the step.
+  for (; version < SCHEMA_VERSION; ++version) {
+    char* sql = fprintf_to_string(
+        "DELETE FROM schema_version; "
+        "INSERT INTO schema_version (version) VALUES (%d); COMMIT;",
+        version + 1);
+    if (sql == NULL) {
+      return SQLITE_NOMEM;
+    }
+    res = sqlite3_exec(database, "BEGIN;", 0, 0, NULL);
+    if (res == SQLITE_OK) {
+      res = migrations[version](database);
+    }
+    if (res == SQLITE_OK) {
+      res = sqlite3_exec(database, sql, 0, 0, &errMsg);
+      if (res != SQLITE_OK) {
+        fprintf(stderr, "Error recording schema version %d: %s\n",
+                version + 1, errMsg);
+        sqlite3_free(errMsg);
+      }
+    }
+    free(sql);
+    if (res != SQLITE_OK) {
+      if (!sqlite3_get_autocommit(database)) {
+        (void)sqlite3_exec(database, "ROLLBACK;", 0, 0, NULL);
+      }
+      fprintf(stderr, "Failed to migrate the schema to version %d.\n",
+              version + 1);
+      return res;
+    }
+  }
+  return SQLITE_OK;
+}
+
+int get_journal_position(sqlite3* database, uint64_t* sequence) {
+  sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(
+      database, "SELECT COALESCE(MAX(sequence), 0) FROM journal_position;", -1,
+      &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to prepare the journal position statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+  res = sqlite3_step(stmt);
+  if (res == SQLITE_ROW) {
+    *sequence = (uint64_t)sqlite3_column_int64(stmt, 0);
+    res = SQLITE_OK;
+  } else {
+    fprintf(stderr, "Failed to read the journal position: %s\n",
+            sqlite3_errmsg(database));
+  }
+  sqlite3_finalize(stmt);
+  return res;
+}
+
+int set_journal_position(sqlite3* database, uint64_t sequence) {
+  sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(database,
+                               "UPDATE journal_position SET sequence = ?;", -1,
+                               &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to prepare the journal position update: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+  sqlite3_bind_int64(stmt, 1, (sqlite3_int64)sequence);
+  res = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK
+                                          : sqlite3_errcode(database);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to record the journal position: %s\n",
+            sqlite3_errmsg(database));
+  }
+  sqlite3_finalize(stmt);
+  return res;
+}
+
+int prewarm_tables(sqlite3* database) {
+  // Matching and logging in read these on every command. Each query reads
+  // every page of a table or index, so they come into the kernel's page cache
+  // and as much of SQLite's own as fits.
+  const char* sql =
+      "SELECT SUM(OMG + DOGE + BTC + ETH) FROM users;"
+      "SELECT COUNT(*) FROM users INDEXED BY sqlite_autoindex_users_1;"
+      "SELECT SUM(quantity) FROM orders;"
+      "SELECT COUNT(*) FROM orders INDEXED BY orders_by_user;";
+  char* errMsg = NULL;
+  int res = sqlite3_exec(database, sql, 0, 0, &errMsg);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Error prewarming tables: %s\n", errMsg);
+    sqlite3_free(errMsg);
+  }
+  return res;
+}
+
 int drop_all_tables(sqlite3* database) {
   char* errMsg = 0;
   const char* sql =
@@ -85,6 +369,13 @@ int drop_all_tables(sqlite3* database) {
       "DROP TABLE IF EXISTS users;"
       "DROP TABLE IF EXISTS orders;"
       "DROP TABLE IF EXISTS archives;"
+      "DROP TABLE IF EXISTS archive_partitions;"
+      "DROP TABLE IF EXISTS archive_partition_users;"
+      "DROP TABLE IF EXISTS candles;"
+      "DROP TABLE IF EXISTS executions;"
+      "DROP TABLE IF EXISTS account_summaries;"
+      "DROP TABLE IF EXISTS schema_version;"
+      "DROP TABLE IF EXISTS journal_position;"
       "COMMIT;"
       "PRAGMA foreign_keys = ON;";
 
@@ -146,8 +437,9 @@ int insert_order(sqlite3* database, order* new_order) {
   }
   // Insert the order into the database
   const char* sql =
-      "INSERT INTO orders (item, buyOrSell, quantity, unitPrice, userID) "
-      "VALUES (?, ?, ?, ?, ?);";
+      "INSERT INTO orders (item, buyOrSell, quantity, unitPrice, userID, "
+      "created_at) "
+      "VALUES (?, ?, ?, ?, ?, COALESCE(?, CURRENT_TIMESTAMP));";
 
   sqlite3_stmt* stmt = NULL;
   res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
@@ -162,6 +454,7 @@ int insert_order(sqlite3* database, order* new_order) {
   sqlite3_bind_int(stmt, 3, new_order->quantity);
   sqlite3_bind_double(stmt, 4, new_order->unitPrice);
   sqlite3_bind_int(stmt, 5, new_order->userID);
+  sqlite3_bind_text(stmt, 6, new_order->created_at, -1, SQLITE_TRANSIENT);
 
   res = sqlite3_step(stmt);
   if (res != SQLITE_DONE) {
@@ -416,7 +709,7 @@ int find_matching_buy(sqlite3* database, order* search_order) {
       "created_at "
       "FROM orders "
       "WHERE item = ? AND buyOrSell = 0 AND unitPrice >= ? AND userID != ? "
-      "ORDER BY created_at ASC LIMIT 1;";
+      "ORDER BY created_at ASC, orderID ASC LIMIT 1;";
   sqlite3_stmt* stmt = NULL;
 
   int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
@@ -449,7 +742,7 @@ int find_matching_sell(sqlite3* database, order* search_order) {
       "created_at "
       "FROM orders "
       "WHERE item = ? AND buyOrSell = 1 AND unitPrice <= ? AND userID != ? "
-      "ORDER BY created_at ASC LIMIT 1;";
+      "ORDER BY created_at ASC, orderID ASC LIMIT 1;";
   sqlite3_stmt* stmt = NULL;
 
   int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
@@ -657,6 +950,41 @@ fail:
   return res;
 }
 
+int add_user_balance_changes(sqlite3* database, const balance_change* changes,
+                             int count, int* written_out) {
+  *written_out = 0;
+  const char* sql =
+      "UPDATE users SET OMG = OMG + ?, DOGE = DOGE + ?, BTC = BTC + ?, "
+      "ETH = ETH + ? WHERE userID = ?;";
+  sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr,
+            "Failed to prepare the add_user_balance_changes statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    for (int coin = COIN_OMG; coin <= COIN_ETH; ++coin) {
+      sqlite3_bind_int64(stmt, coin + 1, changes[i].amounts[coin]);
+    }
+    sqlite3_bind_int(stmt, COIN_ETH + 2, changes[i].userID);
+    res = sqlite3_step(stmt);
+    if (res != SQLITE_DONE) {
+      fprintf(stderr, "Failed to change the balances of user %d: %s\n",
+              changes[i].userID, sqlite3_errmsg(database));
+      sqlite3_finalize(stmt);
+      return res;
+    }
+    sqlite3_reset(stmt);
+    ++*written_out;
+  }
+
+  sqlite3_finalize(stmt);
+  return SQLITE_OK;
+}
+
 int get_user_all_orders(sqlite3* database, int userID, order** orders_out,
                         int* count_out) {
   *count_out = 0;
@@ -703,6 +1031,473 @@ int get_user_all_orders(sqlite3* database, int userID, order** orders_out,
   return SQLITE_OK;
 }
 
+// Append a user's orders to a page with a statement selecting orderID, item,
+// buyOrSell, quantity, unitPrice, userID and created_at for the userID, lower
+// orderID bound and limit bound to it, until the page holds capacity orders.
+static int read_order_rows(sqlite3* database, const char* sql,
+                           const char* name, int userID, int afterID,
+                           order* orders, int capacity, int* count) {
+  sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to prepare the %s statement: %s\n", name,
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  sqlite3_bind_int(stmt, 1, userID);
+  sqlite3_bind_int(stmt, 2, afterID);
+  sqlite3_bind_int(stmt, 3, capacity - *count);
+
+  while (*count < capacity && (res = sqlite3_step(stmt)) == SQLITE_ROW) {
+    order* row = &orders[*count];
+    row->orderID = sqlite3_column_int(stmt, 0);
+    row->item = sqlite3_column_int(stmt, 1);
+    row->buyOrSell = sqlite3_column_int(stmt, 2);
+    row->quantity = sqlite3_column_int(stmt, 3);
+    row->unitPrice = sqlite3_column_double(stmt, 4);
+    row->userID = sqlite3_column_int(stmt, 5);
+    const unsigned char* created_at = sqlite3_column_text(stmt, 6);
+    row->created_at =
+        created_at != NULL ? strdup((const char*)created_at) : NULL;
+    ++*count;
+  }
+  if (*count < capacity && res != SQLITE_DONE) {
+    fprintf(stderr, "Failed to execute the %s statement: %s\n", name,
+            sqlite3_errmsg(database));
+    sqlite3_finalize(stmt);
+    return res;
+  }
+  sqlite3_finalize(stmt);
+  return SQLITE_OK;
+}
+
+// Hand a page read into orders to the caller, or free it if reading failed or
+// found nothing.
+static int finish_order_page(int res, order* orders, int count,
+                             order** orders_out, int* count_out) {
+  if (res != SQLITE_OK || count == 0) {
+    for (int i = 0; i < count; ++i) {
+      free(orders[i].created_at);
+    }
+    free(orders);
+    return res;
+  }
+  *orders_out = orders;
+  *count_out = count;
+  return SQLITE_OK;
+}
+
+// Read one page of a user's orders with a statement for read_order_rows. The
+// page is allocated up front, so its size doesn't depend on how many orders
+// the user has.
+static int read_order_page(sqlite3* database, const char* sql,
+                           const char* name, int userID, int afterID,
+                           int limit, order** orders_out, int* count_out) {
+  *count_out = 0;
+  *orders_out = NULL;
+  if (limit <= 0) {
+    return SQLITE_OK;
+  }
+  order* orders = calloc((size_t)limit, sizeof(order));
+  if (orders == NULL) {
+    return SQLITE_NOMEM;
+  }
+  int count = 0;
+  int res = read_order_rows(database, sql, name, userID, afterID, orders,
+                            limit, &count);
+  return finish_order_page(res, orders, count, orders_out, count_out);
+}
+
+int get_user_orders_after(sqlite3* database, int userID, int afterID,
+                          int limit, order** orders_out, int* count_out) {
+  const char* sql =
+      "SELECT orderID, item, buyOrSell, quantity, unitPrice, userID, "
+      "created_at "
+      "FROM orders WHERE userID = ? AND orderID > ? "
+      "ORDER BY orderID LIMIT ?;";
+  return read_order_page(database, sql, "get_user_orders_after", userID,
+                         afterID, limit, orders_out, count_out);
+}
+
+int get_open_order_totals(sqlite3* database, order_total** levels_out,
+                          int* count_out) {
+  *count_out = 0;
+  *levels_out = NULL;
+
+  const char* sql =
+      "SELECT item, buyOrSell, unitPrice, SUM(quantity), COUNT(*) FROM orders "
+      "GROUP BY item, buyOrSell, unitPrice;";
+  sqlite3_stmt* stmt = NULL;
+
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr,
+            "Failed to prepare the get_open_order_totals statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  while ((sqlite3_step(stmt)) == SQLITE_ROW) {
+    order_total level = {0};
+    level.item = sqlite3_column_int(stmt, 0);
+    level.buyOrSell = sqlite3_column_int(stmt, 1);
+    level.unitPrice = sqlite3_column_double(stmt, 2);
+    level.quantity = sqlite3_column_int(stmt, 3);
+    level.orderCount = sqlite3_column_int(stmt, 4);
+
+    order_total* temp =
+        realloc(*levels_out, (size_t)(*count_out + 1) * sizeof(order_total));
+    if (temp == NULL) {
+      error_and_exit("Realloc failed");
+    }
+    *levels_out = temp;
+    (*levels_out)[*count_out] = level;
+    (*count_out)++;
+  }
+
+  sqlite3_finalize(stmt);
+
+  return SQLITE_OK;
+}
+
+int save_candle(sqlite3* database, const candle* bar) {
+  const char* sql =
+      "INSERT OR REPLACE INTO candles (item, interval, startTime, open, high, "
+      "low, close, volume) "
+      "VALUES (?, ?, ?, ?, ?, ?, ?, ?);";
+
+  sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to prepare the save_candle statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  sqlite3_bind_int(stmt, 1, bar->item);
+  sqlite3_bind_int(stmt, 2, bar->interval);
+  sqlite3_bind_int64(stmt, 3, bar->startTime);
+  sqlite3_bind_int64(stmt, 4, bar->open);
+  sqlite3_bind_int64(stmt, 5, bar->high);
+  sqlite3_bind_int64(stmt, 6, bar->low);
+  sqlite3_bind_int64(stmt, 7, bar->close);
+  sqlite3_bind_int64(stmt, 8, bar->volume);
+
+  res = sqlite3_step(stmt);
+  if (res != SQLITE_DONE) {
+    fprintf(stderr, "Failed to execute the save_candle statement: %s\n",
+            sqlite3_errmsg(database));
+    sqlite3_finalize(stmt);
+    return res;
+  }
+
+  sqlite3_finalize(stmt);
+  return SQLITE_OK;
+}
+
+int get_recent_candles(sqlite3* database, int item, int interval, int limit,
+                       candle** candles_out, int* count_out) {
+  *count_out = 0;
+  *candles_out = NULL;
+
+  // Take the latest candles, then put them back in time order.
+  const char* sql =
+      "SELECT item, interval, startTime, open, high, low, close, volume "
+      "FROM (SELECT * FROM candles WHERE item = ? AND interval = ? "
+      "ORDER BY startTime DESC LIMIT ?) "
+      "ORDER BY startTime ASC;";
+  sqlite3_stmt* stmt = NULL;
+
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to prepare the get_recent_candles statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  sqlite3_bind_int(stmt, 1, item);
+  sqlite3_bind_int(stmt, 2, interval);
+  sqlite3_bind_int(stmt, 3, limit);
+
+  while ((sqlite3_step(stmt)) == SQLITE_ROW) {
+    candle bar;
+    bar.item = sqlite3_column_int(stmt, 0);
+    bar.interval = sqlite3_column_int(stmt, 1);
+    bar.startTime = sqlite3_column_int64(stmt, 2);
+    bar.open = sqlite3_column_int64(stmt, 3);
+    bar.high = sqlite3_column_int64(stmt, 4);
+    bar.low = sqlite3_column_int64(stmt, 5);
+    bar.close = sqlite3_column_int64(stmt, 6);
+    bar.volume = sqlite3_column_int64(stmt, 7);
+
+    candle* temp =
+        realloc(*candles_out, (size_t)(*count_out + 1) * sizeof(candle));
+    if (temp == NULL) {
+      error_and_exit("Realloc failed");
+    }
+    *candles_out = temp;
+    (*candles_out)[*count_out] = bar;
+    (*count_out)++;
+  }
+
+  sqlite3_finalize(stmt);
+
+  return SQLITE_OK;
+}
+
+int insert_execution(sqlite3* database, execution* fill) {
+  const char* sql =
+      "INSERT INTO executions (item, price, quantity, aggressor, buyerID, "
+      "sellerID, executedAt) "
+      "VALUES (?, ?, ?, ?, ?, ?, ?);";
+
+  sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to prepare the insert_execution statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  sqlite3_bind_int(stmt, 1, fill->item);
+  sqlite3_bind_int64(stmt, 2, fill->price);
+  sqlite3_bind_int(stmt, 3, fill->quantity);
+  sqlite3_bind_int(stmt, 4, fill->aggressor);
+  sqlite3_bind_int(stmt, 5, fill->buyerID);
+  sqlite3_bind_int(stmt, 6, fill->sellerID);
+  sqlite3_bind_int64(stmt, 7, fill->executedAt);
+
+  res = sqlite3_step(stmt);
+  if (res != SQLITE_DONE) {
+    fprintf(stderr, "Failed to execute the insert_execution statement: %s\n",
+            sqlite3_errmsg(database));
+    sqlite3_finalize(stmt);
+    return res;
+  }
+
+  fill->executionID = sqlite3_last_insert_rowid(database);
+  sqlite3_finalize(stmt);
+  return SQLITE_OK;
+}
+
+// Read every row of a prepared executions query into a new array.
+static void read_executions(sqlite3_stmt* stmt, execution** executions_out,
+                            int* count_out) {
+  while ((sqlite3_step(stmt)) == SQLITE_ROW) {
+    execution fill;
+    fill.executionID = sqlite3_column_int64(stmt, 0);
+    fill.item = sqlite3_column_int(stmt, 1);
+    fill.price = sqlite3_column_int64(stmt, 2);
+    fill.quantity = sqlite3_column_int(stmt, 3);
+    fill.aggressor = sqlite3_column_int(stmt, 4);
+    fill.buyerID = sqlite3_column_int(stmt, 5);
+    fill.sellerID = sqlite3_column_int(stmt, 6);
+    fill.executedAt = sqlite3_column_int64(stmt, 7);
+
+    execution* temp =
+        realloc(*executions_out, (size_t)(*count_out + 1) * sizeof(execution));
+    if (temp == NULL) {
+      error_and_exit("Realloc failed");
+    }
+    *executions_out = temp;
+    (*executions_out)[*count_out] = fill;
+    (*count_out)++;
+  }
+}
+
+int get_recent_executions(sqlite3* database, int item, int limit,
+                          execution** executions_out, int* count_out) {
+  *count_out = 0;
+  *executions_out = NULL;
+
+  // Take the latest executions, then put them back in the order they
+  // happened.
+  const char* sql =
+      "SELECT executionID, item, price, quantity, aggressor, buyerID, "
+      "sellerID, executedAt "
+      "FROM (SELECT * FROM executions WHERE item = ? "
+      "ORDER BY executionID DESC LIMIT ?) "
+      "ORDER BY executionID ASC;";
+  sqlite3_stmt* stmt = NULL;
+
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr,
+            "Failed to prepare the get_recent_executions statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  sqlite3_bind_int(stmt, 1, item);
+  sqlite3_bind_int(stmt, 2, limit);
+
+  read_executions(stmt, executions_out, count_out);
+
+  sqlite3_finalize(stmt);
+
+  return SQLITE_OK;
+}
+
+int get_executions_since(sqlite3* database, int64_t since,
+                         execution** executions_out, int* count_out) {
+  *count_out = 0;
+  *executions_out = NULL;
+
+  const char* sql =
+      "SELECT executionID, item, price, quantity, aggressor, buyerID, "
+      "sellerID, executedAt "
+      "FROM executions WHERE executedAt >= ? "
+      "ORDER BY executionID ASC;";
+  sqlite3_stmt* stmt = NULL;
+
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr,
+            "Failed to prepare the get_executions_since statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  sqlite3_bind_int64(stmt, 1, since);
+  read_executions(stmt, executions_out, count_out);
+
+  sqlite3_finalize(stmt);
+
+  return SQLITE_OK;
+}
+
+int get_executions_after(sqlite3* database, int64_t afterID,
+                         execution** executions_out, int* count_out) {
+  *count_out = 0;
+  *executions_out = NULL;
+
+  const char* sql =
+      "SELECT executionID, item, price, quantity, aggressor, buyerID, "
+      "sellerID, executedAt "
+      "FROM executions WHERE executionID > ? "
+      "ORDER BY executionID ASC;";
+  sqlite3_stmt* stmt = NULL;
+
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr,
+            "Failed to prepare the get_executions_after statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  sqlite3_bind_int64(stmt, 1, afterID);
+  read_executions(stmt, executions_out, count_out);
+
+  sqlite3_finalize(stmt);
+
+  return SQLITE_OK;
+}
+
+int save_account_summary(sqlite3* database, const account_summary* summary) {
+  const char* sql =
+      "INSERT OR REPLACE INTO account_summaries (userID, filledOMG, "
+      "filledDOGE, filledBTC, filledETH, tradeCount, notional, lastActiveAt, "
+      "lastExecutionID) "
+      "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);";
+
+  sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr,
+            "Failed to prepare the save_account_summary statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  sqlite3_bind_int(stmt, 1, summary->userID);
+  sqlite3_bind_int64(stmt, 2, summary->filled[COIN_OMG]);
+  sqlite3_bind_int64(stmt, 3, summary->filled[COIN_DOGE]);
+  sqlite3_bind_int64(stmt, 4, summary->filled[COIN_BTC]);
+  sqlite3_bind_int64(stmt, 5, summary->filled[COIN_ETH]);
+  sqlite3_bind_int64(stmt, 6, summary->tradeCount);
+  sqlite3_bind_int64(stmt, 7, summary->notional);
+  sqlite3_bind_int64(stmt, 8, summary->lastActiveAt);
+  sqlite3_bind_int64(stmt, 9, summary->lastExecutionID);
+
+  res = sqlite3_step(stmt);
+  if (res != SQLITE_DONE) {
+    fprintf(stderr,
+            "Failed to execute the save_account_summary statement: %s\n",
+            sqlite3_errmsg(database));
+    sqlite3_finalize(stmt);
+    return res;
+  }
+
+  sqlite3_finalize(stmt);
+  return SQLITE_OK;
+}
+
+int get_account_summaries(sqlite3* database, account_summary** summaries_out,
+                          int* count_out) {
+  *count_out = 0;
+  *summaries_out = NULL;
+
+  // Open orders are counted through orders_by_user, one range per user.
+  const char* sql =
+      "SELECT users.userID, COALESCE(filledOMG, 0), COALESCE(filledDOGE, 0), "
+      "COALESCE(filledBTC, 0), COALESCE(filledETH, 0), "
+      "COALESCE(tradeCount, 0), COALESCE(notional, 0), "
+      "MAX(COALESCE(lastActiveAt, 0), COALESCE((SELECT "
+      "MAX(CAST(strftime('%s', created_at) AS INTEGER)) FROM orders "
+      "WHERE orders.userID = users.userID), 0)), "
+      "COALESCE(lastExecutionID, -1), "
+      "(SELECT COUNT(*) FROM orders WHERE orders.userID = users.userID) "
+      "FROM users LEFT JOIN account_summaries "
+      "ON account_summaries.userID = users.userID "
+      "ORDER BY users.userID;";
+  sqlite3_stmt* stmt = NULL;
+
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr,
+            "Failed to prepare the get_account_summaries statement: %s\n",
+            sqlite3_errmsg(database));
+    return res;
+  }
+
+  while ((res = sqlite3_step(stmt)) == SQLITE_ROW) {
+    account_summary summary;
+    summary.userID = sqlite3_column_int(stmt, 0);
+    for (int item = COIN_OMG; item <= COIN_ETH; ++item) {
+      summary.filled[item] = sqlite3_column_int64(stmt, 1 + item);
+    }
+    summary.tradeCount = sqlite3_column_int64(stmt, 5);
+    summary.notional = sqlite3_column_int64(stmt, 6);
+    summary.lastActiveAt = sqlite3_column_int64(stmt, 7);
+    summary.lastExecutionID = sqlite3_column_int64(stmt, 8);
+    summary.openOrders = sqlite3_column_int64(stmt, 9);
+
+    account_summary* temp = realloc(
+        *summaries_out, (size_t)(*count_out + 1) * sizeof(account_summary));
+    if (temp == NULL) {
+      error_and_exit("Realloc failed");
+    }
+    *summaries_out = temp;
+    (*summaries_out)[*count_out] = summary;
+    (*count_out)++;
+  }
+
+  if (res != SQLITE_DONE) {
+    fprintf(stderr, "Failed to read account summaries: %s\n",
+            sqlite3_errmsg(database));
+    sqlite3_finalize(stmt);
+    free(*summaries_out);
+    *summaries_out = NULL;
+    *count_out = 0;
+    return res;
+  }
+
+  sqlite3_finalize(stmt);
+  return SQLITE_OK;
+}
+
 int get_user_inventories(sqlite3* database, user* user_out) {
   const char* sql = "SELECT OMG, DOGE, BTC, ETH FROM users WHERE userID = ?;";
   sqlite3_stmt* stmt = NULL;
@@ -782,11 +1577,12 @@ int get_user_by_username(sqlite3* database, const char* username,
   return SQLITE_NOTFOUND;
 }
 
-int insert_archive(sqlite3* database, const order* archived_order) {
+int insert_archive(sqlite3* database, const order* archived_order,
+                   int64_t archivedAt) {
   const char* sql =
       "INSERT INTO archives (item, buyOrSell, quantity, unitPrice, userID, "
-      "created_at) "
-      "VALUES (?, ?, ?, ?, ?, ?);";
+      "created_at, archivedAt) "
+      "VALUES (?, ?, ?, ?, ?, ?, ?);";
 
   sqlite3_stmt* stmt = NULL;
   int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
@@ -802,6 +1598,7 @@ int insert_archive(sqlite3* database, const order* archived_order) {
   sqlite3_bind_double(stmt, 4, archived_order->unitPrice);
   sqlite3_bind_int(stmt, 5, archived_order->userID);
   sqlite3_bind_text(stmt, 6, archived_order->created_at, -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int64(stmt, 7, archivedAt);
 
   res = sqlite3_step(stmt);
   if (res != SQLITE_DONE) {
@@ -815,68 +1612,264 @@ int insert_archive(sqlite3* database, const order* archived_order) {
   return SQLITE_OK;
 }
 
-int get_user_archived_orders(sqlite3* database, int userID, order** orders_out,
-                             int* count_out) {
-  const char* sql =
-      "SELECT orderID, item, buyOrSell, quantity, unitPrice, userID, "
-      "created_at "
-      "FROM archives WHERE userID = ?;";
+// The room needed for the path of an archive partition, or its URI.
+enum { ARCHIVE_PATH_SIZE = 64 };
+
+// Attach an archive partition as archive_part.
+static int attach_partition(sqlite3* database, const char* path) {
+  // SQLite can't attach inside a transaction, so commit any batch the writer
+  // thread hasn't yet. Callers settle the batch's balance changes first (see
+  // settlement.h), since this library can't.
+  if (!sqlite3_get_autocommit(database)) {
+    (void)sqlite3_exec(database, "COMMIT;", 0, 0, NULL);
+  }
   sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(database, "ATTACH DATABASE ? AS archive_part;",
+                               -1, &stmt, NULL);
+  if (res == SQLITE_OK) {
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    res = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK
+                                            : sqlite3_errcode(database);
+  }
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to attach archive partition %s: %s\n", path,
+            sqlite3_errmsg(database));
+  }
+  sqlite3_finalize(stmt);
+  return res;
+}
+
+// Detach the archive partition attached by attach_partition.
+static void detach_partition(sqlite3* database) {
+  char* errMsg = NULL;
+  if (sqlite3_exec(database, "DETACH DATABASE archive_part;", 0, 0, &errMsg) !=
+      SQLITE_OK) {
+    fprintf(stderr, "Failed to detach archive partition: %s\n", errMsg);
+    sqlite3_free(errMsg);
+  }
+}
 
+// Find the partitions holding a user's archives with IDs above afterID,
+// oldest first.
+static int find_user_partitions(sqlite3* database, int userID, int afterID,
+                                char*** paths_out, int* count_out) {
+  *paths_out = NULL;
+  *count_out = 0;
+  const char* sql =
+      "SELECT path FROM archive_partition_users "
+      "JOIN archive_partitions USING (startTime) "
+      "WHERE userID = ? AND archive_partition_users.lastID > ? "
+      "ORDER BY archive_partition_users.firstID;";
+  sqlite3_stmt* stmt = NULL;
   int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
   if (res != SQLITE_OK) {
     fprintf(stderr,
-            "Failed to prepare the get_user_archived_orders statement: %s\n",
+            "Failed to prepare the find_user_partitions statement: %s\n",
             sqlite3_errmsg(database));
     return res;
   }
-
   sqlite3_bind_int(stmt, 1, userID);
+  sqlite3_bind_int(stmt, 2, afterID);
 
-  int capacity = 10;
-  int count = 0;
-  order* orders = (order*)malloc(sizeof(order) * capacity);
-  if (orders == NULL) {
-    fprintf(stderr, "Unable to allocate memory for archived orders.\n");
-    sqlite3_finalize(stmt);
-    return SQLITE_NOMEM;
+  while ((res = sqlite3_step(stmt)) == SQLITE_ROW) {
+    char** temp =
+        realloc(*paths_out, (size_t)(*count_out + 1) * sizeof(char*));
+    if (temp == NULL) {
+      error_and_exit("Realloc failed");
+    }
+    *paths_out = temp;
+    (*paths_out)[*count_out] =
+        strdup((const char*)sqlite3_column_text(stmt, 0));
+    (*count_out)++;
   }
+  sqlite3_finalize(stmt);
+  return res == SQLITE_DONE ? SQLITE_OK : res;
+}
 
-  while ((sqlite3_step(stmt)) == SQLITE_ROW) {
-    if (count >= capacity) {
-      capacity *= 2;
-      order* temp = (order*)realloc(orders, sizeof(order) * capacity);
-      if (temp == NULL) {
-        fprintf(stderr, "Unable to reallocate memory for archived orders.\n");
-        free(orders);
-        sqlite3_finalize(stmt);
-        return SQLITE_NOMEM;
-      }
-      orders = temp;
-    }
+int get_user_archived_orders(sqlite3* database, int userID, int afterID,
+                             int limit, order** orders_out, int* count_out) {
+  const char* partition_sql =
+      "SELECT orderID, item, buyOrSell, quantity, unitPrice, userID, "
+      "created_at "
+      "FROM archive_part.archives WHERE userID = ? AND orderID > ? "
+      "ORDER BY orderID LIMIT ?;";
+  const char* hot_sql =
+      "SELECT orderID, item, buyOrSell, quantity, unitPrice, userID, "
+      "created_at "
+      "FROM main.archives WHERE userID = ? AND orderID > ? "
+      "ORDER BY orderID LIMIT ?;";
+  *orders_out = NULL;
+  *count_out = 0;
+  if (limit <= 0) {
+    return SQLITE_OK;
+  }
 
-    orders[count].orderID = sqlite3_column_int(stmt, 0);
-    orders[count].item = sqlite3_column_int(stmt, 1);
-    orders[count].buyOrSell = sqlite3_column_int(stmt, 2);
-    orders[count].quantity = sqlite3_column_int(stmt, 3);
-    orders[count].unitPrice = sqlite3_column_double(stmt, 4);
-    orders[count].userID = sqlite3_column_int(stmt, 5);
-    const unsigned char* created_at = sqlite3_column_text(stmt, 6);
-    orders[count].created_at = strdup((const char*)created_at);
+  // Partitions are only opened when the user has archives in them past
+  // afterID, and no more are opened once the page is full.
+  char** paths = NULL;
+  int path_count = 0;
+  int res = find_user_partitions(database, userID, afterID, &paths,
+                                 &path_count);
+  order* orders = calloc((size_t)limit, sizeof(order));
+  if (orders == NULL) {
+    res = SQLITE_NOMEM;
+  }
+  int count = 0;
+  for (int i = 0; i < path_count && count < limit && res == SQLITE_OK; ++i) {
+    // Closed partitions never change again.
+    char uri[ARCHIVE_PATH_SIZE];
+    (void)snprintf(uri, sizeof(uri), "file:%s?mode=ro", paths[i]);
+    res = attach_partition(database, uri);
+    if (res != SQLITE_OK) {
+      break;
+    }
+    if (ARCHIVE_MMAP_SIZE > 0) {
+      char pragma[ARCHIVE_PATH_SIZE];
+      (void)snprintf(pragma, sizeof(pragma),
+                     "PRAGMA archive_part.mmap_size = %d;", ARCHIVE_MMAP_SIZE);
+      (void)sqlite3_exec(database, pragma, 0, 0, NULL);
+    }
+    res = read_order_rows(database, partition_sql, "get_user_archived_orders",
+                          userID, afterID, orders, limit, &count);
+    detach_partition(database);
+  }
+  for (int i = 0; i < path_count; ++i) {
+    free(paths[i]);
+  }
+  free(paths);
 
-    count++;
+  if (res == SQLITE_OK && count < limit) {
+    res = read_order_rows(database, hot_sql, "get_user_archived_orders",
+                          userID, afterID, orders, limit, &count);
   }
+  return finish_order_page(res, orders, count, orders_out, count_out);
+}
 
+// Run one statement of a rotation, with the start and end of the period and
+// the path of its partition bound to ?1, ?2 and ?3 where it uses them.
+static int run_rotation_step(sqlite3* database, const char* sql, int64_t start,
+                             int64_t end, const char* path) {
+  sqlite3_stmt* stmt = NULL;
+  int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+  if (res == SQLITE_OK) {
+    int parameters = sqlite3_bind_parameter_count(stmt);
+    if (parameters >= 1) {
+      sqlite3_bind_int64(stmt, 1, start);
+    }
+    if (parameters >= 2) {
+      sqlite3_bind_int64(stmt, 2, end);
+    }
+    if (parameters >= 3) {
+      sqlite3_bind_text(stmt, 3, path, -1, SQLITE_STATIC);
+    }
+    while ((res = sqlite3_step(stmt)) == SQLITE_ROW) {
+    }
+    res = res == SQLITE_DONE ? SQLITE_OK : res;
+  }
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "Failed to rotate the archives to %s: %s\n", path,
+            sqlite3_errmsg(database));
+  }
   sqlite3_finalize(stmt);
+  return res;
+}
 
-  *orders_out = orders;
-  *count_out = count;
+// Move the archives of one period from the archives table to its partition.
+static int move_to_partition(sqlite3* database, int64_t start) {
+  int64_t end = start + ARCHIVE_PERIOD_SECONDS;
+  char path[ARCHIVE_PATH_SIZE];
+  time_t start_time = (time_t)start;
+  struct tm parts;
+  if (gmtime_r(&start_time, &parts) == NULL ||
+      strftime(path, sizeof(path), ARCHIVE_PATH_FORMAT, &parts) == 0) {
+    return SQLITE_ERROR;
+  }
 
-  return SQLITE_OK;
+  int res = attach_partition(database, path);
+  if (res != SQLITE_OK) {
+    return res;
+  }
+  const char* steps[] = {
+      // The partition has no users table, so it has no foreign key either.
+      "CREATE TABLE IF NOT EXISTS archive_part.archives ("
+      "orderID INTEGER PRIMARY KEY, "
+      "item INTEGER NOT NULL, "
+      "buyOrSell INTEGER NOT NULL, "
+      "quantity INTEGER NOT NULL, "
+      "unitPrice REAL NOT NULL, "
+      "userID INTEGER NOT NULL, "
+      "created_at DATETIME, "
+      "archivedAt INTEGER NOT NULL);",
+      "CREATE INDEX IF NOT EXISTS archive_part.archives_by_user "
+      "ON archives (userID, orderID);",
+      // A file the catalog doesn't list is left over from before the database
+      // was reset, so its contents are stale.
+      "DELETE FROM archive_part.archives WHERE NOT EXISTS ("
+      "SELECT 1 FROM main.archive_partitions WHERE startTime = ?1);",
+      "BEGIN;",
+      "INSERT INTO archive_part.archives "
+      "SELECT orderID, item, buyOrSell, quantity, unitPrice, userID, "
+      "created_at, archivedAt FROM main.archives "
+      "WHERE archivedAt >= ?1 AND archivedAt < ?2;",
+      "INSERT OR REPLACE INTO main.archive_partitions "
+      "(startTime, path, firstID, lastID) "
+      "SELECT ?1, ?3, MIN(orderID), MAX(orderID) FROM archive_part.archives;",
+      "INSERT OR REPLACE INTO main.archive_partition_users "
+      "(userID, startTime, firstID, lastID) "
+      "SELECT userID, ?1, MIN(orderID), MAX(orderID) "
+      "FROM archive_part.archives GROUP BY userID;",
+      "DELETE FROM main.archives WHERE archivedAt >= ?1 AND archivedAt < ?2;",
+      "COMMIT;",
+  };
+  for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]) && res == SQLITE_OK;
+       ++i) {
+    res = run_rotation_step(database, steps[i], start, end, path);
+  }
+  // A step that failed inside the transaction leaves both files as they were.
+  if (!sqlite3_get_autocommit(database)) {
+    (void)sqlite3_exec(database, "ROLLBACK;", 0, 0, NULL);
+  }
+  detach_partition(database);
+  return res;
 }
 
-int assign_order_timestamp(sqlite3* database, order* order_to_update) {
-  const char* sql = "SELECT CURRENT_TIMESTAMP;";
+int rotate_archives(sqlite3* database, int64_t now) {
+  int64_t hot_start = now - now % ARCHIVE_PERIOD_SECONDS;
+  const char* sql =
+      "SELECT MIN(archivedAt) FROM archives WHERE archivedAt < ?;";
+  for (;;) {
+    // Move the oldest period left in the archives table until only the
+    // current one is.
+    sqlite3_stmt* stmt = NULL;
+    int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
+    if (res != SQLITE_OK) {
+      fprintf(stderr, "Failed to prepare the rotate_archives statement: %s\n",
+              sqlite3_errmsg(database));
+      return res;
+    }
+    sqlite3_bind_int64(stmt, 1, hot_start);
+    res = sqlite3_step(stmt);
+    int found =
+        res == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL;
+    int64_t oldest = found ? sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    if (res != SQLITE_ROW) {
+      return res;
+    }
+    if (!found) {
+      return SQLITE_OK;
+    }
+    res = move_to_partition(database, oldest - oldest % ARCHIVE_PERIOD_SECONDS);
+    if (res != SQLITE_OK) {
+      return res;
+    }
+  }
+}
+
+int assign_order_timestamp(sqlite3* database, order* order_to_update,
+                           int64_t now) {
+  // The same format as CURRENT_TIMESTAMP, which new orders default to.
+  const char* sql = "SELECT datetime(?, 'unixepoch');";
   sqlite3_stmt* stmt = NULL;
 
   int res = sqlite3_prepare_v2(database, sql, -1, &stmt, NULL);
@@ -886,9 +1879,12 @@ int assign_order_timestamp(sqlite3* database, order* order_to_update) {
     return res;
   }
 
+  sqlite3_bind_int64(stmt, 1, now);
+
   res = sqlite3_step(stmt);
   if (res == SQLITE_ROW) {
     const unsigned char* current_timestamp = sqlite3_column_text(stmt, 0);
+    free(order_to_update->created_at);
     order_to_update->created_at = strdup((const char*)current_timestamp);
   } else {
     fprintf(stderr, "Failed to retrieve the current timestamp: %s\n",
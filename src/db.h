@@ -1,5 +1,6 @@
 #pragma once
 #include <sqlite3.h>
+#include <stdint.h>
 
 /**
  * @enum TransactionType
@@ -104,6 +105,169 @@ typedef struct {
   char* created_at;  // Timestamp for when the order was created
 } order;
 
+/**
+ * @struct order_total
+ * @brief Represents every open order for one item at one price.
+ *
+ * @var order_total::item
+ * The type of cryptocurrency being traded (refer to CoinType).
+ *
+ * @var order_total::buyOrSell
+ * Indicates whether the orders are buys (0) or sells (1).
+ *
+ * @var order_total::unitPrice
+ * The price per unit shared by the orders.
+ *
+ * @var order_total::quantity
+ * The total quantity of the orders.
+ *
+ * @var order_total::orderCount
+ * The number of orders.
+ */
+typedef struct {
+  int item;
+  int buyOrSell;
+  double unitPrice;
+  int quantity;
+  int orderCount;
+} order_total;
+
+/**
+ * @struct candle
+ * @brief Represents the trades of one item during one interval of time.
+ *
+ * Prices are stored in ticks (see fixed_point.h) so they are exact and
+ * compact.
+ *
+ * @var candle::item
+ * The type of cryptocurrency traded (refer to CoinType).
+ *
+ * @var candle::interval
+ * The length of the interval in seconds.
+ *
+ * @var candle::startTime
+ * When the interval started, in seconds since the Unix epoch. It is a
+ * multiple of the interval.
+ *
+ * @var candle::open
+ * The price of the first trade.
+ *
+ * @var candle::high
+ * The highest price traded.
+ *
+ * @var candle::low
+ * The lowest price traded.
+ *
+ * @var candle::close
+ * The price of the last trade.
+ *
+ * @var candle::volume
+ * The total quantity traded.
+ */
+typedef struct {
+  int item;
+  int interval;
+  int64_t startTime;
+  int64_t open;
+  int64_t high;
+  int64_t low;
+  int64_t close;
+  int64_t volume;
+} candle;
+
+/**
+ * @struct execution
+ * @brief Represents one fill: a trade between a resting order and the order
+ * that matched it.
+ *
+ * @var execution::executionID
+ * Unique identifier for the execution, increasing with every fill.
+ *
+ * @var execution::item
+ * The type of cryptocurrency traded (refer to CoinType).
+ *
+ * @var execution::price
+ * The price traded at, in ticks (see fixed_point.h).
+ *
+ * @var execution::quantity
+ * The quantity traded.
+ *
+ * @var execution::aggressor
+ * The side of the order that matched the resting one: buy (0) or sell (1).
+ *
+ * @var execution::buyerID
+ * The ID of the user who bought.
+ *
+ * @var execution::sellerID
+ * The ID of the user who sold.
+ *
+ * @var execution::executedAt
+ * When the trade happened, in seconds since the Unix epoch.
+ */
+typedef struct {
+  int64_t executionID;
+  int item;
+  int64_t price;
+  int quantity;
+  int aggressor;
+  int buyerID;
+  int sellerID;
+  int64_t executedAt;
+} execution;
+
+/**
+ * @struct account_summary
+ * @brief Represents what a user's trading adds up to, as checkpointed in the
+ * "account_summaries" table.
+ *
+ * @var account_summary::userID
+ * The ID of the user.
+ *
+ * @var account_summary::openOrders
+ * The number of the user's orders on the book. It isn't checkpointed, since
+ * the "orders" table already holds them.
+ *
+ * @var account_summary::filled
+ * The quantity of each CoinType the user has bought or sold.
+ *
+ * @var account_summary::tradeCount
+ * The number of executions the user took part in.
+ *
+ * @var account_summary::notional
+ * The price times quantity of those executions, in ticks.
+ *
+ * @var account_summary::lastActiveAt
+ * When the user last placed, cancelled or filled an order, in seconds since
+ * the Unix epoch, or 0 if never.
+ *
+ * @var account_summary::lastExecutionID
+ * The ID of the latest execution counted, or -1 if never checkpointed.
+ */
+typedef struct {
+  int userID;
+  int64_t openOrders;
+  int64_t filled[COIN_ETH + 1];
+  int64_t tradeCount;
+  int64_t notional;
+  int64_t lastActiveAt;
+  int64_t lastExecutionID;
+} account_summary;
+
+/**
+ * @struct balance_change
+ * @brief Represents how much a user's balances go up or down.
+ *
+ * @var balance_change::userID
+ * The user whose balances change.
+ *
+ * @var balance_change::amounts
+ * The amount added to the balance of each CoinType, negative to take it away.
+ */
+typedef struct {
+  int userID;
+  int64_t amounts[COIN_ETH + 1];
+} balance_change;
+
 /**
  * @def database_FILENAME
  * @brief Default filename for the SQLite database.
@@ -116,6 +280,33 @@ typedef struct {
  */
 #define BUSY_TIMEOUT 1000
 
+/**
+ * @def SCHEMA_VERSION
+ * @brief The version of the schema migrate_tables brings a database up to,
+ * which is the number of migration steps.
+ */
+#define SCHEMA_VERSION 3
+
+/**
+ * @def ARCHIVE_PERIOD_SECONDS
+ * @brief The length of the period each archive partition covers, in seconds.
+ */
+#define ARCHIVE_PERIOD_SECONDS (24 * 60 * 60)
+
+/**
+ * @def ARCHIVE_PATH_FORMAT
+ * @brief The strftime format of a partition's filename, given the UTC start of
+ * its period.
+ */
+#define ARCHIVE_PATH_FORMAT "archives-%Y%m%d.db"
+
+/**
+ * @def ARCHIVE_MMAP_SIZE
+ * @brief How many bytes of a partition SQLite may memory-map while reading it,
+ * or 0 to read partitions through its page cache instead.
+ */
+#define ARCHIVE_MMAP_SIZE (64 * 1024 * 1024)
+
 /**
  * @brief Opens a SQLite3 database for use.
  *
@@ -139,11 +330,61 @@ int close_database(sqlite3* database);
  * - orders: Stores active orders for buying or selling cryptocurrency.
  * - archives: Stores archived orders for historical purposes.
  *
+ * These are version 1 of the schema. Later changes are migration steps run by
+ * migrate_tables.
+ *
  * @param database A pointer to the SQLite3 database.
  * @return SQLITE_OK on success, or an error code on failure.
  */
 int create_tables(sqlite3* database);
 
+/**
+ * @brief Brings a database's tables up to SCHEMA_VERSION, keeping their rows.
+ *
+ * The version a database is at is kept in the `schema_version` table. Each
+ * migration step after it runs in a transaction of its own along with the new
+ * version, so a database from any earlier version, or a new one, ends up with
+ * the same schema.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @return SQLITE_OK on success, or an error code on failure, including when
+ * the database is from a newer version than this program.
+ */
+int migrate_tables(sqlite3* database);
+
+/**
+ * @brief Reads the sequence number of the last journal entry whose effects the
+ * database holds.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param sequence Where to store the sequence number, which is 0 if the
+ * database holds nothing from the journal.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int get_journal_position(sqlite3* database, uint64_t* sequence);
+
+/**
+ * @brief Records the sequence number of the last journal entry whose effects
+ * the database holds.
+ *
+ * Call this in the same transaction as the entry's writes, just before it
+ * commits, so the two are never apart after a crash.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param sequence The sequence number of the entry.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int set_journal_position(sqlite3* database, uint64_t sequence);
+
+/**
+ * @brief Reads the tables and indexes used by every command, so the first
+ * commands after a restart don't wait for the disk.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+int prewarm_tables(sqlite3* database);
+
 /**
  * @brief Drops all tables from the given SQLite database.
  *
@@ -178,6 +419,8 @@ int drop_all_tables(sqlite3* database);
  *                  - quantity: The quantity of the cryptocurrency.
  *                  - unitPrice: The price per unit of the cryptocurrency.
  *                  - userID: The ID of the user placing the order.
+ *                  - created_at: When the order was placed, or NULL for
+ *                    now.
  *
  * @return Returns `SQLITE_OK` (0) on success. On failure, it returns an SQLite
  *         error code and logs the error message to stderr.
@@ -254,7 +497,8 @@ int get_user(sqlite3* database, int userID, user* user_out);
  * - The user ID is different from the user ID in the search order.
  *
  * The matching order is selected based on the earliest creation time
- * (ordered by `created_at` in ascending order) and is limited to one result.
+ * (ordered by `created_at` in ascending order, then by `orderID` among orders
+ * placed in the same second) and is limited to one result.
  *
  * @param database A pointer to the SQLite database connection.
  * @param search_order A pointer to the `order` structure containing the search
@@ -277,8 +521,8 @@ int find_matching_buy(sqlite3* database, order* search_order);
  * - Belong to a different user (userID != search_order->userID).
  *
  * The function returns the `orderID` of the first matching sell order, ordered
- * by creation time in ascending order. If no matching order is found, it
- * returns -1.
+ * by creation time in ascending order and then by `orderID`. If no matching
+ * order is found, it returns -1.
  *
  * @param database A pointer to the SQLite database connection.
  * @param search_order A pointer to the `order` structure containing the search
@@ -321,6 +565,124 @@ int get_item_all_orders(sqlite3* database, int item, order** buy_orders_out,
                         int* buy_count_out, order** sell_orders_out,
                         int* sell_count_out);
 
+/**
+ * Retrieves the total quantity and number of orders resting at every price in
+ * the "orders" table.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param levels_out Pointer to an array of totals, one per item, side, and
+ * price. Memory is allocated and must be freed by the caller.
+ * @param count_out Pointer to an integer to receive the number of levels.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int get_open_order_totals(sqlite3* database, order_total** levels_out,
+                          int* count_out);
+
+/**
+ * Inserts a candle into the "candles" table, replacing any stored for the same
+ * item, interval, and start time.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param bar Pointer to the candle to store.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int save_candle(sqlite3* database, const candle* bar);
+
+/**
+ * Retrieves the latest candles of an item at one interval from the "candles"
+ * table.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param item The CoinType of the candles.
+ * @param interval The length of the candles' interval in seconds.
+ * @param limit The most candles to retrieve.
+ * @param candles_out Pointer to an array of candles, oldest first. Memory is
+ * allocated and must be freed by the caller.
+ * @param count_out Pointer to an integer to receive the number of candles.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int get_recent_candles(sqlite3* database, int item, int interval, int limit,
+                       candle** candles_out, int* count_out);
+
+/**
+ * Appends an execution to the "executions" table.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param fill Pointer to the execution to store. Its executionID is set to the
+ * one the database assigned.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int insert_execution(sqlite3* database, execution* fill);
+
+/**
+ * Retrieves the latest executions of an item from the "executions" table.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param item The CoinType of the executions.
+ * @param limit The most executions to retrieve.
+ * @param executions_out Pointer to an array of executions, oldest first.
+ * Memory is allocated and must be freed by the caller.
+ * @param count_out Pointer to an integer to receive the number of executions.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int get_recent_executions(sqlite3* database, int item, int limit,
+                          execution** executions_out, int* count_out);
+
+/**
+ * Retrieves every execution since a point in time from the "executions" table.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param since The earliest execution time to include, in seconds since the
+ * Unix epoch.
+ * @param executions_out Pointer to an array of executions, oldest first.
+ * Memory is allocated and must be freed by the caller.
+ * @param count_out Pointer to an integer to receive the number of executions.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int get_executions_since(sqlite3* database, int64_t since,
+                         execution** executions_out, int* count_out);
+
+/**
+ * Retrieves every execution after a given one from the "executions" table.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param afterID The ID of the execution to start after.
+ * @param executions_out Pointer to an array of executions, oldest first.
+ * Memory is allocated and must be freed by the caller.
+ * @param count_out Pointer to an integer to receive the number of executions.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int get_executions_after(sqlite3* database, int64_t afterID,
+                         execution** executions_out, int* count_out);
+
+/**
+ * Inserts a user's summary into the "account_summaries" table, replacing the
+ * one stored before.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param summary Pointer to the summary to store. Its openOrders is not
+ * stored.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int save_account_summary(sqlite3* database, const account_summary* summary);
+
+/**
+ * Retrieves a summary for every user: the one last checkpointed in the
+ * "account_summaries" table, with openOrders counted from the "orders" table
+ * and lastActiveAt no earlier than the user's latest open order.
+ *
+ * Users without a checkpoint get a summary of zeros with a lastExecutionID of
+ * -1.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param summaries_out Pointer to an array of summaries, in order of user ID.
+ * Memory is allocated and must be freed by the caller.
+ * @param count_out Pointer to an integer to receive the number of summaries.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int get_account_summaries(sqlite3* database, account_summary** summaries_out,
+                          int* count_out);
+
 /**
  * Updates an existing order in the "orders" table.
  *
@@ -342,6 +704,23 @@ int update_order(sqlite3* database, const order* updated_order);
  */
 int update_user_balance(sqlite3* database, const user* updated_user);
 
+/**
+ * Adds amounts to the coin balances of users, rather than overwriting them,
+ * so the rows don't have to be read first.
+ *
+ * Each user's four balances change with one statement, and the statement is
+ * prepared once for all the users.
+ *
+ * @param database A pointer to the SQLite database connection.
+ * @param changes The changes to make, one per user.
+ * @param count The number of changes.
+ * @param written_out Where to store the number of changes made, which is
+ * count unless one failed.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int add_user_balance_changes(sqlite3* database, const balance_change* changes,
+                             int count, int* written_out);
+
 /**
  * Retrieves all orders associated with a specific user from the database.
  *
@@ -360,6 +739,25 @@ int update_user_balance(sqlite3* database, const user* updated_user);
 int get_user_all_orders(sqlite3* database, int userID, order** orders_out,
                         int* count_out);
 
+/**
+ * Retrieves one page of a user's open orders, in order of ID.
+ *
+ * Pages are found through the (userID, orderID) index, so reading one costs
+ * the same however many orders the user has.
+ *
+ * @param database A pointer to the SQLite3 database connection.
+ * @param userID The ID of the user whose orders are to be retrieved.
+ * @param afterID Only orders with a greater ID are retrieved. Pass 0 for the
+ * first page and the last ID of a page for the next one.
+ * @param limit The most orders to retrieve.
+ * @param orders_out Where to store an array of at most limit orders, or NULL
+ * if there are none. The caller frees it with free_order_list.
+ * @param count_out Where to store the number of orders retrieved.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int get_user_orders_after(sqlite3* database, int userID, int afterID,
+                          int limit, order** orders_out, int* count_out);
+
 /**
  * @brief Retrieves the cryptocurrency inventory for a specific user from the
  * database.
@@ -419,6 +817,8 @@ int get_user_by_username(sqlite3* database, const char* username,
  * @param database A pointer to the SQLite database connection.
  * @param archived_order A pointer to the order structure containing the data to
  * be archived.
+ * @param archivedAt When the order was archived, in seconds since the epoch,
+ * which decides the partition rotate_archives moves it to.
  * @return SQLITE_OK on success, or an SQLite error code on failure.
  *
  * This function prepares an SQL INSERT statement to add a new record to the
@@ -427,41 +827,63 @@ int get_user_by_username(sqlite3* database, const char* username,
  * If the operation fails at any step, an error message is printed to `stderr`,
  * and the corresponding SQLite error code is returned.
  */
-int insert_archive(sqlite3* database, const order* archived_order);
+int insert_archive(sqlite3* database, const order* archived_order,
+                   int64_t archivedAt);
 
 /**
- * Retrieves all archived orders for a specific user from the "archives" table
- * in the SQLite database.
+ * Retrieves one page of a user's archived orders, in order of ID.
+ *
+ * The archives of past periods are in partitions of their own (see
+ * rotate_archives). Only the partitions the catalog lists as holding the
+ * user's archives past afterID are attached, read-only, and only until the
+ * page is full; the "archives" table holding the current period is read last.
+ * Each is read through its (userID, orderID) index, so older history doesn't
+ * make a page slower to read. Attaching a partition commits any open
+ * transaction, so settle held balance changes before calling this.
  *
  * @param database A pointer to the SQLite database connection.
  * @param userID The ID of the user whose archived orders are to be retrieved.
- * @param orders_out A pointer to a dynamically allocated array of `order`
- * structures to store the results.
- * @param count_out A pointer to an integer to store the number of retrieved
- * orders.
+ * @param afterID Only archived orders with a greater ID are retrieved. Pass 0
+ * for the first page and the last ID of a page for the next one.
+ * @param limit The most orders to retrieve.
+ * @param orders_out Where to store an array of at most limit orders, or NULL
+ * if there are none. The caller frees it with free_order_list.
+ * @param count_out Where to store the number of orders retrieved.
  * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int get_user_archived_orders(sqlite3* database, int userID, int afterID,
+                             int limit, order** orders_out, int* count_out);
+
+/**
+ * Moves the archives of every period before the current one out of the
+ * "archives" table, each into its own partition file.
+ *
+ * A partition is a database named by ARCHIVE_PATH_FORMAT in the working
+ * directory. Once its period is over, nothing is written to it again. The
+ * partitions and the range of IDs each holds, overall and per user, are
+ * listed in the archive_partitions and archive_partition_users tables. The
+ * rows of a period are moved in one transaction, so a failure leaves them in
+ * the "archives" table.
  *
- * This function prepares an SQL SELECT statement to query the "archives" table
- * for orders associated with the specified `userID`. It dynamically allocates
- * memory to store the results and populates the `orders_out` array with the
- * retrieved data. If memory allocation or any SQLite operation fails, an error
- * message is printed to `stderr`, and the corresponding SQLite error code is
- * returned.
+ * @param database A pointer to the SQLite database connection.
+ * @param now The current time in seconds since the Unix epoch.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
  */
-int get_user_archived_orders(sqlite3* database, int userID, order** orders_out,
-                             int* count_out);
+int rotate_archives(sqlite3* database, int64_t now);
 
 /**
- * Assigns a timestamp to the specified order and updates it in the database.
+ * Assigns a timestamp to the specified order.
  *
- * This function retrieves the current timestamp, assigns it to the provided
- * order, and updates the corresponding record in the SQLite database.
+ * This function formats a time the way SQLite's CURRENT_TIMESTAMP does and
+ * stores it in the order's created_at, freeing the one it had.
  *
  * @param database A pointer to the SQLite database connection.
  * @param order_to_update A pointer to the order structure that needs to be
- * updated with the current timestamp.
+ * updated with the timestamp.
+ * @param now The time to assign, in seconds since the epoch.
  * @return An integer indicating the success or failure of the operation:
  *         - 0 on success.
  *         - A non-zero error code on failure.
  */
-int assign_order_timestamp(sqlite3* database, order* order_to_update);
+int assign_order_timestamp(sqlite3* database, order* order_to_update,
+                           int64_t now);
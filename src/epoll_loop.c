@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+
+#include <errno.h>       // errno, EAGAIN, EINTR
+#include <stdint.h>      // uint64_t
+#include <stdio.h>       // fputs
+#include <sys/epoll.h>   // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/socket.h>  // accept4, SOCK_NONBLOCK, SOCK_CLOEXEC
+#include <unistd.h>      // read
+
+#include "io_stats.h"
+#include "line_reader.h"
+#include "session.h"
+#include "timer_wheel.h"
+#include "util.h"
+#include "worker.h"
+
+// The most ready sockets handled per wait on the event queue.
+enum { MAX_EVENTS = 64 };
+
+// The state of one thread's epoll event loop.
+typedef struct {
+  /// The worker this loop runs.
+  worker* self;
+  /// The event queue watching the listener and the worker's clients.
+  int epoll_d;
+  /// Sessions whose deadline passed, closed once the events already reported
+  /// for them have been skipped.
+  session* expired;
+} epoll_loop;
+
+// Start watching a client, or change whether to wait for room to send.
+static int watch_session(epoll_loop* loop, session* client, int operation) {
+  struct epoll_event event = {
+      .events = EPOLLIN | (client->awaiting_send ? EPOLLOUT : 0),
+      .data.ptr = client};
+  count_io_syscalls(1);
+  return epoll_ctl(loop->epoll_d, operation, client->socket_descriptor,
+                   &event);
+}
+
+// Stop watching a client and release everything it holds.
+static void close_session(epoll_loop* loop, session* client) {
+  count_io_syscalls(1);
+  (void)epoll_ctl(loop->epoll_d, EPOLL_CTL_DEL, client->socket_descriptor,
+                  NULL);
+  release_session(loop->self, client);
+}
+
+// Send queued replies and wait for room to send the rest if the socket is
+// full. Return -1 if the session should be closed.
+static int send_replies(epoll_loop* loop, session* client) {
+  int status = flush_session(client);
+  if (status == -1) {
+    return -1;
+  }
+  if (status != client->awaiting_send) {
+    client->awaiting_send = status;
+    if (watch_session(loop, client, EPOLL_CTL_MOD) == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Mark a client whose deadline has passed to be disconnected. It isn't freed
+// yet, since the events being handled can still point at it.
+static void expire_session(timer* deadline, void* context) {
+  epoll_loop* loop = context;
+  session* client = deadline->data;
+  client->closing = 1;
+  client->next_closed = loop->expired;
+  loop->expired = client;
+}
+
+// Disconnect every client whose deadline has passed.
+static void close_expired_sessions(epoll_loop* loop) {
+  while (loop->expired != NULL) {
+    session* client = loop->expired;
+    loop->expired = client->next_closed;
+    queue_timeout_notice(client);
+    (void)flush_session(client);
+    close_session(loop, client);
+  }
+}
+
+// Accept and greet one new client. Return -1 once nothing more can be accepted
+// for now.
+static int accept_client(epoll_loop* loop) {
+  worker* self = loop->self;
+  struct sockaddr_storage client_addr;
+  unsigned int address_size = sizeof(client_addr);
+  count_io_syscalls(1);
+  int connect_d = accept4(self->listener, (struct sockaddr*)&client_addr,
+                          &address_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (connect_d == -1) {
+    return handle_accept_error(self, errno);
+  }
+  session* client = start_session(self, connect_d);
+  if (client == NULL) {
+    return 0;
+  }
+  if (watch_session(loop, client, EPOLL_CTL_ADD) == -1) {
+    release_session(self, client);
+    return 0;
+  }
+  if (send_replies(loop, client) == -1) {
+    close_session(loop, client);
+  }
+  return 0;
+}
+
+// Receive data from a client and handle every complete line in it. Return -1
+// if the client hung up, the connection failed, or it doesn't read replies.
+static int read_session(epoll_loop* loop, session* client) {
+  count_io_syscalls(1);
+  ssize_t bytes_read =
+      fill_line_reader(&client->reader, client->socket_descriptor);
+  if (bytes_read == 0) {
+    return -1;
+  }
+  if (bytes_read == -1) {
+    return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+  }
+  return handle_lines(loop->self, client);
+}
+
+// Send a subscriber the market data just queued for it.
+static void send_feed(session* client, void* context) {
+  epoll_loop* loop = context;
+  if (send_replies(loop, client) == -1) {
+    close_session(loop, client);
+  }
+}
+
+// Clear the worker's market data signal and serve its subscribers.
+static void deliver_feed_updates(epoll_loop* loop) {
+  uint64_t signals = 0;
+  count_io_syscalls(1);
+  (void)read(loop->self->feed_event, &signals, sizeof(signals));
+  deliver_market_data(loop->self, send_feed, loop);
+}
+
+void run_epoll_loop(worker* self) {
+  epoll_loop loop = {.self = self, .epoll_d = epoll_create1(EPOLL_CLOEXEC)};
+  if (loop.epoll_d == -1) {
+    error_and_exit("Can't create event queue");
+  }
+  // The listener is the only watched socket without a session.
+  struct epoll_event listener_event = {.events = EPOLLIN, .data.ptr = NULL};
+  if (epoll_ctl(loop.epoll_d, EPOLL_CTL_ADD, self->listener,
+                &listener_event) == -1) {
+    error_and_exit("Can't watch listener");
+  }
+  // Neither is the market data signal, which points at itself instead.
+  struct epoll_event feed_event = {.events = EPOLLIN,
+                                   .data.ptr = &self->feed_event};
+  if (epoll_ctl(loop.epoll_d, EPOLL_CTL_ADD, self->feed_event, &feed_event) ==
+      -1) {
+    error_and_exit("Can't watch market data");
+  }
+
+  struct epoll_event events[MAX_EVENTS];
+  for (;;) {
+    // Wake up every tick while any client has a deadline to check.
+    int timeout = self->timers.count > 0 ? TIMER_TICK_MS : -1;
+    count_io_syscalls(1);
+    int ready = epoll_wait(loop.epoll_d, events, MAX_EVENTS, timeout);
+    if (ready == -1) {
+      if (errno != EINTR) {
+        error_and_exit("Can't wait for events");
+      }
+      ready = 0;
+    }
+    // Bring the clock up to date before handling events, so every deadline
+    // set below counts from now. The sessions that expire are only closed
+    // after the events, which may still point at them.
+    (void)advance_timer_wheel(&self->timers, current_tick(), expire_session,
+                              &loop);
+    int feed_signalled = 0;
+    for (int i = 0; i < ready; ++i) {
+      if (events[i].data.ptr == &self->feed_event) {
+        // Wait until the other events are handled, since sending market data
+        // can close sessions they are for.
+        feed_signalled = 1;
+        continue;
+      }
+      session* client = events[i].data.ptr;
+      if (client == NULL) {
+        // Drain the whole backlog now, since a burst of connections would
+        // otherwise cost one wakeup each.
+        while (accept_client(&loop) == 0) {
+        }
+        continue;
+      }
+      if (client->closing) {
+        // Its deadline passed just before.
+        continue;
+      }
+      int status = 0;
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        status = read_session(&loop, client);
+      }
+      if (status == 0) {
+        status = send_replies(&loop, client);
+      }
+      if (status == -1) {
+        close_session(&loop, client);
+      }
+    }
+    close_expired_sessions(&loop);
+    if (feed_signalled) {
+      deliver_feed_updates(&loop);
+    }
+  }
+}
@@ -0,0 +1,206 @@
+/**
+ * Export archived orders or executions to a columnar file for analysis.
+ *
+ * The database can be database.db or an archive partition. Partitions are
+ * never written once their day is over, so they can be exported in the
+ * background while the server runs. The database is opened read-only.
+ *
+ * With -s, read a columnar file back instead and print the number of rows and
+ * the smallest, largest and total value of each column.
+ */
+#include <sqlite3.h>  // sqlite3_open_v2, sqlite3_prepare_v2, sqlite3_step
+#include <stdint.h>   // int64_t, INT64_MAX, INT64_MIN
+#include <stdio.h>    // fopen, fclose, fprintf, printf
+#include <stdlib.h>   // EXIT_FAILURE, EXIT_SUCCESS
+#include <string.h>   // strcmp
+
+#include "columnar.h"     // make_columnar_writer, make_columnar_reader
+#include "fixed_point.h"  // TICKS_PER_UNIT
+
+// What can be exported: the query that reads it, oldest first, and the columns
+// of its rows. Prices are in ticks and times in seconds since the Unix epoch.
+typedef struct {
+  const char* table;
+  const char* sql;
+  column_spec columns[COLUMNAR_MAX_COLUMNS];
+  int column_count;
+} export_source;
+
+static const export_source sources[] = {
+    {"archives",
+     "SELECT orderID, item, buyOrSell, quantity, "
+     "CAST(round(unitPrice * ?1) AS INTEGER), userID, "
+     "CAST(strftime('%s', created_at) AS INTEGER), archivedAt "
+     "FROM archives ORDER BY orderID;",
+     {{"orderID", COLUMN_DELTA},
+      {"item", COLUMN_VARINT},
+      {"buyOrSell", COLUMN_VARINT},
+      {"quantity", COLUMN_VARINT},
+      {"price", COLUMN_DELTA},
+      {"userID", COLUMN_DICTIONARY},
+      {"createdAt", COLUMN_DELTA},
+      {"archivedAt", COLUMN_DELTA}},
+     8},
+    {"executions",
+     "SELECT executionID, item, price, quantity, aggressor, buyerID, "
+     "sellerID, executedAt FROM executions ORDER BY executionID;",
+     {{"executionID", COLUMN_DELTA},
+      {"item", COLUMN_VARINT},
+      {"price", COLUMN_DELTA},
+      {"quantity", COLUMN_VARINT},
+      {"aggressor", COLUMN_VARINT},
+      {"buyerID", COLUMN_DICTIONARY},
+      {"sellerID", COLUMN_DICTIONARY},
+      {"executedAt", COLUMN_DELTA}},
+     8},
+};
+
+// Copy every row of a table into a columnar file. Return the number of rows,
+// or -1 on failure.
+static int64_t export_table(sqlite3* database, const export_source* source,
+                            FILE* output) {
+  sqlite3_stmt* stmt = NULL;
+  if (sqlite3_prepare_v2(database, source->sql, -1, &stmt, NULL) !=
+      SQLITE_OK) {
+    (void)fprintf(stderr, "Can't read %s: %s\n", source->table,
+                  sqlite3_errmsg(database));
+    return -1;
+  }
+  if (sqlite3_bind_parameter_count(stmt) > 0) {
+    sqlite3_bind_int(stmt, 1, TICKS_PER_UNIT);
+  }
+  columnar_writer* writer =
+      make_columnar_writer(output, source->columns, source->column_count);
+  if (writer == NULL) {
+    sqlite3_finalize(stmt);
+    return -1;
+  }
+
+  int64_t rows = 0;
+  int res = SQLITE_ROW;
+  int failed = 0;
+  while (!failed && (res = sqlite3_step(stmt)) == SQLITE_ROW) {
+    int64_t values[COLUMNAR_MAX_COLUMNS];
+    for (int column = 0; column < source->column_count; ++column) {
+      values[column] = sqlite3_column_int64(stmt, column);
+    }
+    failed = append_columnar_row(writer, values) == -1;
+    ++rows;
+  }
+  if (!failed && res != SQLITE_DONE) {
+    (void)fprintf(stderr, "Can't read %s: %s\n", source->table,
+                  sqlite3_errmsg(database));
+    failed = 1;
+  }
+  sqlite3_finalize(stmt);
+  if (free_columnar_writer(writer) == -1 || failed) {
+    return -1;
+  }
+  return rows;
+}
+
+// Print the number of rows in a columnar file and the smallest, largest and
+// total value of each column.
+static int summarize(FILE* input) {
+  columnar_reader* reader = make_columnar_reader(input);
+  if (reader == NULL) {
+    (void)fprintf(stderr, "Not a columnar file\n");
+    return -1;
+  }
+  int column_count = get_columnar_column_count(reader);
+  int64_t minimums[COLUMNAR_MAX_COLUMNS];
+  int64_t maximums[COLUMNAR_MAX_COLUMNS];
+  int64_t totals[COLUMNAR_MAX_COLUMNS] = {0};
+  for (int column = 0; column < column_count; ++column) {
+    minimums[column] = INT64_MAX;
+    maximums[column] = INT64_MIN;
+  }
+
+  int64_t rows = 0;
+  int block_rows = 0;
+  while ((block_rows = read_columnar_block(reader)) > 0) {
+    for (int column = 0; column < column_count; ++column) {
+      // A flat array per column, so these loops vectorize.
+      const int64_t* values = get_columnar_values(reader, column);
+      int64_t minimum = minimums[column];
+      int64_t maximum = maximums[column];
+      int64_t total = 0;
+      for (int i = 0; i < block_rows; ++i) {
+        minimum = values[i] < minimum ? values[i] : minimum;
+        maximum = values[i] > maximum ? values[i] : maximum;
+        total += values[i];
+      }
+      minimums[column] = minimum;
+      maximums[column] = maximum;
+      totals[column] += total;
+    }
+    rows += block_rows;
+  }
+  if (block_rows == -1) {
+    (void)fprintf(stderr, "The file is cut short or corrupt\n");
+    free_columnar_reader(reader);
+    return -1;
+  }
+
+  printf("Rows: %lld\n", (long long)rows);
+  for (int column = 0; column < column_count && rows > 0; ++column) {
+    printf("%s: min %lld, max %lld, total %lld\n",
+           get_columnar_column_name(reader, column),
+           (long long)minimums[column], (long long)maximums[column],
+           (long long)totals[column]);
+  }
+  free_columnar_reader(reader);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+    FILE* input = fopen(argv[2], "rb");
+    if (input == NULL) {
+      perror(argv[2]);
+      return EXIT_FAILURE;
+    }
+    int result = summarize(input);
+    (void)fclose(input);
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  const export_source* source = NULL;
+  for (size_t i = 0; argc == 4 && i < sizeof(sources) / sizeof(sources[0]);
+       ++i) {
+    if (strcmp(argv[2], sources[i].table) == 0) {
+      source = &sources[i];
+    }
+  }
+  if (source == NULL) {
+    (void)fprintf(stderr,
+                  "Usage: %s <database> archives|executions <output>\n"
+                  "       %s -s <columnar file>\n",
+                  argv[0], argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  sqlite3* database = NULL;
+  if (sqlite3_open_v2(argv[1], &database, SQLITE_OPEN_READONLY, NULL) !=
+      SQLITE_OK) {
+    (void)fprintf(stderr, "Can't open %s: %s\n", argv[1],
+                  sqlite3_errmsg(database));
+    sqlite3_close(database);
+    return EXIT_FAILURE;
+  }
+  FILE* output = fopen(argv[3], "wb");
+  if (output == NULL) {
+    perror(argv[3]);
+    sqlite3_close(database);
+    return EXIT_FAILURE;
+  }
+  int64_t rows = export_table(database, source, output);
+  int closed = fclose(output);
+  sqlite3_close(database);
+  if (rows == -1 || closed != 0) {
+    (void)fprintf(stderr, "Can't export %s to %s\n", source->table, argv[3]);
+    return EXIT_FAILURE;
+  }
+  printf("Exported %lld %s to %s\n", (long long)rows, source->table, argv[3]);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+#include "fixed_point.h"
+
+#include <limits.h>  // INT_MAX
+#include <stdint.h>  // int64_t, uint64_t
+
+// Accumulate a run of digits into value, stopping at the first non-digit.
+// Return the number of characters consumed, or 0 with overflowed set if value
+// would exceed limit.
+static size_t accumulate_digits(const char* text, size_t length,
+                                uint64_t limit, uint64_t* value,
+                                int* overflowed) {
+  size_t i = 0;
+  for (; i < length; ++i) {
+    unsigned digit = (unsigned)(unsigned char)text[i] - '0';
+    if (digit > 9) {
+      break;
+    }
+    if (*value > (limit - digit) / 10) {
+      *overflowed = 1;
+      return 0;
+    }
+    *value = *value * 10 + digit;
+  }
+  return i;
+}
+
+parse_status parse_price(const char* text, size_t length, int64_t* ticks) {
+  if (length == 0) {
+    return PARSE_EMPTY;
+  }
+  if (text[0] == '-') {
+    return PARSE_NEGATIVE;
+  }
+
+  // Count the whole units in ticks from the start so a single overflow check
+  // covers both parts of the price.
+  uint64_t units = 0;
+  int overflowed = 0;
+  uint64_t max_units = (uint64_t)MAX_PRICE_TICKS / TICKS_PER_UNIT;
+  size_t consumed =
+      accumulate_digits(text, length, max_units, &units, &overflowed);
+  if (overflowed) {
+    return PARSE_OVERFLOW;
+  }
+  if (consumed == 0) {
+    return PARSE_INVALID;
+  }
+  uint64_t value = units * TICKS_PER_UNIT;
+
+  if (consumed < length) {
+    if (text[consumed] != '.') {
+      return PARSE_INVALID;
+    }
+    const char* fraction = text + consumed + 1;
+    size_t fraction_length = length - consumed - 1;
+    if (fraction_length == 0) {
+      return PARSE_INVALID;
+    }
+    uint64_t scale = TICKS_PER_UNIT;
+    for (size_t i = 0; i < fraction_length; ++i) {
+      unsigned digit = (unsigned)(unsigned char)fraction[i] - '0';
+      if (digit > 9) {
+        return PARSE_INVALID;
+      }
+      scale /= 10;
+      if (scale == 0) {
+        // Allow trailing zeros, but not a fraction of a tick.
+        if (digit != 0) {
+          return PARSE_TOO_PRECISE;
+        }
+        continue;
+      }
+      value += digit * scale;
+    }
+    if (value > (uint64_t)MAX_PRICE_TICKS) {
+      return PARSE_OVERFLOW;
+    }
+  }
+
+  if (value == 0) {
+    return PARSE_ZERO;
+  }
+  *ticks = (int64_t)value;
+  return PARSE_OK;
+}
+
+parse_status parse_quantity(const char* text, size_t length, int* quantity) {
+  if (length == 0) {
+    return PARSE_EMPTY;
+  }
+  if (text[0] == '-') {
+    return PARSE_NEGATIVE;
+  }
+  uint64_t value = 0;
+  int overflowed = 0;
+  size_t consumed =
+      accumulate_digits(text, length, INT_MAX, &value, &overflowed);
+  if (overflowed) {
+    return PARSE_OVERFLOW;
+  }
+  if (consumed != length) {
+    return PARSE_INVALID;
+  }
+  if (value == 0) {
+    return PARSE_ZERO;
+  }
+  *quantity = (int)value;
+  return PARSE_OK;
+}
+
+const char* parse_status_message(parse_status status) {
+  switch (status) {
+    case PARSE_OK:
+      return "OK";
+    case PARSE_EMPTY:
+      return "Missing number";
+    case PARSE_NEGATIVE:
+      return "Number must not be negative";
+    case PARSE_INVALID:
+      return "Not a valid number";
+    case PARSE_TOO_PRECISE:
+      return "Price can have at most two decimal places";
+    case PARSE_ZERO:
+      return "Number must be greater than zero";
+    case PARSE_OVERFLOW:
+      return "Number is too large";
+  }
+  return "Unknown error";
+}
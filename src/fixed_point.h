@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // int64_t
+
+// The number of price ticks in one unit of currency, so a tick is one cent.
+enum { TICKS_PER_UNIT = 100 };
+
+// The largest price accepted, in ticks. Every price up to this converts to a
+// double exactly, which is how orders store it.
+#define MAX_PRICE_TICKS ((int64_t)1 << 53)
+
+/**
+ * @enum parse_status
+ * @brief The result of parsing a numeric field from a client.
+ *
+ * PARSE_OK - The field was valid and the value was stored.
+ * PARSE_EMPTY - The field had no characters.
+ * PARSE_NEGATIVE - The field started with a minus sign.
+ * PARSE_INVALID - The field was not a plain decimal number.
+ * PARSE_TOO_PRECISE - A price had more decimal places than a tick allows.
+ * PARSE_ZERO - The value was zero where a positive value is required.
+ * PARSE_OVERFLOW - The value was too large.
+ */
+typedef enum {
+  PARSE_OK = 0,
+  PARSE_EMPTY,
+  PARSE_NEGATIVE,
+  PARSE_INVALID,
+  PARSE_TOO_PRECISE,
+  PARSE_ZERO,
+  PARSE_OVERFLOW,
+} parse_status;
+
+/**
+ * Parse a positive decimal price into ticks.
+ *
+ * Accept digits with an optional decimal point followed by at most two more
+ * digits, such as "12", "12.5" or "0.05". Signs, exponents, spaces and any
+ * other characters are rejected. Unlike strtod, this does not depend on the
+ * locale and never rounds.
+ *
+ * @param text The characters to parse. They do not need to be null-terminated.
+ * @param length The number of characters to parse.
+ * @param ticks Where to store the price in ticks if it is valid.
+ * @return PARSE_OK on success, or the reason the price is invalid.
+ */
+parse_status parse_price(const char* text, size_t length, int64_t* ticks);
+
+/**
+ * Parse a positive whole quantity.
+ *
+ * Accept only digits, and reject zero and values larger than INT_MAX.
+ *
+ * @param text The characters to parse. They do not need to be null-terminated.
+ * @param length The number of characters to parse.
+ * @param quantity Where to store the quantity if it is valid.
+ * @return PARSE_OK on success, or the reason the quantity is invalid.
+ */
+parse_status parse_quantity(const char* text, size_t length, int* quantity);
+
+/**
+ * Convert a price in ticks to units of currency.
+ *
+ * @param ticks The price in ticks.
+ * @return The price in units of currency.
+ */
+static inline double ticks_to_price(int64_t ticks) {
+  return (double)ticks / TICKS_PER_UNIT;
+}
+
+/**
+ * Convert a price stored as a double back to ticks.
+ *
+ * Stored prices came from ticks, so rounding to the nearest tick undoes any
+ * representation error.
+ *
+ * @param price The price in units of currency, which must not be negative.
+ * @return The price in ticks.
+ */
+static inline int64_t price_to_ticks(double price) {
+  return (int64_t)(price * TICKS_PER_UNIT + 0.5);
+}
+
+/**
+ * Describe a parse status for a client.
+ *
+ * @param status The status to describe.
+ * @return A short message without a line terminator.
+ */
+const char* parse_status_message(parse_status status);
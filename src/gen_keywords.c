@@ -0,0 +1,160 @@
+/**
+ * Build-time generator for the keyword perfect hash table.
+ *
+ * Read the keywords listed in keywords.def and write a header holding a
+ * collision-free table for them, using the hash-and-displace method: every
+ * keyword is first hashed into a bucket, and each bucket then gets its own
+ * seed (displacement) that sends all of its keywords to free slots. Buckets
+ * are placed largest first, so the search stays fast for hundreds of keys.
+ */
+#include <stdint.h>  // uint32_t
+#include <stdio.h>   // fopen, fprintf, fclose
+#include <stdlib.h>  // calloc, qsort, EXIT_FAILURE
+#include <string.h>  // strlen
+
+#include "keywords.h"
+
+static const char* const keyword_texts[] = {
+#define COMMAND_KEYWORD(text, id) text,
+#define ASSET_KEYWORD(text, coin) text,
+#include "keywords.def"
+#undef COMMAND_KEYWORD
+#undef ASSET_KEYWORD
+};
+
+enum {
+  KEYWORD_COUNT = sizeof(keyword_texts) / sizeof(keyword_texts[0]),
+  // Aim for this many keywords per bucket on average.
+  KEYS_PER_BUCKET = 4,
+  // Give up on a bucket after trying this many displacements.
+  MAX_DISPLACEMENT = 65535,
+};
+
+// A bucket and the keywords hashed into it.
+typedef struct {
+  size_t index;
+  size_t size;
+  size_t keys[KEYWORD_COUNT];
+} bucket;
+
+static int compare_bucket_size(const void* left, const void* right) {
+  const bucket* left_bucket = left;
+  const bucket* right_bucket = right;
+  if (left_bucket->size != right_bucket->size) {
+    return left_bucket->size < right_bucket->size ? 1 : -1;
+  }
+  return left_bucket->index < right_bucket->index ? -1 : 1;
+}
+
+// Try to place every keyword of a bucket with a displacement, filling in
+// slots if all of them land on distinct free slots.
+static int place_bucket(const bucket* current, uint32_t displacement,
+                        int* slots, size_t table_size) {
+  size_t chosen[KEYWORD_COUNT];
+  for (size_t i = 0; i < current->size; ++i) {
+    const char* text = keyword_texts[current->keys[i]];
+    chosen[i] =
+        hash_keyword(text, strlen(text), displacement) & (table_size - 1);
+    if (slots[chosen[i]] != -1) {
+      return 0;
+    }
+    for (size_t j = 0; j < i; ++j) {
+      if (chosen[j] == chosen[i]) {
+        return 0;
+      }
+    }
+  }
+  for (size_t i = 0; i < current->size; ++i) {
+    slots[chosen[i]] = (int)current->keys[i];
+  }
+  return 1;
+}
+
+// Return what to print before the value at an index of a generated array.
+static const char* separator(size_t index) {
+  if (index == 0) {
+    return "\n    ";
+  }
+  return index % 12 ? ", " : ",\n    ";
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    (void)fprintf(stderr, "Usage: %s <output header>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  size_t bucket_count =
+      (KEYWORD_COUNT + KEYS_PER_BUCKET - 1) / KEYS_PER_BUCKET;
+  size_t table_size = 1;
+  while (table_size < KEYWORD_COUNT + KEYWORD_COUNT / 4) {
+    table_size *= 2;
+  }
+
+  bucket* buckets = calloc(bucket_count, sizeof(bucket));
+  int* slots = malloc(table_size * sizeof(int));
+  uint32_t* displacements = calloc(bucket_count, sizeof(uint32_t));
+  if (buckets == NULL || slots == NULL || displacements == NULL) {
+    perror("Can't allocate keyword table");
+    return EXIT_FAILURE;
+  }
+  for (size_t i = 0; i < table_size; ++i) {
+    slots[i] = -1;
+  }
+  for (size_t i = 0; i < bucket_count; ++i) {
+    buckets[i].index = i;
+  }
+  for (size_t i = 0; i < KEYWORD_COUNT; ++i) {
+    const char* text = keyword_texts[i];
+    uint32_t hash = hash_keyword(text, strlen(text), 0);
+    bucket* home = &buckets[hash % bucket_count];
+    home->keys[home->size++] = i;
+  }
+
+  qsort(buckets, bucket_count, sizeof(bucket), compare_bucket_size);
+  for (size_t i = 0; i < bucket_count && buckets[i].size > 0; ++i) {
+    uint32_t displacement = 1;
+    while (!place_bucket(&buckets[i], displacement, slots, table_size)) {
+      if (++displacement > MAX_DISPLACEMENT) {
+        // Two keywords that only differ in case always collide.
+        (void)fprintf(stderr,
+                      "Can't place keyword \"%s\"; is it a duplicate?\n",
+                      keyword_texts[buckets[i].keys[0]]);
+        return EXIT_FAILURE;
+      }
+    }
+    displacements[buckets[i].index] = displacement;
+  }
+
+  FILE* output = fopen(argv[1], "w");
+  if (output == NULL) {
+    perror("Can't open output header");
+    return EXIT_FAILURE;
+  }
+  (void)fprintf(output,
+                "// Generated by gen_keywords from keywords.def. Do not edit.\n"
+                "#pragma once\n\n"
+                "enum {\n"
+                "  KEYWORD_BUCKET_COUNT = %zu,\n"
+                "  KEYWORD_TABLE_SIZE = %zu,\n"
+                "};\n\n"
+                "static const uint16_t keyword_displacements[] = {",
+                bucket_count, table_size);
+  for (size_t i = 0; i < bucket_count; ++i) {
+    (void)fprintf(output, "%s%u", separator(i), (unsigned)displacements[i]);
+  }
+  (void)fprintf(output, "\n};\n\nstatic const int16_t keyword_slots[] = {");
+  for (size_t i = 0; i < table_size; ++i) {
+    (void)fprintf(output, "%s%d", separator(i), slots[i]);
+  }
+  (void)fprintf(output, "\n};\n");
+  if (fclose(output) == EOF) {
+    perror("Can't write output header");
+    return EXIT_FAILURE;
+  }
+
+  free(buckets);
+  free(slots);
+  free(displacements);
+  return 0;
+}
@@ -0,0 +1,14 @@
+#include "io_stats.h"
+
+#include <stdatomic.h>  // atomic_ullong, atomic_fetch_add_explicit
+
+// Only ever read for reports, so the count needs no ordering.
+static atomic_ullong io_syscalls;
+
+void count_io_syscalls(unsigned long long count) {
+  (void)atomic_fetch_add_explicit(&io_syscalls, count, memory_order_relaxed);
+}
+
+unsigned long long total_io_syscalls(void) {
+  return atomic_load_explicit(&io_syscalls, memory_order_relaxed);
+}
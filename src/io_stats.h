@@ -0,0 +1,18 @@
+#pragma once
+
+/**
+ * Count system calls made to move data to and from clients.
+ *
+ * The event loops call this for every accept, receive, send and wait, so the
+ * I/O backends can be compared by how many system calls each order costs.
+ *
+ * @param count The number of system calls made.
+ */
+void count_io_syscalls(unsigned long long count);
+
+/**
+ * Return the number of I/O system calls counted so far by every thread.
+ *
+ * @return The total passed to count_io_syscalls.
+ */
+unsigned long long total_io_syscalls(void);
@@ -0,0 +1,406 @@
+#include "journal.h"
+
+#include <errno.h>    // errno, ENOENT, EINTR
+#include <fcntl.h>    // open
+#include <pthread.h>  // pthread_mutex_t, pthread_cond_t, pthread_create
+#include <stdio.h>    // FILE, fopen, fread, fprintf
+#include <stdlib.h>   // free, malloc, realloc
+#include <string.h>   // memcmp, memcpy, strlen
+#include <unistd.h>   // fdatasync, ftruncate, write
+
+#include "util.h"  // error_and_exit
+
+// The bytes every journal starts with, followed by its format version.
+static const char MAGIC[4] = {'O', 'M', 'G', 'J'};
+enum { FORMAT_VERSION = 1, HEADER_SIZE = sizeof(MAGIC) + 1 };
+
+// A record's length and checksum, before its payload.
+enum { RECORD_HEADER_SIZE = 8 };
+
+// The longest payload: three strings as long as a line, and the rest.
+enum { MAX_PAYLOAD_SIZE = 64 * 1024 };
+
+// The journal's file while open, or -1.
+static int journal_fd = -1;
+static pthread_t flusher_thread;
+// Guards everything below. Appending takes it while holding the lock commands
+// run under, and the flusher only ever takes this one.
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+// Signalled when there are records to write, or the journal is stopping.
+static pthread_cond_t records_pending = PTHREAD_COND_INITIALIZER;
+// Broadcast once records are synced.
+static pthread_cond_t records_synced = PTHREAD_COND_INITIALIZER;
+static int stopping;
+// The records appended since the flusher last took them.
+static uint8_t* pending;
+static size_t pending_size;
+static size_t pending_capacity;
+// The sequence number of the next entry appended.
+static uint64_t next_sequence = 1;
+// The sequence number of the latest entry synced to disk.
+static uint64_t synced_sequence;
+
+// The sequence number of the latest entry appended by this thread.
+static _Thread_local uint64_t last_appended;
+
+static void put_u16(uint8_t* out, size_t* size, uint16_t value) {
+  out[(*size)++] = (uint8_t)value;
+  out[(*size)++] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* out, size_t* size, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out[(*size)++] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static void put_u64(uint8_t* out, size_t* size, uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    out[(*size)++] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+// Store a string, cut to the longest a payload has room for.
+static void put_string(uint8_t* out, size_t* size, const char* text) {
+  size_t length = text != NULL ? strlen(text) : 0;
+  if (length > MAX_PAYLOAD_SIZE / 4) {
+    length = MAX_PAYLOAD_SIZE / 4;
+  }
+  put_u16(out, size, (uint16_t)length);
+  memcpy(out + *size, text, length);
+  *size += length;
+}
+
+// Read numbers and strings from a payload, moving past them. Each returns -1
+// if the payload ends first.
+static int get_bytes(const uint8_t* data, size_t size, size_t* position,
+                     size_t count, uint64_t* value) {
+  if (size - *position < count) {
+    return -1;
+  }
+  uint64_t result = 0;
+  for (size_t i = 0; i < count; ++i) {
+    result |= (uint64_t)data[*position + i] << (8 * i);
+  }
+  *position += count;
+  *value = result;
+  return 0;
+}
+
+// Strings are copied out so they can end in a null character.
+static int get_string(const uint8_t* data, size_t size, size_t* position,
+                      char* out) {
+  uint64_t length = 0;
+  if (get_bytes(data, size, position, 2, &length) == -1 ||
+      size - *position < length) {
+    return -1;
+  }
+  memcpy(out, data + *position, length);
+  out[length] = '\0';
+  *position += length;
+  return 0;
+}
+
+// Write an entry's payload and return its size.
+static size_t encode_payload(const journal_entry* entry, uint8_t* out) {
+  size_t size = 0;
+  put_u64(out, &size, entry->sequence);
+  put_u64(out, &size, (uint64_t)entry->time);
+  out[size++] = (uint8_t)entry->type;
+  switch (entry->type) {
+    case JOURNAL_REGISTER:
+      put_string(out, &size, entry->username);
+      put_string(out, &size, entry->name);
+      put_string(out, &size, entry->password);
+      break;
+    case JOURNAL_ORDER:
+      put_u32(out, &size, (uint32_t)entry->userID);
+      out[size++] = (uint8_t)entry->item;
+      out[size++] = (uint8_t)entry->buyOrSell;
+      put_u32(out, &size, (uint32_t)entry->quantity);
+      put_u64(out, &size, (uint64_t)entry->price);
+      break;
+    case JOURNAL_CANCEL:
+      put_u32(out, &size, (uint32_t)entry->userID);
+      put_u32(out, &size, (uint32_t)entry->orderID);
+      break;
+  }
+  return size;
+}
+
+// Read an entry from its payload, with its strings in text. Return -1 if the
+// payload doesn't hold exactly one entry.
+static int decode_payload(const uint8_t* data, size_t size,
+                          journal_entry* entry, char* text) {
+  size_t position = 0;
+  uint64_t sequence = 0;
+  uint64_t time = 0;
+  uint64_t type = 0;
+  if (get_bytes(data, size, &position, 8, &sequence) == -1 ||
+      get_bytes(data, size, &position, 8, &time) == -1 ||
+      get_bytes(data, size, &position, 1, &type) == -1) {
+    return -1;
+  }
+  memset(entry, 0, sizeof(*entry));
+  entry->sequence = sequence;
+  entry->time = (int64_t)time;
+  entry->type = (journal_entry_type)type;
+
+  uint64_t fields[4] = {0};
+  switch (type) {
+    case JOURNAL_REGISTER: {
+      // Each string is shorter than its place in the payload, so text has
+      // room for all three and their null characters.
+      char* username = text;
+      if (get_string(data, size, &position, username) == -1) {
+        return -1;
+      }
+      char* name = username + strlen(username) + 1;
+      if (get_string(data, size, &position, name) == -1) {
+        return -1;
+      }
+      char* password = name + strlen(name) + 1;
+      if (get_string(data, size, &position, password) == -1) {
+        return -1;
+      }
+      entry->username = username;
+      entry->name = name;
+      entry->password = password;
+      break;
+    }
+    case JOURNAL_ORDER:
+      if (get_bytes(data, size, &position, 4, &fields[0]) == -1 ||
+          get_bytes(data, size, &position, 1, &fields[1]) == -1 ||
+          get_bytes(data, size, &position, 1, &fields[2]) == -1 ||
+          get_bytes(data, size, &position, 4, &fields[3]) == -1) {
+        return -1;
+      }
+      entry->userID = (int)(uint32_t)fields[0];
+      entry->item = (int)fields[1];
+      entry->buyOrSell = (int)fields[2];
+      entry->quantity = (int)(uint32_t)fields[3];
+      if (get_bytes(data, size, &position, 8, &fields[0]) == -1) {
+        return -1;
+      }
+      entry->price = (int64_t)fields[0];
+      break;
+    case JOURNAL_CANCEL:
+      if (get_bytes(data, size, &position, 4, &fields[0]) == -1 ||
+          get_bytes(data, size, &position, 4, &fields[1]) == -1) {
+        return -1;
+      }
+      entry->userID = (int)(uint32_t)fields[0];
+      entry->orderID = (int)(uint32_t)fields[1];
+      break;
+    default:
+      return -1;
+  }
+  return position == size ? 0 : -1;
+}
+
+int64_t replay_journal(const char* path, uint64_t after, journal_apply apply,
+                       void* context) {
+  // Entries appended from here on come after the ones already applied.
+  next_sequence = after + 1;
+  synced_sequence = after;
+  FILE* file = fopen(path, "r+b");
+  if (file == NULL) {
+    return errno == ENOENT ? 0 : -1;
+  }
+  uint8_t header[HEADER_SIZE];
+  size_t header_size = fread(header, 1, sizeof(header), file);
+  if (header_size == 0) {
+    // An empty file, which start_journal gives a header.
+    (void)fclose(file);
+    return 0;
+  }
+  if (header_size != sizeof(header) ||
+      memcmp(header, MAGIC, sizeof(MAGIC)) != 0 ||
+      header[sizeof(MAGIC)] != FORMAT_VERSION) {
+    (void)fclose(file);
+    return -1;
+  }
+
+  uint8_t* payload = malloc(MAX_PAYLOAD_SIZE);
+  char* text = malloc(MAX_PAYLOAD_SIZE);
+  if (payload == NULL || text == NULL) {
+    error_and_exit("Can't allocate journal record");
+  }
+  uint64_t last_sequence = 0;
+  int64_t replayed = 0;
+  long good_end = HEADER_SIZE;
+  for (;;) {
+    uint8_t record_header[RECORD_HEADER_SIZE];
+    size_t position = 0;
+    uint64_t length = 0;
+    uint64_t checksum = 0;
+    journal_entry entry;
+    if (fread(record_header, 1, sizeof(record_header), file) !=
+            sizeof(record_header) ||
+        get_bytes(record_header, sizeof(record_header), &position, 4,
+                  &length) == -1 ||
+        get_bytes(record_header, sizeof(record_header), &position, 4,
+                  &checksum) == -1 ||
+        length > MAX_PAYLOAD_SIZE ||
+        fread(payload, 1, length, file) != length ||
+        crc32(payload, length) != (uint32_t)checksum ||
+        decode_payload(payload, length, &entry, text) == -1 ||
+        entry.sequence <= last_sequence) {
+      break;
+    }
+    last_sequence = entry.sequence;
+    if (entry.sequence > after) {
+      apply(&entry, context);
+      ++replayed;
+    }
+    good_end = ftell(file);
+  }
+  if (last_sequence >= next_sequence) {
+    next_sequence = last_sequence + 1;
+  }
+  free(payload);
+  free(text);
+
+  // Drop whatever follows the last good record, so appends follow it.
+  int failed = fflush(file) != 0 || ftruncate(fileno(file), good_end) != 0;
+  failed |= fclose(file) != 0;
+  synced_sequence = next_sequence - 1;
+  return failed ? -1 : replayed;
+}
+
+// Write bytes to the journal, however many calls it takes.
+static void write_all(const uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(journal_fd, data, size);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error_and_exit("Can't write the journal");
+    }
+    data += written;
+    size -= (size_t)written;
+  }
+}
+
+static void* run_flusher(void* arg) {
+  (void)arg;
+  uint8_t* batch = NULL;
+  size_t batch_capacity = 0;
+  (void)pthread_mutex_lock(&journal_lock);
+  for (;;) {
+    while (!stopping && pending_size == 0) {
+      (void)pthread_cond_wait(&records_pending, &journal_lock);
+    }
+    if (pending_size == 0) {
+      break;
+    }
+    // Take the batch, and let sessions append to the next one while this one
+    // is written.
+    uint8_t* taken = pending;
+    size_t taken_capacity = pending_capacity;
+    size_t size = pending_size;
+    pending = batch;
+    pending_capacity = batch_capacity;
+    pending_size = 0;
+    batch = taken;
+    batch_capacity = taken_capacity;
+    uint64_t through = next_sequence - 1;
+    (void)pthread_mutex_unlock(&journal_lock);
+
+    write_all(batch, size);
+    if (fdatasync(journal_fd) != 0) {
+      error_and_exit("Can't sync the journal");
+    }
+
+    (void)pthread_mutex_lock(&journal_lock);
+    synced_sequence = through;
+    (void)pthread_cond_broadcast(&records_synced);
+  }
+  (void)pthread_mutex_unlock(&journal_lock);
+  free(batch);
+  return NULL;
+}
+
+void start_journal(const char* path) {
+  journal_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+  if (journal_fd == -1) {
+    error_and_exit("Can't open the journal");
+  }
+  if (lseek(journal_fd, 0, SEEK_END) == 0) {
+    uint8_t header[HEADER_SIZE];
+    memcpy(header, MAGIC, sizeof(MAGIC));
+    header[sizeof(MAGIC)] = FORMAT_VERSION;
+    write_all(header, sizeof(header));
+  }
+  stopping = 0;
+  if (pthread_create(&flusher_thread, NULL, run_flusher, NULL) != 0) {
+    error_and_exit("Can't start the journal thread");
+  }
+}
+
+void append_journal(journal_entry* entry) {
+  if (journal_fd == -1) {
+    return;
+  }
+  (void)pthread_mutex_lock(&journal_lock);
+  size_t needed = pending_size + RECORD_HEADER_SIZE + MAX_PAYLOAD_SIZE;
+  if (needed > pending_capacity) {
+    size_t capacity = pending_capacity > 0 ? pending_capacity : 4096;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+    uint8_t* temp = realloc(pending, capacity);
+    if (temp == NULL) {
+      error_and_exit("Can't allocate journal records");
+    }
+    pending = temp;
+    pending_capacity = capacity;
+  }
+  entry->sequence = next_sequence++;
+  uint8_t* record = pending + pending_size;
+  uint8_t* payload = record + RECORD_HEADER_SIZE;
+  size_t length = encode_payload(entry, payload);
+  size_t size = 0;
+  put_u32(record, &size, (uint32_t)length);
+  put_u32(record, &size, crc32(payload, length));
+  pending_size += RECORD_HEADER_SIZE + length;
+  last_appended = entry->sequence;
+  (void)pthread_cond_signal(&records_pending);
+  (void)pthread_mutex_unlock(&journal_lock);
+}
+
+uint64_t get_journal_sequence(void) {
+  (void)pthread_mutex_lock(&journal_lock);
+  uint64_t sequence = next_sequence - 1;
+  (void)pthread_mutex_unlock(&journal_lock);
+  return sequence;
+}
+
+void wait_for_journal(void) {
+  if (journal_fd == -1) {
+    return;
+  }
+  (void)pthread_mutex_lock(&journal_lock);
+  while (synced_sequence < last_appended) {
+    (void)pthread_cond_wait(&records_synced, &journal_lock);
+  }
+  (void)pthread_mutex_unlock(&journal_lock);
+}
+
+void stop_journal(void) {
+  if (journal_fd == -1) {
+    return;
+  }
+  (void)pthread_mutex_lock(&journal_lock);
+  stopping = 1;
+  (void)pthread_cond_signal(&records_pending);
+  (void)pthread_mutex_unlock(&journal_lock);
+  (void)pthread_join(flusher_thread, NULL);
+  (void)close(journal_fd);
+  journal_fd = -1;
+  free(pending);
+  pending = NULL;
+  pending_size = 0;
+  pending_capacity = 0;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>  // int64_t, uint64_t
+
+// The journal is an append-only file of every command that changed the
+// market, written before the command is applied. Replaying it into an empty
+// database rebuilds the users, balances and books.
+//
+// The file starts with the bytes "OMGJ" and a format version. Each record
+// after that is its payload's length and CRC-32 as 4-byte little-endian
+// numbers, then the payload: the entry's sequence number and time as 8-byte
+// little-endian numbers, its type as one byte, and the fields of that type.
+// Numbers are little-endian and strings are a 2-byte length and the bytes.
+//
+// Sessions append to a buffer in memory. A thread of the journal's own writes
+// the buffer and syncs the file, and whatever is appended meanwhile is written
+// and synced together next time, so one fdatasync covers many commands.
+
+/**
+ * @enum journal_entry_type
+ * @brief The kinds of command kept in the journal.
+ *
+ * JOURNAL_REGISTER - A new user, with their username, name and password.
+ * JOURNAL_ORDER - A buy or sell order from a user.
+ * JOURNAL_CANCEL - A user cancelling one of their orders.
+ */
+typedef enum {
+  JOURNAL_REGISTER = 1,
+  JOURNAL_ORDER = 2,
+  JOURNAL_CANCEL = 3,
+} journal_entry_type;
+
+// A command kept in the journal. Only the fields of its type are stored.
+typedef struct {
+  /// The kind of command.
+  journal_entry_type type;
+  /// The entry's number, more than the entry before it. Set by
+  /// append_journal.
+  uint64_t sequence;
+  /// When the command was accepted, in seconds since the Unix epoch.
+  int64_t time;
+  /// The user who sent an order or cancel.
+  int userID;
+  /// The CoinType of an order.
+  int item;
+  /// Whether an order is a buy (0) or a sell (1).
+  int buyOrSell;
+  /// The quantity of an order.
+  int quantity;
+  /// The unit price of an order, in ticks.
+  int64_t price;
+  /// The order a cancel is for.
+  int orderID;
+  /// The username, display name and password of a new user.
+  const char* username;
+  const char* name;
+  const char* password;
+} journal_entry;
+
+// Called with each entry replayed, which is only valid during the call.
+typedef void (*journal_apply)(const journal_entry* entry, void* context);
+
+/**
+ * Read a journal back, handing each entry after a given one to a function in
+ * order.
+ *
+ * Reading stops at the first record that is cut short, fails its checksum or
+ * doesn't come after the one before it, such as the last one written before a
+ * crash, and the file is truncated there so appending carries on after the
+ * last good record. A journal that doesn't exist yet holds no entries.
+ *
+ * @param path The journal's file.
+ * @param after The sequence number of the last entry already applied, such as
+ * by restoring a snapshot, or 0 to replay every entry. Entries appended later
+ * are numbered after both it and the journal's last entry.
+ * @param apply The function to hand each entry to.
+ * @param context Passed to the function along with each entry.
+ * @return The number of entries replayed, or -1 if the file couldn't be read
+ * or is not a journal.
+ */
+int64_t replay_journal(const char* path, uint64_t after, journal_apply apply,
+                       void* context);
+
+/**
+ * Open a journal for appending and start the thread that writes it.
+ *
+ * Call this after replay_journal, so sequence numbers carry on from the last
+ * entry. Until this is called, append_journal does nothing. Exits the program
+ * if the file can't be opened.
+ *
+ * @param path The journal's file, created if it doesn't exist.
+ */
+void start_journal(const char* path);
+
+/**
+ * Add a command to the journal before applying it.
+ *
+ * Entries are numbered in the order they are appended, so call this while
+ * holding the lock commands run under.
+ *
+ * @param entry The command. Its sequence is set.
+ */
+void append_journal(journal_entry* entry);
+
+/**
+ * Get the sequence number of the latest entry appended or replayed.
+ *
+ * Call this while holding the lock commands run under, so every entry up to
+ * it has been applied.
+ *
+ * @return The sequence number, or 0 if there are no entries.
+ */
+uint64_t get_journal_sequence(void);
+
+/**
+ * Wait until every entry the calling thread appended is synced to disk.
+ *
+ * Call this before replying to the commands, without holding the lock
+ * commands run under, so other threads keep appending to the next batch.
+ */
+void wait_for_journal(void);
+
+/**
+ * Write and sync the entries appended so far, then stop the journal's thread
+ * and close the file.
+ */
+void stop_journal(void);
@@ -0,0 +1,49 @@
+#include "keywords.h"
+
+#include <stdint.h>   // uint16_t, int16_t
+#include <strings.h>  // strncasecmp
+
+#include "db.h"             // CoinType
+#include "keyword_table.h"  // Generated by gen_keywords
+
+static const keyword keywords[] = {
+#define COMMAND_KEYWORD(text, id) \
+  {text, sizeof(text) - 1, KEYWORD_COMMAND, id},
+#define ASSET_KEYWORD(text, coin) {text, sizeof(text) - 1, KEYWORD_ASSET, coin},
+#include "keywords.def"
+#undef COMMAND_KEYWORD
+#undef ASSET_KEYWORD
+};
+
+const keyword* find_keyword(const char* text, size_t length) {
+  uint32_t bucket = hash_keyword(text, length, 0) % KEYWORD_BUCKET_COUNT;
+  uint32_t slot = hash_keyword(text, length, keyword_displacements[bucket]) &
+                  (KEYWORD_TABLE_SIZE - 1);
+  int index = keyword_slots[slot];
+  if (index < 0) {
+    return NULL;
+  }
+  // Every word hashes to some slot, so check that it is really this keyword.
+  const keyword* match = &keywords[index];
+  if (match->length != length ||
+      strncasecmp(match->text, text, length) != 0) {
+    return NULL;
+  }
+  return match;
+}
+
+int find_command(const char* text, size_t length) {
+  const keyword* match = find_keyword(text, length);
+  if (match == NULL || match->kind != KEYWORD_COMMAND) {
+    return -1;
+  }
+  return match->value;
+}
+
+int find_asset(const char* text, size_t length) {
+  const keyword* match = find_keyword(text, length);
+  if (match == NULL || match->kind != KEYWORD_ASSET) {
+    return -1;
+  }
+  return match->value;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint32_t
+
+/**
+ * @enum command_id
+ * @brief The command verbs clients can send once logged in, one per
+ * COMMAND_KEYWORD entry in keywords.def.
+ */
+typedef enum {
+#define COMMAND_KEYWORD(text, id) id,
+#define ASSET_KEYWORD(text, coin)
+#include "keywords.def"
+#undef COMMAND_KEYWORD
+#undef ASSET_KEYWORD
+  COMMAND_COUNT
+} command_id;
+
+/**
+ * @enum keyword_kind
+ * @brief Whether a keyword names a command or an asset.
+ */
+typedef enum { KEYWORD_COMMAND, KEYWORD_ASSET } keyword_kind;
+
+// One entry in the keyword table.
+typedef struct {
+  /// The keyword in lowercase.
+  const char* text;
+  /// The number of characters in text.
+  size_t length;
+  /// Whether the keyword is a command or an asset.
+  keyword_kind kind;
+  /// The command_id for commands, or the CoinType for assets.
+  int value;
+} keyword;
+
+/**
+ * Hash the text of a keyword, ignoring ASCII case.
+ *
+ * This is FNV-1a over the bytes with the case bit forced on, finished with a
+ * MurmurHash3 mix so that nearby seeds give unrelated hashes. The generator
+ * and the lookup share it, so it lives in the header.
+ *
+ * @param text The characters to hash. They do not need to be null-terminated.
+ * @param length The number of characters to hash.
+ * @param seed A value that selects one of many different hash functions.
+ * @return The hash of the text.
+ */
+static inline uint32_t hash_keyword(const char* text, size_t length,
+                                    uint32_t seed) {
+  uint32_t hash = 2166136261U ^ seed;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= (uint32_t)(unsigned char)text[i] | 0x20U;
+    hash *= 16777619U;
+  }
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35U;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+/**
+ * Look up a word in the keyword table, ignoring case.
+ *
+ * The table is a perfect hash built at compile time, so a lookup costs two
+ * hashes and one comparison no matter how many keywords there are.
+ *
+ * @param text The word to look up. It does not need to be null-terminated.
+ * @param length The number of characters in the word.
+ * @return The matching keyword, or NULL if the word is not a keyword.
+ */
+const keyword* find_keyword(const char* text, size_t length);
+
+/**
+ * Look up a command verb, ignoring case.
+ *
+ * @param text The word to look up. It does not need to be null-terminated.
+ * @param length The number of characters in the word.
+ * @return The command's ID, or -1 if the word is not a command.
+ */
+int find_command(const char* text, size_t length);
+
+/**
+ * Look up an asset symbol such as "btc", ignoring case.
+ *
+ * @param text The word to look up. It does not need to be null-terminated.
+ * @param length The number of characters in the word.
+ * @return The asset's CoinType, or -1 if the word is not an asset.
+ */
+int find_asset(const char* text, size_t length);
@@ -0,0 +1,105 @@
+#include "line_reader.h"
+
+#include <errno.h>       // errno, ENOBUFS
+#include <string.h>      // memchr, memcpy, memmove
+#include <sys/socket.h>  // recv
+
+void init_line_reader(line_reader* reader) {
+  reader->start = 0;
+  reader->end = 0;
+  reader->scanned = 0;
+  reader->discarding = 0;
+}
+
+// Return how many bytes can be added after the buffered ones.
+static size_t make_room(line_reader* reader) {
+  if (reader->end == LINE_READER_CAPACITY && reader->start > 0) {
+    // Only slide the tail back once the end is reached, so most reads don't
+    // move any bytes at all.
+    memmove(reader->buffer, reader->buffer + reader->start,
+            reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+  }
+  return LINE_READER_CAPACITY - reader->end;
+}
+
+ssize_t fill_line_reader(line_reader* reader, int socket_descriptor) {
+  if (make_room(reader) == 0) {
+    errno = ENOBUFS;
+    return -1;
+  }
+  ssize_t bytes_read = recv(socket_descriptor, reader->buffer + reader->end,
+                            LINE_READER_CAPACITY - reader->end, 0);
+  if (bytes_read > 0) {
+    reader->end += (size_t)bytes_read;
+  }
+  return bytes_read;
+}
+
+size_t feed_line_reader(line_reader* reader, const char* data, size_t size) {
+  size_t room = make_room(reader);
+  if (size > room) {
+    size = room;
+  }
+  memcpy(reader->buffer + reader->end, data, size);
+  reader->end += size;
+  return size;
+}
+
+// Drop every buffered byte, keeping the reader in its current mode.
+static void drop_buffered(line_reader* reader) {
+  reader->start = 0;
+  reader->end = 0;
+  reader->scanned = 0;
+}
+
+line_status next_line(line_reader* reader, line_view* line) {
+  for (;;) {
+    char* line_start = reader->buffer + reader->start;
+    size_t unscanned = reader->end - reader->start - reader->scanned;
+    char* newline = memchr(line_start + reader->scanned, '\n', unscanned);
+
+    if (newline == NULL) {
+      if (reader->discarding) {
+        drop_buffered(reader);
+        return LINE_INCOMPLETE;
+      }
+      reader->scanned += unscanned;
+      if (reader->end - reader->start == LINE_READER_CAPACITY) {
+        drop_buffered(reader);
+        reader->discarding = 1;
+        return LINE_TOO_LONG;
+      }
+      return LINE_INCOMPLETE;
+    }
+
+    size_t length = (size_t)(newline - line_start);
+    reader->start += length + 1;
+    reader->scanned = 0;
+    if (reader->discarding) {
+      // This newline ends the overlong line, so look for the next real one.
+      reader->discarding = 0;
+      continue;
+    }
+
+    if (length > 0 && line_start[length - 1] == '\r') {
+      --length;
+    }
+    line_start[length] = '\0';
+    line->data = line_start;
+    line->length = length;
+    if (reader->start == reader->end) {
+      // Everything has been consumed, so the next fill can start at the front.
+      // The returned view stays intact because nothing is overwritten yet.
+      reader->start = 0;
+      reader->end = 0;
+    }
+    return LINE_READY;
+  }
+}
+
+int has_partial_line(const line_reader* reader) {
+  // An overlong line being thrown away still hasn't ended.
+  return reader->start < reader->end || reader->discarding;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h>     // size_t
+#include <sys/types.h>  // ssize_t
+
+// The most bytes a single client line (including its terminator) may take up.
+enum { LINE_READER_CAPACITY = 4096 };
+
+/**
+ * @enum line_status
+ * @brief The result of asking a line reader for its next complete line.
+ *
+ * LINE_INCOMPLETE - No full line is buffered yet; read more data first.
+ * LINE_READY - A full line was returned.
+ * LINE_TOO_LONG - A line overflowed the buffer and is being discarded.
+ */
+typedef enum {
+  LINE_TOO_LONG = -1,
+  LINE_INCOMPLETE = 0,
+  LINE_READY = 1,
+} line_status;
+
+// A line inside a line reader's buffer. The view is not a copy: its data is
+// null-terminated in place and stays valid until the reader is filled again.
+typedef struct {
+  /// The first character of the line, without any \r\n or \n terminator.
+  char* data;
+  /// The number of characters in the line.
+  size_t length;
+} line_view;
+
+// A per-connection receive buffer that splits a byte stream into lines. The
+// buffer is used as a ring: consumed bytes are reclaimed by sliding the
+// unconsumed tail back to the front only once writes reach the end, so a
+// buffered line is always contiguous and can be handed out without copying.
+typedef struct {
+  /// The raw bytes received so far.
+  char buffer[LINE_READER_CAPACITY];
+  /// The offset of the first byte not yet returned as part of a line.
+  size_t start;
+  /// The offset one past the last byte received.
+  size_t end;
+  /// How many bytes after start are already known not to hold a newline.
+  size_t scanned;
+  /// Whether the rest of an overlong line is still being thrown away.
+  int discarding;
+} line_reader;
+
+/**
+ * Reset a line reader to an empty state.
+ *
+ * @param reader The line reader to initialize.
+ */
+void init_line_reader(line_reader* reader);
+
+/**
+ * Receive more bytes from a socket into a line reader.
+ *
+ * Perform a single read from the socket into the free space at the end of the
+ * reader's buffer, moving unconsumed bytes to the front first if needed. The
+ * socket may be blocking or non-blocking; a partial read is not an error.
+ *
+ * @param reader The line reader to fill.
+ * @param socket_descriptor The socket to read from.
+ * @return The number of bytes read, 0 if the peer closed the connection, or -1
+ * on error with errno set (EAGAIN if a non-blocking socket has no data yet).
+ */
+ssize_t fill_line_reader(line_reader* reader, int socket_descriptor);
+
+/**
+ * Copy bytes that were already received into a line reader.
+ *
+ * This is for I/O backends where the kernel fills its own buffers. Like
+ * fill_line_reader, it moves unconsumed bytes to the front first if needed.
+ * If not everything fits, take the ready lines out with next_line and feed
+ * the rest again.
+ *
+ * @param reader The line reader to fill.
+ * @param data The received bytes.
+ * @param size The number of received bytes.
+ * @return The number of bytes copied, which is 0 if the buffer is full.
+ */
+size_t feed_line_reader(line_reader* reader, const char* data, size_t size);
+
+/**
+ * Return the next complete line buffered in a line reader.
+ *
+ * Scan for a newline starting where the previous call stopped, so bytes are
+ * never searched twice. Both \n and \r\n terminators are accepted and are not
+ * part of the returned line. If the buffer fills up without a newline, the
+ * line is dropped up to its eventual newline and LINE_TOO_LONG is returned
+ * once so the caller can tell the client.
+ *
+ * @param reader The line reader to take a line from.
+ * @param line Where to store the view of the line if one is ready.
+ * @return LINE_READY if line was set, LINE_INCOMPLETE if more data is needed,
+ * or LINE_TOO_LONG if an overlong line was dropped.
+ */
+line_status next_line(line_reader* reader, line_view* line);
+
+/**
+ * Check whether a line reader holds part of a line that hasn't ended yet.
+ *
+ * @param reader The line reader to check.
+ * @return 1 if some received bytes are waiting for a newline, or 0 otherwise.
+ */
+int has_partial_line(const line_reader* reader);
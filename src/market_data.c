@@ -0,0 +1,282 @@
+#include "market_data.h"
+
+#include <stdlib.h>  // realloc, free
+#include <string.h>  // memcpy, memmove, memset
+
+#include "fixed_point.h"  // price_to_ticks, TICKS_PER_UNIT
+#include "util.h"         // coin_type_to_string, error_and_exit
+
+enum { INITIAL_LEVEL_CAPACITY = 16 };
+
+// One side of a coin's book, best price first.
+typedef struct {
+  /// The levels, highest first for bids and lowest first for asks.
+  price_level* levels;
+  /// The number of levels.
+  size_t count;
+  /// The number of levels that fit before growing.
+  size_t capacity;
+} book_side;
+
+// What a feed update says happened.
+typedef enum {
+  UPDATE_ADD,
+  UPDATE_CHANGE,
+  UPDATE_REMOVE,
+  UPDATE_TRADE,
+} update_kind;
+
+// One published change to a coin's book.
+typedef struct {
+  /// What happened.
+  update_kind kind;
+  /// BUY or SELL for level updates.
+  int side;
+  /// The price of the level or trade, in ticks.
+  int64_t price;
+  /// The new quantity at the level, or the quantity traded.
+  int64_t quantity;
+} feed_update;
+
+// The book and recent updates of one coin.
+typedef struct {
+  /// The bids and asks, indexed by BUY and SELL.
+  book_side sides[2];
+  /// The sequence number of the latest update, or 0 if there are none.
+  uint64_t sequence;
+  /// How many times an order for the coin was added, filled, or cancelled.
+  uint64_t version;
+  /// The latest updates, each at its sequence number modulo FEED_LOG_SIZE.
+  feed_update log[FEED_LOG_SIZE];
+} coin_market;
+
+static coin_market markets[MARKET_COIN_COUNT];
+static uint64_t update_count;
+
+// Find where a price is, or would go, on one side of a book. Return whether
+// a level with that price exists.
+static int find_level(const book_side* side, int bids, int64_t price,
+                      size_t* index) {
+  size_t low = 0;
+  size_t high = side->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    int64_t level_price = side->levels[middle].price;
+    if (level_price == price) {
+      *index = middle;
+      return 1;
+    }
+    // Better prices come first: higher bids and lower asks.
+    if (bids ? level_price > price : level_price < price) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  *index = low;
+  return 0;
+}
+
+// Change the quantity and number of orders at a price without publishing
+// anything. Store the update describing the change and return whether there
+// was one.
+static int change_level(int item, int side, int64_t price,
+                        int64_t quantity_change, int64_t order_change,
+                        feed_update* update) {
+  book_side* levels = &markets[item].sides[side];
+  size_t index = 0;
+  int found = find_level(levels, side == BUY, price, &index);
+  if (!found) {
+    if (quantity_change <= 0) {
+      // Nothing rests there, so there is nothing to take away.
+      return 0;
+    }
+    if (levels->count == levels->capacity) {
+      size_t capacity =
+          levels->capacity ? levels->capacity * 2 : INITIAL_LEVEL_CAPACITY;
+      price_level* grown =
+          realloc(levels->levels, capacity * sizeof(price_level));
+      if (grown == NULL) {
+        error_and_exit("Can't grow order book");
+      }
+      levels->levels = grown;
+      levels->capacity = capacity;
+    }
+    memmove(&levels->levels[index + 1], &levels->levels[index],
+            (levels->count - index) * sizeof(price_level));
+    levels->levels[index] =
+        (price_level){price, quantity_change, order_change};
+    ++levels->count;
+    *update = (feed_update){UPDATE_ADD, side, price, quantity_change};
+    return 1;
+  }
+
+  int64_t quantity = levels->levels[index].quantity + quantity_change;
+  if (quantity > 0) {
+    levels->levels[index].quantity = quantity;
+    levels->levels[index].order_count += order_change;
+    *update = (feed_update){UPDATE_CHANGE, side, price, quantity};
+    return 1;
+  }
+  --levels->count;
+  memmove(&levels->levels[index], &levels->levels[index + 1],
+          (levels->count - index) * sizeof(price_level));
+  *update = (feed_update){UPDATE_REMOVE, side, price, 0};
+  return 1;
+}
+
+// Give an update the next sequence number of its coin's feed.
+static void publish(int item, const feed_update* update) {
+  coin_market* market = &markets[item];
+  ++market->sequence;
+  market->log[market->sequence & (FEED_LOG_SIZE - 1)] = *update;
+  ++update_count;
+}
+
+int load_market_data(sqlite3* database) {
+  for (int item = 0; item < MARKET_COIN_COUNT; ++item) {
+    free(markets[item].sides[BUY].levels);
+    free(markets[item].sides[SELL].levels);
+  }
+  memset(markets, 0, sizeof(markets));
+  update_count = 0;
+
+  order_total* levels = NULL;
+  int level_count = 0;
+  if (get_open_order_totals(database, &levels, &level_count) != SQLITE_OK) {
+    return -1;
+  }
+  for (int i = 0; i < level_count; ++i) {
+    feed_update ignored;
+    if (levels[i].item >= 0 && levels[i].item < MARKET_COIN_COUNT) {
+      (void)change_level(levels[i].item, levels[i].buyOrSell,
+                         price_to_ticks(levels[i].unitPrice),
+                         levels[i].quantity, levels[i].orderCount, &ignored);
+    }
+  }
+  free(levels);
+  return 0;
+}
+
+void record_book_change(int item, int side, double unit_price,
+                        int quantity_change, int order_change) {
+  feed_update update;
+  ++markets[item].version;
+  if (change_level(item, side, price_to_ticks(unit_price), quantity_change,
+                   order_change, &update)) {
+    publish(item, &update);
+  }
+}
+
+void record_trade(int item, double unit_price, int quantity) {
+  feed_update update = {UPDATE_TRADE, BUY, price_to_ticks(unit_price),
+                        quantity};
+  publish(item, &update);
+}
+
+uint64_t count_feed_updates(void) { return update_count; }
+
+uint64_t get_book_version(int item) { return markets[item].version; }
+
+size_t copy_book_depth(int item, int side, price_level* levels, size_t depth) {
+  const book_side* book = &markets[item].sides[side];
+  size_t count = book->count < depth ? book->count : depth;
+  memcpy(levels, book->levels, count * sizeof(price_level));
+  return count;
+}
+
+// Write a price in ticks exactly, without going through a double.
+static int write_price(FILE* out, int64_t price) {
+  return fprintf(out, "%lld.%02lld", (long long)(price / TICKS_PER_UNIT),
+                 (long long)(price % TICKS_PER_UNIT));
+}
+
+// Write every level of a coin's book, followed by nothing else.
+static int write_snapshot(int item, FILE* out) {
+  const coin_market* market = &markets[item];
+  const book_side* bids = &market->sides[BUY];
+  const book_side* asks = &market->sides[SELL];
+  if (fprintf(out, "SNAPSHOT %s %llu %zu %zu\r\n", coin_type_to_string(item),
+              (unsigned long long)market->sequence, bids->count,
+              asks->count) < 0) {
+    return -1;
+  }
+  for (int side = BUY; side <= SELL; ++side) {
+    const book_side* levels = &market->sides[side];
+    for (size_t i = 0; i < levels->count; ++i) {
+      if (fputs(side == BUY ? "BID " : "ASK ", out) == EOF ||
+          write_price(out, levels->levels[i].price) < 0 ||
+          fprintf(out, " %lld\r\n", (long long)levels->levels[i].quantity) <
+              0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Write one update from a coin's log.
+static int write_update(int item, uint64_t sequence, FILE* out) {
+  static const char* const actions[] = {
+      [UPDATE_ADD] = "ADD",
+      [UPDATE_CHANGE] = "CHANGE",
+      [UPDATE_REMOVE] = "REMOVE",
+  };
+  const feed_update* update =
+      &markets[item].log[sequence & (FEED_LOG_SIZE - 1)];
+  const char* coin = coin_type_to_string(item);
+  int status = 0;
+  if (update->kind == UPDATE_TRADE) {
+    status = fprintf(out, "TRADE %s %llu ", coin, (unsigned long long)sequence);
+  } else {
+    status = fprintf(out, "UPDATE %s %llu %s %s ", coin,
+                     (unsigned long long)sequence,
+                     update->side == BUY ? "BID" : "ASK",
+                     actions[update->kind]);
+  }
+  if (status < 0 || write_price(out, update->price) < 0 ||
+      fprintf(out, " %lld\r\n", (long long)update->quantity) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int subscribe_to_feed(feed_subscription* subscription, int item, FILE* out) {
+  subscription->coins |= 1U << item;
+  subscription->next_sequence[item] = markets[item].sequence + 1;
+  return write_snapshot(item, out);
+}
+
+void unsubscribe_from_feed(feed_subscription* subscription, int item) {
+  subscription->coins &= ~(1U << item);
+}
+
+int deliver_feed(feed_subscription* subscription, FILE* out) {
+  int wrote = 0;
+  for (int item = 0; item < MARKET_COIN_COUNT; ++item) {
+    if (!(subscription->coins & (1U << item))) {
+      continue;
+    }
+    uint64_t latest = markets[item].sequence;
+    uint64_t next = subscription->next_sequence[item];
+    if (next > latest) {
+      continue;
+    }
+    wrote = 1;
+    uint64_t oldest = latest >= FEED_LOG_SIZE ? latest - FEED_LOG_SIZE + 1 : 1;
+    if (next < oldest) {
+      // The updates in between are gone, so start the subscriber over.
+      if (write_snapshot(item, out) == -1) {
+        return -1;
+      }
+    } else {
+      for (uint64_t sequence = next; sequence <= latest; ++sequence) {
+        if (write_update(item, sequence, out) == -1) {
+          return -1;
+        }
+      }
+    }
+    subscription->next_sequence[item] = latest + 1;
+  }
+  return wrote;
+}
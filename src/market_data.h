@@ -0,0 +1,145 @@
+#pragma once
+
+#include <sqlite3.h>  // sqlite3
+#include <stddef.h>   // size_t
+#include <stdint.h>   // int64_t, uint64_t
+#include <stdio.h>    // FILE
+
+#include "db.h"  // CoinType, TransactionType
+
+// Every coin that can be traded has its own book and feed.
+enum { MARKET_COIN_COUNT = COIN_ETH + 1 };
+
+// The number of recent updates kept for each coin. A subscriber that falls
+// further behind than this is sent a fresh snapshot instead. A power of two.
+enum { FEED_LOG_SIZE = 1024 };
+
+// The orders resting at one price on one side of a book.
+typedef struct {
+  /// The price in ticks.
+  int64_t price;
+  /// The total quantity of every order at the price.
+  int64_t quantity;
+  /// The number of orders at the price.
+  int64_t order_count;
+} price_level;
+
+// What a client is subscribed to, and how far it has been sent each feed.
+typedef struct {
+  /// A bit for each subscribed coin, by CoinType.
+  unsigned coins;
+  /// The sequence number of the next update to send for each coin.
+  uint64_t next_sequence[MARKET_COIN_COUNT];
+} feed_subscription;
+
+// The market data below is shared by every session. Like the database, it
+// may only be used by one thread at a time, so call these functions while
+// holding the lock commands run under.
+
+/**
+ * Rebuild every coin's book from the orders resting in the database.
+ *
+ * Call this once at startup, before any client can trade. Every feed starts
+ * over at sequence 0.
+ *
+ * @param database The database holding the open orders.
+ * @return 0 on success, or -1 if the orders couldn't be read.
+ */
+int load_market_data(sqlite3* database);
+
+/**
+ * Record that the orders resting at a price changed and publish the change.
+ *
+ * The engine calls this whenever an order is added to, partly filled in, or
+ * removed from the book.
+ *
+ * @param item The coin the order is for.
+ * @param side BUY or SELL.
+ * @param unit_price The order's price.
+ * @param quantity_change How much the quantity at the price grew, which is
+ * negative when it shrank.
+ * @param order_change 1 if the order was added, -1 if it was removed, or 0 if
+ * it was partly filled.
+ */
+void record_book_change(int item, int side, double unit_price,
+                        int quantity_change, int order_change);
+
+/**
+ * Publish a trade.
+ *
+ * @param item The coin traded.
+ * @param unit_price The price the trade happened at.
+ * @param quantity The number of coins traded.
+ */
+void record_trade(int item, double unit_price, int quantity);
+
+/**
+ * Return how many updates have been published across every coin.
+ *
+ * Comparing the result before and after a command tells whether the command
+ * published anything.
+ *
+ * @return The number of updates published since startup.
+ */
+uint64_t count_feed_updates(void);
+
+/**
+ * Return the version of a coin's book.
+ *
+ * The version changes whenever an order for the coin is added, filled, or
+ * cancelled, so anything worked out from the coin's orders can be kept until
+ * it does.
+ *
+ * @param item The coin whose book to check.
+ * @return The book's version.
+ */
+uint64_t get_book_version(int item);
+
+/**
+ * Copy the best price levels of one side of a coin's book.
+ *
+ * The levels are kept up to date as orders rest, fill, and are cancelled, so
+ * this never looks at individual orders.
+ *
+ * @param item The coin whose book to copy.
+ * @param side BUY for the bids, highest first, or SELL for the asks, lowest
+ * first.
+ * @param levels Where to copy the levels. It must have room for depth levels.
+ * @param depth The most levels to copy.
+ * @return The number of levels copied.
+ */
+size_t copy_book_depth(int item, int side, price_level* levels, size_t depth);
+
+/**
+ * Subscribe to a coin's feed and write a snapshot of its book.
+ *
+ * The snapshot lists every price level, and the updates that follow it start
+ * right after its sequence number. Subscribing again sends a fresh snapshot.
+ *
+ * @param subscription The subscriber's subscription.
+ * @param item The coin to subscribe to.
+ * @param out Where to write the snapshot.
+ * @return 0 on success, or -1 if writing failed.
+ */
+int subscribe_to_feed(feed_subscription* subscription, int item, FILE* out);
+
+/**
+ * Stop sending a coin's updates.
+ *
+ * @param subscription The subscriber's subscription.
+ * @param item The coin to unsubscribe from.
+ */
+void unsubscribe_from_feed(feed_subscription* subscription, int item);
+
+/**
+ * Write every update the subscriber hasn't been sent yet.
+ *
+ * A subscriber that missed updates that are no longer kept is sent a new
+ * snapshot instead, so it never has to fill a gap itself.
+ *
+ * @param subscription The subscriber's subscription.
+ * @param out Where to write the updates.
+ * @return 1 if anything was written, 0 if the subscriber was up to date, or
+ * -1 if writing failed.
+ */
+int deliver_feed(feed_subscription* subscription, FILE* out);
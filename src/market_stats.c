@@ -0,0 +1,148 @@
+#include "market_stats.h"
+
+#include <stdlib.h>  // free
+#include <string.h>  // memset
+
+#include "db.h"           // execution, get_executions_since
+#include "market_data.h"  // MARKET_COIN_COUNT
+
+enum { BUCKET_COUNT = STATS_WINDOW_SECONDS / STATS_BUCKET_SECONDS };
+
+// The trades of one coin during one minute.
+typedef struct {
+  /// The number of trades.
+  int64_t trade_count;
+  /// The total quantity traded.
+  int64_t volume;
+  /// The sum of price times quantity over every trade, in ticks.
+  double notional;
+  /// The highest price traded in ticks.
+  int64_t high;
+  /// The lowest price traded in ticks.
+  int64_t low;
+} stats_bucket;
+
+// The sliding window of one coin's trades.
+typedef struct {
+  /// The minutes of the window, each at its number modulo BUCKET_COUNT.
+  stats_bucket buckets[BUCKET_COUNT];
+  /// The number of the latest minute in the window, counted from the epoch.
+  int64_t latest_minute;
+  /// The number of trades in every bucket, kept as trades enter and leave.
+  int64_t trade_count;
+  /// The quantity traded in every bucket.
+  int64_t volume;
+  /// The notional of every bucket.
+  double notional;
+  /// The highest price in the window, unless stale.
+  int64_t high;
+  /// The lowest price in the window, unless stale.
+  int64_t low;
+  /// Whether trades that may have set the high or low left the window.
+  int extremes_stale;
+} coin_stats;
+
+static coin_stats coins[MARKET_COIN_COUNT];
+
+// Slide a coin's window forward to end at a minute, dropping the minutes that
+// fall out of it. A minute before the window's end leaves it where it is.
+static void advance(coin_stats* stats, int64_t minute) {
+  if (minute <= stats->latest_minute) {
+    return;
+  }
+  if (minute - stats->latest_minute >= BUCKET_COUNT) {
+    // Every minute in the window is over.
+    memset(stats, 0, sizeof(*stats));
+    stats->latest_minute = minute;
+    return;
+  }
+  while (stats->latest_minute < minute) {
+    ++stats->latest_minute;
+    stats_bucket* expired =
+        &stats->buckets[stats->latest_minute % BUCKET_COUNT];
+    if (expired->trade_count > 0) {
+      stats->trade_count -= expired->trade_count;
+      stats->volume -= expired->volume;
+      stats->notional -= expired->notional;
+      stats->extremes_stale = 1;
+    }
+    memset(expired, 0, sizeof(*expired));
+  }
+}
+
+int load_market_stats(sqlite3* database, int64_t now) {
+  memset(coins, 0, sizeof(coins));
+  execution* stored = NULL;
+  int count = 0;
+  if (get_executions_since(database, now - STATS_WINDOW_SECONDS, &stored,
+                           &count) != SQLITE_OK) {
+    return -1;
+  }
+  for (int i = 0; i < count; ++i) {
+    if (stored[i].item >= 0 && stored[i].item < MARKET_COIN_COUNT) {
+      record_stats_trade(stored[i].item, stored[i].price, stored[i].quantity,
+                         stored[i].executedAt);
+    }
+  }
+  free(stored);
+  return 0;
+}
+
+void record_stats_trade(int item, int64_t price, int quantity, int64_t now) {
+  coin_stats* stats = &coins[item];
+  advance(stats, now / STATS_BUCKET_SECONDS);
+  stats_bucket* bucket = &stats->buckets[stats->latest_minute % BUCKET_COUNT];
+  if (bucket->trade_count == 0 || price > bucket->high) {
+    bucket->high = price;
+  }
+  if (bucket->trade_count == 0 || price < bucket->low) {
+    bucket->low = price;
+  }
+  ++bucket->trade_count;
+  bucket->volume += quantity;
+  bucket->notional += (double)price * quantity;
+
+  if (stats->trade_count == 0 || price > stats->high) {
+    stats->high = price;
+  }
+  if (stats->trade_count == 0 || price < stats->low) {
+    stats->low = price;
+  }
+  ++stats->trade_count;
+  stats->volume += quantity;
+  stats->notional += (double)price * quantity;
+}
+
+void get_market_stats(int item, int64_t now, rolling_stats* out) {
+  coin_stats* stats = &coins[item];
+  advance(stats, now / STATS_BUCKET_SECONDS);
+  if (stats->extremes_stale) {
+    stats->high = 0;
+    stats->low = 0;
+    int found = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+      const stats_bucket* bucket = &stats->buckets[i];
+      if (bucket->trade_count == 0) {
+        continue;
+      }
+      if (!found || bucket->high > stats->high) {
+        stats->high = bucket->high;
+      }
+      if (!found || bucket->low < stats->low) {
+        stats->low = bucket->low;
+      }
+      found = 1;
+    }
+    stats->extremes_stale = 0;
+  }
+
+  *out = (rolling_stats){0};
+  if (stats->trade_count == 0) {
+    return;
+  }
+  out->trade_count = stats->trade_count;
+  out->volume = stats->volume;
+  out->vwap = stats->volume > 0 ? stats->notional / (double)stats->volume : 0;
+  out->high = stats->high;
+  out->low = stats->low;
+}
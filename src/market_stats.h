@@ -0,0 +1,66 @@
+#pragma once
+
+#include <sqlite3.h>  // sqlite3
+#include <stdint.h>   // int64_t
+
+// Statistics cover the trades of the last day, counted in buckets of one
+// minute, so the window slides forward a minute at a time.
+enum {
+  STATS_WINDOW_SECONDS = 24 * 60 * 60,
+  STATS_BUCKET_SECONDS = 60,
+};
+
+// What a coin's trades in the window add up to.
+typedef struct {
+  /// The number of trades.
+  int64_t trade_count;
+  /// The total quantity traded.
+  int64_t volume;
+  /// The volume-weighted average price in ticks, or 0 without trades.
+  double vwap;
+  /// The highest price traded in ticks, or 0 without trades.
+  int64_t high;
+  /// The lowest price traded in ticks, or 0 without trades.
+  int64_t low;
+} rolling_stats;
+
+// Like the market data, the statistics are shared by every session and may
+// only be used by one thread at a time, so call these functions while holding
+// the lock commands run under.
+
+/**
+ * Rebuild the statistics from the executions stored in the database.
+ *
+ * Call this once at startup, before any client can trade.
+ *
+ * @param database The database holding the executions.
+ * @param now The current time in seconds since the Unix epoch.
+ * @return 0 on success, or -1 if the executions couldn't be read.
+ */
+int load_market_stats(sqlite3* database, int64_t now);
+
+/**
+ * Add a trade to a coin's statistics.
+ *
+ * This takes constant time, apart from clearing out the minutes that passed
+ * without trades since the last call.
+ *
+ * @param item The coin traded.
+ * @param price The price traded at, in ticks.
+ * @param quantity The number of coins traded.
+ * @param now The time of the trade in seconds since the Unix epoch.
+ */
+void record_stats_trade(int item, int64_t price, int quantity, int64_t now);
+
+/**
+ * Get a coin's statistics over the window ending now.
+ *
+ * The totals are kept up to date as trades come in and leave the window. The
+ * high and low are only worked out again from the minutes in the window when
+ * a minute holding trades has left it.
+ *
+ * @param item The coin.
+ * @param now The current time in seconds since the Unix epoch.
+ * @param stats Where to store the statistics.
+ */
+void get_market_stats(int item, int64_t now, rolling_stats* stats);
@@ -3,35 +3,155 @@
 #include <sqlite3.h>
 #include <stddef.h>  // For NULL
 #include <stdio.h>
+#include <stdlib.h>  // strtol, EXIT_FAILURE
+#include <string.h>  // strcmp, strrchr, memcpy
 #include <sys/mman.h>
+#include <unistd.h>  // getopt, sysconf
 
 #include "command.h"
 #include "server.h"  // echo_server, related functions
 #include "util.h"    // socket_address, PORT
 
-int main(void) {
+// Parse a positive count given on the command line, exiting if it is invalid.
+static int parse_count(const char* text, const char* name) {
+  char* endptr = NULL;
+  long count = strtol(text, &endptr, 10);
+  if (*text == '\0' || *endptr != '\0' || count < 1 || count > 65535) {
+    (void)fprintf(stderr, "Invalid %s: %s\n", name, text);
+    exit(EXIT_FAILURE);
+  }
+  return (int)count;
+}
+
+// Parse an IPv4 address and port given as address:port on the command line,
+// exiting if it is invalid.
+static struct sockaddr_in parse_address(const char* text) {
+  const char* colon = strrchr(text, ':');
+  char host[INET_ADDRSTRLEN] = "";
+  struct in_addr addr;
+  if (colon == NULL || (size_t)(colon - text) >= sizeof(host)) {
+    (void)fprintf(stderr, "Invalid feed address: %s\n", text);
+    exit(EXIT_FAILURE);
+  }
+  memcpy(host, text, (size_t)(colon - text));
+  if (inet_pton(AF_INET, host, &addr) != 1) {
+    (void)fprintf(stderr, "Invalid feed address: %s\n", text);
+    exit(EXIT_FAILURE);
+  }
+  int port = parse_count(colon + 1, "feed port");
+  return socket_address(ntohl(addr.s_addr), (in_port_t)port);
+}
+
+int main(int argc, char* argv[]) {
+  // By default, listen once per core so connection bursts spread out.
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int listener_count = cores > 0 ? (int)cores : 1;
+  int backlog = DEFAULT_BACKLOG_SIZE;
+  io_backend backend = IO_BACKEND_EPOLL;
+  ack_durability durability = ACK_ON_ENQUEUE;
+  const char* local_path = NULL;
+  const char* shm_path = NULL;
+  const char* feed_address = NULL;
+  const char* journal_path = NULL;
+  const char* state_snapshot_path = NULL;
+  int reset = 0;
+  int option = 0;
+  while ((option = getopt(argc, argv, "l:b:e:u:m:f:w:j:s:r")) != -1) {
+    switch (option) {
+      case 'l':
+        listener_count = parse_count(optarg, "listener count");
+        break;
+      case 'b':
+        backlog = parse_count(optarg, "backlog size");
+        break;
+      case 'e':
+        if (strcmp(optarg, "epoll") == 0) {
+          backend = IO_BACKEND_EPOLL;
+        } else if (strcmp(optarg, "uring") == 0) {
+          backend = IO_BACKEND_URING;
+        } else {
+          (void)fprintf(stderr, "Unknown I/O backend: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'u':
+        local_path = optarg;
+        break;
+      case 'm':
+        shm_path = optarg;
+        break;
+      case 'f':
+        feed_address = optarg;
+        break;
+      case 'w':
+        if (strcmp(optarg, "enqueue") == 0) {
+          durability = ACK_ON_ENQUEUE;
+        } else if (strcmp(optarg, "commit") == 0) {
+          durability = ACK_ON_COMMIT;
+        } else {
+          (void)fprintf(stderr, "Unknown durability: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'j':
+        journal_path = optarg;
+        break;
+      case 's':
+        state_snapshot_path = optarg;
+        break;
+      case 'r':
+        reset = 1;
+        break;
+      default:
+        (void)fprintf(stderr,
+                      "Usage: %s [-l listeners] [-b backlog] "
+                      "[-e epoll|uring] [-u socket path] [-m socket path] "
+                      "[-f feed address:port] [-w enqueue|commit] "
+                      "[-j journal path] [-s snapshot path] [-r]\n",
+                      argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (state_snapshot_path != NULL && journal_path == NULL) {
+    // A snapshot on its own would lose every command since it was taken.
+    (void)fprintf(stderr, "Snapshots need a journal (-j)\n");
+    return EXIT_FAILURE;
+  }
+
   // Spin up database
   sqlite3* db_ptr = NULL;
   if (open_db(&db_ptr) == -1) {
     error_and_exit("Can't open databse!");
   }
-  if (init_db(db_ptr) == -1) {
-    error_and_exit("Can't initialize database!");
+  // With a journal, the database is kept too, unless nothing in it came from
+  // the journal (see recover_market).
+  if (reset) {
+    if (init_db(db_ptr) == -1) {
+      error_and_exit("Can't initialize database!");
+    }
+  } else if (upgrade_db(db_ptr) == -1) {
+    error_and_exit("Can't upgrade database!");
   }
 
   struct sockaddr_in server_addr = socket_address(INADDR_ANY, PORT);
-  echo_server* server = make_echo_server(server_addr, BACKLOG_SIZE);
+  echo_server* server = make_echo_server(server_addr, backlog, listener_count);
+  server->backend = backend;
+  server->durability = durability;
+  server->journal_path = journal_path;
+  server->state_snapshot_path = state_snapshot_path;
   listen_for_connections(server);
-  int accept_status = 0;
-  while (accept_status != -1) {
-    accept_status = accept_client(server, db_ptr);
+  if (local_path != NULL) {
+    listen_locally(server, local_path);
   }
-  free_echo_server(server);
-
-  // Need to check for parent process
-  if (accept_status != -1) {
-    close_db(db_ptr);
+  if (shm_path != NULL) {
+    listen_for_shm_clients(server, shm_path);
+  }
+  if (feed_address != NULL) {
+    publish_market_data(server, parse_address(feed_address));
   }
+  serve_clients(server, db_ptr);
+  free_echo_server(server);
+  close_db(db_ptr);
 
   return 0;
 }
@@ -7,310 +7,820 @@
 
 #include "server.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "account_summary.h"
+#include "candles.h"
 #include "command.h"
 #include "db.h"
+#include "fixed_point.h"
+#include "io_stats.h"
+#include "journal.h"
+#include "keywords.h"
+#include "market_data.h"
+#include "market_stats.h"
+#include "state_snapshot.h"
+#include "timer_wheel.h"
+#include "trade_tape.h"
 #include "util.h"
-
-echo_server* make_echo_server(struct sockaddr_in ip_addr, int max_backlog) {
+#include "worker.h"
+
+// Handling a line touches the market and the database, so only one thread
+// does it at a time.
+static pthread_mutex_t market_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Every worker, so a command that publishes market data can wake the ones with
+// subscribers.
+static worker* feed_workers;
+static int feed_worker_count;
+
+// The most output a subscriber may have waiting before it stops being sent
+// market data, so a client that doesn't read can't use up memory.
+enum { FEED_BACKLOG_LIMIT = 1 << 20 };
+
+// The most output a client may have waiting before it is disconnected. It is
+// well above FEED_BACKLOG_LIMIT, so only a client that keeps sending commands
+// without reading the replies gets there.
+enum { REPLY_BACKLOG_LIMIT = 4 << 20 };
+
+// A coin's rendered view, reused until the coin's book changes. Like the
+// market, only used while holding market_lock.
+typedef struct {
+  /// The book version the view was rendered at.
+  uint64_t version;
+  /// The number of levels rendered on each side.
+  int depth;
+  /// The rendered response, or NULL if it was never rendered.
+  char* text;
+  /// The length of the rendered response.
+  size_t size;
+} view_cache;
+
+static view_cache view_caches[MARKET_COIN_COUNT];
+
+// The number of price levels view shows on each side unless asked for another
+// number, and the most it shows.
+enum { DEFAULT_VIEW_DEPTH = 5, MAX_VIEW_DEPTH = 100 };
+
+// The number of trades the trades command shows unless asked for another
+// number.
+enum { DEFAULT_TRADE_COUNT = 10 };
+
+// The number of orders myOrders shows in each section unless asked for another
+// number, and the most it shows.
+enum { DEFAULT_ORDER_PAGE = 20, MAX_ORDER_PAGE = 100 };
+
+// The sections of myOrders, which shows both unless asked for one.
+enum { ORDERS_OPEN = 1, ORDERS_HISTORY = 2 };
+
+echo_server* make_echo_server(struct sockaddr_in ip_addr, int max_backlog,
+                              int listener_count) {
   echo_server* server = malloc(sizeof(echo_server));
-  server->listener = open_tcp_socket();
+  if (server == NULL) {
+    error_and_exit("Can't allocate server");
+  }
+  server->listeners = malloc((size_t)listener_count * sizeof(int));
+  if (server->listeners == NULL) {
+    error_and_exit("Can't allocate listeners");
+  }
+  for (int i = 0; i < listener_count; ++i) {
+    server->listeners[i] = open_tcp_socket();
+  }
+  server->listener_count = listener_count;
+  server->backend = IO_BACKEND_EPOLL;
   server->addr = ip_addr;
   server->max_backlog = max_backlog;
+  server->local_listener = -1;
+  server->shm_listener = -1;
+  server->feed_socket = -1;
+  server->snapshot_listener = -1;
+  server->durability = ACK_ON_ENQUEUE;
+  server->journal_path = NULL;
+  server->state_snapshot_path = NULL;
   return server;
 }
 
 void free_echo_server(echo_server* server) {
-  close_tcp_socket(server->listener);
+  for (int i = 0; i < server->listener_count; ++i) {
+    close_tcp_socket(server->listeners[i]);
+  }
+  if (server->local_listener != -1) {
+    close_tcp_socket(server->local_listener);
+  }
+  if (server->shm_listener != -1) {
+    close_tcp_socket(server->shm_listener);
+  }
+  if (server->feed_socket != -1) {
+    close_tcp_socket(server->feed_socket);
+  }
+  if (server->snapshot_listener != -1) {
+    close_tcp_socket(server->snapshot_listener);
+  }
+  free(server->listeners);
   free(server);
 }
 
 void listen_for_connections(echo_server* server) {
   int reuse = 1;
-  int listener = server->listener;
   struct sockaddr_in addr = server->addr;
+  for (int i = 0; i < server->listener_count; ++i) {
+    int listener = server->listeners[i];
+    if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (char*)&reuse,
+                   sizeof(int)) == -1) {
+      error_and_exit("Can't reuse socket");
+    }
+    // Let every listener bind the same port so the kernel balances incoming
+    // connections across them.
+    if (setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, (char*)&reuse,
+                   sizeof(int)) == -1) {
+      error_and_exit("Can't share port between listeners");
+    }
+    int bind_status = bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+    if (bind_status == -1) {
+      error_and_exit("Can't bind to socket");
+    }
+    if (listen(listener, server->max_backlog) == -1) {
+      error_and_exit("Can't listen");
+    }
+    // The event loop only accepts once the listener is ready, but a client can
+    // give up in between, so never let accept block the other sessions.
+    int flags = fcntl(listener, F_GETFL);
+    if (flags == -1 || fcntl(listener, F_SETFL, flags | O_NONBLOCK) == -1) {
+      error_and_exit("Can't make listener non-blocking");
+    }
+  }
+}
+
+// Open a non-blocking listener on a Unix domain socket at a path.
+static int open_unix_listener(const char* path, int max_backlog) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    error_and_exit("Can't use socket path");
+  }
+  strcpy(addr.sun_path, path);
+  // A socket left behind by an earlier run would keep bind from working, but
+  // never remove anything else that happens to be there.
+  struct stat existing;
+  if (lstat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+    (void)unlink(path);
+  }
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listener == -1) {
+    error_and_exit("Can't open local socket");
+  }
+  if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    error_and_exit("Can't bind to local socket");
+  }
+  if (listen(listener, max_backlog) == -1) {
+    error_and_exit("Can't listen on local socket");
+  }
+  return listener;
+}
+
+void listen_locally(echo_server* server, const char* path) {
+  server->local_listener = open_unix_listener(path, server->max_backlog);
+}
+
+void listen_for_shm_clients(echo_server* server, const char* path) {
+  server->shm_listener = open_unix_listener(path, server->max_backlog);
+}
+
+void publish_market_data(echo_server* server, struct sockaddr_in addr) {
+  // The socket is left unconnected, so a consumer that isn't listening yet
+  // can't make a later datagram fail with the error it caused.
+  server->feed_socket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (server->feed_socket == -1) {
+    error_and_exit("Can't open market data socket");
+  }
+  server->feed_addr = addr;
+
+  // Snapshots are served on the same port number, over TCP on every address.
+  int reuse = 1;
+  struct sockaddr_in snapshot_addr =
+      socket_address(INADDR_ANY, ntohs(addr.sin_port));
+  int listener = open_tcp_socket();
   if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (char*)&reuse,
                  sizeof(int)) == -1) {
     error_and_exit("Can't reuse socket");
   }
-  int bind_status = bind(listener, (struct sockaddr*)&addr, sizeof(addr));
-  if (bind_status == -1) {
-    error_and_exit("Can't bind to socket");
+  if (bind(listener, (struct sockaddr*)&snapshot_addr,
+           sizeof(snapshot_addr)) == -1) {
+    error_and_exit("Can't bind to snapshot socket");
   }
   if (listen(listener, server->max_backlog) == -1) {
-    error_and_exit("Can't listen");
+    error_and_exit("Can't listen for snapshot requests");
   }
+  int flags = fcntl(listener, F_GETFL);
+  if (flags == -1 || fcntl(listener, F_SETFL, flags | O_NONBLOCK) == -1) {
+    error_and_exit("Can't make listener non-blocking");
+  }
+  server->snapshot_listener = listener;
 }
 
-int accept_client(echo_server* server, sqlite3* database) {
-  struct sockaddr_storage client_addr;
-  unsigned int address_size = sizeof(client_addr);
-  int connect_d = accept4(server->listener, (struct sockaddr*)&client_addr,
-                          &address_size, SOCK_CLOEXEC);
-  if (connect_d == -1) {
-    error_and_exit("Can't open secondary socket");
-  }
-  if (!fork()) {
-    FILE* comm_file = fdopen(connect_d, "r+");
-    int userID = -1;
-    int status = 0;
-    if (comm_file == NULL) {
-      error_and_exit("Can't open file");
-    }
 
-    // Either register or log in
-    while (userID == -1 || userID == 0 || status != 1) {
-      if (fputs(
-              "Welcome to OMG. \"r\" to register, and \"u\" for existing users "
-              "\r\n",
-              comm_file) == EOF) {
-        error_and_exit("Couldn't send prompt");
-      }
-      char* input = NULL;
-      size_t input_size = 0;
-      if (getline(&input, &input_size, comm_file) == -1) {
-        error_and_exit("Couldn't read input");
-      }
-      // Check the first character of the input
-      if (input[0] == 'r') {
-        // Handle 'r' case
-        userID = register_user(comm_file, database);
-      } else if (input[0] == 'u') {
-        // Handle 'u' case
-        userID = authenticate(comm_file, database);
-        status = 1;
-      } else {
-        // Handle invalid input
-        if (fputs("Invalid option. Please enter 'r' or 'u'.\r\n", comm_file) ==
-            EOF) {
-          error_and_exit("Couldn't send error message");
-        }
-        (void)fflush(comm_file);
-      }
-      free(input);
-    }
-    echo(comm_file, userID, database);
-    return -1;
-  }
-  return 0;
+// Forward declarations
+static void display_welcome_message(FILE* comm_file);
+static void prompt_choice(session* client);
+static void handle_line(session* client, const line_view* line,
+                        sqlite3* database);
+
+uint64_t current_tick(void) {
+  struct timespec now;
+  (void)clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000) /
+         TIMER_TICK_MS;
 }
 
-// Handle registration
-int register_user(FILE* comm_file, sqlite3* database) {
-  int userID = 0;
-  if (fputs("Please enter a username: \r\n", comm_file) == EOF) {
-    error_and_exit("Couldn't send prompt");
+// Schedule a client's timer for the earliest deadline that applies to it.
+static void update_deadline(worker* self, session* client) {
+  uint64_t deadline = client->last_active_at + IDLE_TIMEOUT;
+  if (client->state != SESSION_READY &&
+      client->connected_at + LOGIN_TIMEOUT < deadline) {
+    deadline = client->connected_at + LOGIN_TIMEOUT;
   }
+  if (client->reading_partial &&
+      client->partial_since + PARTIAL_LINE_TIMEOUT < deadline) {
+    deadline = client->partial_since + PARTIAL_LINE_TIMEOUT;
+  }
+  schedule_timer(&self->timers, &client->deadline, deadline);
+}
 
-  char* username = NULL;
-  size_t username_size = 0;
-  if (getline(&username, &username_size, comm_file) == -1) {
-    error_and_exit("Couldn't read username");
+session* start_session(worker* self, int socket_descriptor) {
+  session* client = make_session(socket_descriptor);
+  if (client == NULL) {
+    puts("Can't allocate session!");
+    (void)close(socket_descriptor);
+    return NULL;
   }
+  client->connected_at = self->timers.current;
+  client->last_active_at = self->timers.current;
+  update_deadline(self, client);
+  prompt_choice(client);
+  return client;
+}
 
-  // Remove trailing newline character if present
-  size_t len = strlen(username);
-  if (len > 0 && username[len - 1] == '\n') {
-    username[len - 2] = '\0';
+// Signal every worker with subscribers that market data was published, unless
+// it was signalled already and hasn't caught up yet.
+static void wake_feed_workers(void) {
+  for (int i = 0; i < feed_worker_count; ++i) {
+    worker* other = &feed_workers[i];
+    if (atomic_load(&other->subscriber_count) > 0 &&
+        atomic_exchange(&other->feed_pending, 1) == 0) {
+      uint64_t one = 1;
+      count_io_syscalls(1);
+      (void)write(other->feed_event, &one, sizeof(one));
+    }
   }
+}
 
-  if (fputs("Please enter your name (for display purposes): \r\n", comm_file) ==
-      EOF) {
-    error_and_exit("Couldn't send prompt");
+// Remove a session from its worker's subscribers if it is there.
+static void unlink_subscriber(worker* self, session* client) {
+  if (client->pprev_subscriber == NULL) {
+    return;
+  }
+  *client->pprev_subscriber = client->next_subscriber;
+  if (client->next_subscriber != NULL) {
+    client->next_subscriber->pprev_subscriber = client->pprev_subscriber;
   }
+  client->next_subscriber = NULL;
+  client->pprev_subscriber = NULL;
+  (void)atomic_fetch_sub(&self->subscriber_count, 1);
+}
 
-  char* name = NULL;
-  size_t name_size = 0;
-  if (getline(&name, &name_size, comm_file) == -1) {
-    error_and_exit("Couldn't read name");
+// Add a session to its worker's subscribers once it subscribes to anything,
+// and remove it once it has unsubscribed from everything.
+static void update_subscriber(worker* self, session* client) {
+  if (client->subscription.coins == 0) {
+    unlink_subscriber(self, client);
+    return;
+  }
+  if (client->pprev_subscriber != NULL) {
+    return;
   }
+  client->next_subscriber = self->subscribers;
+  if (self->subscribers != NULL) {
+    self->subscribers->pprev_subscriber = &client->next_subscriber;
+  }
+  self->subscribers = client;
+  client->pprev_subscriber = &self->subscribers;
+  (void)atomic_fetch_add(&self->subscriber_count, 1);
+}
+
+// The number of bytes queued for a client that it hasn't been sent yet.
+static size_t count_backlog(const session* client) {
+  return client->output_size - client->output_sent + client->sending_size;
+}
 
-  // Remove trailing newline character if present
-  len = strlen(name);
-  if (len > 0 && name[len - 1] == '\n') {
-    name[len - 2] = '\0';
+int handle_lines(worker* self, session* client) {
+  // A single read can hold several pipelined lines, or only part of one.
+  line_view line;
+  line_status status = LINE_INCOMPLETE;
+  int published = 0;
+  int handled = 0;
+  int overflowing = 0;
+  while (!overflowing &&
+         (status = next_line(&client->reader, &line)) != LINE_INCOMPLETE) {
+    if (status == LINE_TOO_LONG) {
+      if (fputs("Line too long!\r\n", client->comm_file) == EOF) {
+        error_and_exit("Couldn't send error message");
+      }
+      continue;
+    }
+    (void)pthread_mutex_lock(&market_lock);
+    rotate_archives_if_due(self->database, (int64_t)time(NULL));
+    begin_write_batch();
+    uint64_t updates = count_feed_updates();
+    handle_line(client, &line, self->database);
+    handled = 1;
+    published |= count_feed_updates() != updates;
+    // Track subscribers while still holding the lock, so no update is
+    // published between subscribing and being found by wake_feed_workers.
+    update_subscriber(self, client);
+    (void)pthread_mutex_unlock(&market_lock);
+    // Stop taking commands from a client that doesn't read the replies.
+    overflowing = fflush(client->comm_file) == EOF ||
+                  count_backlog(client) > REPLY_BACKLOG_LIMIT;
+  }
+  if (published) {
+    wake_feed_workers();
+  }
+  // The replies are only sent once this returns, so every line read at once
+  // waits for the same commit.
+  if (handled) {
+    (void)pthread_mutex_lock(&market_lock);
+    acknowledge_writes();
+    (void)pthread_mutex_unlock(&market_lock);
+    wait_for_journal();
   }
 
-  if (fputs("Please enter a password: \r\n", comm_file) == EOF) {
-    error_and_exit("Couldn't send prompt");
+  // Receiving anything counts as activity, but a line that never ends does
+  // not keep the session alive forever.
+  client->last_active_at = self->timers.current;
+  if (!has_partial_line(&client->reader)) {
+    client->reading_partial = 0;
+  } else if (!client->reading_partial) {
+    client->reading_partial = 1;
+    client->partial_since = self->timers.current;
   }
+  update_deadline(self, client);
+  return overflowing ? -1 : 0;
+}
+
+void queue_timeout_notice(session* client) {
+  // Say why, but don't wait for a client that has stopped listening.
+  (void)fputs("Session timed out\r\n", client->comm_file);
+}
+
+void release_session(worker* self, session* client) {
+  cancel_timer(&self->timers, &client->deadline);
+  unlink_subscriber(self, client);
+  free_session(client);
+}
 
-  char* password = NULL;
-  size_t password_size = 0;
-  if (getline(&password, &password_size, comm_file) == -1) {
-    error_and_exit("Couldn't read password");
+void deliver_market_data(worker* self, void (*send)(session*, void*),
+                         void* context) {
+  // Clear the flag first, so anything published from now on signals again.
+  atomic_store(&self->feed_pending, 0);
+  (void)pthread_mutex_lock(&market_lock);
+  for (session* client = self->subscribers; client != NULL;
+       client = client->next_subscriber) {
+    if (client->closing || count_backlog(client) > FEED_BACKLOG_LIMIT) {
+      continue;
+    }
+    int status = deliver_feed(&client->subscription, client->comm_file);
+    if (status == -1) {
+      error_and_exit("Couldn't queue market data");
+    }
+    client->feed_ready |= status;
+  }
+  (void)pthread_mutex_unlock(&market_lock);
+
+  // Send outside the lock. Sending may release the session, so step past it
+  // first.
+  session* next = NULL;
+  for (session* client = self->subscribers; client != NULL; client = next) {
+    next = client->next_subscriber;
+    if (client->feed_ready) {
+      client->feed_ready = 0;
+      send(client, context);
+    }
   }
+}
 
-  // Remove trailing newline character if present
-  len = strlen(password);
-  if (len > 0 && password[len - 1] == '\n') {
-    password[len - 2] = '\0';
+int copy_market_snapshot(feed_subscription* subscription, FILE* out) {
+  int status = 0;
+  (void)pthread_mutex_lock(&market_lock);
+  for (int item = 0; item < MARKET_COIN_COUNT && status == 0; ++item) {
+    status = subscribe_to_feed(subscription, item, out);
   }
+  (void)pthread_mutex_unlock(&market_lock);
+  return status;
+}
+
+int copy_market_updates(feed_subscription* subscription, FILE* out) {
+  (void)pthread_mutex_lock(&market_lock);
+  int status = deliver_feed(subscription, out);
+  (void)pthread_mutex_unlock(&market_lock);
+  return status;
+}
 
-  // Register the user in the database
-  user new_user = {.username = username,
-                   .password = password,
-                   .name = name,
-                   .BTC = DEFAULT_BTC,
-                   .DOGE = DEFAULT_DOGE,
-                   .ETH = DEFAULT_ETH,
-                   .OMG = DEFAULT_OMG};
+// Open the spare descriptor used when the process runs out of descriptors.
+static int open_reserve_fd(void) {
+  return open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
 
-  if (insert_user(database, &new_user, &userID) != SQLITE_OK) {
-    puts("Error inserting user!");
+// Out of descriptors: give up the spare one to accept the oldest waiting
+// connection and close it at once, rather than leaving the listener readable
+// forever. Return -1 if there was nothing to drop.
+static int drop_connection(worker* self) {
+  if (self->reserve_fd == -1) {
     return -1;
   }
+  (void)close(self->reserve_fd);
+  count_io_syscalls(1);
+  int connect_d = accept(self->listener, NULL, NULL);
+  if (connect_d != -1) {
+    (void)close(connect_d);
+  }
+  self->reserve_fd = open_reserve_fd();
+  return connect_d == -1 ? -1 : 0;
+}
+
+int handle_accept_error(worker* self, int error) {
+  switch (error) {
+    case EINTR:
+    case ECONNABORTED:
+      // Only this connection failed, so keep accepting.
+      return 0;
+    case EMFILE:
+    case ENFILE:
+      puts("Out of file descriptors, dropping a connection!");
+      return drop_connection(self);
+    case ENOBUFS:
+    case ENOMEM:
+      puts("Out of memory, can't accept connections right now!");
+      return -1;
+    default:
+      // EAGAIN means the backlog is empty. Anything else is a problem with
+      // a single connection that the next accept won't share.
+      return -1;
+  }
+}
+
+// Run the event loop for one listener and the clients accepted on it.
+static void* serve_listener(void* arg) {
+  worker* self = arg;
+  self->reserve_fd = open_reserve_fd();
+  if (self->reserve_fd == -1) {
+    error_and_exit("Can't open reserve descriptor");
+  }
+  init_timer_wheel(&self->timers, current_tick());
+  if (self->feed_socket != -1) {
+    run_datagram_loop(self);
+  } else if (self->shared_memory) {
+    run_shm_loop(self);
+  } else if (self->backend == IO_BACKEND_URING) {
+    run_uring_loop(self);
+  } else {
+    run_epoll_loop(self);
+  }
+  return NULL;
+}
 
-  if (fputs("Registration successful! You can now log in.\r\n", comm_file) ==
-      EOF) {
-    error_and_exit("Couldn't send success message");
+void serve_clients(echo_server* server, sqlite3* database) {
+  io_backend backend = server->backend;
+  if (backend == IO_BACKEND_URING && !uring_supported()) {
+    puts("io_uring is not available, using epoll instead.");
+    backend = IO_BACKEND_EPOLL;
+  }
+  // Local listeners come after the TCP ones, each with a worker of its own.
+  int worker_count = server->listener_count;
+  worker_count += server->local_listener != -1;
+  worker_count += server->shm_listener != -1;
+  worker_count += server->feed_socket != -1;
+  worker* workers = calloc((size_t)worker_count, sizeof(worker));
+  if (workers == NULL) {
+    error_and_exit("Can't allocate workers");
+  }
+  if (server->journal_path != NULL) {
+    // The journal is the record of the market, so the database catches up
+    // with whatever it accepted after the last commit.
+    int64_t replayed = recover_market(database, server->journal_path,
+                                      server->state_snapshot_path);
+    if (replayed == -1) {
+      error_and_exit("Can't recover the market from the journal");
+    }
+    printf("Replayed %lld commands from the journal.\n", (long long)replayed);
+    start_journal(server->journal_path);
   }
+  if (load_market_data(database) == -1) {
+    error_and_exit("Can't load the order book");
+  }
+  if (load_candles(database) == -1) {
+    error_and_exit("Can't load candles");
+  }
+  if (load_trade_tape(database) == -1) {
+    error_and_exit("Can't load the latest trades");
+  }
+  if (load_market_stats(database, (int64_t)time(NULL)) == -1) {
+    error_and_exit("Can't load market statistics");
+  }
+  if (load_account_summaries(database) == -1) {
+    error_and_exit("Can't load account summaries");
+  }
+  start_write_behind(database, &market_lock, server->durability);
+  if (server->journal_path != NULL && server->state_snapshot_path != NULL) {
+    start_state_snapshots(database, &market_lock, server->state_snapshot_path);
+  }
+  for (int i = 0; i < worker_count; ++i) {
+    workers[i].backend = backend;
+    workers[i].database = database;
+    workers[i].feed_socket = -1;
+    workers[i].feed_event = eventfd(0, EFD_CLOEXEC);
+    if (workers[i].feed_event == -1) {
+      error_and_exit("Can't create market data event");
+    }
+  }
+  feed_workers = workers;
+  feed_worker_count = worker_count;
+  for (int i = 0; i < server->listener_count; ++i) {
+    workers[i].listener = server->listeners[i];
+  }
+  int next_worker = server->listener_count;
+  if (server->local_listener != -1) {
+    workers[next_worker++].listener = server->local_listener;
+  }
+  if (server->shm_listener != -1) {
+    workers[next_worker].listener = server->shm_listener;
+    workers[next_worker++].shared_memory = 1;
+  }
+  if (server->feed_socket != -1) {
+    // The datagram feed counts as a subscriber, so it is woken for every
+    // update.
+    workers[next_worker].listener = server->snapshot_listener;
+    workers[next_worker].feed_socket = server->feed_socket;
+    workers[next_worker].feed_addr = server->feed_addr;
+    atomic_store(&workers[next_worker].subscriber_count, 1);
+  }
+  // The calling thread serves the first listener itself.
+  for (int i = 1; i < worker_count; ++i) {
+    if (pthread_create(&workers[i].thread, NULL, serve_listener,
+                       &workers[i]) != 0) {
+      error_and_exit("Can't start worker thread");
+    }
+  }
+  (void)serve_listener(&workers[0]);
+  stop_state_snapshots();
+  stop_write_behind();
+  stop_journal();
+  free(workers);
+}
 
-  free(username);
-  free(name);
-  free(password);
-  return userID;
+// Send the prompt asking the client to register or log in.
+static void prompt_choice(session* client) {
+  if (fputs("Welcome to OMG. \"r\" to register, and \"u\" for existing users "
+            "\r\n",
+            client->comm_file) == EOF) {
+    error_and_exit("Couldn't send prompt");
+  }
 }
 
-int authenticate(FILE* comm_file, sqlite3* database) {
-  int authenticated = 0;
-  while (authenticated != 1) {
-    dump_database(database);
+// Send the prompt asking an existing user for their username.
+static void prompt_username(session* client) {
+  // Write "username: " to the socket
+  if (fputs("Username: \r\n", client->comm_file) == EOF) {
+    error_and_exit("Couldn't send prompt");
+  }
+}
 
-    // Write "username: " to the socket
-    if (fputs("Username: \r\n", comm_file) == EOF) {
+// Handle the reply to the register-or-log-in prompt.
+static void handle_choice(session* client, const line_view* line) {
+  // Check the first character of the input
+  if (line->data[0] == 'r') {
+    // Handle 'r' case
+    if (fputs("Please enter a username: \r\n", client->comm_file) == EOF) {
       error_and_exit("Couldn't send prompt");
     }
-
-    // Read the input into a char*
-    char* username = NULL;
-    size_t username_size = 0;
-    if (getline(&username, &username_size, comm_file) == -1) {
-      error_and_exit("Couldn't read username");
+    client->state = SESSION_REGISTER_USERNAME;
+  } else if (line->data[0] == 'u') {
+    // Handle 'u' case
+    prompt_username(client);
+    client->state = SESSION_LOGIN_USERNAME;
+  } else {
+    // Handle invalid input
+    if (fputs("Invalid option. Please enter 'r' or 'u'.\r\n",
+              client->comm_file) == EOF) {
+      error_and_exit("Couldn't send error message");
     }
+    prompt_choice(client);
+  }
+}
 
-    // Remove trailing newline character if present
-    size_t len = strlen(username);
-    if (len > 0 && username[len - 1] == '\n') {
-      username[len - 2] = '\0';
+// Handle registration
+void register_user(session* client, const line_view* line, sqlite3* database) {
+  FILE* comm_file = client->comm_file;
+  switch (client->state) {
+    case SESSION_REGISTER_USERNAME:
+      client->pending_user.username = strndup(line->data, line->length);
+      if (fputs("Please enter your name (for display purposes): \r\n",
+                comm_file) == EOF) {
+        error_and_exit("Couldn't send prompt");
+      }
+      client->state = SESSION_REGISTER_NAME;
+      return;
+
+    case SESSION_REGISTER_NAME:
+      client->pending_user.name = strndup(line->data, line->length);
+      if (fputs("Please enter a password: \r\n", comm_file) == EOF) {
+        error_and_exit("Couldn't send prompt");
+      }
+      client->state = SESSION_REGISTER_PASSWORD;
+      return;
+
+    case SESSION_REGISTER_PASSWORD: {
+      client->pending_user.password = strndup(line->data, line->length);
+
+      // Register the user in the database
+      user* new_user = &client->pending_user;
+      journal_entry entry = {
+          .type = JOURNAL_REGISTER,
+          .time = (int64_t)time(NULL),
+          .username = new_user->username,
+          .name = new_user->name,
+          .password = new_user->password,
+      };
+      append_journal(&entry);
+
+      int userID = 0;
+      if (register_account(database, new_user, &userID) != SQLITE_OK) {
+        puts("Error inserting user!");
+      } else if (fputs("Registration successful! You can now log in.\r\n",
+                       comm_file) == EOF) {
+        error_and_exit("Couldn't send success message");
+      }
+      clear_pending_user(client);
+      client->state = SESSION_CHOOSE;
+      prompt_choice(client);
+      return;
     }
 
-    user auth_user;
-    if (get_user_with_username(database, username, &auth_user) != SQLITE_OK) {
+    default:
+      return;
+  }
+}
+
+void authenticate(session* client, const line_view* line, sqlite3* database) {
+  FILE* comm_file = client->comm_file;
+  if (client->state == SESSION_LOGIN_USERNAME) {
+    if (get_user_with_username(database, line->data, &client->pending_user) !=
+        SQLITE_OK) {
       puts("Name is wrong");
       if (fputs("Failed to authenticate username!\r\n\n", comm_file) == EOF) {
         error_and_exit("Couldn't send error message");
       }
-      (void)fflush(comm_file);
-      free(username);
-      continue;
+      clear_pending_user(client);
+      prompt_username(client);
+      return;
     }
 
     // Write "Password: " to the socket
     if (fputs("Password: \r\n", comm_file) == EOF) {
       error_and_exit("Couldn't send prompt");
     }
+    client->state = SESSION_LOGIN_PASSWORD;
+    return;
+  }
 
-    // Read the input into a char*
-    char* password = NULL;
-    size_t password_size = 0;
-    if (getline(&password, &password_size, comm_file) == -1) {
-      error_and_exit("Couldn't read password");
-    }
-
-    // Remove trailing newline character if present
-    len = strlen(password);
-    if (len > 0 && password[len - 1] == '\n') {
-      password[len - 2] = '\0';
-    }
-
-    if (strcmp(password, auth_user.password) == 0) {
-      (void)fprintf(comm_file, "Welcome back, %s\r\n", auth_user.name);
-      (void)fflush(comm_file);
-      authenticated = 1;
-      free(username);
-      free(password);
-      return auth_user.userID;
-    }
-
-    if (fputs("Password incorrect\r\n\n", comm_file) == EOF) {
-      error_and_exit("Couldn't send error message");
-    }
-    (void)fflush(comm_file);
+  if (client->state != SESSION_LOGIN_PASSWORD) {
+    return;
+  }
+  if (strcmp(line->data, client->pending_user.password) == 0) {
+    (void)fprintf(comm_file, "Welcome back, %s\r\n", client->pending_user.name);
+    client->userID = client->pending_user.userID;
+    client->state = SESSION_READY;
+    clear_pending_user(client);
+    display_welcome_message(comm_file);
+    return;
+  }
 
-    // Free allocated memory for username and password
-    free(username);
-    free(password);
+  if (fputs("Password incorrect\r\n\n", comm_file) == EOF) {
+    error_and_exit("Couldn't send error message");
   }
+  clear_pending_user(client);
+  client->state = SESSION_LOGIN_USERNAME;
+  prompt_username(client);
 }
 
 // Forward declarations
-static void display_welcome_message(FILE* comm_file);
-static void handle_my_inventory(FILE* comm_file, int userID, sqlite3* database);
+static void handle_my_inventory(FILE* comm_file, int userID, sqlite3* database,
+                                const token_array* command_tokens);
 static void handle_buy(FILE* comm_file, int userID, sqlite3* database,
-                       string_array* command_tokens);
+                       const token_array* command_tokens);
 static void handle_sell(FILE* comm_file, int userID, sqlite3* database,
-                        string_array* command_tokens);
-static void handle_my_orders(FILE* comm_file, int userID, sqlite3* database);
+                        const token_array* command_tokens);
+static void handle_my_orders(FILE* comm_file, int userID, sqlite3* database,
+                             const token_array* command_tokens);
 static void handle_cancel_order(FILE* comm_file, int userID, sqlite3* database,
-                                string_array* command_tokens);
+                                const token_array* command_tokens);
 static void handle_view(FILE* comm_file, int userID, sqlite3* database,
-                        string_array* command_tokens);
-static void handle_help(FILE* comm_file);
+                        const token_array* command_tokens);
+static void handle_candles(FILE* comm_file, int userID, sqlite3* database,
+                           const token_array* command_tokens);
+static void handle_trades(FILE* comm_file, int userID, sqlite3* database,
+                          const token_array* command_tokens);
+static void handle_stats(FILE* comm_file, int userID, sqlite3* database,
+                         const token_array* command_tokens);
+static void handle_ticker(FILE* comm_file, int userID, sqlite3* database,
+                          const token_array* command_tokens);
+static void handle_account(FILE* comm_file, int userID, sqlite3* database,
+                           const token_array* command_tokens);
+static void handle_help(FILE* comm_file, int userID, sqlite3* database,
+                        const token_array* command_tokens);
+
+static void handle_subscription(session* client, int command,
+                                const token_array* command_tokens);
+
+// The signature shared by every command handler.
+typedef void (*command_handler)(FILE* comm_file, int userID,
+                                sqlite3* database,
+                                const token_array* command_tokens);
+
+// The handler for each command verb, indexed by the ID find_command returns.
+static const command_handler command_handlers[COMMAND_COUNT] = {
+    [COMMAND_MY_INVENTORY] = handle_my_inventory,
+    [COMMAND_BUY] = handle_buy,
+    [COMMAND_SELL] = handle_sell,
+    [COMMAND_MY_ORDERS] = handle_my_orders,
+    [COMMAND_CANCEL_ORDER] = handle_cancel_order,
+    [COMMAND_VIEW] = handle_view,
+    [COMMAND_CANDLES] = handle_candles,
+    [COMMAND_TRADES] = handle_trades,
+    [COMMAND_STATS] = handle_stats,
+    [COMMAND_TICKER] = handle_ticker,
+    [COMMAND_ACCOUNT] = handle_account,
+    [COMMAND_HELP] = handle_help,
+};
+
+// Hand a line to whichever part of the dialog the client is in.
+static void handle_line(session* client, const line_view* line,
+                        sqlite3* database) {
+  switch (client->state) {
+    case SESSION_CHOOSE:
+      handle_choice(client, line);
+      break;
+    case SESSION_REGISTER_USERNAME:
+    case SESSION_REGISTER_NAME:
+    case SESSION_REGISTER_PASSWORD:
+      register_user(client, line, database);
+      break;
+    case SESSION_LOGIN_USERNAME:
+    case SESSION_LOGIN_PASSWORD:
+      authenticate(client, line, database);
+      break;
+    case SESSION_READY:
+      echo(client, line, database);
+      break;
+  }
+}
 
 // Main function
-void echo(FILE* comm_file, int userID, sqlite3* database) {
-  display_welcome_message(comm_file);
-
-  while (!feof(comm_file)) {
-    dump_database(database);
-    char* buffer = NULL;
-    size_t buf_size = 0;
-    if (getline(&buffer, &buf_size, comm_file) == -1) {
-      error_and_exit("Can't get line");
-    }
+void echo(session* client, const line_view* line, sqlite3* database) {
+  FILE* comm_file = client->comm_file;
+  int userID = client->userID;
 
-    // Process the command
-    string_array* command_tokens = tokenize_line(buffer);
+  // Process the command
+  token_array command_tokens;
+  tokenize_line(line->data, &command_tokens);
 
-    if (command_tokens->size == 0) {
-      // Empty command
-      if (fputs("Invalid syntax!\r\n", comm_file) == EOF) {
-        error_and_exit("Couldn't send error message");
-      }
-      (void)fflush(comm_file);
-    } else if (strcasecmp(command_tokens->strings[0], "myinventory") == 0) {
-      // Handles myInventory command
-      handle_my_inventory(comm_file, userID, database);
-
-    } else if (strcasecmp(command_tokens->strings[0], "buy") == 0) {
-      // Handles buy command
-      handle_buy(comm_file, userID, database, command_tokens);
-
-    } else if (strcasecmp(command_tokens->strings[0], "sell") == 0) {
-      // Handles sell command
-      handle_sell(comm_file, userID, database, command_tokens);
-
-    } else if (strcasecmp(command_tokens->strings[0], "myorders") == 0) {
-      // Handles myOrders command
-      handle_my_orders(comm_file, userID, database);
-
-    } else if (strcasecmp(command_tokens->strings[0], "cancelorder") == 0) {
-      // Handles cancelOrder command
-      handle_cancel_order(comm_file, userID, database, command_tokens);
-
-    } else if (strcasecmp(command_tokens->strings[0], "view") == 0) {
-      // Handles view command
-      handle_view(comm_file, userID, database, command_tokens);
-    } else if (strcasecmp(command_tokens->strings[0], "help") == 0) {
-      // Handles help command
-      handle_help(comm_file);
+  if (command_tokens.size == 0) {
+    // Empty command
+    if (fputs("Invalid syntax!\r\n", comm_file) == EOF) {
+      error_and_exit("Couldn't send error message");
+    }
+    (void)fflush(comm_file);
+  } else {
+    // Look the verb up instead of comparing it against every command name
+    const token_view* verb = &command_tokens.tokens[0];
+    int command = find_command(verb->data, verb->length);
+    if (command == COMMAND_SUBSCRIBE || command == COMMAND_UNSUBSCRIBE) {
+      // These change what the session is sent, not the market.
+      handle_subscription(client, command, &command_tokens);
+    } else if (command != -1) {
+      command_handlers[command](comm_file, userID, database, &command_tokens);
     } else {
       // Handle unknown command
       if (fputs("Invalid syntax! Try help. \r\n", comm_file) == EOF) {
@@ -318,13 +828,8 @@ void echo(FILE* comm_file, int userID, sqlite3* database) {
       }
       (void)fflush(comm_file);
     }
-
-    free(buffer);
-    free_string_array(command_tokens);
   }
-  puts("EXITED");
 }
-
 // Display the OMG welcome banner
 static void display_welcome_message(FILE* comm_file) {
   if (fputs(" $$$$$$\\  $$\\      $$\\  $$$$$$\\ \r\n"
@@ -341,10 +846,11 @@ static void display_welcome_message(FILE* comm_file) {
 }
 
 // Handle the myInventory command
-static void handle_my_inventory(FILE* comm_file, int userID,
-                                sqlite3* database) {
+static void handle_my_inventory(FILE* comm_file, int userID, sqlite3* database,
+                                const token_array* command_tokens) {
+  (void)command_tokens;
   user current_user = {.userID = userID};
-  if (get_user_inventories(database, &current_user) != SQLITE_OK) {
+  if (get_user_inventory(database, &current_user) != SQLITE_OK) {
     if (fputs("Error retrieving inventory!\r\n", comm_file) == EOF) {
       error_and_exit("Couldn't send error message");
     }
@@ -360,15 +866,39 @@ static void handle_my_inventory(FILE* comm_file, int userID,
   (void)fflush(comm_file);
 }
 
+// Journal a buy or sell order placed at a time before it is applied.
+static void journal_order(const order* ord, int64_t now) {
+  journal_entry entry = {
+      .type = JOURNAL_ORDER,
+      .time = now,
+      .userID = ord->userID,
+      .item = ord->item,
+      .buyOrSell = ord->buyOrSell,
+      .quantity = ord->quantity,
+      .price = price_to_ticks(ord->unitPrice),
+  };
+  append_journal(&entry);
+}
+
 // Handle the buy command
 static void handle_buy(FILE* comm_file, int userID, sqlite3* database,
-                       string_array* command_tokens) {
+                       const token_array* command_tokens) {
   if (validate_command_args(comm_file, command_tokens, 4) != 1) {
     return;
   }
 
-  order* buy_order = create_order_from_string(command_tokens, userID);
-  if (buy(database, buy_order) == -1) {
+  const char* error = NULL;
+  order* buy_order = create_order_from_string(command_tokens, userID, &error);
+  if (buy_order == NULL) {
+    if (fprintf(comm_file, "%s\r\n", error) < 0) {
+      error_and_exit("Couldn't send error message");
+    }
+    (void)fflush(comm_file);
+    return;
+  }
+  int64_t now = (int64_t)time(NULL);
+  journal_order(buy_order, now);
+  if (buy(database, buy_order, now) == -1) {
     if (fputs("Can't create buy order!\r\n", comm_file) == EOF) {
       error_and_exit("Couldn't send error message");
     }
@@ -377,17 +907,28 @@ static void handle_buy(FILE* comm_file, int userID, sqlite3* database,
       error_and_exit("Couldn't send success message");
     }
   }
+  (void)free_order(buy_order);
   (void)fflush(comm_file);
 }
 
 // Handle the sell command
 static void handle_sell(FILE* comm_file, int userID, sqlite3* database,
-                        string_array* command_tokens) {
+                        const token_array* command_tokens) {
   if (validate_command_args(comm_file, command_tokens, 4) != 1) {
     return;
   }
-  order* sell_order = create_order_from_string(command_tokens, userID);
-  if (sell(database, sell_order) == -1) {
+  const char* error = NULL;
+  order* sell_order = create_order_from_string(command_tokens, userID, &error);
+  if (sell_order == NULL) {
+    if (fprintf(comm_file, "%s\r\n", error) < 0) {
+      error_and_exit("Couldn't send error message");
+    }
+    (void)fflush(comm_file);
+    return;
+  }
+  int64_t now = (int64_t)time(NULL);
+  journal_order(sell_order, now);
+  if (sell(database, sell_order, now) == -1) {
     if (fputs("Can't create sell order!\r\n", comm_file) == EOF) {
       error_and_exit("Couldn't send error message");
     }
@@ -396,89 +937,135 @@ static void handle_sell(FILE* comm_file, int userID, sqlite3* database,
       error_and_exit("Couldn't send success message");
     }
   }
+  (void)free_order(sell_order);
   (void)fflush(comm_file);
 }
 
-// Handle the myOrders command
-static void handle_my_orders(FILE* comm_file, int userID, sqlite3* database) {
-  order* order_list = NULL;
-  int order_count = 0;
-
-  my_orders(database, userID, &order_list, &order_count);
+// Whether a token is a word, ignoring case.
+static int token_is(const token_view* token, const char* word) {
+  size_t length = strlen(word);
+  return token->length == length &&
+         strncasecmp(token->data, word, length) == 0;
+}
 
-  if (fputs("Open Orders:\r\n", comm_file) == EOF) {
+// Print a page of one section of myOrders and free it. A page with one order
+// more than the limit has another after it, so the command that shows the
+// next page is printed instead of that order.
+static void print_order_page(FILE* comm_file, const char* heading,
+                             const char* empty, const char* section,
+                             order* orders, int count, int limit) {
+  if (fputs(heading, comm_file) == EOF ||
+      (count == 0 && fputs(empty, comm_file) == EOF)) {
     error_and_exit("Couldn't send message");
   }
-  if (order_list != NULL) {
-    for (int i = 0; i < order_count; i++) {
-      const char* item = coin_type_to_string(order_list[i].item);
-
-      if (fprintf(comm_file,
-                  "Order %d: Type: %s, Item: %s, Amount: %d, Price: "
-                  "%.2f, ID: %d\r\n",
-                  i + 1, order_list[i].buyOrSell == 0 ? "BUY" : "SELL", item,
-                  order_list[i].quantity, order_list[i].unitPrice,
-                  order_list[i].orderID) == -1) {
-        puts("Error sending order!");
-      }
+  int shown = count > limit ? limit : count;
+  for (int i = 0; i < shown; i++) {
+    if (fprintf(comm_file,
+                "Order %d: Type: %s, Item: %s, Amount: %d, Price: "
+                "%.2f, ID: %d\r\n",
+                i + 1, orders[i].buyOrSell == BUY ? "BUY" : "SELL",
+                coin_type_to_string(orders[i].item), orders[i].quantity,
+                orders[i].unitPrice, orders[i].orderID) < 0) {
+      error_and_exit("Couldn't send order");
     }
-    (void)fflush(comm_file);
-    free(order_list);
-  } else {
-    if (fputs("No open orders.\r\n", comm_file) == EOF) {
-      error_and_exit("Couldn't send message");
-    }
-    if (fputs("------------------------------------\r\n", comm_file) == EOF) {
-      error_and_exit("Couldn't send message");
-    }
-    (void)fflush(comm_file);
   }
-
-  if (fputs("------------------------------------\r\n", comm_file) == EOF) {
+  if (count > limit &&
+      fprintf(comm_file, "More: myOrders %s %d after %d\r\n", section, limit,
+              orders[shown - 1].orderID) < 0) {
     error_and_exit("Couldn't send message");
   }
+  if (orders != NULL) {
+    (void)free_order_list(orders, count);
+  }
+}
 
-  order_list = NULL;
-  order_count = 0;
-
-  get_archived_orders(database, userID, &order_list, &order_count);
-
-  if (fputs("Archived Orders:\r\n", comm_file) == EOF) {
-    error_and_exit("Couldn't send message");
+// Handle the myOrders command
+static void handle_my_orders(FILE* comm_file, int userID, sqlite3* database,
+                             const token_array* command_tokens) {
+  // myOrders [open|history] [limit] [after <id>]
+  int sections = ORDERS_OPEN | ORDERS_HISTORY;
+  int limit = DEFAULT_ORDER_PAGE;
+  int afterID = 0;
+  size_t next = 1;
+  int valid = !command_tokens->truncated;
+  if (valid && next < command_tokens->size) {
+    if (token_is(&command_tokens->tokens[next], "open")) {
+      sections = ORDERS_OPEN;
+      ++next;
+    } else if (token_is(&command_tokens->tokens[next], "history")) {
+      sections = ORDERS_HISTORY;
+      ++next;
+    }
   }
-  if (order_list != NULL && order_count != 0) {
-    for (int i = 0; i < order_count; i++) {
-      const char* item = coin_type_to_string(order_list[i].item);
-
-      if (fprintf(comm_file,
-                  "Order %d: Type: %s, Item: %s, Amount: %d, Price: "
-                  "%.2f, ID: %d\r\n",
-                  i + 1, order_list[i].buyOrSell == 0 ? "BUY" : "SELL", item,
-                  order_list[i].quantity, order_list[i].unitPrice,
-                  order_list[i].orderID) == -1) {
-        puts("Error sending order!");
+  if (valid && next < command_tokens->size &&
+      !token_is(&command_tokens->tokens[next], "after")) {
+    const token_view* limit_token = &command_tokens->tokens[next];
+    if (parse_quantity(limit_token->data, limit_token->length, &limit) !=
+            PARSE_OK ||
+        limit > MAX_ORDER_PAGE) {
+      if (fprintf(comm_file, "Invalid limit! Use 1 to %d orders.\r\n",
+                  MAX_ORDER_PAGE) < 0) {
+        error_and_exit("Couldn't send error message");
       }
+      (void)fflush(comm_file);
+      return;
     }
-    (void)fflush(comm_file);
-    free(order_list);
-  } else {
-    if (fputs("No archived orders.\r\n", comm_file) == EOF) {
-      error_and_exit("Couldn't send message");
+    ++next;
+  }
+  if (valid && next < command_tokens->size) {
+    // An ID only makes sense within one section.
+    const token_view* id_token = &command_tokens->tokens[next + 1];
+    valid = sections != (ORDERS_OPEN | ORDERS_HISTORY) &&
+            next + 2 == command_tokens->size &&
+            token_is(&command_tokens->tokens[next], "after") &&
+            parse_quantity(id_token->data, id_token->length, &afterID) ==
+                PARSE_OK;
+  }
+  if (!valid) {
+    if (fputs("Invalid command syntax! Usage: myOrders [open|history] "
+              "[limit] [after <id>]\r\n",
+              comm_file) == EOF) {
+      error_and_exit("Couldn't send error message");
     }
     (void)fflush(comm_file);
+    return;
   }
+
+  // One order past the limit tells whether there is another page.
+  order* order_list = NULL;
+  int order_count = 0;
+  if (sections & ORDERS_OPEN) {
+    my_orders(database, userID, afterID, limit + 1, &order_list,
+              &order_count);
+    print_order_page(comm_file, "Open Orders:\r\n", "No open orders.\r\n",
+                     "open", order_list, order_count, limit);
+  }
+  if (sections == (ORDERS_OPEN | ORDERS_HISTORY) &&
+      fputs("------------------------------------\r\n", comm_file) == EOF) {
+    error_and_exit("Couldn't send message");
+  }
+  if (sections & ORDERS_HISTORY) {
+    get_archived_orders(database, userID, afterID, limit + 1, &order_list,
+                        &order_count);
+    print_order_page(comm_file, "Archived Orders:\r\n",
+                     "No archived orders.\r\n", "history", order_list,
+                     order_count, limit);
+  }
+  (void)fflush(comm_file);
 }
 
 // Handle the cancelOrder command
 static void handle_cancel_order(FILE* comm_file, int userID, sqlite3* database,
-                                string_array* command_tokens) {
+                                const token_array* command_tokens) {
   if (validate_command_args(comm_file, command_tokens, 2) != 1) {
     return;
   }
 
-  char* endptr = NULL;
-  int orderID = strtol(command_tokens->strings[1], &endptr, 10);
-  if (*endptr != '\0') {
+  // Order IDs are positive and fit in an int, just like quantities.
+  const token_view* order_token = &command_tokens->tokens[1];
+  int orderID = 0;
+  if (parse_quantity(order_token->data, order_token->length, &orderID) !=
+      PARSE_OK) {
     if (fputs("Invalid order ID format!\r\n", comm_file) == EOF) {
       error_and_exit("Couldn't send error message");
     }
@@ -486,7 +1073,14 @@ static void handle_cancel_order(FILE* comm_file, int userID, sqlite3* database,
     return;
   }
 
-  if (cancel_order(database, orderID, userID) != 0) {
+  journal_entry entry = {
+      .type = JOURNAL_CANCEL,
+      .time = (int64_t)time(NULL),
+      .userID = userID,
+      .orderID = orderID,
+  };
+  append_journal(&entry);
+  if (cancel_order(database, orderID, userID, entry.time) != 0) {
     if (fputs("Failed to cancel order!\r\n", comm_file) == EOF) {
       error_and_exit("Couldn't send error message");
     }
@@ -498,32 +1092,158 @@ static void handle_cancel_order(FILE* comm_file, int userID, sqlite3* database,
   (void)fflush(comm_file);
 }
 
+// Write the table of a coin's best price levels on each side.
+static void render_view(FILE* out, int item, int depth) {
+  price_level* bids = malloc((size_t)depth * sizeof(price_level));
+  price_level* asks = malloc((size_t)depth * sizeof(price_level));
+  if (bids == NULL || asks == NULL) {
+    error_and_exit("Can't allocate depth");
+  }
+  size_t bid_count = copy_book_depth(item, BUY, bids, (size_t)depth);
+  size_t ask_count = copy_book_depth(item, SELL, asks, (size_t)depth);
+
+  // Print header and separator
+  if (fprintf(out,
+              "----------------------------------------------------"
+              "----------------------------\r\n") < 0) {
+    error_and_exit("Couldn't render header");
+  }
+  if (fprintf(out, "%-38s | %s\r\n", "Bids", "Asks") < 0) {
+    error_and_exit("Couldn't render header");
+  }
+
+  // Print a row per level, with empty space where one side has run out
+  size_t rows = bid_count > ask_count ? bid_count : ask_count;
+  for (size_t i = 0; i < rows; i++) {
+    char bid_info[64] = "";
+    if (i < bid_count) {
+      (void)snprintf(bid_info, sizeof(bid_info),
+                     "Price: %.2f, Quantity: %lld (%lld)",
+                     ticks_to_price(bids[i].price), (long long)bids[i].quantity,
+                     (long long)bids[i].order_count);
+    }
+    if (fprintf(out, "%-38s | ", bid_info) < 0) {
+      error_and_exit("Couldn't render bid");
+    }
+    if (i < ask_count) {
+      if (fprintf(out, "Price: %.2f, Quantity: %lld (%lld)",
+                  ticks_to_price(asks[i].price), (long long)asks[i].quantity,
+                  (long long)asks[i].order_count) < 0) {
+        error_and_exit("Couldn't render ask");
+      }
+    }
+    if (fprintf(out, "\r\n") < 0) {
+      error_and_exit("Couldn't render newline");
+    }
+  }
+
+  free(bids);
+  free(asks);
+}
+
+// Return a coin's view, rendering it again only if the book changed or a
+// different depth was asked for since it was last rendered.
+static const view_cache* get_view(int item, int depth) {
+  view_cache* view = &view_caches[item];
+  uint64_t version = get_book_version(item);
+  if (view->text != NULL && view->version == version &&
+      view->depth == depth) {
+    return view;
+  }
+  free(view->text);
+  view->text = NULL;
+  FILE* out = open_memstream(&view->text, &view->size);
+  if (out == NULL) {
+    error_and_exit("Can't render view");
+  }
+  render_view(out, item, depth);
+  if (fclose(out) == EOF) {
+    error_and_exit("Couldn't render view");
+  }
+  view->version = version;
+  view->depth = depth;
+  return view;
+}
+
 // Handle the view command
 static void handle_view(FILE* comm_file, int userID, sqlite3* database,
-                        string_array* command_tokens) {
-  if (validate_command_args(comm_file, command_tokens, 2) != 1) {
+                        const token_array* command_tokens) {
+  // The view comes from the in-memory book, not the database.
+  (void)database;
+  if (command_tokens->truncated ||
+      (command_tokens->size != 2 && command_tokens->size != 3)) {
+    if (fputs("Invalid command syntax! Usage: view <coin> [depth]\r\n",
+              comm_file) == EOF) {
+      error_and_exit("Couldn't send error message");
+    }
+    (void)fflush(comm_file);
     return;
   }
 
-  if (command_tokens->size != 2) {
-    if (fputs("Invalid command syntax! Usage: view <coin>\r\n", comm_file) ==
-        EOF) {
+  const token_view* symbol = &command_tokens->tokens[1];
+  int item = find_asset(symbol->data, symbol->length);
+  if (item == -1) {
+    if (fputs("Invalid item type\r\n", comm_file) == EOF) {
       error_and_exit("Couldn't send error message");
     }
     (void)fflush(comm_file);
     return;
   }
 
-  int item = -1;
-  if (strcasecmp(command_tokens->strings[1], "omg") == 0) {
-    item = COIN_OMG;
-  } else if (strcasecmp(command_tokens->strings[1], "doge") == 0) {
-    item = COIN_DOGE;
-  } else if (strcasecmp(command_tokens->strings[1], "btc") == 0) {
-    item = COIN_BTC;
-  } else if (strcasecmp(command_tokens->strings[1], "eth") == 0) {
-    item = COIN_ETH;
-  } else {
+  int depth = DEFAULT_VIEW_DEPTH;
+  if (command_tokens->size == 3) {
+    const token_view* depth_token = &command_tokens->tokens[2];
+    if (parse_quantity(depth_token->data, depth_token->length, &depth) !=
+            PARSE_OK ||
+        depth > MAX_VIEW_DEPTH) {
+      if (fprintf(comm_file, "Invalid depth! Use 1 to %d levels.\r\n",
+                  MAX_VIEW_DEPTH) < 0) {
+        error_and_exit("Couldn't send error message");
+      }
+      (void)fflush(comm_file);
+      return;
+    }
+  }
+
+  const view_cache* view = get_view(item, depth);
+  if (fwrite(view->text, 1, view->size, comm_file) != view->size) {
+    error_and_exit("Couldn't send view");
+  }
+  (void)fflush(comm_file);
+}
+
+// The room needed for a time written by format_utc_time.
+enum { UTC_TIME_SIZE = 32 };
+
+// Write a time in seconds since the Unix epoch as a UTC date and time.
+static void format_utc_time(int64_t seconds, char text[UTC_TIME_SIZE]) {
+  time_t time = (time_t)seconds;
+  struct tm parts;
+  text[0] = '\0';
+  if (gmtime_r(&time, &parts) != NULL) {
+    (void)strftime(text, UTC_TIME_SIZE, "%Y-%m-%d %H:%M:%S", &parts);
+  }
+}
+
+// Handle the candles command
+static void handle_candles(FILE* comm_file, int userID, sqlite3* database,
+                           const token_array* command_tokens) {
+  // Candles are the same for everyone and kept in memory.
+  (void)userID;
+  (void)database;
+  if (command_tokens->truncated || command_tokens->size != 4) {
+    if (fputs("Invalid command syntax! Usage: candles <coin> <1s|1m|1h> "
+              "<count>\r\n",
+              comm_file) == EOF) {
+      error_and_exit("Couldn't send error message");
+    }
+    (void)fflush(comm_file);
+    return;
+  }
+
+  const token_view* symbol = &command_tokens->tokens[1];
+  int item = find_asset(symbol->data, symbol->length);
+  if (item == -1) {
     if (fputs("Invalid item type\r\n", comm_file) == EOF) {
       error_and_exit("Couldn't send error message");
     }
@@ -531,75 +1251,312 @@ static void handle_view(FILE* comm_file, int userID, sqlite3* database,
     return;
   }
 
-  order* buy_orders = NULL;
-  int buy_count = 0;
-  order* sell_orders = NULL;
-  int sell_count = 0;
+  const token_view* interval_token = &command_tokens->tokens[2];
+  int interval =
+      find_candle_interval(interval_token->data, interval_token->length);
+  if (interval == -1) {
+    if (fputs("Invalid interval! Use 1s, 1m, or 1h.\r\n", comm_file) == EOF) {
+      error_and_exit("Couldn't send error message");
+    }
+    (void)fflush(comm_file);
+    return;
+  }
+
+  const token_view* count_token = &command_tokens->tokens[3];
+  int count = 0;
+  if (parse_quantity(count_token->data, count_token->length, &count) !=
+          PARSE_OK ||
+      count > CANDLE_HISTORY) {
+    if (fprintf(comm_file, "Invalid count! Use 1 to %d candles.\r\n",
+                CANDLE_HISTORY) < 0) {
+      error_and_exit("Couldn't send error message");
+    }
+    (void)fflush(comm_file);
+    return;
+  }
 
-  view_item_orders(database, item, &buy_orders, &buy_count, &sell_orders,
-                   &sell_count);
+  candle candles[CANDLE_HISTORY];
+  size_t copied =
+      copy_candles(item, (candle_interval)interval, candles, (size_t)count);
+  if (copied == 0) {
+    if (fputs("No trades yet\r\n", comm_file) == EOF) {
+      error_and_exit("Couldn't send message");
+    }
+    (void)fflush(comm_file);
+    return;
+  }
 
-  // Print header and separator
-  if (fprintf(comm_file,
-              "----------------------------------------------------\r\n") < 0) {
+  if (fprintf(comm_file, "%-19s | %10s | %10s | %10s | %10s | %10s\r\n",
+              "Start (UTC)", "Open", "High", "Low", "Close", "Volume") < 0) {
     error_and_exit("Couldn't send header");
   }
-  if (fprintf(comm_file, "%-30s | %s\r\n", "Buy Orders", "Sell Orders") < 0) {
-    error_and_exit("Couldn't send header");
+  for (size_t i = 0; i < copied; ++i) {
+    const candle* bar = &candles[i];
+    char start_text[UTC_TIME_SIZE];
+    format_utc_time(bar->startTime, start_text);
+    if (fprintf(comm_file,
+                "%-19s | %10.2f | %10.2f | %10.2f | %10.2f | %10lld\r\n",
+                start_text, ticks_to_price(bar->open),
+                ticks_to_price(bar->high), ticks_to_price(bar->low),
+                ticks_to_price(bar->close), (long long)bar->volume) < 0) {
+      error_and_exit("Couldn't send candle");
+    }
   }
+  (void)fflush(comm_file);
+}
 
-  // Determine maximum number of rows needed
-  int max_rows = (buy_count > sell_count) ? buy_count : sell_count;
+// Handle the trades command
+static void handle_trades(FILE* comm_file, int userID, sqlite3* database,
+                          const token_array* command_tokens) {
+  // The tape is the same for everyone and kept in memory.
+  (void)userID;
+  (void)database;
+  if (command_tokens->truncated ||
+      (command_tokens->size != 2 && command_tokens->size != 3)) {
+    if (fputs("Invalid command syntax! Usage: trades <coin> [count]\r\n",
+              comm_file) == EOF) {
+      error_and_exit("Couldn't send error message");
+    }
+    (void)fflush(comm_file);
+    return;
+  }
 
-  // Print each row
-  for (int i = 0; i < max_rows; i++) {
-    // Print buy order info if available
-    if (i < buy_count) {
-      if (fprintf(comm_file, "%-30s",
-                  fprintf_to_string("Price: %.2f, Quantity: %d",
-                                    buy_orders[i].unitPrice,
-                                    buy_orders[i].quantity)) < 0) {
-        error_and_exit("Couldn't send buy order info");
-      }
-    } else {
-      // Print empty space if no buy order for this row
-      if (fprintf(comm_file, "%-30s", "") < 0) {
-        error_and_exit("Couldn't send spacing");
+  const token_view* symbol = &command_tokens->tokens[1];
+  int item = find_asset(symbol->data, symbol->length);
+  if (item == -1) {
+    if (fputs("Invalid item type\r\n", comm_file) == EOF) {
+      error_and_exit("Couldn't send error message");
+    }
+    (void)fflush(comm_file);
+    return;
+  }
+
+  int count = DEFAULT_TRADE_COUNT;
+  if (command_tokens->size == 3) {
+    const token_view* count_token = &command_tokens->tokens[2];
+    if (parse_quantity(count_token->data, count_token->length, &count) !=
+            PARSE_OK ||
+        count > TRADE_TAPE_SIZE) {
+      if (fprintf(comm_file, "Invalid count! Use 1 to %d trades.\r\n",
+                  TRADE_TAPE_SIZE) < 0) {
+        error_and_exit("Couldn't send error message");
       }
+      (void)fflush(comm_file);
+      return;
     }
+  }
 
-    // Print separator
-    if (fprintf(comm_file, " | ") < 0) {
-      error_and_exit("Couldn't send separator");
+  execution fills[TRADE_TAPE_SIZE];
+  size_t copied = copy_recent_trades(item, fills, (size_t)count);
+  if (copied == 0) {
+    if (fputs("No trades yet\r\n", comm_file) == EOF) {
+      error_and_exit("Couldn't send message");
     }
+    (void)fflush(comm_file);
+    return;
+  }
 
-    // Print sell order info if available
-    if (i < sell_count) {
-      if (fprintf(comm_file, "Price: %.2f, Quantity: %d",
-                  sell_orders[i].unitPrice, sell_orders[i].quantity) < 0) {
-        error_and_exit("Couldn't send sell order info");
-      }
+  // The newest trade comes first, so its price is the last price.
+  if (fprintf(comm_file, "Last price: %.2f\r\n",
+              ticks_to_price(fills[0].price)) < 0 ||
+      fprintf(comm_file, "%-19s | %-4s | %10s | %10s\r\n", "Time (UTC)",
+              "Side", "Price", "Quantity") < 0) {
+    error_and_exit("Couldn't send header");
+  }
+  for (size_t i = 0; i < copied; ++i) {
+    char time_text[UTC_TIME_SIZE];
+    format_utc_time(fills[i].executedAt, time_text);
+    if (fprintf(comm_file, "%-19s | %-4s | %10.2f | %10d\r\n", time_text,
+                fills[i].aggressor == BUY ? "BUY" : "SELL",
+                ticks_to_price(fills[i].price), fills[i].quantity) < 0) {
+      error_and_exit("Couldn't send trade");
     }
+  }
+  (void)fflush(comm_file);
+}
+
+// Handle the stats command
+static void handle_stats(FILE* comm_file, int userID, sqlite3* database,
+                         const token_array* command_tokens) {
+  // The statistics are the same for everyone and kept in memory.
+  (void)userID;
+  (void)database;
+  if (validate_command_args(comm_file, command_tokens, 2) != 1) {
+    return;
+  }
 
-    // End the row
-    if (fprintf(comm_file, "\r\n") < 0) {
-      error_and_exit("Couldn't send newline");
+  const token_view* symbol = &command_tokens->tokens[1];
+  int item = find_asset(symbol->data, symbol->length);
+  if (item == -1) {
+    if (fputs("Invalid item type\r\n", comm_file) == EOF) {
+      error_and_exit("Couldn't send error message");
     }
+    (void)fflush(comm_file);
+    return;
+  }
+
+  rolling_stats stats;
+  get_market_stats(item, (int64_t)time(NULL), &stats);
+  if (fprintf(comm_file, "%s over the last 24 hours\r\n",
+              coin_type_to_string(item)) < 0 ||
+      fprintf(comm_file, "Trades: %lld, Volume: %lld\r\n",
+              (long long)stats.trade_count, (long long)stats.volume) < 0) {
+    error_and_exit("Couldn't send statistics");
+  }
+  if (stats.trade_count > 0 &&
+      fprintf(comm_file, "VWAP: %.2f, High: %.2f, Low: %.2f\r\n",
+              stats.vwap / TICKS_PER_UNIT, ticks_to_price(stats.high),
+              ticks_to_price(stats.low)) < 0) {
+    error_and_exit("Couldn't send statistics");
   }
 
+  // The spread is only known while both sides have orders.
+  price_level best_bid;
+  price_level best_ask;
+  int has_bid = copy_book_depth(item, BUY, &best_bid, 1) == 1;
+  int has_ask = copy_book_depth(item, SELL, &best_ask, 1) == 1;
+  if (has_bid && has_ask) {
+    if (fprintf(comm_file, "Bid: %.2f, Ask: %.2f, Spread: %.2f\r\n",
+                ticks_to_price(best_bid.price), ticks_to_price(best_ask.price),
+                ticks_to_price(best_ask.price - best_bid.price)) < 0) {
+      error_and_exit("Couldn't send statistics");
+    }
+  } else if (fputs("Spread: no bids or no asks\r\n", comm_file) == EOF) {
+    error_and_exit("Couldn't send statistics");
+  }
   (void)fflush(comm_file);
+}
+
+// The room needed for a price written by format_ticker_price.
+enum { TICKER_PRICE_SIZE = 32 };
+
+// Format a price in ticks for the ticker, or "-" if there is none.
+static void format_ticker_price(int known, int64_t ticks,
+                                char text[TICKER_PRICE_SIZE]) {
+  if (known) {
+    (void)snprintf(text, TICKER_PRICE_SIZE, "%.2f", ticks_to_price(ticks));
+  } else {
+    (void)snprintf(text, TICKER_PRICE_SIZE, "-");
+  }
+}
+
+// Handle the ticker command
+static void handle_ticker(FILE* comm_file, int userID, sqlite3* database,
+                          const token_array* command_tokens) {
+  // Every value comes from the books, tapes and statistics in memory, so one
+  // request covers every coin without touching the database.
+  (void)userID;
+  (void)database;
+  if (validate_command_args(comm_file, command_tokens, 1) != 1) {
+    return;
+  }
 
-  // Free allocated memory
-  if (buy_orders != NULL) {
-    free(buy_orders);
+  if (fprintf(comm_file, "%-4s | %10s | %10s | %10s | %10s\r\n", "Coin",
+              "Bid", "Ask", "Last", "Volume") < 0) {
+    error_and_exit("Couldn't send header");
   }
-  if (sell_orders != NULL) {
-    free(sell_orders);
+  int64_t now = (int64_t)time(NULL);
+  for (int item = 0; item < MARKET_COIN_COUNT; ++item) {
+    price_level best_bid = {0};
+    price_level best_ask = {0};
+    execution last = {0};
+    rolling_stats stats;
+    int has_bid = copy_book_depth(item, BUY, &best_bid, 1) == 1;
+    int has_ask = copy_book_depth(item, SELL, &best_ask, 1) == 1;
+    int has_traded = get_last_trade(item, &last);
+    get_market_stats(item, now, &stats);
+
+    char bid_text[TICKER_PRICE_SIZE];
+    char ask_text[TICKER_PRICE_SIZE];
+    char last_text[TICKER_PRICE_SIZE];
+    format_ticker_price(has_bid, best_bid.price, bid_text);
+    format_ticker_price(has_ask, best_ask.price, ask_text);
+    format_ticker_price(has_traded, last.price, last_text);
+    if (fprintf(comm_file, "%-4s | %10s | %10s | %10s | %10lld\r\n",
+                coin_type_to_string(item), bid_text, ask_text, last_text,
+                (long long)stats.volume) < 0) {
+      error_and_exit("Couldn't send ticker");
+    }
+  }
+  (void)fflush(comm_file);
+}
+
+// Handle the account command
+static void handle_account(FILE* comm_file, int userID, sqlite3* database,
+                           const token_array* command_tokens) {
+  // The summary is kept up to date in memory as the user trades, so this
+  // doesn't read the user's orders.
+  (void)database;
+  if (validate_command_args(comm_file, command_tokens, 1) != 1) {
+    return;
+  }
+
+  account_summary summary;
+  get_account_summary(userID, &summary);
+  if (fprintf(comm_file, "Open orders: %lld, Trades: %lld\r\n",
+              (long long)summary.openOrders,
+              (long long)summary.tradeCount) < 0 ||
+      fputs("Filled:", comm_file) == EOF) {
+    error_and_exit("Couldn't send account summary");
+  }
+  for (int item = 0; item < MARKET_COIN_COUNT; ++item) {
+    if (fprintf(comm_file, "%s %s %lld", item == 0 ? "" : ",",
+                coin_type_to_string(item),
+                (long long)summary.filled[item]) < 0) {
+      error_and_exit("Couldn't send account summary");
+    }
+  }
+  if (fprintf(comm_file, "\r\nNotional: %.2f\r\n",
+              ticks_to_price(summary.notional)) < 0) {
+    error_and_exit("Couldn't send account summary");
+  }
+
+  char active_text[UTC_TIME_SIZE] = "never";
+  if (summary.lastActiveAt > 0) {
+    format_utc_time(summary.lastActiveAt, active_text);
+  }
+  if (fprintf(comm_file, "Last activity: %s\r\n", active_text) < 0) {
+    error_and_exit("Couldn't send account summary");
+  }
+  (void)fflush(comm_file);
+}
+
+// Handle the subscribe and unsubscribe commands
+static void handle_subscription(session* client, int command,
+                                const token_array* command_tokens) {
+  FILE* comm_file = client->comm_file;
+  if (validate_command_args(comm_file, command_tokens, 2) != 1) {
+    return;
+  }
+
+  const token_view* symbol = &command_tokens->tokens[1];
+  int item = find_asset(symbol->data, symbol->length);
+  if (item == -1) {
+    if (fputs("Invalid item type\r\n", comm_file) == EOF) {
+      error_and_exit("Couldn't send error message");
+    }
+    return;
+  }
+
+  if (command == COMMAND_SUBSCRIBE) {
+    if (subscribe_to_feed(&client->subscription, item, comm_file) == -1) {
+      error_and_exit("Couldn't send snapshot");
+    }
+  } else {
+    unsubscribe_from_feed(&client->subscription, item);
+    if (fprintf(comm_file, "Unsubscribed from %s\r\n",
+                coin_type_to_string(item)) < 0) {
+      error_and_exit("Couldn't send message");
+    }
   }
 }
 
 // Handle help command
-static void handle_help(FILE* comm_file) {
+static void handle_help(FILE* comm_file, int userID, sqlite3* database,
+                        const token_array* command_tokens) {
+  (void)userID;
+  (void)database;
+  (void)command_tokens;
   if (fputs("Available commands:\r\n", comm_file) == EOF) {
     error_and_exit("Couldn't send help message");
   }
@@ -621,9 +1578,13 @@ static void handle_help(FILE* comm_file) {
             comm_file) == EOF) {
     error_and_exit("Couldn't send help message");
   }
-  if (fputs("myOrders\r\nLists all active buy/sell orders submitted by the "
-            "current user.\r\n"
-            "Returns the IDs of all active orders.\r\n\r\n",
+  if (fputs("myOrders [open|history] [limit] [after <id>]\r\nLists the "
+            "active and archived buy/sell orders of the current user, oldest "
+            "first, with their IDs.\r\n"
+            "open or history: Lists only active or only archived orders.\r\n"
+            "limit: How many orders to list in each, 20 by default.\r\n"
+            "after: Lists the orders after that ID, to see the next page.\r\n"
+            "\r\n",
             comm_file) == EOF) {
     error_and_exit("Couldn't send help message");
   }
@@ -632,11 +1593,64 @@ static void handle_help(FILE* comm_file) {
             comm_file) == EOF) {
     error_and_exit("Couldn't send help message");
   }
-  if (fputs("view <item>\r\nViews the top 5 buy/sell orders for a specific "
-            "item.\r\n"
+  if (fputs("view <item> [depth]\r\nViews the best buy/sell prices for a "
+            "specific item, with the total quantity and number of orders at "
+            "each.\r\n"
+            "item: The name of the item to check.\r\n"
+            "depth: How many prices to show on each side, 5 by default.\r\n"
+            "\r\n",
+            comm_file) == EOF) {
+    error_and_exit("Couldn't send help message");
+  }
+  if (fputs("candles <item> <interval> <count>\r\nShows the open, high, low, "
+            "and close prices and the volume traded of an item over the "
+            "latest intervals.\r\n"
+            "item: The name of the item to check.\r\n"
+            "interval: 1s, 1m, or 1h.\r\n"
+            "count: How many intervals with trades to show.\r\n\r\n",
+            comm_file) == EOF) {
+    error_and_exit("Couldn't send help message");
+  }
+  if (fputs("trades <item> [count]\r\nShows the latest trades of an item, "
+            "newest first, and its last price. Side is the side of the order "
+            "that took the resting one.\r\n"
+            "item: The name of the item to check.\r\n"
+            "count: How many trades to show, 10 by default.\r\n\r\n",
+            comm_file) == EOF) {
+    error_and_exit("Couldn't send help message");
+  }
+  if (fputs("stats <item>\r\nShows the number of trades, volume, "
+            "volume-weighted average price, high, and low of an item over the "
+            "last 24 hours, and its current spread.\r\n"
             "item: The name of the item to check.\r\n\r\n",
             comm_file) == EOF) {
     error_and_exit("Couldn't send help message");
   }
+  if (fputs("ticker\r\nShows the best bid, best ask, last price, and 24-hour "
+            "volume of every item, one line each.\r\n\r\n",
+            comm_file) == EOF) {
+    error_and_exit("Couldn't send help message");
+  }
+  if (fputs("account\r\nShows how many orders the current user has open, "
+            "how many trades they took part in, how much of each item they "
+            "bought or sold, the notional of those trades, and when they last "
+            "traded.\r\n\r\n",
+            comm_file) == EOF) {
+    error_and_exit("Couldn't send help message");
+  }
+  if (fputs("subscribe <item>\r\nStreams the order book of an item.\r\n"
+            "Sends SNAPSHOT <item> <seq> <bids> <asks> followed by one "
+            "BID or ASK <price> <quantity> line per level, then\r\n"
+            "UPDATE <item> <seq> BID|ASK ADD|CHANGE|REMOVE <price> "
+            "<quantity> and TRADE <item> <seq> <price> <quantity>\r\n"
+            "lines as the book changes.\r\n\r\n",
+            comm_file) == EOF) {
+    error_and_exit("Couldn't send help message");
+  }
+  if (fputs("unsubscribe <item>\r\nStops streaming the order book of an "
+            "item.\r\n\r\n",
+            comm_file) == EOF) {
+    error_and_exit("Couldn't send help message");
+  }
   (void)fflush(comm_file);
 }
@@ -6,32 +6,88 @@
 #include <stdio.h>
 #include <sys/socket.h>
 
-enum { BACKLOG_SIZE = 10 };
+#include "line_reader.h"
+#include "session.h"
+#include "write_behind.h"
+
+// How many clients may wait to be accepted on each listener by default.
+enum { DEFAULT_BACKLOG_SIZE = 128 };
+
+/**
+ * @enum io_backend
+ * @brief How the server waits for and performs socket I/O.
+ *
+ * IO_BACKEND_EPOLL - Wait for sockets to become ready, then read and write
+ * them with one system call each.
+ * IO_BACKEND_URING - Hand reads and writes for every session to io_uring and
+ * collect their results, batching the system calls.
+ */
+typedef enum {
+  IO_BACKEND_EPOLL,
+  IO_BACKEND_URING,
+} io_backend;
 
 // Group the data needed for a server to run.
 typedef struct {
-  /// The socket descriptor to listen for connections.
-  int listener;
-  /// The address and port for the listener socket.
+  /// The listener sockets, all bound to the same address with SO_REUSEPORT so
+  /// the kernel spreads new connections across them.
+  int* listeners;
+  /// The number of listener sockets, and so of threads serving clients.
+  int listener_count;
+  /// How the threads perform I/O. make_echo_server picks IO_BACKEND_EPOLL,
+  /// which can be changed before serving clients.
+  io_backend backend;
+  /// The address and port for the listener sockets.
   struct sockaddr_in addr;
-  /// The maximum number of clients that can be waiting to connect at once.
+  /// The maximum number of clients that can be waiting to connect at once on
+  /// each listener.
   int max_backlog;
+  /// A listener on a Unix domain socket for clients on the same host, served
+  /// like the TCP listeners by a thread of its own, or -1 if there is none.
+  int local_listener;
+  /// A listener on a Unix domain socket that gives each client a channel in
+  /// shared memory to talk over instead, or -1 if there is none.
+  int shm_listener;
+  /// A UDP socket to publish market data from as datagrams, or -1 if it isn't
+  /// published.
+  int feed_socket;
+  /// Where the datagrams are sent.
+  struct sockaddr_in feed_addr;
+  /// A TCP listener that sends a snapshot of every book to each client, so a
+  /// consumer of the datagrams can recover from a gap, or -1 if there is none.
+  int snapshot_listener;
+  /// When clients hear back about lines that wrote to the database.
+  /// make_echo_server picks ACK_ON_ENQUEUE, which can be changed before
+  /// serving clients.
+  ack_durability durability;
+  /// The journal every command that changes the market is written to before
+  /// it is applied, and that the database is rebuilt from at startup, or NULL
+  /// if there is none.
+  const char* journal_path;
+  /// Where the market is snapshotted while serving clients, so a restart
+  /// restores it and replays only the journal after it, or NULL if it isn't.
+  /// Only used along with a journal.
+  const char* state_snapshot_path;
 } echo_server;
 
 /**
  * Create a new echo server in dynamic memory.
  *
- * Given a socket address and a maximum backlog size, create a new echo server
- * on the heap. Since the new server (or rather, the data it stores) is
- * dynamically allocated, the caller is responsible for cleaning the server up
- * afterwards (or terminating the program and letting that take care of things).
+ * Given a socket address, a maximum backlog size, and a number of listeners,
+ * create a new echo server on the heap. Since the new server (or rather, the
+ * data it stores) is dynamically allocated, the caller is responsible for
+ * cleaning the server up afterwards (or terminating the program and letting
+ * that take care of things).
  *
  * @param addr The IPv4 address and port that the server will listen on.
- * @param max_backlog The max number of clients that can wait to connect to the
- * server.
+ * @param max_backlog The max number of clients that can wait to connect to
+ * each listener.
+ * @param listener_count The number of listener sockets to open. Each one is
+ * served by its own thread, so this is usually the number of cores.
  * @return A pointer to the new echo server.
  */
-echo_server* make_echo_server(struct sockaddr_in ip_addr, int max_backlog);
+echo_server* make_echo_server(struct sockaddr_in ip_addr, int max_backlog,
+                              int listener_count);
 
 /**
  * Free an echo server in dynamic memory.
@@ -49,100 +105,142 @@ void free_echo_server(echo_server* server);
 /**
  * Start listening on a server for potential client connections.
  *
- * Bind the listener socket and set it to listen for client connection requests.
- * The listener socket is part of the server's internal data and does not need
- * to be opened separately. In the event that binding or listening on the socket
- * fails, print an error message and exit the program without returning.
+ * Bind every listener socket to the server's address with SO_REUSEPORT and set
+ * it to listen for client connection requests. The listener sockets are part
+ * of the server's internal data and do not need to be opened separately. In
+ * the event that binding or listening on a socket fails, print an error
+ * message and exit the program without returning.
  *
  * @param server The server to start listening on.
  */
 void listen_for_connections(echo_server* server);
 
 /**
- * Accept a new client connection and start the echo process.
+ * Also listen for clients on the same host on a Unix domain socket.
  *
- * Wait until a client connection request comes in, accepting it. Once accepted,
- * fork a new process. In the child process, run the echo process, and in the
- * parent, end the function. The server program should run the function in a
- * loop, whereas the child can exit the function after the echo process. In the
- * event of an error in accepting a connection or forking a new process, print
- * an appropriate error message and accept the program.
+ * Clients connecting to the socket use the same protocol as over TCP, but skip
+ * the network stack. Any stale socket left at the path by an earlier run is
+ * replaced. In the event that the socket can't be set up, print an error
+ * message and exit the program without returning.
  *
- * @param server The server to accept the connection on.
- * @return 0 for the parent process and -1 for the child (echo) process.
+ * @param server The server to add the listener to.
+ * @param path The file system path to bind the socket to.
  */
-int accept_client(echo_server* server, sqlite3* database);
+void listen_locally(echo_server* server, const char* path);
 
 /**
- * @brief Registers a new user by interacting with the client through a
- * communication file and storing the user's information in the database.
+ * Also hand out shared-memory channels to clients on the same host.
+ *
+ * A client connecting to the Unix domain socket at the path is sent three
+ * descriptors along with a single byte: a memfd holding an shm_channel, an
+ * eventfd the server waits on, and an eventfd the client waits on. From then
+ * on the client writes lines to the channel's request ring and reads replies
+ * from its reply ring, using the same protocol as over TCP, and signals the
+ * server's eventfd when unpark_shm_reader or unpark_shm_writer says to. The
+ * socket stays open only so each side notices the other leaving. In the event
+ * that the socket can't be set up, print an error message and exit the
+ * program without returning.
+ *
+ * @param server The server to add the listener to.
+ * @param path The file system path to bind the socket to.
+ */
+void listen_for_shm_clients(echo_server* server, const char* path);
+
+/**
+ * Also publish market data as datagrams to a UDP address.
+ *
+ * Every book update and trade is sent once to the address, which may be a
+ * unicast or a multicast address, however many consumers listen there. Each
+ * datagram starts with a `FEED <packet>` line, numbered from 1, followed by
+ * the same lines subscribed clients are sent, each carrying its coin's
+ * sequence number. A consumer that sees a packet number skipped connects over
+ * TCP to the same port on the server, which sends a `SNAPSHOT` of every book
+ * and closes the connection, and then applies only the updates after each
+ * snapshot's sequence number. In the event that either socket can't be set
+ * up, print an error message and exit the program without returning.
+ *
+ * @param server The server to publish from.
+ * @param addr The IPv4 address and port to send the datagrams to.
+ */
+void publish_market_data(echo_server* server, struct sockaddr_in addr);
+
+/**
+ * Serve every client connection from one event loop per listener.
+ *
+ * Start a thread for each listener (the calling thread serves the first one).
+ * Each thread watches its listener and the clients it accepted, and handles
+ * each as it becomes ready, so a slow or idle client never blocks the others.
+ * New connections are accepted in batches and greeted, received bytes are
+ * split into lines and handed to the login dialog or the command handlers,
+ * and replies are sent as the sockets accept them, using the server's I/O
+ * backend. If io_uring is asked for but the kernel can't run it, epoll is
+ * used instead. The local listener is served the same way, and shared-memory
+ * clients are served by a thread of their own that waits on their eventfds.
+ * Datagrams and snapshots of the market data, if published, are sent by one
+ * more thread.
+ * Commands from different threads take turns with the market, so they see the
+ * same results as if there were one thread. This function only returns by
+ * exiting the program on a critical error, such as being unable to wait for
+ * events.
+ *
+ * @param server The server to accept connections on. It must already be
+ * listening.
+ * @param database A pointer to the SQLite database connection used by every
+ * client.
+ */
+void serve_clients(echo_server* server, sqlite3* database);
+
+/**
+ * @brief Handles one reply in the registration dialog and stores the new user
+ * in the database once all of it has been entered.
  *
- * This function prompts the user for a username, display name, and password via
- * the provided communication file. It then validates and processes the input,
- * and registers the user in the database with default cryptocurrency balances.
- * If successful, the function returns the newly created user's ID.
+ * The dialog prompts for a username, display name, and password in turn, one
+ * line per call. After the password, the user is registered in the database
+ * with default cryptocurrency balances and the client is sent back to the
+ * register-or-log-in prompt.
  *
- * @param comm_file A pointer to a FILE object used for communication with the
- * client. This is typically a socket or file stream for sending and receiving
- * data.
+ * @param client The session of the client registering. Its state says which
+ * prompt the line answers.
+ * @param line The client's reply to the current prompt.
  * @param database  A pointer to an SQLite3 database connection where the user
  * information will be stored.
  *
- * @return The ID of the newly registered user on success, or -1 if an error
- * occurs during the registration process.
- *
  * @note The function will terminate the program if it encounters a critical
- * error, such as being unable to send prompts or read input from the
- * communication file.
- *
- * @warning The function assumes that the communication file and database
- * connection are valid and properly initialized. It also assumes that the
- * database schema supports the `insert_user` function for adding new users.
+ * error, such as being unable to queue a prompt for the client.
  */
-int register_user(FILE* comm_file, sqlite3* database);
+void register_user(session* client, const line_view* line, sqlite3* database);
 
 /**
- * Handle client communication by echoing messages and interacting with the
- * database.
+ * Handle one command from a logged in client.
  *
- * This function manages communication with a connected client through a socket.
- * It reads messages from the client, processes them, and sends appropriate
- * responses back to the client. The function also interacts with a SQLite
- * database to perform operations based on the client's requests. The
- * communication continues until the client disconnects or an error occurs.
+ * Split the line into tokens, run the matching command against the database,
+ * and queue the response for the client.
  *
- * @param comm_file A file stream associated with the socket connection to the
- * client.
- * @param userID The unique identifier of the authenticated user.
+ * @param client The session of the logged in client.
+ * @param line The command line received from the client.
  * @param database A pointer to the SQLite database connection for handling
  * client requests.
  *
- * @note The function ensures proper cleanup of resources, such as closing the
- * file stream, before returning or exiting. Critical errors, such as socket
- * communication failures or database access issues, will result in program
- * termination.
+ * @note Critical errors, such as being unable to queue a response, will result
+ * in program termination.
  */
-void echo(FILE* comm_file, int userID, sqlite3* database);
+void echo(session* client, const line_view* line, sqlite3* database);
 
 /**
- * Handles user authentication by communicating over a socket connection.
+ * Handle one reply in the login dialog.
  *
- * This function facilitates user authentication by interacting with a client
- * through a socket. It requests a username and password from the client and
- * verifies the credentials against a SQLite database. If the credentials are
- * valid, the user is authenticated, and a success message is sent back to the
- * client. If the credentials are invalid, the client is prompted to retry.
+ * The dialog asks for a username and then a password, one line per call. The
+ * username is looked up in the database and the password is checked against
+ * it. If the credentials are valid, a success message is queued and the session
+ * becomes ready for commands. Otherwise the client is prompted to retry.
  *
- * @param comm_file A file stream associated with the socket connection to the
- * client.
+ * @param client The session of the client logging in. Its state says which
+ * prompt the line answers.
+ * @param line The client's reply to the current prompt.
  * @param database A pointer to the SQLite database connection used for
  * verifying user credentials.
- * @return Returns 0 (EXIT_SUCCESS) if authentication is successful. The
- * function terminates the program on critical errors.
  *
- * @note The function ensures that any dynamically allocated memory for the
- * username and password is properly freed before returning or exiting.
- * @note Critical errors, such as socket communication failures or database
- * access issues, will result in program termination.
+ * @note Critical errors, such as being unable to queue a prompt, will result in
+ * program termination.
  */
-int authenticate(FILE* comm_file, sqlite3* database);
+void authenticate(session* client, const line_view* line, sqlite3* database);
@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+
+#include "session.h"
+
+#include <errno.h>       // errno, EAGAIN, EINTR
+#include <stdio.h>       // fopencookie, cookie_io_functions_t
+#include <stdlib.h>      // malloc, realloc, free
+#include <string.h>      // memcpy, memmove
+#include <sys/socket.h>  // send, MSG_NOSIGNAL
+#include <unistd.h>      // close
+
+#include "io_stats.h"
+
+enum { INITIAL_OUTPUT_CAPACITY = 1024 };
+
+// Queue bytes written to a session's stream instead of sending them directly.
+static ssize_t queue_output(void* cookie, const char* buf, size_t size) {
+  session* client = cookie;
+  if (client->output_sent > 0 &&
+      client->output_size + size > client->output_capacity) {
+    // Reclaim the space taken by bytes that were already sent.
+    memmove(client->output, client->output + client->output_sent,
+            client->output_size - client->output_sent);
+    client->output_size -= client->output_sent;
+    client->output_sent = 0;
+  }
+  if (client->output_size + size > client->output_capacity) {
+    size_t capacity = client->output_capacity ? client->output_capacity * 2
+                                              : INITIAL_OUTPUT_CAPACITY;
+    while (capacity < client->output_size + size) {
+      capacity *= 2;
+    }
+    char* output = realloc(client->output, capacity);
+    if (output == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+    client->output = output;
+    client->output_capacity = capacity;
+  }
+  memcpy(client->output + client->output_size, buf, size);
+  client->output_size += size;
+  return (ssize_t)size;
+}
+
+session* make_session(int socket_descriptor) {
+  session* client = malloc(sizeof(session));
+  if (client == NULL) {
+    return NULL;
+  }
+  client->socket_descriptor = socket_descriptor;
+  client->state = SESSION_CHOOSE;
+  client->userID = -1;
+  client->pending_user = (user){.userID = -1};
+  init_line_reader(&client->reader);
+  client->output = NULL;
+  client->output_size = 0;
+  client->output_sent = 0;
+  client->output_capacity = 0;
+  client->awaiting_send = 0;
+  init_timer(&client->deadline, client);
+  client->connected_at = 0;
+  client->last_active_at = 0;
+  client->partial_since = 0;
+  client->reading_partial = 0;
+  client->sending = NULL;
+  client->sending_size = 0;
+  client->sending_capacity = 0;
+  client->operations = 0;
+  client->closing = 0;
+  client->next_closed = NULL;
+  client->transport = NULL;
+  client->subscription = (feed_subscription){0};
+  client->next_subscriber = NULL;
+  client->pprev_subscriber = NULL;
+  client->feed_ready = 0;
+
+  cookie_io_functions_t functions = {.write = queue_output};
+  client->comm_file = fopencookie(client, "w", functions);
+  if (client->comm_file == NULL) {
+    free(client);
+    return NULL;
+  }
+  return client;
+}
+
+void free_session(session* client) {
+  (void)fclose(client->comm_file);
+  (void)close(client->socket_descriptor);
+  clear_pending_user(client);
+  free(client->output);
+  free(client->sending);
+  free(client);
+}
+
+void clear_pending_user(session* client) {
+  free(client->pending_user.username);
+  free(client->pending_user.password);
+  free(client->pending_user.name);
+  client->pending_user = (user){.userID = -1};
+}
+
+int flush_session(session* client) {
+  if (fflush(client->comm_file) == EOF) {
+    return -1;
+  }
+  while (client->output_sent < client->output_size) {
+    count_io_syscalls(1);
+    ssize_t sent = send(client->socket_descriptor,
+                        client->output + client->output_sent,
+                        client->output_size - client->output_sent,
+                        MSG_NOSIGNAL);
+    if (sent == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN) {
+        return 1;
+      }
+      return -1;
+    }
+    client->output_sent += (size_t)sent;
+  }
+  client->output_size = 0;
+  client->output_sent = 0;
+  return 0;
+}
+
+int take_output(session* client) {
+  if (fflush(client->comm_file) == EOF) {
+    return -1;
+  }
+  if (client->sending_size > 0 || client->output_size == 0) {
+    return 0;
+  }
+  // Swap the buffers instead of copying, so the old sending buffer takes the
+  // next replies.
+  char* spare = client->sending;
+  size_t spare_capacity = client->sending_capacity;
+  client->sending = client->output;
+  client->sending_size = client->output_size;
+  client->sending_capacity = client->output_capacity;
+  client->output = spare;
+  client->output_size = 0;
+  client->output_sent = 0;
+  client->output_capacity = spare_capacity;
+  return 1;
+}
+
+void finish_send(session* client) {
+  client->sending_size = 0;
+}
+
+ssize_t peek_output(session* client, const char** data) {
+  if (fflush(client->comm_file) == EOF) {
+    return -1;
+  }
+  *data = client->output + client->output_sent;
+  return (ssize_t)(client->output_size - client->output_sent);
+}
+
+void consume_output(session* client, size_t size) {
+  client->output_sent += size;
+  if (client->output_sent == client->output_size) {
+    client->output_size = 0;
+    client->output_sent = 0;
+  }
+}
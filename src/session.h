@@ -0,0 +1,177 @@
+#pragma once
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint64_t
+#include <stdio.h>      // FILE
+#include <sys/types.h>  // ssize_t
+
+#include "db.h"           // user
+#include "line_reader.h"  // line_reader
+#include "market_data.h"  // feed_subscription
+#include "timer_wheel.h"  // timer
+
+/**
+ * @enum session_state
+ * @brief Where a client is in the login dialog.
+ *
+ * A client starts in SESSION_CHOOSE, goes through the registration or login
+ * prompts, and can only issue market commands once in SESSION_READY.
+ */
+typedef enum {
+  SESSION_CHOOSE,
+  SESSION_REGISTER_USERNAME,
+  SESSION_REGISTER_NAME,
+  SESSION_REGISTER_PASSWORD,
+  SESSION_LOGIN_USERNAME,
+  SESSION_LOGIN_PASSWORD,
+  SESSION_READY,
+} session_state;
+
+// Group the data needed to serve one connected client.
+typedef struct session {
+  /// The socket descriptor connected to the client.
+  int socket_descriptor;
+  /// A stream for replies. Anything written to it is queued in output below
+  /// when flushed, so writing never blocks on a slow client.
+  FILE* comm_file;
+  /// Where the client is in the login dialog.
+  session_state state;
+  /// The ID of the logged in user, or -1 before login.
+  int userID;
+  /// The user being registered or logged in, filled in prompt by prompt.
+  user pending_user;
+  /// Bytes received from the client that have not been handled yet.
+  line_reader reader;
+  /// Bytes queued for the client.
+  char* output;
+  /// The number of bytes queued in output.
+  size_t output_size;
+  /// The number of queued bytes that have already been sent.
+  size_t output_sent;
+  /// The number of bytes output can hold before needing to be resized.
+  size_t output_capacity;
+  /// Whether the socket was full and the rest of output is waiting to be sent.
+  int awaiting_send;
+  /// Fires when the earliest of the session's deadlines passes. Its data
+  /// points back to the session.
+  timer deadline;
+  /// The tick at which the client connected.
+  uint64_t connected_at;
+  /// The tick at which the client last sent anything.
+  uint64_t last_active_at;
+  /// The tick at which the client started the line it hasn't finished yet.
+  uint64_t partial_since;
+  /// Whether the client has sent part of a line, so partial_since is set.
+  int reading_partial;
+  /// Output handed to the kernel by a completion-based backend. It is kept
+  /// apart from output, so queueing more replies can't move it mid-send.
+  char* sending;
+  /// The number of bytes in sending, or 0 if no send is in flight.
+  size_t sending_size;
+  /// The number of bytes sending can hold.
+  size_t sending_capacity;
+  /// The number of operations a completion-based backend has in flight for
+  /// the session. The session can only be freed once this is 0.
+  int operations;
+  /// Whether the session is shutting down and only waits for its operations
+  /// to finish, or for the events already reported for it to be skipped.
+  int closing;
+  /// The next session waiting to be closed by a backend that closes sessions
+  /// only once it is done with the events it has been handed.
+  struct session* next_closed;
+  /// State of a transport that doesn't go through the socket, such as a
+  /// shared-memory channel, or NULL.
+  void* transport;
+  /// The market data feeds the client is subscribed to.
+  feed_subscription subscription;
+  /// The next subscriber served by the same thread.
+  struct session* next_subscriber;
+  /// The link pointing at this session in its thread's list of subscribers,
+  /// or NULL if it isn't in the list.
+  struct session** pprev_subscriber;
+  /// Whether feed updates were queued and still have to be sent.
+  int feed_ready;
+} session;
+
+/**
+ * Create a new session for a connected client in dynamic memory.
+ *
+ * The session takes ownership of the socket, which is closed when the session
+ * is freed. The caller is responsible for freeing the session afterwards.
+ *
+ * @param socket_descriptor The connected socket for the client.
+ * @return A pointer to the new session, or NULL if memory allocation fails.
+ */
+session* make_session(int socket_descriptor);
+
+/**
+ * Free a session in dynamic memory and close its socket.
+ *
+ * Any output that has not been sent yet is discarded.
+ *
+ * @param client A pointer to the session to free.
+ */
+void free_session(session* client);
+
+/**
+ * Clear the user being registered or logged in, freeing its strings.
+ *
+ * @param client The session whose pending user should be cleared.
+ */
+void clear_pending_user(session* client);
+
+/**
+ * Send as much queued output to the client as the socket accepts.
+ *
+ * Flush the session's stream into its output queue, then write the queue to
+ * the socket until it is empty or the socket would block.
+ *
+ * @param client The session to send output for.
+ * @return 0 if all output was sent, 1 if some output is still queued, or -1
+ * if the connection failed.
+ */
+int flush_session(session* client);
+
+/**
+ * Move queued output into the session's sending buffer.
+ *
+ * This is for I/O backends that hand the bytes to the kernel and learn later
+ * that they were sent. Replies queued while the send is in flight go to a
+ * separate buffer, so the bytes being sent never move. Call finish_send once
+ * the send completes. Don't mix this with flush_session on one session.
+ *
+ * @param client The session to send output for.
+ * @return 1 if sending now holds output to send, 0 if there is nothing to send
+ * or a send is already in flight, or -1 if the output couldn't be flushed.
+ */
+int take_output(session* client);
+
+/**
+ * Mark the send started by take_output as done, freeing the sending buffer
+ * for the next one.
+ *
+ * @param client The session whose send completed.
+ */
+void finish_send(session* client);
+
+/**
+ * Find the queued output that hasn't been sent yet.
+ *
+ * This is for transports that hand output over some other way than the
+ * socket. The session's stream is flushed first. Call consume_output with
+ * the number of bytes handed over.
+ *
+ * @param client The session to send output for.
+ * @param data Where to store the start of the output.
+ * @return The number of bytes at data, or -1 if the output couldn't be
+ * flushed.
+ */
+ssize_t peek_output(session* client, const char** data);
+
+/**
+ * Drop output returned by peek_output once it has been handed over.
+ *
+ * @param client The session the output was queued for.
+ * @param size The number of bytes handed over.
+ */
+void consume_output(session* client, size_t size);
@@ -0,0 +1,121 @@
+#include "settlement.h"
+
+#include <stdlib.h>  // realloc
+#include <string.h>  // memmove, memset
+
+#include "db.h"    // balance_change, add_user_balance_changes
+#include "util.h"  // error_and_exit
+
+// Everything below is only used while holding the lock commands run under.
+
+// Whether changes are held until they are settled.
+static int netting;
+
+// The changes held, one per user, in the order the users were first touched.
+static balance_change* pending;
+static int pending_count;
+static int pending_capacity;
+
+// For each user ID, one more than where the user's change is in pending, or 0
+// if nothing is held for the user.
+static int* pending_index;
+static int index_count;
+
+// Find the slot of a user's index, making room for it if the user is new.
+static int* find_index(int userID) {
+  if (userID >= index_count) {
+    int count = index_count > 0 ? index_count : 64;
+    while (count <= userID) {
+      count *= 2;
+    }
+    int* temp = realloc(pending_index, (size_t)count * sizeof(int));
+    if (temp == NULL) {
+      error_and_exit("Can't allocate balance changes");
+    }
+    memset(temp + index_count, 0, (size_t)(count - index_count) * sizeof(int));
+    pending_index = temp;
+    index_count = count;
+  }
+  return &pending_index[userID];
+}
+
+void start_netting(void) { netting = 1; }
+
+int add_balance_change(sqlite3* database, int userID, int coin,
+                       int64_t amount) {
+  if (!netting) {
+    balance_change change = {.userID = userID};
+    change.amounts[coin] = amount;
+    int written = 0;
+    return add_user_balance_changes(database, &change, 1, &written);
+  }
+  if (userID < 0) {
+    return SQLITE_MISUSE;
+  }
+  int* index = find_index(userID);
+  if (*index == 0) {
+    if (pending_count == pending_capacity) {
+      int capacity = pending_capacity > 0 ? 2 * pending_capacity : 64;
+      balance_change* temp =
+          realloc(pending, (size_t)capacity * sizeof(balance_change));
+      if (temp == NULL) {
+        error_and_exit("Can't allocate balance changes");
+      }
+      pending = temp;
+      pending_capacity = capacity;
+    }
+    pending[pending_count] = (balance_change){.userID = userID};
+    *index = ++pending_count;
+  }
+  pending[*index - 1].amounts[coin] += amount;
+  return SQLITE_OK;
+}
+
+int settle_user(sqlite3* database, int userID) {
+  if (userID < 0 || userID >= index_count || pending_index[userID] == 0) {
+    return SQLITE_OK;
+  }
+  int position = pending_index[userID] - 1;
+  int written = 0;
+  int res =
+      add_user_balance_changes(database, &pending[position], 1, &written);
+  if (res != SQLITE_OK) {
+    return res;
+  }
+  // Fill the gap with the last change, so the rest stay together.
+  pending_index[userID] = 0;
+  --pending_count;
+  if (position != pending_count) {
+    pending[position] = pending[pending_count];
+    pending_index[pending[position].userID] = position + 1;
+  }
+  return SQLITE_OK;
+}
+
+int settle_balances(sqlite3* database) {
+  if (pending_count == 0) {
+    return SQLITE_OK;
+  }
+  int written = 0;
+  int res =
+      add_user_balance_changes(database, pending, pending_count, &written);
+  // Only the changes that weren't written are held on to.
+  for (int i = 0; i < written; ++i) {
+    pending_index[pending[i].userID] = 0;
+  }
+  pending_count -= written;
+  if (pending_count > 0) {
+    memmove(pending, pending + written,
+            (size_t)pending_count * sizeof(balance_change));
+    for (int i = 0; i < pending_count; ++i) {
+      pending_index[pending[i].userID] = i + 1;
+    }
+  }
+  return res;
+}
+
+int stop_netting(sqlite3* database) {
+  int res = settle_balances(database);
+  netting = 0;
+  return res;
+}
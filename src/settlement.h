@@ -0,0 +1,69 @@
+#pragma once
+
+#include <sqlite3.h>  // sqlite3
+#include <stdint.h>   // int64_t
+
+// A fill changes two coin balances of both its buyer and its seller. Rather
+// than reading and rewriting each user's row for every fill, the changes are
+// added up in memory per user and written as one update per user when the
+// batch they belong to commits (see write_behind.h), so a market maker on the
+// other side of hundreds of fills is written once per batch.
+//
+// The balances in the database plus the changes still held are the true
+// ones. Anything that checks or shows a user's balances settles that user
+// first, and the changes are written relative to the row, so code that reads
+// and rewrites a row in the meantime loses nothing.
+
+/**
+ * Start holding balance changes until they are settled.
+ *
+ * Until this is called, and after stop_netting, each change is written
+ * straight away.
+ */
+void start_netting(void);
+
+/**
+ * Add an amount to one of a user's balances.
+ *
+ * Call this while holding the lock commands run under.
+ *
+ * @param database The database the balances are in.
+ * @param userID The user whose balance changes.
+ * @param coin The CoinType of the balance.
+ * @param amount How much to add, negative to take it away.
+ * @return SQLITE_OK on success, or an SQLite error code if the change was
+ * written straight away and failed.
+ */
+int add_balance_change(sqlite3* database, int userID, int coin,
+                       int64_t amount);
+
+/**
+ * Write the changes held for one user, so their balances in the database are
+ * up to date.
+ *
+ * @param database The database the balances are in.
+ * @param userID The user to settle.
+ * @return SQLITE_OK on success, or an SQLite error code on failure, in which
+ * case the changes are still held.
+ */
+int settle_user(sqlite3* database, int userID);
+
+/**
+ * Write the changes held for every user, one update per user.
+ *
+ * Call this before committing the writes the changes came from, so the
+ * balances commit along with the fills.
+ *
+ * @param database The database the balances are in.
+ * @return SQLITE_OK on success, or an SQLite error code on failure, in which
+ * case the changes not yet written are still held.
+ */
+int settle_balances(sqlite3* database);
+
+/**
+ * Write the changes held for every user and stop holding them.
+ *
+ * @param database The database the balances are in.
+ * @return SQLITE_OK on success, or an SQLite error code on failure.
+ */
+int stop_netting(sqlite3* database);
@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+
+#include <errno.h>        // errno, EINTR
+#include <stdint.h>       // uint64_t
+#include <stdio.h>        // puts
+#include <stdlib.h>       // calloc, free
+#include <string.h>       // memcpy
+#include <sys/epoll.h>    // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/eventfd.h>  // eventfd, EFD_NONBLOCK, EFD_CLOEXEC
+#include <sys/mman.h>     // memfd_create, mmap, munmap
+#include <sys/socket.h>   // accept4, sendmsg, SCM_RIGHTS
+#include <unistd.h>       // close, ftruncate, read, write
+
+#include "io_stats.h"
+#include "line_reader.h"
+#include "session.h"
+#include "shm_ring.h"
+#include "timer_wheel.h"
+#include "util.h"
+#include "worker.h"
+
+// The most ready descriptors handled per wait on the event queue.
+enum { MAX_EVENTS = 64 };
+
+// The shared-memory half of a session, kept in the session's transport.
+typedef struct shm_client {
+  /// The session the channel carries lines for.
+  session* client;
+  /// The memory shared with the client.
+  shm_channel* channel;
+  /// The eventfd the client signals when the server should look at the
+  /// channel.
+  int server_event;
+  /// The eventfd the server signals when the client should look at the
+  /// channel.
+  int client_event;
+  /// The next client closed during the current pass of the event loop.
+  struct shm_client* next_closed;
+} shm_client;
+
+// The state of the thread serving shared-memory clients.
+typedef struct {
+  /// The worker this loop runs.
+  worker* self;
+  /// The event queue watching the listener and every client's eventfd and
+  /// socket.
+  int epoll_d;
+  /// Clients closed during the current pass, freed once it is over. A client
+  /// can have events for both of its descriptors in one batch, so it must
+  /// outlive the batch.
+  shm_client* closed;
+} shm_loop;
+
+// Wake up the client.
+static void signal_client(shm_client* peer) {
+  uint64_t one = 1;
+  count_io_syscalls(1);
+  (void)write(peer->client_event, &one, sizeof(one));
+}
+
+// Unmap a channel and close its eventfds, whichever were set up.
+static void close_channel(shm_client* peer) {
+  if (peer->channel != NULL) {
+    (void)munmap(peer->channel, sizeof(shm_channel));
+    peer->channel = NULL;
+  }
+  if (peer->server_event != -1) {
+    (void)close(peer->server_event);
+    peer->server_event = -1;
+  }
+  if (peer->client_event != -1) {
+    (void)close(peer->client_event);
+    peer->client_event = -1;
+  }
+}
+
+// Release a channel and everything set up for it so far.
+static void free_channel(shm_client* peer) {
+  close_channel(peer);
+  free(peer);
+}
+
+// Pass the channel's memory and eventfds to the client over its socket.
+static int send_descriptors(int socket_descriptor, int memory,
+                            const shm_client* peer) {
+  int descriptors[3] = {memory, peer->server_event, peer->client_event};
+  // Ancillary data needs at least one byte of normal data to travel with.
+  char byte = 0;
+  struct iovec payload = {.iov_base = &byte, .iov_len = 1};
+  union {
+    char buffer[CMSG_SPACE(sizeof(descriptors))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr message = {.msg_iov = &payload,
+                           .msg_iovlen = 1,
+                           .msg_control = control.buffer,
+                           .msg_controllen = sizeof(control.buffer)};
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(descriptors));
+  memcpy(CMSG_DATA(header), descriptors, sizeof(descriptors));
+  count_io_syscalls(1);
+  return sendmsg(socket_descriptor, &message, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+// Set up a channel for a newly accepted client and send it over. Return NULL
+// if that failed.
+static shm_client* open_channel(int socket_descriptor) {
+  shm_client* peer = calloc(1, sizeof(shm_client));
+  if (peer == NULL) {
+    return NULL;
+  }
+  peer->server_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  peer->client_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int memory = memfd_create("omg-channel", MFD_CLOEXEC);
+  if (peer->server_event == -1 || peer->client_event == -1 || memory == -1 ||
+      ftruncate(memory, sizeof(shm_channel)) == -1) {
+    if (memory != -1) {
+      (void)close(memory);
+    }
+    free_channel(peer);
+    return NULL;
+  }
+  void* shared = mmap(NULL, sizeof(shm_channel), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, memory, 0);
+  if (shared != MAP_FAILED) {
+    peer->channel = shared;
+    init_shm_ring(&peer->channel->requests);
+    init_shm_ring(&peer->channel->replies);
+  }
+  // The mapping keeps the memory alive once the client has its descriptor.
+  int status = shared == MAP_FAILED
+                   ? -1
+                   : send_descriptors(socket_descriptor, memory, peer);
+  (void)close(memory);
+  if (status == -1) {
+    free_channel(peer);
+    return NULL;
+  }
+  return peer;
+}
+
+// Stop watching a client and release everything it holds, apart from the
+// channel record, which is freed at the end of the pass. The client holds its
+// own copies of the eventfds, so closing ours wouldn't stop epoll from
+// reporting them.
+static void close_client(shm_loop* loop, shm_client* peer) {
+  session* client = peer->client;
+  count_io_syscalls(2);
+  (void)epoll_ctl(loop->epoll_d, EPOLL_CTL_DEL, peer->server_event, NULL);
+  (void)epoll_ctl(loop->epoll_d, EPOLL_CTL_DEL, client->socket_descriptor,
+                  NULL);
+  close_channel(peer);
+  release_session(loop->self, client);
+  peer->client = NULL;
+  peer->next_closed = loop->closed;
+  loop->closed = peer;
+}
+
+// Copy queued replies into the reply ring, waking the client if it waits for
+// them. Whatever doesn't fit stays queued until the client makes room. Return
+// -1 if the session should be closed.
+static int send_replies(shm_client* peer) {
+  shm_ring* replies = &peer->channel->replies;
+  for (;;) {
+    const char* data = NULL;
+    ssize_t size = peek_output(peer->client, &data);
+    if (size <= 0) {
+      return (int)size;
+    }
+    // A client that corrupts the ring is cut off.
+    ssize_t written = write_shm_ring(replies, data, (size_t)size);
+    if (written == -1) {
+      return -1;
+    }
+    consume_output(peer->client, (size_t)written);
+    if (written > 0 && unpark_shm_reader(replies)) {
+      signal_client(peer);
+    }
+    // Stop once everything fit, or the ring is full and the client will say
+    // when it has made room.
+    if (written == size) {
+      return 0;
+    }
+    int parked = park_shm_writer(replies);
+    if (parked != 0) {
+      return parked == 1 ? 0 : -1;
+    }
+  }
+}
+
+// Hand every line waiting in the request ring to the session. Return -1 if
+// the session should be closed.
+static int read_requests(shm_loop* loop, shm_client* peer) {
+  // Only the signal matters, not how many times it was sent.
+  uint64_t signals = 0;
+  count_io_syscalls(1);
+  (void)read(peer->server_event, &signals, sizeof(signals));
+
+  session* client = peer->client;
+  shm_ring* requests = &peer->channel->requests;
+  for (;;) {
+    const char* data = NULL;
+    size_t size = peek_shm_ring(requests, &data);
+    if (size == 0) {
+      // Keep going if the client wrote more while we were busy.
+      if (park_shm_reader(requests)) {
+        return 0;
+      }
+      continue;
+    }
+    // The line reader can hold less than the ring, so feed it in pieces,
+    // taking the lines out in between.
+    while (size > 0) {
+      size_t fed = feed_line_reader(&client->reader, data, size);
+      consume_shm_ring(requests, fed);
+      data += fed;
+      size -= fed;
+      if (handle_lines(loop->self, client) == -1) {
+        return -1;
+      }
+    }
+    if (unpark_shm_writer(requests)) {
+      signal_client(peer);
+    }
+  }
+}
+
+// Disconnect a client whose deadline has passed.
+static void expire_session(timer* deadline, void* context) {
+  shm_loop* loop = context;
+  session* client = deadline->data;
+  queue_timeout_notice(client);
+  (void)send_replies(client->transport);
+  close_client(loop, client->transport);
+}
+
+// Watch a client's eventfd for signals and its socket for hanging up.
+static int watch_client(shm_loop* loop, shm_client* peer) {
+  struct epoll_event signalled = {.events = EPOLLIN, .data.ptr = peer};
+  struct epoll_event hung_up = {.events = EPOLLRDHUP, .data.ptr = peer};
+  count_io_syscalls(2);
+  if (epoll_ctl(loop->epoll_d, EPOLL_CTL_ADD, peer->server_event,
+                &signalled) == -1) {
+    return -1;
+  }
+  if (epoll_ctl(loop->epoll_d, EPOLL_CTL_ADD, peer->client->socket_descriptor,
+                &hung_up) == -1) {
+    (void)epoll_ctl(loop->epoll_d, EPOLL_CTL_DEL, peer->server_event, NULL);
+    return -1;
+  }
+  return 0;
+}
+
+// Accept a new client, give it a channel, and greet it over the channel.
+// Return -1 once nothing more can be accepted for now.
+static int accept_client(shm_loop* loop) {
+  worker* self = loop->self;
+  count_io_syscalls(1);
+  int connect_d =
+      accept4(self->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (connect_d == -1) {
+    return handle_accept_error(self, errno);
+  }
+  shm_client* peer = open_channel(connect_d);
+  if (peer == NULL) {
+    puts("Can't set up shared-memory channel!");
+    (void)close(connect_d);
+    return 0;
+  }
+  session* client = start_session(self, connect_d);
+  if (client == NULL) {
+    free_channel(peer);
+    return 0;
+  }
+  peer->client = client;
+  client->transport = peer;
+  if (watch_client(loop, peer) == -1) {
+    free_channel(peer);
+    release_session(self, client);
+    return 0;
+  }
+  if (send_replies(peer) == -1) {
+    close_client(loop, peer);
+  }
+  return 0;
+}
+
+// Send a subscriber the market data just queued for it.
+static void send_feed(session* client, void* context) {
+  shm_loop* loop = context;
+  if (send_replies(client->transport) == -1) {
+    close_client(loop, client->transport);
+  }
+}
+
+void run_shm_loop(worker* self) {
+  shm_loop loop = {
+      .self = self, .epoll_d = epoll_create1(EPOLL_CLOEXEC), .closed = NULL};
+  if (loop.epoll_d == -1) {
+    error_and_exit("Can't create event queue");
+  }
+  // The listener is the only watched descriptor without a client.
+  struct epoll_event listener_event = {.events = EPOLLIN, .data.ptr = NULL};
+  if (epoll_ctl(loop.epoll_d, EPOLL_CTL_ADD, self->listener,
+                &listener_event) == -1) {
+    error_and_exit("Can't watch listener");
+  }
+  // Neither is the market data signal, which points at itself instead.
+  struct epoll_event feed_event = {.events = EPOLLIN,
+                                   .data.ptr = &self->feed_event};
+  if (epoll_ctl(loop.epoll_d, EPOLL_CTL_ADD, self->feed_event, &feed_event) ==
+      -1) {
+    error_and_exit("Can't watch market data");
+  }
+
+  struct epoll_event events[MAX_EVENTS];
+  for (;;) {
+    // Wake up every tick while any client has a deadline to check.
+    int timeout = self->timers.count > 0 ? TIMER_TICK_MS : -1;
+    count_io_syscalls(1);
+    int ready = epoll_wait(loop.epoll_d, events, MAX_EVENTS, timeout);
+    if (ready == -1) {
+      if (errno != EINTR) {
+        error_and_exit("Can't wait for events");
+      }
+      ready = 0;
+    }
+    (void)advance_timer_wheel(&self->timers, current_tick(), expire_session,
+                              &loop);
+    int feed_signalled = 0;
+    for (int i = 0; i < ready; ++i) {
+      if (events[i].data.ptr == &self->feed_event) {
+        feed_signalled = 1;
+        continue;
+      }
+      shm_client* peer = events[i].data.ptr;
+      if (peer == NULL) {
+        while (accept_client(&loop) == 0) {
+        }
+        continue;
+      }
+      if (peer->client == NULL) {
+        // Closed earlier in this batch.
+        continue;
+      }
+      // Only the socket reports hanging up, and only the eventfd reports
+      // being signalled.
+      if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        close_client(&loop, peer);
+        continue;
+      }
+      if (read_requests(&loop, peer) == -1 || send_replies(peer) == -1) {
+        close_client(&loop, peer);
+      }
+    }
+    if (feed_signalled) {
+      uint64_t signals = 0;
+      count_io_syscalls(1);
+      (void)read(self->feed_event, &signals, sizeof(signals));
+      deliver_market_data(self, send_feed, &loop);
+    }
+    while (loop.closed != NULL) {
+      shm_client* next = loop.closed->next_closed;
+      free(loop.closed);
+      loop.closed = next;
+    }
+  }
+}
@@ -0,0 +1,89 @@
+#include "shm_ring.h"
+
+#include <string.h>  // memcpy
+
+// Turn a position into an index into the ring's data.
+static size_t ring_index(unsigned position) {
+  return position & (SHM_RING_CAPACITY - 1);
+}
+
+void init_shm_ring(shm_ring* ring) {
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->reader_parked, 1);
+  atomic_init(&ring->writer_parked, 0);
+}
+
+ssize_t write_shm_ring(shm_ring* ring, const char* data, size_t size) {
+  unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  // The reader can write to the head, so don't trust it to be in range.
+  if (tail - head > SHM_RING_CAPACITY) {
+    return -1;
+  }
+  size_t room = SHM_RING_CAPACITY - (size_t)(tail - head);
+  if (size > room) {
+    size = room;
+  }
+  // The bytes may wrap around the end of the ring.
+  size_t start = ring_index(tail);
+  size_t first = SHM_RING_CAPACITY - start;
+  if (first > size) {
+    first = size;
+  }
+  memcpy(ring->data + start, data, first);
+  memcpy(ring->data, data + first, size - first);
+  // Every pending wakeup is decided by comparing positions with the parked
+  // flags, so publish the tail in the same total order as them.
+  atomic_store(&ring->tail, tail + (unsigned)size);
+  return (ssize_t)size;
+}
+
+size_t peek_shm_ring(shm_ring* ring, const char** data) {
+  unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  size_t start = ring_index(head);
+  size_t size = (size_t)(tail - head);
+  if (size > SHM_RING_CAPACITY - start) {
+    size = SHM_RING_CAPACITY - start;
+  }
+  *data = ring->data + start;
+  return size;
+}
+
+void consume_shm_ring(shm_ring* ring, size_t size) {
+  unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  atomic_store(&ring->head, head + (unsigned)size);
+}
+
+int park_shm_reader(shm_ring* ring) {
+  atomic_store(&ring->reader_parked, 1);
+  // Check again, since the writer may have written just before seeing the
+  // flag and so won't wake the reader.
+  if (atomic_load(&ring->tail) != atomic_load(&ring->head)) {
+    atomic_store(&ring->reader_parked, 0);
+    return 0;
+  }
+  return 1;
+}
+
+int park_shm_writer(shm_ring* ring) {
+  atomic_store(&ring->writer_parked, 1);
+  unsigned used = atomic_load(&ring->tail) - atomic_load(&ring->head);
+  if (used > SHM_RING_CAPACITY) {
+    return -1;
+  }
+  if (used < SHM_RING_CAPACITY) {
+    atomic_store(&ring->writer_parked, 0);
+    return 0;
+  }
+  return 1;
+}
+
+int unpark_shm_reader(shm_ring* ring) {
+  return atomic_exchange(&ring->reader_parked, 0) != 0;
+}
+
+int unpark_shm_writer(shm_ring* ring) {
+  return atomic_exchange(&ring->writer_parked, 0) != 0;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdalign.h>   // alignas
+#include <stdatomic.h>  // atomic_uint
+#include <stddef.h>     // size_t
+#include <sys/types.h>  // ssize_t
+
+// The number of bytes each ring can hold. A power of two, so positions can
+// run freely and wrap with a mask.
+enum { SHM_RING_CAPACITY = 1 << 16 };
+
+// The size of a cache line, which the two ends of a ring keep apart on so
+// they don't slow each other down.
+enum { SHM_CACHE_LINE = 64 };
+
+// A single-producer, single-consumer byte ring in memory shared by two
+// processes. Positions only ever grow; the bytes between head and tail are
+// waiting to be read.
+//
+// Either end can park, telling the other end to wake it through an eventfd
+// the next time it makes progress, instead of being woken on every write.
+typedef struct {
+  /// Where the reader will read next. Only the reader moves it.
+  alignas(SHM_CACHE_LINE) atomic_uint head;
+  /// Whether the reader is waiting to be woken once there is data.
+  atomic_uint reader_parked;
+  /// Where the writer will write next. Only the writer moves it.
+  alignas(SHM_CACHE_LINE) atomic_uint tail;
+  /// Whether the writer is waiting to be woken once there is room.
+  atomic_uint writer_parked;
+  /// The bytes in the ring.
+  alignas(SHM_CACHE_LINE) char data[SHM_RING_CAPACITY];
+} shm_ring;
+
+// The memory shared between the server and one client: lines go to the
+// server through requests and replies come back through replies, in the same
+// protocol as over a socket.
+typedef struct {
+  /// Lines from the client, read by the server.
+  shm_ring requests;
+  /// Replies from the server, read by the client.
+  shm_ring replies;
+} shm_channel;
+
+/**
+ * Initialize an empty ring with both ends parked, so the first write on
+ * either side wakes the other.
+ *
+ * @param ring The ring to initialize.
+ */
+void init_shm_ring(shm_ring* ring);
+
+/**
+ * Copy as many bytes into a ring as there is room for.
+ *
+ * Only the writing end may call this.
+ *
+ * @param ring The ring to write to.
+ * @param data The bytes to write.
+ * @param size The number of bytes to write.
+ * @return The number of bytes written, which is less than size if the ring
+ * filled up, or -1 if the reader has moved its head out of range, in which
+ * case nothing is written.
+ */
+ssize_t write_shm_ring(shm_ring* ring, const char* data, size_t size);
+
+/**
+ * Find the bytes waiting in a ring that can be read in one piece.
+ *
+ * Only the reading end may call this. The bytes stay in the ring until
+ * consume_shm_ring is called, so they can be used without copying.
+ *
+ * @param ring The ring to read from.
+ * @param data Where to store the start of the bytes.
+ * @return The number of bytes at data, which is 0 if the ring is empty. More
+ * may follow at the start of the ring once these are consumed.
+ */
+size_t peek_shm_ring(shm_ring* ring, const char** data);
+
+/**
+ * Give bytes returned by peek_shm_ring back to the writer.
+ *
+ * @param ring The ring the bytes were read from.
+ * @param size The number of bytes to give back.
+ */
+void consume_shm_ring(shm_ring* ring, size_t size);
+
+/**
+ * Ask to be woken once a ring has data, before the reader goes to sleep.
+ *
+ * @param ring The ring the reader waits on.
+ * @return 1 if the ring is still empty and the reader should sleep, or 0 if
+ * data arrived in the meantime and should be read first.
+ */
+int park_shm_reader(shm_ring* ring);
+
+/**
+ * Ask to be woken once a ring has room, before the writer goes to sleep.
+ *
+ * @param ring The ring the writer waits on.
+ * @return 1 if the ring is still full and the writer should sleep, 0 if
+ * room was made in the meantime and the writer should try again first, or -1
+ * if the reader has moved its head out of range.
+ */
+int park_shm_writer(shm_ring* ring);
+
+/**
+ * Check after writing whether the reader of a ring has to be woken.
+ *
+ * @param ring The ring just written to.
+ * @return 1 if the reader was parked and must be signalled, or 0 if not.
+ */
+int unpark_shm_reader(shm_ring* ring);
+
+/**
+ * Check after consuming whether the writer of a ring has to be woken.
+ *
+ * @param ring The ring just consumed from.
+ * @return 1 if the writer was parked and must be signalled, or 0 if not.
+ */
+int unpark_shm_writer(shm_ring* ring);
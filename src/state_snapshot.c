@@ -0,0 +1,523 @@
+#include "state_snapshot.h"
+
+#include <errno.h>     // errno, ENOENT, EINTR
+#include <fcntl.h>     // open, O_CREAT, O_WRONLY, O_TRUNC, O_CLOEXEC
+#include <stdio.h>     // fprintf, snprintf, rename
+#include <stdlib.h>    // malloc, realloc, free
+#include <string.h>    // memcpy, memcmp, memchr, strlen
+#include <sys/mman.h>  // mmap, munmap
+#include <sys/stat.h>  // fstat
+#include <time.h>      // time, clock_gettime
+#include <unistd.h>    // write, fdatasync, close
+
+#include "fixed_point.h"  // price_to_ticks, ticks_to_price
+#include "journal.h"      // get_journal_sequence
+#include "settlement.h"   // settle_balances
+#include "util.h"         // error_and_exit, crc32
+
+static const char MAGIC[8] = "OMGSNAP";
+enum { FORMAT_VERSION = 1 };
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// A snapshot being put together in memory, one array at a time.
+typedef struct {
+  snapshot_user* users;
+  size_t user_count;
+  size_t user_capacity;
+  snapshot_order* orders;
+  size_t order_count;
+  size_t order_capacity;
+  snapshot_counter* counters;
+  size_t counter_count;
+  size_t counter_capacity;
+  char* strings;
+  size_t strings_size;
+  size_t strings_capacity;
+} state_image;
+
+// Make room for one more element at the end of an array, doubling it when it
+// is full.
+static void* grow_array(void* array, size_t count, size_t* capacity,
+                        size_t element_size) {
+  if (count < *capacity) {
+    return array;
+  }
+  *capacity = *capacity == 0 ? 64 : *capacity * 2;
+  array = realloc(array, *capacity * element_size);
+  if (array == NULL) {
+    error_and_exit("Can't allocate snapshot");
+  }
+  return array;
+}
+
+// Copy a string and its null terminator to the end of the image's strings,
+// returning where it starts.
+static uint64_t add_string(state_image* image, const unsigned char* text) {
+  const char* value = text == NULL ? "" : (const char*)text;
+  size_t length = strlen(value) + 1;
+  while (image->strings_size + length > image->strings_capacity) {
+    image->strings_capacity =
+        image->strings_capacity == 0 ? 4096 : image->strings_capacity * 2;
+    image->strings = realloc(image->strings, image->strings_capacity);
+    if (image->strings == NULL) {
+      error_and_exit("Can't allocate snapshot");
+    }
+  }
+  uint64_t offset = image->strings_size;
+  memcpy(image->strings + offset, value, length);
+  image->strings_size += length;
+  return offset;
+}
+
+static void free_state_image(state_image* image) {
+  free(image->users);
+  free(image->orders);
+  free(image->counters);
+  free(image->strings);
+  *image = (state_image){0};
+}
+
+// Run a query and hand each of its rows to a function. Return 0 on success, or
+// -1 on failure.
+static int for_each_row(sqlite3* database, const char* sql,
+                        void (*add_row)(sqlite3_stmt*, state_image*),
+                        state_image* image) {
+  sqlite3_stmt* stmt = NULL;
+  if (sqlite3_prepare_v2(database, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    fprintf(stderr, "Failed to prepare statement: %s\n",
+            sqlite3_errmsg(database));
+    return -1;
+  }
+  int rc = 0;
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    add_row(stmt, image);
+  }
+  if (rc != SQLITE_DONE) {
+    fprintf(stderr, "Failed to read the market: %s\n",
+            sqlite3_errmsg(database));
+  }
+  sqlite3_finalize(stmt);
+  return rc == SQLITE_DONE ? 0 : -1;
+}
+
+static void add_user(sqlite3_stmt* stmt, state_image* image) {
+  image->users = grow_array(image->users, image->user_count,
+                            &image->user_capacity, sizeof(snapshot_user));
+  snapshot_user* user = &image->users[image->user_count++];
+  *user = (snapshot_user){.userID = sqlite3_column_int64(stmt, 0)};
+  user->username_offset = add_string(image, sqlite3_column_text(stmt, 1));
+  user->name_offset = add_string(image, sqlite3_column_text(stmt, 2));
+  user->password_offset = add_string(image, sqlite3_column_text(stmt, 3));
+  for (int coin = 0; coin < 4; ++coin) {
+    user->balances[coin] = sqlite3_column_int64(stmt, 4 + coin);
+  }
+}
+
+static void add_order(sqlite3_stmt* stmt, state_image* image) {
+  image->orders = grow_array(image->orders, image->order_count,
+                             &image->order_capacity, sizeof(snapshot_order));
+  image->orders[image->order_count++] = (snapshot_order){
+      .orderID = sqlite3_column_int64(stmt, 0),
+      .item = sqlite3_column_int(stmt, 1),
+      .buyOrSell = sqlite3_column_int(stmt, 2),
+      .quantity = sqlite3_column_int64(stmt, 3),
+      .price = price_to_ticks(sqlite3_column_double(stmt, 4)),
+      .userID = sqlite3_column_int64(stmt, 5),
+      .created_at = sqlite3_column_int64(stmt, 6),
+  };
+}
+
+static void add_counter(sqlite3_stmt* stmt, state_image* image) {
+  const unsigned char* table = sqlite3_column_text(stmt, 0);
+  if (table == NULL ||
+      strlen((const char*)table) >= SNAPSHOT_TABLE_NAME_SIZE) {
+    return;
+  }
+  image->counters =
+      grow_array(image->counters, image->counter_count,
+                 &image->counter_capacity, sizeof(snapshot_counter));
+  snapshot_counter* counter = &image->counters[image->counter_count++];
+  *counter = (snapshot_counter){.sequence = sqlite3_column_int64(stmt, 1)};
+  (void)snprintf(counter->table, sizeof(counter->table), "%s", table);
+}
+
+// Copy the market out of the database. Return 0 on success, or -1 on failure.
+static int capture_state(sqlite3* database, state_image* image) {
+  // The balance changes still held are part of the market too.
+  if (settle_balances(database) != SQLITE_OK ||
+      for_each_row(database,
+                   "SELECT userID, username, name, password, OMG, DOGE, BTC, "
+                   "ETH FROM users ORDER BY userID;",
+                   add_user, image) == -1 ||
+      for_each_row(database,
+                   "SELECT orderID, item, buyOrSell, quantity, unitPrice, "
+                   "userID, CAST(strftime('%s', created_at) AS INTEGER) "
+                   "FROM orders ORDER BY orderID;",
+                   add_order, image) == -1 ||
+      for_each_row(database, "SELECT name, seq FROM sqlite_sequence;",
+                   add_counter, image) == -1) {
+    free_state_image(image);
+    return -1;
+  }
+  return 0;
+}
+
+// Lay an image out as a snapshot file in one block of memory, which the caller
+// frees.
+static uint8_t* assemble_snapshot(const state_image* image,
+                                  uint64_t journal_sequence, size_t* size) {
+  snapshot_header header = {
+      .version = FORMAT_VERSION,
+      .byte_order = BYTE_ORDER_MARK,
+      .journal_sequence = journal_sequence,
+      .created_at = (int64_t)time(NULL),
+      .user_count = image->user_count,
+      .order_count = image->order_count,
+      .counter_count = image->counter_count,
+      .strings_size = image->strings_size,
+  };
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.users_offset = sizeof(header);
+  header.orders_offset =
+      header.users_offset + image->user_count * sizeof(snapshot_user);
+  header.counters_offset =
+      header.orders_offset + image->order_count * sizeof(snapshot_order);
+  header.strings_offset = header.counters_offset +
+                          image->counter_count * sizeof(snapshot_counter);
+  header.file_size = header.strings_offset + image->strings_size;
+
+  uint8_t* file = malloc(header.file_size);
+  if (file == NULL) {
+    error_and_exit("Can't allocate snapshot");
+  }
+  if (image->user_count > 0) {
+    memcpy(file + header.users_offset, image->users,
+           image->user_count * sizeof(snapshot_user));
+  }
+  if (image->order_count > 0) {
+    memcpy(file + header.orders_offset, image->orders,
+           image->order_count * sizeof(snapshot_order));
+  }
+  if (image->counter_count > 0) {
+    memcpy(file + header.counters_offset, image->counters,
+           image->counter_count * sizeof(snapshot_counter));
+  }
+  if (image->strings_size > 0) {
+    memcpy(file + header.strings_offset, image->strings, image->strings_size);
+  }
+  header.checksum =
+      crc32(file + sizeof(header), header.file_size - sizeof(header));
+  memcpy(file, &header, sizeof(header));
+  *size = header.file_size;
+  return file;
+}
+
+// Write a snapshot next to its file, sync it and move it into place. Return 0
+// on success, or -1 on failure.
+static int write_snapshot(const uint8_t* file, size_t size, const char* path) {
+  char temporary[4096];
+  if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >=
+      (int)sizeof(temporary)) {
+    return -1;
+  }
+  int fd = open(temporary, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    return -1;
+  }
+  size_t written = 0;
+  while (written < size) {
+    ssize_t count = write(fd, file + written, size - written);
+    if (count == -1 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      (void)close(fd);
+      return -1;
+    }
+    written += (size_t)count;
+  }
+  if (fdatasync(fd) == -1) {
+    (void)close(fd);
+    return -1;
+  }
+  if (close(fd) == -1 || rename(temporary, path) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+int take_state_snapshot(sqlite3* database, uint64_t journal_sequence,
+                        const char* path) {
+  state_image image = {0};
+  if (capture_state(database, &image) == -1) {
+    return -1;
+  }
+  size_t size = 0;
+  uint8_t* file = assemble_snapshot(&image, journal_sequence, &size);
+  free_state_image(&image);
+  int result = write_snapshot(file, size, path);
+  free(file);
+  return result;
+}
+
+// Whether an array of count elements of a size fits in the file from offset,
+// on an 8-byte boundary.
+static int array_fits(uint64_t offset, uint64_t count, size_t element_size,
+                      uint64_t file_size) {
+  return offset % 8 == 0 && offset <= file_size &&
+         count <= (file_size - offset) / element_size;
+}
+
+// Check that a mapped file is a whole, undamaged snapshot of this layout.
+static int validate_snapshot(const uint8_t* file, size_t size) {
+  if (size < sizeof(snapshot_header)) {
+    return -1;
+  }
+  const snapshot_header* header = (const snapshot_header*)file;
+  if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header->version != FORMAT_VERSION ||
+      header->byte_order != BYTE_ORDER_MARK || header->file_size != size ||
+      !array_fits(header->users_offset, header->user_count,
+                  sizeof(snapshot_user), size) ||
+      !array_fits(header->orders_offset, header->order_count,
+                  sizeof(snapshot_order), size) ||
+      !array_fits(header->counters_offset, header->counter_count,
+                  sizeof(snapshot_counter), size) ||
+      header->strings_offset > size ||
+      header->strings_size > size - header->strings_offset) {
+    return -1;
+  }
+  if (crc32(file + sizeof(*header), size - sizeof(*header)) !=
+      header->checksum) {
+    return -1;
+  }
+  // Every string has to end inside the strings, and every name in its record.
+  const char* strings = (const char*)file + header->strings_offset;
+  if (header->strings_size > 0 && strings[header->strings_size - 1] != '\0') {
+    return -1;
+  }
+  const snapshot_user* users =
+      (const snapshot_user*)(file + header->users_offset);
+  for (uint64_t i = 0; i < header->user_count; ++i) {
+    if (users[i].username_offset >= header->strings_size ||
+        users[i].name_offset >= header->strings_size ||
+        users[i].password_offset >= header->strings_size) {
+      return -1;
+    }
+  }
+  const snapshot_counter* counters =
+      (const snapshot_counter*)(file + header->counters_offset);
+  for (uint64_t i = 0; i < header->counter_count; ++i) {
+    if (memchr(counters[i].table, '\0', sizeof(counters[i].table)) == NULL) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Insert a validated snapshot's rows. Return 0 on success, or -1 on failure.
+static int insert_snapshot(sqlite3* database, const uint8_t* file) {
+  const snapshot_header* header = (const snapshot_header*)file;
+  const snapshot_user* users =
+      (const snapshot_user*)(file + header->users_offset);
+  const snapshot_order* orders =
+      (const snapshot_order*)(file + header->orders_offset);
+  const snapshot_counter* counters =
+      (const snapshot_counter*)(file + header->counters_offset);
+  const char* strings = (const char*)file + header->strings_offset;
+
+  sqlite3_stmt* insert_user = NULL;
+  sqlite3_stmt* insert_order = NULL;
+  sqlite3_stmt* update_counter = NULL;
+  sqlite3_stmt* insert_counter = NULL;
+  int rc = SQLITE_OK;
+  if (sqlite3_prepare_v2(database,
+                         "INSERT INTO users (userID, username, name, "
+                         "password, OMG, DOGE, BTC, ETH) "
+                         "VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
+                         -1, &insert_user, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(database,
+                         "INSERT INTO orders (orderID, item, buyOrSell, "
+                         "quantity, unitPrice, userID, created_at) "
+                         "VALUES (?, ?, ?, ?, ?, ?, datetime(?, 'unixepoch'));",
+                         -1, &insert_order, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(database,
+                         "UPDATE sqlite_sequence SET seq = ?2 WHERE name = ?1;",
+                         -1, &update_counter, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(database,
+                         "INSERT INTO sqlite_sequence (name, seq) "
+                         "VALUES (?1, ?2);",
+                         -1, &insert_counter, NULL) != SQLITE_OK) {
+    rc = SQLITE_ERROR;
+  }
+
+  for (uint64_t i = 0; rc == SQLITE_OK && i < header->user_count; ++i) {
+    const snapshot_user* user = &users[i];
+    sqlite3_bind_int64(insert_user, 1, user->userID);
+    sqlite3_bind_text(insert_user, 2, strings + user->username_offset, -1,
+                      SQLITE_STATIC);
+    sqlite3_bind_text(insert_user, 3, strings + user->name_offset, -1,
+                      SQLITE_STATIC);
+    sqlite3_bind_text(insert_user, 4, strings + user->password_offset, -1,
+                      SQLITE_STATIC);
+    for (int coin = 0; coin < 4; ++coin) {
+      sqlite3_bind_int64(insert_user, 5 + coin, user->balances[coin]);
+    }
+    rc = sqlite3_step(insert_user) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+    sqlite3_reset(insert_user);
+  }
+  for (uint64_t i = 0; rc == SQLITE_OK && i < header->order_count; ++i) {
+    const snapshot_order* order = &orders[i];
+    sqlite3_bind_int64(insert_order, 1, order->orderID);
+    sqlite3_bind_int(insert_order, 2, order->item);
+    sqlite3_bind_int(insert_order, 3, order->buyOrSell);
+    sqlite3_bind_int64(insert_order, 4, order->quantity);
+    sqlite3_bind_double(insert_order, 5, ticks_to_price(order->price));
+    sqlite3_bind_int64(insert_order, 6, order->userID);
+    sqlite3_bind_int64(insert_order, 7, order->created_at);
+    rc = sqlite3_step(insert_order) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+    sqlite3_reset(insert_order);
+  }
+  // Inserting with IDs only raises a counter to the largest ID inserted, and
+  // the IDs of orders since filled or cancelled were handed out too.
+  for (uint64_t i = 0; rc == SQLITE_OK && i < header->counter_count; ++i) {
+    sqlite3_bind_text(update_counter, 1, counters[i].table, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(update_counter, 2, counters[i].sequence);
+    rc = sqlite3_step(update_counter) == SQLITE_DONE ? SQLITE_OK
+                                                     : SQLITE_ERROR;
+    sqlite3_reset(update_counter);
+    if (rc == SQLITE_OK && sqlite3_changes(database) == 0) {
+      sqlite3_bind_text(insert_counter, 1, counters[i].table, -1,
+                        SQLITE_STATIC);
+      sqlite3_bind_int64(insert_counter, 2, counters[i].sequence);
+      rc = sqlite3_step(insert_counter) == SQLITE_DONE ? SQLITE_OK
+                                                       : SQLITE_ERROR;
+      sqlite3_reset(insert_counter);
+    }
+  }
+  if (rc != SQLITE_OK) {
+    fprintf(stderr, "Failed to restore the snapshot: %s\n",
+            sqlite3_errmsg(database));
+  }
+  sqlite3_finalize(insert_user);
+  sqlite3_finalize(insert_order);
+  sqlite3_finalize(update_counter);
+  sqlite3_finalize(insert_counter);
+  return rc == SQLITE_OK ? 0 : -1;
+}
+
+int restore_state_snapshot(sqlite3* database, const char* path,
+                           uint64_t* journal_sequence) {
+  *journal_sequence = 0;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return errno == ENOENT ? 0 : -1;
+  }
+  struct stat status;
+  if (fstat(fd, &status) == -1 || status.st_size <= 0) {
+    (void)close(fd);
+    return -1;
+  }
+  size_t size = (size_t)status.st_size;
+  void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  (void)close(fd);
+  if (mapped == MAP_FAILED) {
+    return -1;
+  }
+  const uint8_t* file = mapped;
+  int result = validate_snapshot(file, size);
+  if (result == 0) {
+    // One transaction for the whole snapshot, rather than one per row.
+    result = sqlite3_exec(database, "BEGIN;", 0, 0, NULL) == SQLITE_OK &&
+                     insert_snapshot(database, file) == 0 &&
+                     sqlite3_exec(database, "COMMIT;", 0, 0, NULL) ==
+                         SQLITE_OK
+                 ? 0
+                 : -1;
+    if (result == -1 && !sqlite3_get_autocommit(database)) {
+      (void)sqlite3_exec(database, "ROLLBACK;", 0, 0, NULL);
+    }
+  }
+  if (result == 0) {
+    *journal_sequence = ((const snapshot_header*)file)->journal_sequence;
+  }
+  (void)munmap(mapped, size);
+  return result;
+}
+
+// Everything below is only used while holding the lock handed to
+// start_state_snapshots, apart from the thread handle and the path.
+
+static sqlite3* snapshot_database;
+static pthread_mutex_t* snapshot_lock;
+static const char* snapshot_path;
+static pthread_t snapshot_thread;
+// Whether the snapshot thread should keep going.
+static int snapshotting;
+// Signalled to wake the snapshot thread before its interval is up.
+static pthread_cond_t snapshot_requested;
+
+static void* run_snapshots(void* arg) {
+  (void)arg;
+  (void)pthread_mutex_lock(snapshot_lock);
+  int running = 1;
+  while (running) {
+    if (snapshotting) {
+      struct timespec deadline;
+      (void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += SNAPSHOT_INTERVAL_SECONDS;
+      (void)pthread_cond_timedwait(&snapshot_requested, snapshot_lock,
+                                   &deadline);
+    }
+    // Stopping takes one last snapshot, so the next start replays little.
+    running = snapshotting;
+    state_image image = {0};
+    uint64_t sequence = get_journal_sequence();
+    int captured = capture_state(snapshot_database, &image);
+
+    // Writing the file doesn't touch the market, so commands carry on.
+    (void)pthread_mutex_unlock(snapshot_lock);
+    if (captured == 0) {
+      size_t size = 0;
+      uint8_t* file = assemble_snapshot(&image, sequence, &size);
+      free_state_image(&image);
+      if (write_snapshot(file, size, snapshot_path) == -1) {
+        perror("Failed to write a snapshot");
+      }
+      free(file);
+    }
+    (void)pthread_mutex_lock(snapshot_lock);
+  }
+  (void)pthread_mutex_unlock(snapshot_lock);
+  return NULL;
+}
+
+void start_state_snapshots(sqlite3* database, pthread_mutex_t* lock,
+                           const char* path) {
+  pthread_condattr_t attributes;
+  if (pthread_condattr_init(&attributes) != 0 ||
+      pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC) != 0 ||
+      pthread_cond_init(&snapshot_requested, &attributes) != 0) {
+    error_and_exit("Can't set up the snapshot thread");
+  }
+  (void)pthread_condattr_destroy(&attributes);
+
+  snapshot_database = database;
+  snapshot_lock = lock;
+  snapshot_path = path;
+  snapshotting = 1;
+  if (pthread_create(&snapshot_thread, NULL, run_snapshots, NULL) != 0) {
+    error_and_exit("Can't start the snapshot thread");
+  }
+}
+
+void stop_state_snapshots(void) {
+  if (snapshot_lock == NULL) {
+    return;
+  }
+  (void)pthread_mutex_lock(snapshot_lock);
+  snapshotting = 0;
+  (void)pthread_cond_signal(&snapshot_requested);
+  (void)pthread_mutex_unlock(snapshot_lock);
+  (void)pthread_join(snapshot_thread, NULL);
+}
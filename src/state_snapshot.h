@@ -0,0 +1,130 @@
+#pragma once
+
+#include <pthread.h>  // pthread_mutex_t
+#include <sqlite3.h>  // sqlite3
+#include <stdint.h>   // int64_t, uint32_t, uint64_t
+
+// A state snapshot is a copy of everything live in the market, the users and
+// their balances, the open orders and the next IDs to hand out, tagged with
+// the last journal entry it includes. Restarting restores the latest one and
+// replays only the journal entries after it, rather than every command ever
+// accepted.
+//
+// The file is laid out as it is in memory, so it is read by mapping it rather
+// than parsing it: a header, then arrays of fixed-size records, then the
+// users' null-terminated strings. Every offset is in bytes from the start of
+// the file, and every array starts on an 8-byte boundary.
+
+// How often the market is snapshotted while the server runs, in seconds.
+enum { SNAPSHOT_INTERVAL_SECONDS = 60 };
+
+// The size of a counter's table name, including the null terminator.
+enum { SNAPSHOT_TABLE_NAME_SIZE = 24 };
+
+// The start of every snapshot file.
+typedef struct {
+  /// "OMGSNAP" and a null terminator.
+  char magic[8];
+  /// The version of the layout, which changes whenever any record does.
+  uint32_t version;
+  /// 0x01020304 as written, so a file from a machine of the other byte order
+  /// is turned away.
+  uint32_t byte_order;
+  /// The sequence number of the last journal entry the snapshot includes.
+  uint64_t journal_sequence;
+  /// When the snapshot was taken, in seconds since the Unix epoch.
+  int64_t created_at;
+  /// The size of the whole file, in bytes.
+  uint64_t file_size;
+  uint64_t user_count;
+  uint64_t users_offset;
+  uint64_t order_count;
+  uint64_t orders_offset;
+  uint64_t counter_count;
+  uint64_t counters_offset;
+  uint64_t strings_size;
+  uint64_t strings_offset;
+  /// The CRC-32 of everything after the header.
+  uint32_t checksum;
+  uint32_t reserved;
+} snapshot_header;
+
+// A user and their balances.
+typedef struct {
+  int64_t userID;
+  /// Indexed by CoinType.
+  int64_t balances[4];
+  /// Where the user's strings start, from the start of the strings.
+  uint64_t username_offset;
+  uint64_t name_offset;
+  uint64_t password_offset;
+} snapshot_user;
+
+// An open order.
+typedef struct {
+  int64_t orderID;
+  int64_t userID;
+  int64_t quantity;
+  /// The unit price, in ticks.
+  int64_t price;
+  /// When the order was placed, in seconds since the Unix epoch.
+  int64_t created_at;
+  int32_t item;
+  int32_t buyOrSell;
+} snapshot_order;
+
+// The last ID handed out for a table, so IDs are never reused.
+typedef struct {
+  char table[SNAPSHOT_TABLE_NAME_SIZE];
+  int64_t sequence;
+} snapshot_counter;
+
+/**
+ * Snapshot a database's users, open orders and ID counters to a file.
+ *
+ * The file is written under a temporary name, synced and then renamed, so a
+ * crash leaves either the old snapshot or the new one.
+ *
+ * @param database The database to copy.
+ * @param journal_sequence The last journal entry the database includes.
+ * @param path The snapshot's file.
+ * @return 0 on success, or -1 on failure.
+ */
+int take_state_snapshot(sqlite3* database, uint64_t journal_sequence,
+                        const char* path);
+
+/**
+ * Copy a snapshot into an empty database.
+ *
+ * The users and orders keep their IDs, and new ones carry on from the
+ * snapshot's counters. Everything is inserted in one transaction.
+ *
+ * @param database The database, with its tables created and empty.
+ * @param path The snapshot's file.
+ * @param journal_sequence Where to store the last journal entry the snapshot
+ * includes, or 0 if there is no snapshot yet.
+ * @return 0 on success, including when there is no snapshot yet, or -1 if the
+ * file couldn't be read, isn't a snapshot or is damaged.
+ */
+int restore_state_snapshot(sqlite3* database, const char* path,
+                           uint64_t* journal_sequence);
+
+/**
+ * Start a thread that snapshots the market every SNAPSHOT_INTERVAL_SECONDS.
+ *
+ * The thread copies the market into memory while holding the lock, so the
+ * copy matches the journal, then writes the file without it, so commands keep
+ * running meanwhile. Exits the program if the thread can't be started.
+ *
+ * @param database The database commands write to.
+ * @param lock The lock commands are handled under.
+ * @param path The snapshot's file.
+ */
+void start_state_snapshots(sqlite3* database, pthread_mutex_t* lock,
+                           const char* path);
+
+/**
+ * Take a last snapshot and stop the thread started by start_state_snapshots,
+ * if it is running.
+ */
+void stop_state_snapshots(void);
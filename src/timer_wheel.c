@@ -0,0 +1,123 @@
+#include "timer_wheel.h"
+
+#include <stddef.h>  // NULL, size_t
+#include <stdint.h>  // uint64_t
+
+// The largest number of ticks ahead a timer can be placed.
+static const uint64_t MAX_DELAY =
+    ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+
+// Return the slot a tick falls into on a level.
+static size_t slot_index(uint64_t tick, int level) {
+  return (size_t)(tick >> (TIMER_WHEEL_BITS * level)) &
+         (TIMER_WHEEL_SLOTS - 1);
+}
+
+// Put a timer into the slot its expiry falls into, given how far away it is.
+static void place_timer(timer_wheel* wheel, timer* deadline) {
+  uint64_t delay = deadline->expires - wheel->current;
+  int level = 0;
+  while (level < TIMER_WHEEL_LEVELS - 1 &&
+         delay >= (uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1))) {
+    ++level;
+  }
+  timer** head = &wheel->slots[level][slot_index(deadline->expires, level)];
+  deadline->next = *head;
+  if (*head != NULL) {
+    (*head)->pprev = &deadline->next;
+  }
+  *head = deadline;
+  deadline->pprev = head;
+}
+
+// Take a timer out of its slot.
+static void unlink_timer(timer* deadline) {
+  *deadline->pprev = deadline->next;
+  if (deadline->next != NULL) {
+    deadline->next->pprev = deadline->pprev;
+  }
+  deadline->next = NULL;
+  deadline->pprev = NULL;
+}
+
+// Move the timers in the current slot of a level down to the levels below,
+// now that they are close enough. Return whether the level above should do
+// the same because this level has just wrapped around.
+static int cascade(timer_wheel* wheel, int level) {
+  size_t index = slot_index(wheel->current, level);
+  timer* pending = wheel->slots[level][index];
+  wheel->slots[level][index] = NULL;
+  while (pending != NULL) {
+    timer* next = pending->next;
+    place_timer(wheel, pending);
+    pending = next;
+  }
+  return index == 0;
+}
+
+void init_timer_wheel(timer_wheel* wheel, uint64_t now) {
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+    for (size_t i = 0; i < TIMER_WHEEL_SLOTS; ++i) {
+      wheel->slots[level][i] = NULL;
+    }
+  }
+  wheel->current = now;
+  wheel->count = 0;
+}
+
+void init_timer(timer* deadline, void* data) {
+  deadline->next = NULL;
+  deadline->pprev = NULL;
+  deadline->expires = 0;
+  deadline->data = data;
+}
+
+void schedule_timer(timer_wheel* wheel, timer* deadline, uint64_t expires) {
+  cancel_timer(wheel, deadline);
+  if (expires <= wheel->current) {
+    expires = wheel->current + 1;
+  } else if (expires - wheel->current > MAX_DELAY) {
+    expires = wheel->current + MAX_DELAY;
+  }
+  deadline->expires = expires;
+  place_timer(wheel, deadline);
+  ++wheel->count;
+}
+
+void cancel_timer(timer_wheel* wheel, timer* deadline) {
+  if (deadline->pprev == NULL) {
+    return;
+  }
+  unlink_timer(deadline);
+  --wheel->count;
+}
+
+size_t advance_timer_wheel(timer_wheel* wheel, uint64_t now,
+                           void (*expire)(timer* deadline, void* context),
+                           void* context) {
+  size_t expired = 0;
+  while (wheel->current < now) {
+    // With nothing scheduled there is nothing to cascade or expire, so skip
+    // straight to the present after a long quiet spell.
+    if (wheel->count == 0) {
+      wheel->current = now;
+      break;
+    }
+    ++wheel->current;
+    if (slot_index(wheel->current, 0) == 0) {
+      for (int level = 1; level < TIMER_WHEEL_LEVELS && cascade(wheel, level);
+           ++level) {
+      }
+    }
+    // Take timers off one at a time, since expiring one may cancel another.
+    timer** head = &wheel->slots[0][slot_index(wheel->current, 0)];
+    while (*head != NULL) {
+      timer* deadline = *head;
+      unlink_timer(deadline);
+      --wheel->count;
+      ++expired;
+      expire(deadline, context);
+    }
+  }
+  return expired;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+
+// The number of levels in a timer wheel. Each level covers TIMER_WHEEL_SLOTS
+// times the span of the level below it.
+enum { TIMER_WHEEL_LEVELS = 4 };
+
+// The number of slots in each level of a timer wheel, as a power of two.
+enum { TIMER_WHEEL_BITS = 6, TIMER_WHEEL_SLOTS = 1 << TIMER_WHEEL_BITS };
+
+// A deadline tracked by a timer wheel. Timers are meant to be embedded in the
+// structure they time out, so scheduling one never allocates.
+typedef struct timer {
+  /// The next timer in the same slot.
+  struct timer* next;
+  /// The pointer that points to this timer, or NULL if it is not scheduled.
+  struct timer** pprev;
+  /// The tick at which the timer expires.
+  uint64_t expires;
+  /// Whatever the owner of the timer needs to handle it expiring.
+  void* data;
+} timer;
+
+// A hierarchical timer wheel. The lowest level holds timers due within the
+// next TIMER_WHEEL_SLOTS ticks, one slot per tick. Each higher level holds
+// later timers in coarser slots and moves them down a level as their time
+// comes closer, so scheduling, cancelling and expiring a timer are all O(1).
+typedef struct {
+  /// The timers in each slot of each level.
+  timer* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+  /// The last tick that has been processed.
+  uint64_t current;
+  /// The number of scheduled timers.
+  size_t count;
+} timer_wheel;
+
+/**
+ * Reset a timer wheel to hold no timers.
+ *
+ * @param wheel The timer wheel to initialize.
+ * @param now The current tick.
+ */
+void init_timer_wheel(timer_wheel* wheel, uint64_t now);
+
+/**
+ * Reset a timer so it is not scheduled.
+ *
+ * @param deadline The timer to initialize.
+ * @param data Whatever the owner of the timer needs to handle it expiring.
+ */
+void init_timer(timer* deadline, void* data);
+
+/**
+ * Schedule a timer to expire at a tick, rescheduling it if it was already.
+ *
+ * A timer due at or before the current tick expires on the next tick. A timer
+ * due further out than the wheel can hold expires at the furthest tick it can.
+ *
+ * @param wheel The timer wheel to schedule the timer on.
+ * @param deadline The timer to schedule.
+ * @param expires The tick at which the timer should expire.
+ */
+void schedule_timer(timer_wheel* wheel, timer* deadline, uint64_t expires);
+
+/**
+ * Stop a timer from expiring. Cancelling a timer that is not scheduled does
+ * nothing.
+ *
+ * @param wheel The timer wheel the timer was scheduled on.
+ * @param deadline The timer to cancel.
+ */
+void cancel_timer(timer_wheel* wheel, timer* deadline);
+
+/**
+ * Process every tick up to and including the current one.
+ *
+ * Call expire for each timer that comes due, after removing the timer from
+ * the wheel. The callback may schedule or cancel any timer, including the one
+ * that expired, and may free the memory holding it.
+ *
+ * @param wheel The timer wheel to advance.
+ * @param now The current tick.
+ * @param expire The function to call for each expired timer.
+ * @param context Passed to expire along with the timer.
+ * @return The number of timers that expired.
+ */
+size_t advance_timer_wheel(timer_wheel* wheel, uint64_t now,
+                           void (*expire)(timer* deadline, void* context),
+                           void* context);
@@ -0,0 +1,67 @@
+#include "trade_tape.h"
+
+#include <stdlib.h>  // free
+#include <string.h>  // memset
+
+#include "market_data.h"  // MARKET_COIN_COUNT
+
+// The latest executions of one coin.
+typedef struct {
+  /// The executions, each at its position modulo TRADE_TAPE_SIZE.
+  execution fills[TRADE_TAPE_SIZE];
+  /// The number of executions ever added.
+  size_t count;
+} trade_tape;
+
+static trade_tape tapes[MARKET_COIN_COUNT];
+
+// Add an execution to the end of its coin's tape.
+static void append(const execution* fill) {
+  trade_tape* tape = &tapes[fill->item];
+  tape->fills[tape->count % TRADE_TAPE_SIZE] = *fill;
+  ++tape->count;
+}
+
+int load_trade_tape(sqlite3* database) {
+  memset(tapes, 0, sizeof(tapes));
+  for (int item = 0; item < MARKET_COIN_COUNT; ++item) {
+    execution* stored = NULL;
+    int count = 0;
+    if (get_recent_executions(database, item, TRADE_TAPE_SIZE, &stored,
+                              &count) != SQLITE_OK) {
+      return -1;
+    }
+    for (int i = 0; i < count; ++i) {
+      append(&stored[i]);
+    }
+    free(stored);
+  }
+  return 0;
+}
+
+int record_execution(sqlite3* database, execution* fill) {
+  int result = insert_execution(database, fill);
+  append(fill);
+  return result;
+}
+
+size_t copy_recent_trades(int item, execution* fills, size_t count) {
+  const trade_tape* tape = &tapes[item];
+  size_t kept = tape->count < TRADE_TAPE_SIZE ? tape->count : TRADE_TAPE_SIZE;
+  if (count > kept) {
+    count = kept;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    fills[i] = tape->fills[(tape->count - 1 - i) % TRADE_TAPE_SIZE];
+  }
+  return count;
+}
+
+int get_last_trade(int item, execution* fill) {
+  const trade_tape* tape = &tapes[item];
+  if (tape->count == 0) {
+    return 0;
+  }
+  *fill = tape->fills[(tape->count - 1) % TRADE_TAPE_SIZE];
+  return 1;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <sqlite3.h>  // sqlite3
+#include <stddef.h>   // size_t
+
+#include "db.h"  // execution
+
+// The number of latest executions kept in memory for each coin. A power of
+// two.
+enum { TRADE_TAPE_SIZE = 256 };
+
+// Like the market data, the tape is shared by every session and may only be
+// used by one thread at a time, so call these functions while holding the lock
+// commands run under.
+
+/**
+ * Reload the latest executions stored in the database.
+ *
+ * Call this once at startup, before any client can trade.
+ *
+ * @param database The database holding the executions.
+ * @return 0 on success, or -1 if the executions couldn't be read.
+ */
+int load_trade_tape(sqlite3* database);
+
+/**
+ * Append an execution to the executions table and to its coin's tape.
+ *
+ * @param database The database to store the execution in.
+ * @param fill The execution. Its executionID is set once it is stored.
+ * @return SQLITE_OK on success, or an SQLite error code if the execution
+ * couldn't be stored, in which case it is still added to the tape.
+ */
+int record_execution(sqlite3* database, execution* fill);
+
+/**
+ * Copy the latest executions of a coin.
+ *
+ * @param item The coin.
+ * @param fills Where to copy the executions, newest first. It must have room
+ * for count executions.
+ * @param count The most executions to copy, at most TRADE_TAPE_SIZE.
+ * @return The number of executions copied.
+ */
+size_t copy_recent_trades(int item, execution* fills, size_t count);
+
+/**
+ * Look up a coin's latest execution.
+ *
+ * @param item The coin.
+ * @param fill Where to store the execution if there is one.
+ * @return 1 if the coin has traded, or 0 if not.
+ */
+int get_last_trade(int item, execution* fill);
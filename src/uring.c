@@ -0,0 +1,248 @@
+#include "uring.h"
+
+#include <errno.h>        // errno, EINVAL, ETIME, EINTR, EBUSY, EOPNOTSUPP
+#include <stdint.h>       // uint16_t, uintptr_t
+#include <stdlib.h>       // malloc, free
+#include <string.h>       // memset
+#include <sys/mman.h>     // mmap, munmap
+#include <sys/syscall.h>  // SYS_io_uring_*
+#include <unistd.h>       // syscall, close
+
+#include "io_stats.h"
+
+// Setup flags that cut down on work the kernel does behind our back, which
+// older kernels may not know about.
+static const unsigned PREFERRED_SETUP_FLAGS =
+    IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+    IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* params) {
+  return (int)syscall(SYS_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags, void* arg, size_t arg_size) {
+  return (int)syscall(SYS_io_uring_enter, fd, to_submit, min_complete, flags,
+                      arg, arg_size);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg,
+                             unsigned nr_args) {
+  return (int)syscall(SYS_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Map one of the regions the kernel shares with a ring.
+static void* map_ring(int fd, size_t size, off_t offset) {
+  void* region = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, offset);
+  return region == MAP_FAILED ? NULL : region;
+}
+
+int init_uring(uring* ring, unsigned entries) {
+  memset(ring, 0, sizeof(*ring));
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = PREFERRED_SETUP_FLAGS;
+  int fd = io_uring_setup(entries, &params);
+  if (fd == -1 && errno == EINVAL) {
+    memset(&params, 0, sizeof(params));
+    fd = io_uring_setup(entries, &params);
+  }
+  if (fd == -1) {
+    return -1;
+  }
+  ring->fd = fd;
+  ring->features = params.features;
+  ring->setup_flags = params.flags;
+  // Timed waits need to pass their timeout to io_uring_enter directly.
+  if (!(params.features & IORING_FEAT_EXT_ARG)) {
+    (void)close(fd);
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+
+  ring->sq_ring_size =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    // Both rings share one mapping, so it must fit the larger.
+    if (ring->cq_ring_size > ring->sq_ring_size) {
+      ring->sq_ring_size = ring->cq_ring_size;
+    }
+    ring->cq_ring_size = ring->sq_ring_size;
+  }
+  ring->sq_ring = map_ring(fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+  if (ring->sq_ring == NULL) {
+    free_uring(ring);
+    return -1;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_ring = ring->sq_ring;
+  } else {
+    ring->cq_ring = map_ring(fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+    if (ring->cq_ring == NULL) {
+      free_uring(ring);
+      return -1;
+    }
+  }
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = map_ring(fd, ring->sqes_size, IORING_OFF_SQES);
+  if (ring->sqes == NULL) {
+    free_uring(ring);
+    return -1;
+  }
+
+  char* sq = ring->sq_ring;
+  ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+  ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+  ring->sq_entries = params.sq_entries;
+  ring->sqe_tail = *ring->sq_tail;
+  // Entries are always submitted in order, so the index array never changes.
+  unsigned* sq_array = (unsigned*)(sq + params.sq_off.array);
+  for (unsigned i = 0; i < params.sq_entries; ++i) {
+    sq_array[i] = i;
+  }
+  char* cq = ring->cq_ring;
+  ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+  ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+  return 0;
+}
+
+void free_uring(uring* ring) {
+  if (ring->sqes != NULL) {
+    (void)munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring) {
+    (void)munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  if (ring->sq_ring != NULL) {
+    (void)munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+  (void)close(ring->fd);
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+}
+
+struct io_uring_sqe* get_sqe(uring* ring) {
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  if (ring->sqe_tail - head >= ring->sq_entries) {
+    return NULL;
+  }
+  struct io_uring_sqe* sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  ++ring->sqe_tail;
+  return sqe;
+}
+
+int submit_uring(uring* ring, unsigned wait_for, int timeout_ms) {
+  unsigned to_submit = ring->sqe_tail - *ring->sq_tail;
+  // Publish the new entries only once they are completely filled in.
+  __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+  unsigned flags = 0;
+  // Completions are only posted during io_uring_enter when task work is
+  // deferred, so always ask for them then.
+  if (wait_for > 0 || (ring->setup_flags & IORING_SETUP_DEFER_TASKRUN)) {
+    flags |= IORING_ENTER_GETEVENTS;
+  }
+  struct __kernel_timespec timeout;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  if (timeout_ms >= 0 && wait_for > 0) {
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+    arg.ts = (uint64_t)(uintptr_t)&timeout;
+  }
+  flags |= IORING_ENTER_EXT_ARG;
+  if (to_submit == 0 && !(flags & IORING_ENTER_GETEVENTS)) {
+    return 0;
+  }
+
+  count_io_syscalls(1);
+  if (io_uring_enter(ring->fd, to_submit, wait_for, flags, &arg, sizeof(arg)) ==
+      -1) {
+    // Running out of time, being interrupted, or having a full completion
+    // queue all just mean the caller should look at its completions.
+    if (errno == ETIME || errno == EINTR || errno == EBUSY) {
+      return 0;
+    }
+    return -1;
+  }
+  return 0;
+}
+
+struct io_uring_cqe* peek_cqe(uring* ring) {
+  unsigned head = *ring->cq_head;
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &ring->cqes[head & ring->cq_mask];
+}
+
+void consume_cqe(uring* ring) {
+  // Let the kernel reuse the entry only once we are done reading it.
+  __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int init_uring_buffers(uring* ring, uring_buffers* buffers, uint16_t group,
+                       unsigned count, unsigned size) {
+  size_t ring_size = count * sizeof(struct io_uring_buf);
+  // The kernel needs the ring to start on a page boundary.
+  void* shared = mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    return -1;
+  }
+  buffers->ring = shared;
+  buffers->memory = malloc((size_t)count * size);
+  if (buffers->memory == NULL) {
+    (void)munmap(shared, ring_size);
+    errno = ENOMEM;
+    return -1;
+  }
+  buffers->count = count;
+  buffers->size = size;
+  buffers->group = group;
+  buffers->tail = 0;
+
+  struct io_uring_buf_reg registration;
+  memset(&registration, 0, sizeof(registration));
+  registration.ring_addr = (uint64_t)(uintptr_t)shared;
+  registration.ring_entries = count;
+  registration.bgid = group;
+  if (io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &registration,
+                        1) == -1) {
+    free_uring_buffers(buffers);
+    return -1;
+  }
+  for (unsigned i = 0; i < count; ++i) {
+    recycle_uring_buffer(buffers, (uint16_t)i);
+  }
+  return 0;
+}
+
+void free_uring_buffers(uring_buffers* buffers) {
+  (void)munmap(buffers->ring, buffers->count * sizeof(struct io_uring_buf));
+  free(buffers->memory);
+  buffers->ring = NULL;
+  buffers->memory = NULL;
+}
+
+char* uring_buffer(const uring_buffers* buffers, uint16_t id) {
+  return buffers->memory + (size_t)id * buffers->size;
+}
+
+void recycle_uring_buffer(uring_buffers* buffers, uint16_t id) {
+  struct io_uring_buf* slot =
+      &buffers->ring->bufs[buffers->tail & (buffers->count - 1)];
+  slot->addr = (uint64_t)(uintptr_t)uring_buffer(buffers, id);
+  slot->len = buffers->size;
+  slot->bid = id;
+  ++buffers->tail;
+  // Hand the buffer over only once its slot is filled in.
+  __atomic_store_n(&buffers->ring->tail, buffers->tail, __ATOMIC_RELEASE);
+}
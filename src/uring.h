@@ -0,0 +1,158 @@
+#pragma once
+
+#include <linux/io_uring.h>  // io_uring_sqe, io_uring_cqe, io_uring_buf_ring
+#include <stddef.h>          // size_t
+#include <stdint.h>          // uint16_t
+
+// A minimal io_uring instance driven through the raw system calls, since the
+// server only needs a handful of operations.
+typedef struct {
+  /// The io_uring file descriptor.
+  int fd;
+  /// The IORING_FEAT_* flags the kernel reported.
+  unsigned features;
+  /// The IORING_SETUP_* flags the ring was created with.
+  unsigned setup_flags;
+  /// The submission queue head, advanced by the kernel.
+  unsigned* sq_head;
+  /// The submission queue tail, advanced when entries are submitted.
+  unsigned* sq_tail;
+  /// The mask to turn a submission queue position into an index.
+  unsigned sq_mask;
+  /// The number of entries in the submission queue.
+  unsigned sq_entries;
+  /// The submission queue entries.
+  struct io_uring_sqe* sqes;
+  /// One past the last entry handed out by get_sqe, which may not have been
+  /// submitted yet.
+  unsigned sqe_tail;
+  /// The completion queue head, advanced as completions are consumed.
+  unsigned* cq_head;
+  /// The completion queue tail, advanced by the kernel.
+  unsigned* cq_tail;
+  /// The mask to turn a completion queue position into an index.
+  unsigned cq_mask;
+  /// The completion queue entries.
+  struct io_uring_cqe* cqes;
+  /// The mapped submission queue ring.
+  void* sq_ring;
+  /// The size of the mapped submission queue ring.
+  size_t sq_ring_size;
+  /// The mapped completion queue ring, which may be the same mapping as the
+  /// submission queue ring.
+  void* cq_ring;
+  /// The size of the mapped completion queue ring.
+  size_t cq_ring_size;
+  /// The size of the mapped submission queue entries.
+  size_t sqes_size;
+} uring;
+
+// A ring of equally sized buffers the kernel picks from when receiving, so a
+// receive only takes up memory once data actually arrives.
+typedef struct {
+  /// The ring shared with the kernel.
+  struct io_uring_buf_ring* ring;
+  /// The memory for every buffer, one after another.
+  char* memory;
+  /// The number of buffers, as a power of two.
+  unsigned count;
+  /// The size of each buffer.
+  unsigned size;
+  /// The ID receives use to pick from this ring.
+  uint16_t group;
+  /// The ring tail as last published to the kernel.
+  uint16_t tail;
+} uring_buffers;
+
+/**
+ * Create an io_uring instance.
+ *
+ * @param ring The ring to initialize.
+ * @param entries The number of submission queue entries to ask for.
+ * @return 0 on success, or -1 with errno set if the kernel refuses.
+ */
+int init_uring(uring* ring, unsigned entries);
+
+/**
+ * Release an io_uring instance. Operations still in flight are cancelled.
+ *
+ * @param ring The ring to release.
+ */
+void free_uring(uring* ring);
+
+/**
+ * Get a blank submission queue entry to fill in.
+ *
+ * The entry is submitted by the next call to submit_uring.
+ *
+ * @param ring The ring to get an entry from.
+ * @return The entry, or NULL if the submission queue is full.
+ */
+struct io_uring_sqe* get_sqe(uring* ring);
+
+/**
+ * Submit every entry filled in since the last call and wait for completions.
+ *
+ * All of the submissions and the wait cost a single system call.
+ *
+ * @param ring The ring to submit to.
+ * @param wait_for The number of completions to wait for, which may be 0.
+ * @param timeout_ms The most time to wait in milliseconds, or -1 to wait as
+ * long as it takes.
+ * @return 0 on success, even if the wait timed out or was interrupted, or -1
+ * with errno set on failure.
+ */
+int submit_uring(uring* ring, unsigned wait_for, int timeout_ms);
+
+/**
+ * Return the oldest completion that hasn't been consumed yet.
+ *
+ * @param ring The ring to look at.
+ * @return The completion, or NULL if there are none.
+ */
+struct io_uring_cqe* peek_cqe(uring* ring);
+
+/**
+ * Mark the completion returned by peek_cqe as consumed.
+ *
+ * @param ring The ring the completion came from.
+ */
+void consume_cqe(uring* ring);
+
+/**
+ * Allocate a ring of receive buffers and register it with the kernel.
+ *
+ * @param ring The io_uring instance to register the buffers with.
+ * @param buffers The buffer ring to initialize.
+ * @param group The ID receives will use to pick from the buffers.
+ * @param count The number of buffers, which must be a power of two.
+ * @param size The size of each buffer.
+ * @return 0 on success, or -1 with errno set on failure.
+ */
+int init_uring_buffers(uring* ring, uring_buffers* buffers, uint16_t group,
+                       unsigned count, unsigned size);
+
+/**
+ * Release a ring of receive buffers. The io_uring instance it was registered
+ * with must be released first.
+ *
+ * @param buffers The buffer ring to release.
+ */
+void free_uring_buffers(uring_buffers* buffers);
+
+/**
+ * Return the memory of a buffer picked by the kernel.
+ *
+ * @param buffers The buffer ring the buffer belongs to.
+ * @param id The buffer ID from the completion flags.
+ * @return The start of the buffer.
+ */
+char* uring_buffer(const uring_buffers* buffers, uint16_t id);
+
+/**
+ * Give a buffer back to the kernel once its data has been used.
+ *
+ * @param buffers The buffer ring the buffer belongs to.
+ * @param id The buffer ID from the completion flags.
+ */
+void recycle_uring_buffer(uring_buffers* buffers, uint16_t id);
@@ -0,0 +1,312 @@
+#define _GNU_SOURCE
+
+#include <errno.h>       // ENOBUFS
+#include <stdint.h>      // uint16_t, uint64_t, uintptr_t
+#include <sys/socket.h>  // SHUT_RDWR, SOCK_NONBLOCK, SOCK_CLOEXEC, MSG_*
+
+#include "line_reader.h"
+#include "session.h"
+#include "timer_wheel.h"
+#include "uring.h"
+#include "util.h"
+#include "worker.h"
+
+enum {
+  // The number of submission queue entries in each thread's ring.
+  URING_ENTRIES = 256,
+  // The number of receive buffers each thread shares between its clients.
+  RECEIVE_BUFFER_COUNT = 256,
+  // The size of each receive buffer. A full one fills the line reader.
+  RECEIVE_BUFFER_SIZE = LINE_READER_CAPACITY,
+  // The ID of the receive buffer ring.
+  RECEIVE_BUFFER_GROUP = 0,
+};
+
+// What a completion is for. It is kept in the low bits of the user data, next
+// to the session pointer, which malloc aligns to well over eight bytes.
+typedef enum {
+  OPERATION_ACCEPT,
+  OPERATION_RECEIVE,
+  OPERATION_SEND,
+  OPERATION_SHUTDOWN,
+  OPERATION_CANCEL,
+  OPERATION_FEED,
+  OPERATION_MASK = 7,
+} operation;
+
+// The state of one thread's io_uring event loop.
+typedef struct {
+  /// The worker this loop runs.
+  worker* self;
+  /// The ring every operation of this thread goes through.
+  uring ring;
+  /// The buffers receives pick from.
+  uring_buffers buffers;
+  /// Where the worker's market data signal is read into.
+  uint64_t feed_signals;
+} uring_loop;
+
+// Return an entry to fill in, submitting what is queued to make room first if
+// the submission queue is full.
+static struct io_uring_sqe* next_sqe(uring_loop* loop) {
+  struct io_uring_sqe* sqe = get_sqe(&loop->ring);
+  if (sqe == NULL) {
+    if (submit_uring(&loop->ring, 0, -1) == -1) {
+      error_and_exit("Can't submit to io_uring");
+    }
+    sqe = get_sqe(&loop->ring);
+    if (sqe == NULL) {
+      error_and_exit("io_uring submission queue is stuck");
+    }
+  }
+  return sqe;
+}
+
+// Queue an operation on a socket, counting it against the session it is for.
+static struct io_uring_sqe* queue_operation(uring_loop* loop, session* client,
+                                            int socket_descriptor,
+                                            uint8_t opcode, operation kind) {
+  struct io_uring_sqe* sqe = next_sqe(loop);
+  sqe->opcode = opcode;
+  sqe->fd = socket_descriptor;
+  sqe->user_data = (uint64_t)(uintptr_t)client | kind;
+  if (client != NULL) {
+    ++client->operations;
+  }
+  return sqe;
+}
+
+// Accept connections until told otherwise, with a single request.
+static void arm_accept(uring_loop* loop) {
+  struct io_uring_sqe* sqe = queue_operation(
+      loop, NULL, loop->self->listener, IORING_OP_ACCEPT, OPERATION_ACCEPT);
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+}
+
+// Wait for the worker's market data signal.
+static void arm_feed(uring_loop* loop) {
+  struct io_uring_sqe* sqe = queue_operation(
+      loop, NULL, loop->self->feed_event, IORING_OP_READ, OPERATION_FEED);
+  sqe->addr = (uint64_t)(uintptr_t)&loop->feed_signals;
+  sqe->len = sizeof(loop->feed_signals);
+}
+
+// Receive from a client until told otherwise, with a single request. The
+// kernel picks a buffer for each chunk of data as it arrives.
+static void arm_receive(uring_loop* loop, session* client) {
+  struct io_uring_sqe* sqe =
+      queue_operation(loop, client, client->socket_descriptor, IORING_OP_RECV,
+                      OPERATION_RECEIVE);
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = RECEIVE_BUFFER_GROUP;
+}
+
+// Queue a send of the client's output if there is some and none is in flight.
+// Return whether a send was queued.
+static int queue_send(uring_loop* loop, session* client, uint8_t flags) {
+  if (take_output(client) != 1) {
+    return 0;
+  }
+  struct io_uring_sqe* sqe =
+      queue_operation(loop, client, client->socket_descriptor, IORING_OP_SEND,
+                      OPERATION_SEND);
+  sqe->addr = (uint64_t)(uintptr_t)client->sending;
+  sqe->len = (uint32_t)client->sending_size;
+  // Have the kernel retry short sends itself.
+  sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+  sqe->flags = flags;
+  return 1;
+}
+
+// Free a closing session once the kernel is done with it.
+static void release_if_idle(uring_loop* loop, session* client) {
+  if (client->closing && client->operations == 0) {
+    release_session(loop->self, client);
+  }
+}
+
+// Start closing a session: send whatever is queued, then shut the socket down
+// and cancel anything still waiting on it. The three are linked so they run
+// in order in the kernel even if one fails. The session is freed once all of
+// its operations have completed.
+static void close_session(uring_loop* loop, session* client) {
+  if (client->closing) {
+    return;
+  }
+  client->closing = 1;
+  cancel_timer(&loop->self->timers, &client->deadline);
+  (void)queue_send(loop, client, IOSQE_IO_HARDLINK);
+  struct io_uring_sqe* sqe =
+      queue_operation(loop, client, client->socket_descriptor,
+                      IORING_OP_SHUTDOWN, OPERATION_SHUTDOWN);
+  sqe->len = SHUT_RDWR;
+  sqe->flags = IOSQE_IO_HARDLINK;
+  sqe = queue_operation(loop, client, client->socket_descriptor,
+                        IORING_OP_ASYNC_CANCEL, OPERATION_CANCEL);
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+}
+
+// Disconnect a client whose deadline has passed.
+static void expire_session(timer* deadline, void* context) {
+  uring_loop* loop = context;
+  session* client = deadline->data;
+  queue_timeout_notice(client);
+  close_session(loop, client);
+}
+
+// Handle a new connection, or a failure to accept one.
+static void complete_accept(uring_loop* loop, const struct io_uring_cqe* cqe) {
+  if (cqe->res < 0) {
+    (void)handle_accept_error(loop->self, -cqe->res);
+  } else {
+    session* client = start_session(loop->self, cqe->res);
+    if (client != NULL) {
+      arm_receive(loop, client);
+      (void)queue_send(loop, client, 0);
+    }
+  }
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    arm_accept(loop);
+  }
+}
+
+// Hand received data to the session's line reader and handle the lines in it.
+static void complete_receive(uring_loop* loop, session* client,
+                             const struct io_uring_cqe* cqe) {
+  int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+  if (!more) {
+    --client->operations;
+  }
+  if (cqe->res > 0) {
+    uint16_t id = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    if (!client->closing) {
+      const char* data = uring_buffer(&loop->buffers, id);
+      size_t size = (size_t)cqe->res;
+      // A buffer can hold more than fits after a partial line, so hand it
+      // over in pieces, taking the lines out in between.
+      int overflowing = 0;
+      while (size > 0 && !overflowing) {
+        size_t fed = feed_line_reader(&client->reader, data, size);
+        data += fed;
+        size -= fed;
+        overflowing = handle_lines(loop->self, client) == -1;
+      }
+      if (overflowing) {
+        close_session(loop, client);
+      } else {
+        (void)queue_send(loop, client, 0);
+      }
+    }
+    recycle_uring_buffer(&loop->buffers, id);
+    if (!more && !client->closing) {
+      arm_receive(loop, client);
+    }
+  } else if (cqe->res == -ENOBUFS && !client->closing) {
+    // Every buffer was in use. They are given back as soon as their data is
+    // copied, so there is room again by the time this runs.
+    if (!more) {
+      arm_receive(loop, client);
+    }
+  } else {
+    // The client hung up, or the connection failed.
+    close_session(loop, client);
+  }
+  release_if_idle(loop, client);
+}
+
+// Follow up on a finished send.
+static void complete_send(uring_loop* loop, session* client,
+                          const struct io_uring_cqe* cqe) {
+  --client->operations;
+  int failed = cqe->res < 0 || (size_t)cqe->res < client->sending_size;
+  finish_send(client);
+  if (failed) {
+    close_session(loop, client);
+  } else if (!client->closing) {
+    // Send whatever was queued while this send was in flight.
+    (void)queue_send(loop, client, 0);
+  }
+  release_if_idle(loop, client);
+}
+
+// Send a subscriber the market data just queued for it.
+static void send_feed(session* client, void* context) {
+  (void)queue_send(context, client, 0);
+}
+
+// Handle one completion.
+static void complete(uring_loop* loop, const struct io_uring_cqe* cqe) {
+  operation kind = (operation)(cqe->user_data & OPERATION_MASK);
+  session* client =
+      (session*)(uintptr_t)(cqe->user_data & ~(uint64_t)OPERATION_MASK);
+  switch (kind) {
+    case OPERATION_ACCEPT:
+      complete_accept(loop, cqe);
+      return;
+    case OPERATION_RECEIVE:
+      complete_receive(loop, client, cqe);
+      return;
+    case OPERATION_SEND:
+      complete_send(loop, client, cqe);
+      return;
+    case OPERATION_FEED:
+      arm_feed(loop);
+      deliver_market_data(loop->self, send_feed, loop);
+      return;
+    default:
+      // Shutting down and cancelling only matter once the session is idle.
+      --client->operations;
+      release_if_idle(loop, client);
+      return;
+  }
+}
+
+int uring_supported(void) {
+  uring ring;
+  if (init_uring(&ring, 4) == -1) {
+    return 0;
+  }
+  uring_buffers buffers;
+  int supported = init_uring_buffers(&ring, &buffers, RECEIVE_BUFFER_GROUP, 1,
+                                     RECEIVE_BUFFER_SIZE) == 0;
+  free_uring(&ring);
+  if (supported) {
+    free_uring_buffers(&buffers);
+  }
+  return supported;
+}
+
+void run_uring_loop(worker* self) {
+  uring_loop loop = {.self = self};
+  if (init_uring(&loop.ring, URING_ENTRIES) == -1) {
+    error_and_exit("Can't create io_uring");
+  }
+  if (init_uring_buffers(&loop.ring, &loop.buffers, RECEIVE_BUFFER_GROUP,
+                         RECEIVE_BUFFER_COUNT, RECEIVE_BUFFER_SIZE) == -1) {
+    error_and_exit("Can't register receive buffers");
+  }
+  arm_accept(&loop);
+  arm_feed(&loop);
+
+  for (;;) {
+    // Submit everything queued since the last pass and wait, all in one
+    // system call, waking up every tick while any client has a deadline.
+    int timeout = self->timers.count > 0 ? TIMER_TICK_MS : -1;
+    if (submit_uring(&loop.ring, 1, timeout) == -1) {
+      error_and_exit("Can't wait for completions");
+    }
+    // Bring the clock up to date before handling completions, so every
+    // deadline set below counts from now.
+    (void)advance_timer_wheel(&self->timers, current_tick(), expire_session,
+                              &loop);
+    struct io_uring_cqe* cqe = NULL;
+    while ((cqe = peek_cqe(&loop.ring)) != NULL) {
+      // Copy the completion out first, since handling it may queue more work.
+      struct io_uring_cqe completion = *cqe;
+      consume_cqe(&loop.ring);
+      complete(&loop, &completion);
+    }
+  }
+}
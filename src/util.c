@@ -10,7 +10,6 @@
 #include "db.h"
 
 const uint16_t PORT = 4242;
-const size_t INITIAL_TOKENS_CAPACITY = 4;
 
 void error_and_exit(const char* error_msg) {
   perror(error_msg);
@@ -39,28 +38,30 @@ struct sockaddr_in socket_address(in_addr_t addr, in_port_t port) {
   return name;
 }
 
-string_array* tokenize_line(const char* line) {
-  string_array* tokens = make_string_array(INITIAL_TOKENS_CAPACITY);
-  const char* token_start = line;
-  size_t token_size = 0;
-  for (const char* current_pos = line; *current_pos != '\0'; ++current_pos) {
-    if (isspace((int)*current_pos)) {
-      // If we are switching from non-whitespace to whitespace, we've reached
-      // the end of a token, so add what we currently have.
-      if (token_size) {
-        add_string(tokens, token_start, token_size);
-        token_size = 0;
-      }
-    } else {
-      // If we are switching from whitespace to non-whitespace, we've reached
-      // the start of a token, so move the token start position.
-      if (token_size == 0) {
-        token_start = current_pos;
-      }
-      ++token_size;
+void tokenize_line(const char* line, token_array* tokens) {
+  tokens->size = 0;
+  tokens->truncated = 0;
+  const char* current_pos = line;
+  for (;;) {
+    // Skip the whitespace before the next token.
+    while (isspace((unsigned char)*current_pos)) {
+      ++current_pos;
     }
+    if (*current_pos == '\0') {
+      return;
+    }
+    const char* token_start = current_pos;
+    while (*current_pos != '\0' && !isspace((unsigned char)*current_pos)) {
+      ++current_pos;
+    }
+    if (tokens->size == MAX_TOKENS) {
+      tokens->truncated = 1;
+      return;
+    }
+    tokens->tokens[tokens->size].data = token_start;
+    tokens->tokens[tokens->size].length = (size_t)(current_pos - token_start);
+    ++tokens->size;
   }
-  return tokens;
 }
 
 // Helper function to format a string and return it
@@ -90,9 +91,9 @@ const char* coin_type_to_string(int coin_type) {
   }
 }
 
-int validate_command_args(FILE* comm_file, string_array* command_tokens,
-                          int expected_count) {
-  if (command_tokens->size != expected_count) {
+int validate_command_args(FILE* comm_file, const token_array* command_tokens,
+                          size_t expected_count) {
+  if (command_tokens->truncated || command_tokens->size != expected_count) {
     if (fputs("Invalid command syntax! Try help.", comm_file) == EOF) {
       error_and_exit("Couldn't send error message");
     }
@@ -101,3 +102,15 @@ int validate_command_args(FILE* comm_file, string_array* command_tokens,
   }
   return 1;
 }
+
+uint32_t crc32(const void* data, size_t size) {
+  const uint8_t* bytes = data;
+  uint32_t crc = 0xffffffffU;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= bytes[i];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0xedb88320U & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
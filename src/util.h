@@ -1,16 +1,37 @@
 #pragma once
 
 #include <netinet/in.h>   // port, struct sockaddr_in, in_addr_t, in_port_t
+#include <stddef.h>       // size_t
 #include <stdint.h>       // uint16_t, uint32_t
 #include <stdio.h>        // FILE
 #include <stdnoreturn.h>  // noreturn
 
-#include "string_array.h"
-
 // The port number that the server listens on. Include it here because both the
 // client and the server need this value.
 extern const uint16_t PORT;
-extern const size_t INITIAL_TOKENS_CAPACITY;
+
+// The most tokens kept from a single line of input.
+enum { MAX_TOKENS = 8 };
+
+// A token inside a line of input. It points into the line instead of copying
+// it, so it is not null-terminated and is only valid while the line is.
+typedef struct {
+  /// The first character of the token.
+  const char* data;
+  /// The number of characters in the token.
+  size_t length;
+} token_view;
+
+// The tokens of a line of input, small enough to live on the stack.
+typedef struct {
+  /// The tokens, in the order they appear in the line.
+  token_view tokens[MAX_TOKENS];
+  /// The number of tokens stored.
+  size_t size;
+  /// Whether the line had more than MAX_TOKENS tokens and the rest were
+  /// dropped.
+  int truncated;
+} token_array;
 
 /**
  * Print an error message and exit with a failure status code.
@@ -64,14 +85,14 @@ struct sockaddr_in socket_address(in_addr_t addr, in_port_t port);
  * Split a line of input into tokens.
  *
  * Given a line of null-terminated input, split a string by whitespace into
- * tokens. The original line is not changed, and new memory is dynamically
- * allocated for the array of strings. The caller is responsible for cleaning up
- * the memory allocated by this function.
+ * tokens. The original line is not changed and nothing is allocated: each
+ * token is a view into the line, so the tokens are only valid while the line
+ * is. At most MAX_TOKENS tokens are kept.
  *
  * @param line A line of input.
- * @return A pointer to the array of strings.
+ * @param tokens The token array to fill in.
  */
-string_array* tokenize_line(const char* line);
+void tokenize_line(const char* line, token_array* tokens);
 
 /**
  * @brief Formats a string using a printf-style format and returns it as a
@@ -116,9 +137,18 @@ const char* coin_type_to_string(int coin_type);
  * @param comm_file File stream for client communication
  * @param command_tokens Tokenized command line
  * @param expected_count Expected number of arguments (including command)
- * @param usage_message The usage message to display if validation fails
  *
  * @return 1 if validation passes, 0 if it fails
  */
-int validate_command_args(FILE* comm_file, string_array* command_tokens,
-                          int expected_count);
+int validate_command_args(FILE* comm_file, const token_array* command_tokens,
+                          size_t expected_count);
+
+/**
+ * Computes the CRC-32 (as used by zlib and PNG) of a block of bytes, to tell
+ * whether data read back from a file is what was written.
+ *
+ * @param data The bytes to check.
+ * @param size The number of bytes.
+ * @return The checksum.
+ */
+uint32_t crc32(const void* data, size_t size);
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <pthread.h>    // pthread_t
+#include <sqlite3.h>    // sqlite3
+#include <stdatomic.h>  // atomic_int
+#include <stdint.h>     // uint64_t
+#include <stdio.h>      // FILE
+
+#include "market_data.h"  // feed_subscription
+#include "server.h"       // io_backend
+#include "session.h"      // session
+#include "timer_wheel.h"  // timer_wheel
+
+// Session deadlines are tracked in ticks of one second. A client that hasn't
+// logged in, sent anything, or finished a line within these many seconds is
+// disconnected.
+enum {
+  TIMER_TICK_MS = 1000,
+  LOGIN_TIMEOUT = 120,
+  IDLE_TIMEOUT = 30 * 60,
+  PARTIAL_LINE_TIMEOUT = 30,
+};
+
+// Group the data one thread needs to serve the clients of one listener. The
+// I/O backend running the thread keeps its own event queue on top of this.
+typedef struct {
+  /// The listener this thread accepts connections on.
+  int listener;
+  /// How this thread waits for and performs I/O.
+  io_backend backend;
+  /// Whether the listener hands out shared-memory channels, in which case the
+  /// thread serves them instead of using the I/O backend.
+  int shared_memory;
+  /// The socket to publish market data to as datagrams, in which case the
+  /// thread does that and the listener hands out snapshots instead, or -1.
+  int feed_socket;
+  /// Where the datagrams are sent.
+  struct sockaddr_in feed_addr;
+  /// The deadlines of this thread's clients.
+  timer_wheel timers;
+  /// A spare descriptor given up to accept and drop a connection when the
+  /// process runs out of descriptors, so the client isn't left waiting.
+  int reserve_fd;
+  /// The database connection shared by every thread.
+  sqlite3* database;
+  /// The sessions of this thread subscribed to market data.
+  session* subscribers;
+  /// The number of sessions in subscribers, read by other threads to decide
+  /// whether to wake this one.
+  atomic_int subscriber_count;
+  /// An eventfd signalled when market data was published, so this thread
+  /// sends it to its subscribers.
+  int feed_event;
+  /// Whether feed_event was signalled and this thread hasn't delivered the
+  /// market data yet, so it isn't signalled again for every update.
+  atomic_int feed_pending;
+  /// The thread running this worker.
+  pthread_t thread;
+} worker;
+
+/**
+ * Return the current time in timer ticks.
+ *
+ * @return The number of ticks since an arbitrary point in the past.
+ */
+uint64_t current_tick(void);
+
+/**
+ * Set up a session for a newly accepted client and queue its greeting.
+ *
+ * The backend still has to start receiving from the client and send the
+ * greeting.
+ *
+ * @param self The worker that accepted the client.
+ * @param socket_descriptor The client's socket.
+ * @return The new session, or NULL if it couldn't be created, in which case
+ * the socket is closed.
+ */
+session* start_session(worker* self, int socket_descriptor);
+
+/**
+ * Handle every complete line a client has sent so far.
+ *
+ * Run each line through the login dialog or the command handlers, one thread
+ * at a time, queue the replies, and push the client's deadlines back. Call
+ * this after adding received bytes to the session's line reader.
+ *
+ * @param self The worker serving the client.
+ * @param client The client that sent data.
+ * @return 0 on success, or -1 if the client has let too many replies pile up
+ * without reading them and should be disconnected. The lines after the one
+ * that went over the limit are left unhandled.
+ */
+int handle_lines(worker* self, session* client);
+
+/**
+ * Tell a client that it is being disconnected for missing a deadline.
+ *
+ * The backend still has to send the notice and close the session.
+ *
+ * @param client The client whose deadline passed.
+ */
+void queue_timeout_notice(session* client);
+
+/**
+ * Stop tracking a session's deadlines and free it, closing its socket.
+ *
+ * @param self The worker serving the client.
+ * @param client The session to release.
+ */
+void release_session(worker* self, session* client);
+
+/**
+ * Decide what to do after accepting a connection failed.
+ *
+ * If the process is out of descriptors, accept the oldest waiting connection
+ * with the reserve descriptor and drop it, so the listener doesn't stay ready
+ * forever.
+ *
+ * @param self The worker whose accept failed.
+ * @param error The errno value of the failed accept.
+ * @return 0 if it is worth trying to accept again right away, or -1 if not.
+ */
+int handle_accept_error(worker* self, int error);
+
+/**
+ * Queue the market data published since the last call for every subscriber of
+ * a worker, and have the backend send it.
+ *
+ * Call this once the worker's feed_event was signalled, after clearing it. A
+ * subscriber with too much output still waiting is skipped, and catches up,
+ * possibly with a fresh snapshot, on a later call.
+ *
+ * @param self The worker whose subscribers to serve.
+ * @param send Starts sending a subscriber's queued output. It may close and
+ * release the session.
+ * @param context Passed on to send.
+ */
+void deliver_market_data(worker* self, void (*send)(session*, void*),
+                         void* context);
+
+/**
+ * Subscribe to every coin and write a snapshot of each book, holding the
+ * market lock.
+ *
+ * @param subscription The subscription to start over.
+ * @param out Where to write the snapshots.
+ * @return 0 on success, or -1 if writing failed.
+ */
+int copy_market_snapshot(feed_subscription* subscription, FILE* out);
+
+/**
+ * Write the market data published since the subscription was last caught up,
+ * holding the market lock.
+ *
+ * @param subscription The subscription to catch up.
+ * @param out Where to write the updates.
+ * @return 1 if anything was written, 0 if the subscription was up to date, or
+ * -1 if writing failed.
+ */
+int copy_market_updates(feed_subscription* subscription, FILE* out);
+
+/**
+ * Serve a worker's listener and clients with epoll until a critical error.
+ *
+ * @param self The worker to run.
+ */
+void run_epoll_loop(worker* self);
+
+/**
+ * Serve a worker's listener and clients with io_uring until a critical error.
+ *
+ * @param self The worker to run.
+ */
+void run_uring_loop(worker* self);
+
+/**
+ * Hand out shared-memory channels on a worker's listener and serve the clients
+ * using them until a critical error.
+ *
+ * @param self The worker to run.
+ */
+void run_shm_loop(worker* self);
+
+/**
+ * Publish market data as datagrams on a worker's feed socket, and send
+ * snapshots to clients of its listener, until a critical error.
+ *
+ * @param self The worker to run.
+ */
+void run_datagram_loop(worker* self);
+
+/**
+ * Check whether the kernel supports everything the io_uring backend uses.
+ *
+ * @return 1 if the io_uring backend can run, or 0 if not.
+ */
+int uring_supported(void);
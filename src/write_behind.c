@@ -0,0 +1,155 @@
+#include "write_behind.h"
+
+#include <stdint.h>  // uint64_t
+#include <stdio.h>   // fprintf
+#include <time.h>    // clock_gettime
+
+#include "db.h"          // set_journal_position
+#include "journal.h"     // get_journal_sequence
+#include "settlement.h"  // start_netting, settle_balances, stop_netting
+#include "util.h"        // error_and_exit
+
+// Everything below is only used while holding the lock handed to
+// start_write_behind, apart from the thread handle.
+
+static sqlite3* batch_database;
+static pthread_mutex_t* batch_lock;
+static ack_durability batch_durability;
+static pthread_t writer_thread;
+// Whether the writer thread is running, so batches are being opened.
+static int batching;
+// Signalled to make the writer thread commit before its interval is up.
+static pthread_cond_t commit_requested;
+// Broadcast once the writer thread has committed.
+static pthread_cond_t commit_done;
+// The number of times the writer thread has committed.
+static uint64_t commit_count;
+// The database's total changes when the open batch began, to tell whether it
+// has any writes.
+static int changes_at_begin;
+
+// Commit the open batch, if there is one, and tell anyone waiting for it.
+static void commit_batch(void) {
+  // The balance changes of the batch's fills commit along with them.
+  if (settle_balances(batch_database) != SQLITE_OK) {
+    fprintf(stderr, "Failed to settle balances: %s\n",
+            sqlite3_errmsg(batch_database));
+  }
+  if (!sqlite3_get_autocommit(batch_database)) {
+    // So is how far into the journal the market is, for a restart to resume
+    // from. Committing without it would have the restart apply the batch's
+    // commands twice.
+    if (set_journal_position(batch_database, get_journal_sequence()) !=
+        SQLITE_OK) {
+      fprintf(stderr, "Failed to record the journal position: %s\n",
+              sqlite3_errmsg(batch_database));
+      return;
+    }
+    char* errMsg = NULL;
+    if (sqlite3_exec(batch_database, "COMMIT;", 0, 0, &errMsg) != SQLITE_OK) {
+      fprintf(stderr, "Failed to commit a batch: %s\n", errMsg);
+      sqlite3_free(errMsg);
+      // Try again next time, unless SQLite has given up on the batch.
+      if (!sqlite3_get_autocommit(batch_database)) {
+        return;
+      }
+    }
+  }
+  ++commit_count;
+  (void)pthread_cond_broadcast(&commit_done);
+}
+
+static void* run_writer(void* arg) {
+  (void)arg;
+  (void)pthread_mutex_lock(batch_lock);
+  while (batching) {
+    struct timespec deadline;
+    (void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += (long)WRITE_BEHIND_INTERVAL_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    // Waiting releases the lock, so lines keep joining the batch.
+    (void)pthread_cond_timedwait(&commit_requested, batch_lock, &deadline);
+    commit_batch();
+  }
+  (void)pthread_mutex_unlock(batch_lock);
+  return NULL;
+}
+
+void start_write_behind(sqlite3* database, pthread_mutex_t* lock,
+                        ack_durability durability) {
+  // Without waiting for the disk on every commit, a crash can only lose the
+  // latest batches, which is all ACK_ON_ENQUEUE promises.
+  const char* sql = durability == ACK_ON_COMMIT
+                        ? "PRAGMA journal_mode = WAL; "
+                          "PRAGMA synchronous = FULL;"
+                        : "PRAGMA journal_mode = WAL; "
+                          "PRAGMA synchronous = NORMAL;";
+  char* errMsg = NULL;
+  if (sqlite3_exec(database, sql, 0, 0, &errMsg) != SQLITE_OK) {
+    fprintf(stderr, "Failed to enable write-ahead logging: %s\n", errMsg);
+    sqlite3_free(errMsg);
+  }
+
+  pthread_condattr_t attributes;
+  if (pthread_condattr_init(&attributes) != 0 ||
+      pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC) != 0 ||
+      pthread_cond_init(&commit_requested, &attributes) != 0 ||
+      pthread_cond_init(&commit_done, NULL) != 0) {
+    error_and_exit("Can't set up the writer thread");
+  }
+  (void)pthread_condattr_destroy(&attributes);
+
+  batch_database = database;
+  batch_lock = lock;
+  batch_durability = durability;
+  batching = 1;
+  start_netting();
+  if (pthread_create(&writer_thread, NULL, run_writer, NULL) != 0) {
+    error_and_exit("Can't start the writer thread");
+  }
+}
+
+void begin_write_batch(void) {
+  if (!batching || !sqlite3_get_autocommit(batch_database)) {
+    return;
+  }
+  char* errMsg = NULL;
+  if (sqlite3_exec(batch_database, "BEGIN;", 0, 0, &errMsg) != SQLITE_OK) {
+    // The line's statements then commit on their own.
+    fprintf(stderr, "Failed to begin a batch: %s\n", errMsg);
+    sqlite3_free(errMsg);
+    return;
+  }
+  changes_at_begin = sqlite3_total_changes(batch_database);
+}
+
+void acknowledge_writes(void) {
+  if (!batching || batch_durability != ACK_ON_COMMIT ||
+      sqlite3_get_autocommit(batch_database) ||
+      sqlite3_total_changes(batch_database) == changes_at_begin) {
+    return;
+  }
+  uint64_t target = commit_count + 1;
+  (void)pthread_cond_signal(&commit_requested);
+  while (commit_count < target) {
+    (void)pthread_cond_wait(&commit_done, batch_lock);
+  }
+}
+
+void stop_write_behind(void) {
+  if (batch_lock == NULL) {
+    return;
+  }
+  (void)pthread_mutex_lock(batch_lock);
+  batching = 0;
+  (void)pthread_cond_signal(&commit_requested);
+  (void)pthread_mutex_unlock(batch_lock);
+  (void)pthread_join(writer_thread, NULL);
+  // The writer thread settled and committed the last batch.
+  (void)pthread_mutex_lock(batch_lock);
+  (void)stop_netting(batch_database);
+  (void)pthread_mutex_unlock(batch_lock);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <pthread.h>  // pthread_mutex_t
+#include <sqlite3.h>  // sqlite3
+
+// Matching reads back what it writes (balances, resting orders), so writes
+// can't simply be queued for another connection. Instead every line runs
+// inside a batch transaction that stays open across lines, so its writes only
+// reach SQLite's page cache, and a writer thread commits the batch every
+// WRITE_BEHIND_INTERVAL_MS. Each batch costs one commit, however many
+// statements the lines in it ran, and the balance changes of its fills are
+// netted to one update per user (see settlement.h).
+
+// How often the writer thread commits the batch, in milliseconds.
+enum { WRITE_BEHIND_INTERVAL_MS = 5 };
+
+/**
+ * @enum ack_durability
+ * @brief When a client hears back about a line that wrote to the database.
+ *
+ * ACK_ON_ENQUEUE - As soon as the line has run. A crash can lose the last
+ * batches, but never leaves the database half written, since commits don't
+ * wait for the disk.
+ * ACK_ON_COMMIT - Once the batch holding the line's writes is committed to
+ * disk. Lines handled while the batch is open share its commit.
+ */
+typedef enum {
+  ACK_ON_ENQUEUE,
+  ACK_ON_COMMIT,
+} ack_durability;
+
+/**
+ * Start batching the writes to a database and committing them from a thread
+ * of its own.
+ *
+ * This switches the database to write-ahead logging, so the commits don't
+ * stop readers such as export_archives. Until this is called, and after
+ * stop_write_behind, every statement commits on its own as usual.
+ *
+ * @param database The database lines write to.
+ * @param lock The lock lines are handled under. The writer thread holds it
+ * while committing.
+ * @param durability When clients hear back about their writes.
+ */
+void start_write_behind(sqlite3* database, pthread_mutex_t* lock,
+                        ack_durability durability);
+
+/**
+ * Make sure a batch is open before handling a line. Call this while holding
+ * the lock.
+ */
+void begin_write_batch(void);
+
+/**
+ * Wait until the lines handled so far may be acknowledged. Call this while
+ * holding the lock, after handling lines and before sending their replies.
+ *
+ * With ACK_ON_COMMIT, if the open batch has writes, this wakes the writer
+ * thread and waits for it to commit them, releasing the lock meanwhile so
+ * other threads can keep handling lines and join the batch. Otherwise it
+ * returns at once.
+ */
+void acknowledge_writes(void);
+
+/**
+ * Stop the writer thread, committing the last batch.
+ */
+void stop_write_behind(void);
@@ -0,0 +1,81 @@
+#include <criterion/criterion.h>
+
+#include "../src/account_summary.h"
+#include "../src/db.h"
+
+static const int64_t start = 1700000000;
+
+Test(test_account_summary, test_unknown_user) {
+  account_summary summary;
+  get_account_summary(1000, &summary);
+  cr_assert_eq(summary.openOrders, 0);
+  cr_assert_eq(summary.tradeCount, 0);
+  cr_assert_eq(summary.lastActiveAt, 0);
+}
+
+Test(test_account_summary, test_orders_and_fills) {
+  record_order_opened(1, start);
+  record_order_opened(1, start + 1);
+  execution fill = {.executionID = 1, .item = COIN_BTC, .price = 500,
+                    .quantity = 3, .buyerID = 2, .sellerID = 1,
+                    .executedAt = start + 5};
+  record_account_fill(&fill);
+  record_order_closed(1, start + 5);
+
+  account_summary seller;
+  get_account_summary(1, &seller);
+  cr_assert_eq(seller.openOrders, 1);
+  cr_assert_eq(seller.tradeCount, 1);
+  cr_assert_eq(seller.filled[COIN_BTC], 3);
+  cr_assert_eq(seller.notional, 1500);
+  cr_assert_eq(seller.lastActiveAt, start + 5);
+
+  account_summary buyer;
+  get_account_summary(2, &buyer);
+  cr_assert_eq(buyer.openOrders, 0);
+  cr_assert_eq(buyer.tradeCount, 1);
+  cr_assert_eq(buyer.filled[COIN_BTC], 3);
+  cr_assert_eq(buyer.filled[COIN_ETH], 0);
+}
+
+Test(test_account_summary, test_reload_from_checkpoint) {
+  sqlite3* database = NULL;
+  cr_assert_eq(sqlite3_open(":memory:", &database), SQLITE_OK);
+  cr_assert_eq(create_tables(database), SQLITE_OK);
+  cr_assert_eq(sqlite3_exec(database,
+                            "INSERT INTO users (username, password, name) "
+                            "VALUES ('a', 'pw', 'a'), ('b', 'pw', 'b');"
+                            "INSERT INTO orders (item, buyOrSell, quantity, "
+                            "unitPrice, userID) VALUES (1, 0, 2, 1.5, 2);",
+                            0, 0, NULL),
+               SQLITE_OK);
+  cr_assert_eq(load_account_summaries(database), 0);
+
+  // One fill is checkpointed, and the other is counted again at startup.
+  execution first = {.item = COIN_ETH, .price = 200, .quantity = 4,
+                     .buyerID = 1, .sellerID = 2, .executedAt = start};
+  cr_assert_eq(insert_execution(database, &first), SQLITE_OK);
+  record_account_fill(&first);
+  cr_assert_eq(checkpoint_account_summaries(database), SQLITE_OK);
+  execution second = {.item = COIN_ETH, .price = 300, .quantity = 1,
+                      .buyerID = 2, .sellerID = 1, .executedAt = start + 60};
+  cr_assert_eq(insert_execution(database, &second), SQLITE_OK);
+  record_account_fill(&second);
+
+  account_summary before;
+  get_account_summary(1, &before);
+  cr_assert_eq(load_account_summaries(database), 0);
+  account_summary after;
+  get_account_summary(1, &after);
+  cr_assert_eq(after.tradeCount, 2);
+  cr_assert_eq(after.tradeCount, before.tradeCount);
+  cr_assert_eq(after.filled[COIN_ETH], 5);
+  cr_assert_eq(after.notional, before.notional);
+  cr_assert_eq(after.lastActiveAt, start + 60);
+
+  get_account_summary(2, &after);
+  cr_assert_eq(after.openOrders, 1);
+  cr_assert_eq(after.tradeCount, 2);
+  cr_assert_eq(after.notional, 1100);
+  sqlite3_close(database);
+}
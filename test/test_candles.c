@@ -0,0 +1,87 @@
+#include <criterion/criterion.h>
+#include <string.h>
+
+#include "../src/candles.h"
+
+// Open an empty database in memory with the candles table.
+static sqlite3* open_candle_database(void) {
+  sqlite3* database = NULL;
+  cr_assert_eq(sqlite3_open(":memory:", &database), SQLITE_OK);
+  cr_assert_eq(create_tables(database), SQLITE_OK);
+  cr_assert_eq(load_candles(database), 0);
+  return database;
+}
+
+Test(test_candles, test_find_interval) {
+  cr_assert_eq(find_candle_interval("1s", 2), CANDLE_SECOND);
+  cr_assert_eq(find_candle_interval("1m", 2), CANDLE_MINUTE);
+  cr_assert_eq(find_candle_interval("1h", 2), CANDLE_HOUR);
+  cr_assert_eq(find_candle_interval("1d", 2), -1);
+  cr_assert_eq(find_candle_interval("1", 1), -1);
+  cr_assert_eq(candle_interval_seconds(CANDLE_HOUR), 3600);
+}
+
+Test(test_candles, test_trades_update_current_candle) {
+  sqlite3* database = open_candle_database();
+  cr_assert_eq(record_candle_trade(database, COIN_BTC, 500, 2, 120), 0);
+  cr_assert_eq(record_candle_trade(database, COIN_BTC, 650, 1, 130), 0);
+  cr_assert_eq(record_candle_trade(database, COIN_BTC, 400, 3, 150), 0);
+  cr_assert_eq(record_candle_trade(database, COIN_BTC, 450, 4, 179), 0);
+
+  candle candles[4];
+  cr_assert_eq(copy_candles(COIN_BTC, CANDLE_MINUTE, candles, 4), 1);
+  cr_assert_eq(candles[0].startTime, 120);
+  cr_assert_eq(candles[0].open, 500);
+  cr_assert_eq(candles[0].high, 650);
+  cr_assert_eq(candles[0].low, 400);
+  cr_assert_eq(candles[0].close, 450);
+  cr_assert_eq(candles[0].volume, 10);
+  // Every trade was in a different second.
+  cr_assert_eq(copy_candles(COIN_BTC, CANDLE_SECOND, candles, 4), 4);
+  cr_assert_eq(candles[3].startTime, 179);
+  sqlite3_close(database);
+}
+
+Test(test_candles, test_candles_are_stored_and_reloaded) {
+  sqlite3* database = open_candle_database();
+  cr_assert_eq(record_candle_trade(database, COIN_ETH, 100, 1, 60), 0);
+  cr_assert_eq(record_candle_trade(database, COIN_ETH, 200, 1, 125), 0);
+  cr_assert_eq(record_candle_trade(database, COIN_ETH, 300, 1, 190), 0);
+
+  // The minute in progress was stored along with the finished ones.
+  cr_assert_eq(load_candles(database), 0);
+  candle candles[4];
+  cr_assert_eq(copy_candles(COIN_ETH, CANDLE_MINUTE, candles, 4), 3);
+  cr_assert_eq(candles[0].startTime, 60);
+  cr_assert_eq(candles[0].close, 100);
+  cr_assert_eq(candles[1].startTime, 120);
+  cr_assert_eq(candles[1].close, 200);
+  cr_assert_eq(candles[2].startTime, 180);
+  cr_assert_eq(candles[2].close, 300);
+
+  // A trade after the reload carries on with that minute rather than
+  // replacing it.
+  cr_assert_eq(record_candle_trade(database, COIN_ETH, 250, 2, 195), 0);
+  cr_assert_eq(load_candles(database), 0);
+  cr_assert_eq(copy_candles(COIN_ETH, CANDLE_MINUTE, candles, 4), 3);
+  cr_assert_eq(candles[2].open, 300);
+  cr_assert_eq(candles[2].high, 300);
+  cr_assert_eq(candles[2].low, 250);
+  cr_assert_eq(candles[2].close, 250);
+  cr_assert_eq(candles[2].volume, 3);
+  sqlite3_close(database);
+}
+
+Test(test_candles, test_copy_keeps_latest) {
+  sqlite3* database = open_candle_database();
+  for (int64_t second = 0; second < CANDLE_HISTORY + 10; ++second) {
+    cr_assert_eq(
+        record_candle_trade(database, COIN_DOGE, 100 + second, 1, second), 0);
+  }
+  candle candles[3];
+  cr_assert_eq(copy_candles(COIN_DOGE, CANDLE_SECOND, candles, 3), 3);
+  cr_assert_eq(candles[0].startTime, CANDLE_HISTORY + 7);
+  cr_assert_eq(candles[2].startTime, CANDLE_HISTORY + 9);
+  cr_assert_eq(candles[2].close, 100 + CANDLE_HISTORY + 9);
+  sqlite3_close(database);
+}
@@ -0,0 +1,115 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/columnar.h"
+
+static const column_spec columns[] = {
+    {"id", COLUMN_DELTA},
+    {"quantity", COLUMN_VARINT},
+    {"user", COLUMN_DICTIONARY},
+};
+
+// The value of each column in a row, with IDs going up and down, quantities
+// of every size, and a few users repeating.
+static void make_row(int64_t row, int64_t* values) {
+  values[0] = row % 3 == 0 ? INT64_MIN + row : 1000 * row - 7;
+  values[1] = row * row;
+  values[2] = 40 + row % 5;
+}
+
+// Write rows to a temporary file and rewind it for reading.
+static FILE* write_rows(int64_t row_count) {
+  FILE* file = tmpfile();
+  cr_assert_not_null(file);
+  columnar_writer* writer = make_columnar_writer(file, columns, 3);
+  cr_assert_not_null(writer);
+  for (int64_t row = 0; row < row_count; ++row) {
+    int64_t values[3];
+    make_row(row, values);
+    cr_assert_eq(append_columnar_row(writer, values), 0);
+  }
+  cr_assert_eq(free_columnar_writer(writer), 0);
+  rewind(file);
+  return file;
+}
+
+Test(test_columnar, test_round_trip_across_blocks) {
+  int64_t row_count = COLUMNAR_BLOCK_ROWS * 2 + 17;
+  FILE* file = write_rows(row_count);
+  columnar_reader* reader = make_columnar_reader(file);
+  cr_assert_not_null(reader);
+  cr_assert_eq(get_columnar_column_count(reader), 3);
+  cr_assert_str_eq(get_columnar_column_name(reader, 2), "user");
+  cr_assert_eq(find_columnar_column(reader, "quantity"), 1);
+  cr_assert_eq(find_columnar_column(reader, "price"), -1);
+
+  int64_t row = 0;
+  int block_rows = 0;
+  while ((block_rows = read_columnar_block(reader)) > 0) {
+    for (int i = 0; i < block_rows; ++i, ++row) {
+      int64_t expected[3];
+      make_row(row, expected);
+      for (int column = 0; column < 3; ++column) {
+        cr_assert_eq(get_columnar_values(reader, column)[i], expected[column],
+                     "Row %lld, column %d", (long long)row, column);
+      }
+    }
+  }
+  cr_assert_eq(block_rows, 0);
+  cr_assert_eq(row, row_count);
+  free_columnar_reader(reader);
+  fclose(file);
+}
+
+Test(test_columnar, test_empty_file) {
+  FILE* file = write_rows(0);
+  columnar_reader* reader = make_columnar_reader(file);
+  cr_assert_not_null(reader);
+  cr_assert_eq(read_columnar_block(reader), 0);
+  free_columnar_reader(reader);
+  fclose(file);
+}
+
+Test(test_columnar, test_increasing_ids_take_a_byte) {
+  static const column_spec id_column[] = {{"id", COLUMN_DELTA}};
+  FILE* file = tmpfile();
+  cr_assert_not_null(file);
+  columnar_writer* writer = make_columnar_writer(file, id_column, 1);
+  long header_size = ftell(file);
+  for (int64_t id = 1000000; id < 1000000 + 1000; ++id) {
+    cr_assert_eq(append_columnar_row(writer, &id), 0);
+  }
+  cr_assert_eq(free_columnar_writer(writer), 0);
+  // The first ID, then one byte for each of the others, and a few bytes of
+  // block and end markers.
+  cr_assert_lt(ftell(file) - header_size, 1000 + 16);
+  fclose(file);
+}
+
+Test(test_columnar, test_rejects_cut_short_and_foreign_files) {
+  FILE* file = write_rows(100);
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  char* bytes = malloc((size_t)size);
+  cr_assert_eq(fread(bytes, 1, (size_t)size, file), (size_t)size);
+  fclose(file);
+
+  // Lose the end of the only block.
+  FILE* cut = tmpfile();
+  fwrite(bytes, 1, (size_t)size - 5, cut);
+  rewind(cut);
+  columnar_reader* reader = make_columnar_reader(cut);
+  cr_assert_not_null(reader);
+  cr_assert_eq(read_columnar_block(reader), -1);
+  free_columnar_reader(reader);
+  fclose(cut);
+
+  FILE* foreign = tmpfile();
+  fputs("SQLite format 3", foreign);
+  rewind(foreign);
+  cr_assert_null(make_columnar_reader(foreign));
+  fclose(foreign);
+  free(bytes);
+}
@@ -1,6 +1,22 @@
 #include <criterion/criterion.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "../src/command.h"
+#include "../src/journal.h"
+#include "../src/settlement.h"
+#include "../src/state_snapshot.h"
+
+// Read a single number back from a query.
+static int64_t query_number(sqlite3* database, const char* sql) {
+  sqlite3_stmt* stmt = NULL;
+  cr_assert_eq(sqlite3_prepare_v2(database, sql, -1, &stmt, NULL), SQLITE_OK);
+  cr_assert_eq(sqlite3_step(stmt), SQLITE_ROW);
+  int64_t value = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+  return value;
+}
 
 Test(test_command_db, test_open_db) {
   sqlite3* database = NULL;
@@ -37,7 +53,7 @@ Test(test_command_db, test_buy) {
       test_order,
       "Expected create_order to return a valid order, but got NULL");
 
-  int buy_res = buy(database, test_order);
+  int buy_res = buy(database, test_order, time(NULL));
   cr_assert_eq(buy_res, 0, "Expected buy to return 0, but got %d", buy_res);
 
   // dump_database(
@@ -76,7 +92,7 @@ Test(test_command_db, test_sell) {
       test_order,
       "Expected create_order to return a valid order, but got NULL");
 
-  int sell_res = sell(database, test_order);
+  int sell_res = sell(database, test_order, time(NULL));
   cr_assert_eq(sell_res, 0, "Expected sell to return 0, but got %d", sell_res);
 
   // dump_database(
@@ -130,7 +146,7 @@ Test(test_command_db, test_sell_with_two_users) {
       buy_order1,
       "Expected create_order to return a valid order, but got NULL");
 
-  res = buy(database, buy_order1);
+  res = buy(database, buy_order1, time(NULL));
   cr_assert_eq(res, 0, "Expected buy to return 0, but got %d", res);
 
   order* buy_order2 = create_order(1, BUY, 2, 14.5, user1.userID);
@@ -138,7 +154,7 @@ Test(test_command_db, test_sell_with_two_users) {
       buy_order2,
       "Expected create_order to return a valid order, but got NULL");
 
-  res = buy(database, buy_order2);
+  res = buy(database, buy_order2, time(NULL));
   cr_assert_eq(res, 0, "Expected buy to return 0, but got %d", res);
 
   // User2 tries to post a sell order at a higher price
@@ -148,7 +164,7 @@ Test(test_command_db, test_sell_with_two_users) {
       "Expected create_order to return a valid order, but got NULL");
   dump_database(database);
 
-  int sell_res_high = sell(database, sell_order_high);
+  int sell_res_high = sell(database, sell_order_high, time(NULL));
   cr_assert_eq(sell_res_high, 0, "Selling failed, got %d", sell_res_high);
 
   free_order(sell_order_high);
@@ -204,7 +220,7 @@ Test(test_command_db, test_partial_match_sell_and_buy) {
   cr_assert_not_null(
       buy_order, "Expected create_order to return a valid order, but got NULL");
 
-  res = buy(database, buy_order);
+  res = buy(database, buy_order, time(NULL));
   cr_assert_eq(res, 0, "Expected buy to return 0, but got %d", res);
 
   // Seller places a sell order for 5 units
@@ -214,7 +230,7 @@ Test(test_command_db, test_partial_match_sell_and_buy) {
       "Expected create_order to return a valid order, but got NULL");
   // Dump database to verify the state before partial match
   dump_database(database);
-  int sell_res = sell(database, sell_order);
+  int sell_res = sell(database, sell_order, time(NULL));
   cr_assert_eq(sell_res, 0, "Expected sell to return 0, but got %d", sell_res);
 
   // Dump database to verify the state after partial match
@@ -223,3 +239,177 @@ Test(test_command_db, test_partial_match_sell_and_buy) {
   free_order(sell_order);
   close_db(database);
 }
+
+Test(test_command_db, test_archived_orders_settle_before_committing) {
+  sqlite3* database = NULL;
+  int res = open_db(&database);
+  cr_assert_eq(res, 0, "Expected open_db to return 0, but got %d", res);
+  res = init_db(database);
+  cr_assert_eq(res, 0, "Expected init_db to return 0, but got %d", res);
+
+  user new_user = {
+      .username = "archivist",
+      .password = "password123",
+      .name = "Archive Reader",
+      .OMG = 100,
+  };
+  int user_id = 0;
+  res = insert_user(database, &new_user, &user_id);
+  cr_assert_eq(res, 0, "Expected insert_user to return 0, but got %d", res);
+
+  // Put an archive in a partition, so reading it back attaches one.
+  order archived = {.item = COIN_ETH,
+                    .buyOrSell = SELL,
+                    .quantity = 2,
+                    .unitPrice = 3.0,
+                    .userID = user_id};
+  res = insert_archive(database, &archived, time(NULL));
+  cr_assert_eq(res, SQLITE_OK, "insert_archive failed: %d", res);
+  res = rotate_archives(database,
+                        (int64_t)time(NULL) + 2 * ARCHIVE_PERIOD_SECONDS);
+  cr_assert_eq(res, SQLITE_OK, "rotate_archives failed: %d", res);
+
+  // A batch is open and holds a fill's balance change when the user reads
+  // their history.
+  start_netting();
+  cr_assert_eq(sqlite3_exec(database, "BEGIN;", 0, 0, NULL), SQLITE_OK);
+  cr_assert_eq(add_balance_change(database, user_id, COIN_OMG, 5), SQLITE_OK);
+  order* orders = NULL;
+  int count = 0;
+  get_archived_orders(database, user_id, 0, 10, &orders, &count);
+  cr_assert_eq(count, 1);
+  free_order_list(orders, count);
+
+  // Attaching the partition committed the batch, balance change included.
+  cr_assert_neq(sqlite3_get_autocommit(database), 0);
+  user balances = {.userID = user_id};
+  cr_assert_eq(get_user_inventories(database, &balances), SQLITE_OK);
+  cr_assert_eq(balances.OMG, 105);
+  cr_assert_eq(stop_netting(database), SQLITE_OK);
+  cr_assert_eq(get_user_inventories(database, &balances), SQLITE_OK);
+  cr_assert_eq(balances.OMG, 105);
+
+  sqlite3_stmt* stmt = NULL;
+  sqlite3_prepare_v2(database, "SELECT path FROM archive_partitions;", -1,
+                     &stmt, NULL);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    remove((const char*)sqlite3_column_text(stmt, 0));
+  }
+  sqlite3_finalize(stmt);
+  close_db(database);
+}
+
+Test(test_command_db, test_replay_keeps_journaled_times) {
+  // Two sells placed in the same second, then a buy that takes one of them.
+  const char* path = "test_command.log";
+  const int64_t placed = 1700000000;
+  (void)unlink(path);
+  start_journal(path);
+  const char* names[] = {"first", "second", "taker"};
+  for (int i = 0; i < 3; ++i) {
+    journal_entry user = {.type = JOURNAL_REGISTER,
+                          .time = placed,
+                          .username = names[i],
+                          .name = names[i],
+                          .password = "pw"};
+    append_journal(&user);
+  }
+  for (int userID = 1; userID <= 3; ++userID) {
+    journal_entry ord = {.type = JOURNAL_ORDER,
+                         .time = userID == 3 ? placed + 5 : placed,
+                         .userID = userID,
+                         .item = COIN_BTC,
+                         .buyOrSell = userID == 3 ? BUY : SELL,
+                         .quantity = 1,
+                         .price = 100};
+    append_journal(&ord);
+  }
+  wait_for_journal();
+  stop_journal();
+
+  sqlite3* database = NULL;
+  cr_assert_eq(open_db(&database), 0);
+  cr_assert_eq(init_db(database), 0);
+  cr_assert_eq(replay_commands(database, path, 0), 6);
+
+  // The earlier order ID goes first among orders placed in the same second.
+  cr_assert_eq(query_number(database, "SELECT orderID FROM orders;"), 2);
+  cr_assert_eq(query_number(database,
+                            "SELECT COUNT(*) FROM orders WHERE created_at = "
+                            "datetime(1700000000, 'unixepoch');"),
+               1);
+  // What the fill left behind is dated when the buy was placed, not now.
+  cr_assert_eq(query_number(database, "SELECT executedAt FROM executions;"),
+               placed + 5);
+  cr_assert_eq(query_number(database, "SELECT MIN(archivedAt) FROM archives;"),
+               placed + 5);
+  cr_assert_eq(query_number(database,
+                            "SELECT COUNT(*) FROM archives WHERE created_at = "
+                            "datetime(1700000000, 'unixepoch');"),
+               1);
+  cr_assert_eq(query_number(database,
+                            "SELECT COUNT(*) FROM archives WHERE created_at = "
+                            "datetime(1700000005, 'unixepoch');"),
+               1);
+  close_db(database);
+  (void)unlink(path);
+}
+
+Test(test_command_db, test_restart_keeps_history) {
+  const char* path = "test_command.log";
+  const char* snapshot = "test_command.snap";
+  (void)unlink(path);
+  (void)unlink(snapshot);
+  // Two users, then a trade between them on each side of a restart.
+  start_journal(path);
+  const char* names[] = {"seller", "buyer"};
+  for (int i = 0; i < 2; ++i) {
+    journal_entry user = {.type = JOURNAL_REGISTER,
+                          .time = 1700000000,
+                          .username = names[i],
+                          .name = names[i],
+                          .password = "pw"};
+    append_journal(&user);
+  }
+  for (int trade = 0; trade < 2; ++trade) {
+    for (int userID = 1; userID <= 2; ++userID) {
+      journal_entry ord = {.type = JOURNAL_ORDER,
+                           .time = 1700000000 + trade,
+                           .userID = userID,
+                           .item = COIN_BTC,
+                           .buyOrSell = userID == 2 ? BUY : SELL,
+                           .quantity = 1,
+                           .price = 100};
+      append_journal(&ord);
+    }
+    if (trade == 0) {
+      wait_for_journal();
+      stop_journal();
+      sqlite3* database = NULL;
+      cr_assert_eq(open_db(&database), 0);
+      cr_assert_eq(init_db(database), 0);
+      cr_assert_eq(recover_market(database, path, snapshot), 4);
+      cr_assert_eq(take_state_snapshot(database, 4, snapshot), 0);
+      close_db(database);
+      start_journal(path);
+    }
+  }
+  wait_for_journal();
+  stop_journal();
+
+  // Only the second trade is replayed, and the first one's history is kept.
+  sqlite3* database = NULL;
+  cr_assert_eq(open_db(&database), 0);
+  cr_assert_eq(upgrade_db(database), 0);
+  cr_assert_eq(recover_market(database, path, snapshot), 2);
+  cr_assert_eq(query_number(database, "SELECT COUNT(*) FROM executions;"), 2);
+  cr_assert_eq(query_number(database, "SELECT COUNT(*) FROM archives;"), 4);
+
+  // A lost database is rebuilt from the snapshot, which holds no history.
+  cr_assert_eq(init_db(database), 0);
+  cr_assert_eq(recover_market(database, path, snapshot), 2);
+  cr_assert_eq(query_number(database, "SELECT COUNT(*) FROM executions;"), 1);
+  close_db(database);
+  (void)unlink(path);
+  (void)unlink(snapshot);
+}
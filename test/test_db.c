@@ -1,5 +1,8 @@
 #include <criterion/criterion.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../src/db.h"
@@ -52,6 +55,117 @@ Test(test_db, test_drop_all_tables) {
   close_database(database);
 }
 
+Test(test_db, test_migrate_tables_keeps_rows) {
+  sqlite3* database = open_database();
+  drop_all_tables(database);
+
+  // A database from before versioning, with a user in it.
+  int res = create_tables(database);
+  cr_assert_eq(res, SQLITE_OK, "create_tables failed: %d", res);
+  res = sqlite3_exec(database,
+                     "INSERT INTO users (username, password, name) "
+                     "VALUES ('kept', 'pw', 'Kept');",
+                     0, 0, NULL);
+  cr_assert_eq(res, SQLITE_OK);
+
+  // Migrating twice runs each step once and keeps the user.
+  cr_assert_eq(migrate_tables(database), SQLITE_OK);
+  cr_assert_eq(migrate_tables(database), SQLITE_OK);
+  sqlite3_stmt* stmt = NULL;
+  res = sqlite3_prepare_v2(database,
+                           "SELECT (SELECT COUNT(*) FROM schema_version), "
+                           "(SELECT version FROM schema_version), "
+                           "(SELECT COUNT(*) FROM users);",
+                           -1, &stmt, NULL);
+  cr_assert_eq(res, SQLITE_OK);
+  cr_assert_eq(sqlite3_step(stmt), SQLITE_ROW);
+  cr_assert_eq(sqlite3_column_int(stmt, 0), 1);
+  cr_assert_eq(sqlite3_column_int(stmt, 1), SCHEMA_VERSION);
+  cr_assert_eq(sqlite3_column_int(stmt, 2), 1);
+  sqlite3_finalize(stmt);
+  cr_assert_eq(prewarm_tables(database), SQLITE_OK);
+
+  // A database from a newer version is left alone.
+  res = sqlite3_exec(database, "UPDATE schema_version SET version = 1000;", 0,
+                     0, NULL);
+  cr_assert_eq(res, SQLITE_OK);
+  cr_assert_neq(migrate_tables(database), SQLITE_OK);
+
+  drop_all_tables(database);
+  close_database(database);
+}
+
+Test(test_db, test_migrate_tables_from_baseline) {
+  sqlite3* database = open_database();
+  drop_all_tables(database);
+
+  // The tables as the first release created them, before archives were
+  // partitioned by when they were archived.
+  int res = sqlite3_exec(
+      database,
+      "CREATE TABLE users ("
+      "userID INTEGER PRIMARY KEY AUTOINCREMENT, "
+      "username TEXT UNIQUE NOT NULL, password TEXT NOT NULL, "
+      "name TEXT NOT NULL, OMG INTEGER DEFAULT 0, DOGE INTEGER DEFAULT 0, "
+      "BTC INTEGER DEFAULT 0, ETH INTEGER DEFAULT 0);"
+      "CREATE TABLE orders ("
+      "orderID INTEGER PRIMARY KEY AUTOINCREMENT, item INTEGER NOT NULL, "
+      "buyOrSell INTEGER NOT NULL, quantity INTEGER NOT NULL, "
+      "unitPrice REAL NOT NULL, userID INTEGER NOT NULL, "
+      "created_at DATETIME DEFAULT CURRENT_TIMESTAMP, "
+      "FOREIGN KEY(userID) REFERENCES users(userID));"
+      "CREATE TABLE archives ("
+      "orderID INTEGER PRIMARY KEY AUTOINCREMENT, item INTEGER NOT NULL, "
+      "buyOrSell INTEGER NOT NULL, quantity INTEGER NOT NULL, "
+      "unitPrice REAL NOT NULL, userID INTEGER NOT NULL, "
+      "created_at DATETIME DEFAULT CURRENT_TIMESTAMP, "
+      "FOREIGN KEY(userID) REFERENCES users(userID));"
+      "INSERT INTO users (username, password, name) "
+      "VALUES ('old', 'pw', 'Old');"
+      "INSERT INTO archives (item, buyOrSell, quantity, unitPrice, userID, "
+      "created_at) VALUES (2, 1, 1, 5.0, 1, '2024-01-02 03:04:05');",
+      0, 0, NULL);
+  cr_assert_eq(res, SQLITE_OK, "Creating the baseline tables failed: %d", res);
+
+  cr_assert_eq(migrate_tables(database), SQLITE_OK);
+
+  // The old archive is dated by when it was placed.
+  sqlite3_stmt* stmt = NULL;
+  res = sqlite3_prepare_v2(database, "SELECT archivedAt FROM archives;", -1,
+                           &stmt, NULL);
+  cr_assert_eq(res, SQLITE_OK, "archivedAt is missing: %s",
+               sqlite3_errmsg(database));
+  cr_assert_eq(sqlite3_step(stmt), SQLITE_ROW);
+  cr_assert_eq(sqlite3_column_int64(stmt, 0), 1704164645);
+  sqlite3_finalize(stmt);
+
+  // So it can be archived alongside new ones and moved to its partition.
+  order archived = {.item = COIN_ETH,
+                    .buyOrSell = SELL,
+                    .quantity = 2,
+                    .unitPrice = 3.0,
+                    .userID = 1};
+  res = insert_archive(database, &archived, time(NULL));
+  cr_assert_eq(res, SQLITE_OK, "insert_archive failed: %d", res);
+  res = rotate_archives(database, time(NULL));
+  cr_assert_eq(res, SQLITE_OK, "rotate_archives failed: %d", res);
+  res = sqlite3_prepare_v2(database, "SELECT COUNT(*) FROM archives;", -1,
+                           &stmt, NULL);
+  cr_assert_eq(res, SQLITE_OK);
+  cr_assert_eq(sqlite3_step(stmt), SQLITE_ROW);
+  cr_assert_eq(sqlite3_column_int(stmt, 0), 1);
+  sqlite3_finalize(stmt);
+
+  sqlite3_prepare_v2(database, "SELECT path FROM archive_partitions;", -1,
+                     &stmt, NULL);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    remove((const char*)sqlite3_column_text(stmt, 0));
+  }
+  sqlite3_finalize(stmt);
+  drop_all_tables(database);
+  close_database(database);
+}
+
 Test(test_db, test_create_tables_function) {
   // Open database
   sqlite3* database = open_database();
@@ -677,3 +791,136 @@ Test(test_orders, test_get_user_all_orders) {
 
   close_database(database);
 }
+
+Test(test_orders, test_get_user_orders_after) {
+  sqlite3* database = open_database();
+  cr_assert_not_null(database, "Database connection should not be NULL");
+  drop_all_tables(database);
+  create_tables(database);
+
+  user new_user = {
+      .username = "pager",
+      .password = "password123",
+      .name = "Page Reader",
+      .OMG = 1000,
+  };
+  int user_id = 0;
+  int res = insert_user(database, &new_user, &user_id);
+  cr_assert_eq(res, SQLITE_OK, "insert_user failed: %d", res);
+
+  for (int i = 0; i < 5; i++) {
+    order new_order = {.item = COIN_BTC,
+                       .buyOrSell = BUY,
+                       .quantity = 1,
+                       .unitPrice = 1.0 + i,
+                       .userID = user_id};
+    res = insert_order(database, &new_order);
+    cr_assert_eq(res, SQLITE_OK, "Failed to insert order %d: %d", i, res);
+  }
+
+  // The first page stops at the limit, in order of ID.
+  order* orders = NULL;
+  int order_count = 0;
+  res = get_user_orders_after(database, user_id, 0, 2, &orders, &order_count);
+  cr_assert_eq(res, SQLITE_OK, "get_user_orders_after failed: %d", res);
+  cr_assert_eq(order_count, 2);
+  cr_assert_lt(orders[0].orderID, orders[1].orderID);
+  int last_id = orders[1].orderID;
+  for (int i = 0; i < order_count; i++) {
+    free(orders[i].created_at);
+  }
+  free(orders);
+
+  // The next page starts after the last ID of the previous one.
+  res = get_user_orders_after(database, user_id, last_id, 10, &orders,
+                              &order_count);
+  cr_assert_eq(res, SQLITE_OK, "get_user_orders_after failed: %d", res);
+  cr_assert_eq(order_count, 3);
+  cr_assert_gt(orders[0].orderID, last_id);
+  cr_assert_float_eq(orders[2].unitPrice, 5.0, 1e-9);
+  for (int i = 0; i < order_count; i++) {
+    free(orders[i].created_at);
+  }
+  free(orders);
+
+  // Past the last order there is nothing left.
+  res = get_user_orders_after(database, user_id, INT_MAX, 10, &orders,
+                              &order_count);
+  cr_assert_eq(res, SQLITE_OK, "get_user_orders_after failed: %d", res);
+  cr_assert_eq(order_count, 0);
+  cr_assert_null(orders);
+
+  close_database(database);
+}
+
+Test(test_orders, test_rotate_archives) {
+  sqlite3* database = open_database();
+  cr_assert_not_null(database, "Database connection should not be NULL");
+  drop_all_tables(database);
+  create_tables(database);
+
+  user new_user = {
+      .username = "archivist",
+      .password = "password123",
+      .name = "Archive Reader",
+  };
+  int user_id = 0;
+  int res = insert_user(database, &new_user, &user_id);
+  cr_assert_eq(res, SQLITE_OK, "insert_user failed: %d", res);
+
+  order archived = {.item = COIN_ETH,
+                    .buyOrSell = SELL,
+                    .quantity = 2,
+                    .unitPrice = 3.0,
+                    .userID = user_id};
+  for (int i = 0; i < 3; i++) {
+    res = insert_archive(database, &archived, time(NULL));
+    cr_assert_eq(res, SQLITE_OK, "insert_archive failed: %d", res);
+  }
+
+  // Two periods later, every archive so far belongs to a past period.
+  int64_t later = (int64_t)time(NULL) + 2 * ARCHIVE_PERIOD_SECONDS;
+  res = rotate_archives(database, later);
+  cr_assert_eq(res, SQLITE_OK, "rotate_archives failed: %d", res);
+
+  sqlite3_stmt* stmt = NULL;
+  sqlite3_prepare_v2(database, "SELECT COUNT(*) FROM archives;", -1, &stmt,
+                     NULL);
+  cr_assert_eq(sqlite3_step(stmt), SQLITE_ROW);
+  cr_assert_eq(sqlite3_column_int(stmt, 0), 0,
+               "The archives table should be empty after rotating");
+  sqlite3_finalize(stmt);
+
+  // The current period's archives are read after the partition's.
+  res = insert_archive(database, &archived, time(NULL));
+  cr_assert_eq(res, SQLITE_OK, "insert_archive failed: %d", res);
+
+  order* orders = NULL;
+  int order_count = 0;
+  res = get_user_archived_orders(database, user_id, 0, 10, &orders,
+                                 &order_count);
+  cr_assert_eq(res, SQLITE_OK, "get_user_archived_orders failed: %d", res);
+  cr_assert_eq(order_count, 4);
+  for (int i = 1; i < order_count; i++) {
+    cr_assert_lt(orders[i - 1].orderID, orders[i].orderID);
+  }
+  int third_id = orders[2].orderID;
+  int fourth_id = orders[3].orderID;
+  free(orders);
+
+  // A page past the partition's IDs only reads the archives table.
+  res = get_user_archived_orders(database, user_id, third_id, 10, &orders,
+                                 &order_count);
+  cr_assert_eq(res, SQLITE_OK, "get_user_archived_orders failed: %d", res);
+  cr_assert_eq(order_count, 1);
+  cr_assert_eq(orders[0].orderID, fourth_id);
+  free(orders);
+
+  sqlite3_prepare_v2(database, "SELECT path FROM archive_partitions;", -1,
+                     &stmt, NULL);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    remove((const char*)sqlite3_column_text(stmt, 0));
+  }
+  sqlite3_finalize(stmt);
+  close_database(database);
+}
@@ -0,0 +1,65 @@
+#include <criterion/criterion.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/fixed_point.h"
+
+// Parse a null-terminated price and return the status.
+static parse_status price(const char* text, int64_t* ticks) {
+  return parse_price(text, strlen(text), ticks);
+}
+
+// Parse a null-terminated quantity and return the status.
+static parse_status quantity(const char* text, int* value) {
+  return parse_quantity(text, strlen(text), value);
+}
+
+Test(test_fixed_point, test_valid_prices) {
+  int64_t ticks = 0;
+  cr_assert_eq(price("12", &ticks), PARSE_OK);
+  cr_assert_eq(ticks, 1200, "Expected 1200 ticks, but got %lld",
+               (long long)ticks);
+  cr_assert_eq(price("12.5", &ticks), PARSE_OK);
+  cr_assert_eq(ticks, 1250, "Expected 1250 ticks, but got %lld",
+               (long long)ticks);
+  cr_assert_eq(price("0.05", &ticks), PARSE_OK);
+  cr_assert_eq(ticks, 5, "Expected 5 ticks, but got %lld", (long long)ticks);
+  cr_assert_eq(price("3.100", &ticks), PARSE_OK);
+  cr_assert_eq(ticks, 310, "Expected 310 ticks, but got %lld",
+               (long long)ticks);
+}
+
+Test(test_fixed_point, test_invalid_prices) {
+  int64_t ticks = 0;
+  cr_assert_eq(price("", &ticks), PARSE_EMPTY);
+  cr_assert_eq(price("-1", &ticks), PARSE_NEGATIVE);
+  cr_assert_eq(price("12abc", &ticks), PARSE_INVALID);
+  cr_assert_eq(price("1e3", &ticks), PARSE_INVALID);
+  cr_assert_eq(price(".5", &ticks), PARSE_INVALID);
+  cr_assert_eq(price("5.", &ticks), PARSE_INVALID);
+  cr_assert_eq(price("1.001", &ticks), PARSE_TOO_PRECISE);
+  cr_assert_eq(price("0.00", &ticks), PARSE_ZERO);
+  cr_assert_eq(price("99999999999999999999", &ticks), PARSE_OVERFLOW);
+}
+
+Test(test_fixed_point, test_quantities) {
+  int value = 0;
+  cr_assert_eq(quantity("42", &value), PARSE_OK);
+  cr_assert_eq(value, 42, "Expected 42, but got %d", value);
+  cr_assert_eq(quantity("2147483647", &value), PARSE_OK);
+  cr_assert_eq(value, INT_MAX);
+  cr_assert_eq(quantity("2147483648", &value), PARSE_OVERFLOW);
+  cr_assert_eq(quantity("0", &value), PARSE_ZERO);
+  cr_assert_eq(quantity("-3", &value), PARSE_NEGATIVE);
+  cr_assert_eq(quantity("1.5", &value), PARSE_INVALID);
+  cr_assert_eq(quantity("", &value), PARSE_EMPTY);
+}
+
+Test(test_fixed_point, test_stops_at_length) {
+  // Tokens are views into a longer line, so only length characters count.
+  int64_t ticks = 0;
+  cr_assert_eq(parse_price("7.25 3", 4, &ticks), PARSE_OK);
+  cr_assert_eq(ticks, 725, "Expected 725 ticks, but got %lld",
+               (long long)ticks);
+}
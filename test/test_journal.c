@@ -0,0 +1,135 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/journal.h"
+
+static const char* path = "test_journal.log";
+
+// The entries replayed by a test, with their strings copied out.
+typedef struct {
+  journal_entry entries[8];
+  char usernames[8][32];
+  int count;
+} replayed_entries;
+
+static void collect(const journal_entry* entry, void* context) {
+  replayed_entries* replayed = context;
+  cr_assert_lt(replayed->count, 8);
+  replayed->entries[replayed->count] = *entry;
+  if (entry->type == JOURNAL_REGISTER) {
+    (void)snprintf(replayed->usernames[replayed->count], 32, "%s",
+                   entry->username);
+  }
+  ++replayed->count;
+}
+
+// Write a register, an order and a cancel to a new journal.
+static void write_entries(void) {
+  (void)unlink(path);
+  cr_assert_eq(replay_journal(path, 0, collect, &(replayed_entries){0}), 0);
+  start_journal(path);
+  journal_entry user = {.type = JOURNAL_REGISTER, .time = 100,
+                        .username = "alice", .name = "Alice",
+                        .password = "pw"};
+  journal_entry order = {.type = JOURNAL_ORDER, .time = 101, .userID = 1,
+                         .item = 2, .buyOrSell = 1, .quantity = 7,
+                         .price = 12345};
+  journal_entry cancel = {.type = JOURNAL_CANCEL, .time = 102, .userID = 1,
+                          .orderID = 9};
+  append_journal(&user);
+  append_journal(&order);
+  append_journal(&cancel);
+  cr_assert_eq(cancel.sequence, 3);
+  wait_for_journal();
+  stop_journal();
+}
+
+Test(test_journal, test_missing_journal) {
+  (void)unlink(path);
+  replayed_entries replayed = {0};
+  cr_assert_eq(replay_journal(path, 0, collect, &replayed), 0);
+  cr_assert_eq(replayed.count, 0);
+}
+
+Test(test_journal, test_round_trip) {
+  write_entries();
+  replayed_entries replayed = {0};
+  cr_assert_eq(replay_journal(path, 0, collect, &replayed), 3);
+  cr_assert_eq(replayed.entries[0].type, JOURNAL_REGISTER);
+  cr_assert_str_eq(replayed.usernames[0], "alice");
+  cr_assert_eq(replayed.entries[1].type, JOURNAL_ORDER);
+  cr_assert_eq(replayed.entries[1].sequence, 2);
+  cr_assert_eq(replayed.entries[1].item, 2);
+  cr_assert_eq(replayed.entries[1].buyOrSell, 1);
+  cr_assert_eq(replayed.entries[1].quantity, 7);
+  cr_assert_eq(replayed.entries[1].price, 12345);
+  cr_assert_eq(replayed.entries[2].orderID, 9);
+  cr_assert_eq(replayed.entries[2].time, 102);
+  (void)unlink(path);
+}
+
+Test(test_journal, test_torn_record_is_dropped) {
+  write_entries();
+  // Cut the last record short, as a crash while writing it would.
+  FILE* file = fopen(path, "r+b");
+  cr_assert_not_null(file);
+  cr_assert_eq(fseek(file, 0, SEEK_END), 0);
+  long size = ftell(file);
+  cr_assert_eq(ftruncate(fileno(file), size - 3), 0);
+  (void)fclose(file);
+
+  replayed_entries replayed = {0};
+  cr_assert_eq(replay_journal(path, 0, collect, &replayed), 2);
+
+  // Appending carries on after the last good record.
+  start_journal(path);
+  journal_entry cancel = {.type = JOURNAL_CANCEL, .time = 103, .userID = 1,
+                          .orderID = 4};
+  append_journal(&cancel);
+  cr_assert_eq(cancel.sequence, 3);
+  stop_journal();
+
+  replayed = (replayed_entries){0};
+  cr_assert_eq(replay_journal(path, 0, collect, &replayed), 3);
+  cr_assert_eq(replayed.entries[2].orderID, 4);
+  (void)unlink(path);
+}
+
+Test(test_journal, test_corrupt_record_is_dropped) {
+  write_entries();
+  // Flip a byte inside the second record's payload.
+  FILE* file = fopen(path, "r+b");
+  cr_assert_not_null(file);
+  cr_assert_eq(fseek(file, 5 + 8 + 17 + 2 + 5 + 2 + 5 + 2 + 2 + 8 + 10,
+                     SEEK_SET),
+               0);
+  int byte = fgetc(file);
+  cr_assert_eq(fseek(file, -1, SEEK_CUR), 0);
+  cr_assert_neq(fputc(byte ^ 0xff, file), EOF);
+  (void)fclose(file);
+
+  replayed_entries replayed = {0};
+  cr_assert_eq(replay_journal(path, 0, collect, &replayed), 1);
+  (void)unlink(path);
+}
+
+Test(test_journal, test_entries_already_applied_are_skipped) {
+  write_entries();
+  replayed_entries replayed = {0};
+  cr_assert_eq(replay_journal(path, 2, collect, &replayed), 1);
+  cr_assert_eq(replayed.entries[0].type, JOURNAL_CANCEL);
+  cr_assert_eq(replayed.entries[0].sequence, 3);
+
+  // Numbering carries on after a snapshot newer than the journal.
+  replayed = (replayed_entries){0};
+  cr_assert_eq(replay_journal(path, 5, collect, &replayed), 0);
+  start_journal(path);
+  journal_entry cancel = {.type = JOURNAL_CANCEL, .time = 103, .userID = 1,
+                          .orderID = 4};
+  append_journal(&cancel);
+  cr_assert_eq(cancel.sequence, 6);
+  stop_journal();
+  (void)unlink(path);
+}
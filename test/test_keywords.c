@@ -0,0 +1,39 @@
+#include <criterion/criterion.h>
+#include <string.h>
+
+#include "../src/db.h"
+#include "../src/keywords.h"
+
+Test(test_keywords, test_find_command) {
+  cr_assert_eq(find_command("buy", 3), COMMAND_BUY);
+  cr_assert_eq(find_command("sell", 4), COMMAND_SELL);
+  cr_assert_eq(find_command("myInventory", 11), COMMAND_MY_INVENTORY);
+  cr_assert_eq(find_command("MYORDERS", 8), COMMAND_MY_ORDERS);
+  cr_assert_eq(find_command("cancelOrder", 11), COMMAND_CANCEL_ORDER);
+  cr_assert_eq(find_command("View", 4), COMMAND_VIEW);
+  cr_assert_eq(find_command("help", 4), COMMAND_HELP);
+}
+
+Test(test_keywords, test_find_asset) {
+  cr_assert_eq(find_asset("omg", 3), COIN_OMG);
+  cr_assert_eq(find_asset("DOGE", 4), COIN_DOGE);
+  cr_assert_eq(find_asset("Btc", 3), COIN_BTC);
+  cr_assert_eq(find_asset("eTh", 3), COIN_ETH);
+}
+
+Test(test_keywords, test_rejects_other_words) {
+  // Prefixes, longer words and words of the wrong kind are not matches.
+  cr_assert_eq(find_command("bu", 2), -1);
+  cr_assert_eq(find_command("buyer", 5), -1);
+  cr_assert_eq(find_command("btc", 3), -1);
+  cr_assert_eq(find_asset("buy", 3), -1);
+  cr_assert_eq(find_asset("xrp", 3), -1);
+  cr_assert_eq(find_asset("", 0), -1);
+  cr_assert_null(find_keyword("b[y", 3));
+}
+
+Test(test_keywords, test_length_limits_match) {
+  // Only the given number of characters is looked at.
+  cr_assert_eq(find_command("buy btc 1 2", 3), COMMAND_BUY);
+  cr_assert_eq(find_asset("btc 1 2", 3), COIN_BTC);
+}
@@ -0,0 +1,109 @@
+#include <criterion/criterion.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/line_reader.h"
+
+// Send a string down one end of a socket pair and read it into the reader from
+// the other end.
+static void feed(line_reader* reader, int sockets[2], const char* data) {
+  size_t length = strlen(data);
+  cr_assert_eq(write(sockets[0], data, length), (ssize_t)length,
+               "Failed to write test data");
+  cr_assert_eq(fill_line_reader(reader, sockets[1]), (ssize_t)length,
+               "Expected the reader to receive all %zu bytes", length);
+}
+
+Test(test_line_reader, test_both_terminators) {
+  int sockets[2];
+  cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+  line_reader reader;
+  init_line_reader(&reader);
+
+  feed(&reader, sockets, "buy btc 1 2\r\nmyorders\n");
+
+  line_view line;
+  cr_assert_eq(next_line(&reader, &line), LINE_READY);
+  cr_assert_str_eq(line.data, "buy btc 1 2", "Got line '%s'", line.data);
+  cr_assert_eq(line.length, 11, "Expected length 11, but got %zu",
+               line.length);
+
+  cr_assert_eq(next_line(&reader, &line), LINE_READY);
+  cr_assert_str_eq(line.data, "myorders", "Got line '%s'", line.data);
+  cr_assert_eq(line.length, 8, "Expected length 8, but got %zu", line.length);
+
+  cr_assert_eq(next_line(&reader, &line), LINE_INCOMPLETE);
+
+  close(sockets[0]);
+  close(sockets[1]);
+}
+
+Test(test_line_reader, test_partial_reads) {
+  int sockets[2];
+  cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+  line_reader reader;
+  init_line_reader(&reader);
+  line_view line;
+
+  feed(&reader, sockets, "view ");
+  cr_assert_eq(next_line(&reader, &line), LINE_INCOMPLETE);
+  feed(&reader, sockets, "btc\r");
+  cr_assert_eq(next_line(&reader, &line), LINE_INCOMPLETE);
+  feed(&reader, sockets, "\nhelp");
+  cr_assert_eq(next_line(&reader, &line), LINE_READY);
+  cr_assert_str_eq(line.data, "view btc", "Got line '%s'", line.data);
+  cr_assert_eq(next_line(&reader, &line), LINE_INCOMPLETE);
+
+  close(sockets[0]);
+  close(sockets[1]);
+}
+
+Test(test_line_reader, test_compacts_when_end_is_reached) {
+  int sockets[2];
+  cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+  line_reader reader;
+  init_line_reader(&reader);
+  line_view line;
+
+  // Fill all but the last few bytes with one line plus the start of another.
+  char data[LINE_READER_CAPACITY];
+  memset(data, 'a', LINE_READER_CAPACITY - 11);
+  data[LINE_READER_CAPACITY - 12] = '\n';
+  data[LINE_READER_CAPACITY - 11] = '\0';
+  feed(&reader, sockets, data);
+  feed(&reader, sockets, "myInventory");
+  cr_assert_eq(next_line(&reader, &line), LINE_READY);
+  cr_assert_eq(line.length, LINE_READER_CAPACITY - 12);
+  cr_assert_eq(next_line(&reader, &line), LINE_INCOMPLETE);
+
+  // The buffer is at its end, so the next fill has to move the tail forward.
+  feed(&reader, sockets, "\n");
+  cr_assert_eq(next_line(&reader, &line), LINE_READY);
+  cr_assert_str_eq(line.data, "myInventory", "Got line '%s'", line.data);
+
+  close(sockets[0]);
+  close(sockets[1]);
+}
+
+Test(test_line_reader, test_too_long_line_is_dropped) {
+  int sockets[2];
+  cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+  line_reader reader;
+  init_line_reader(&reader);
+  line_view line;
+
+  char data[LINE_READER_CAPACITY + 1];
+  memset(data, 'x', LINE_READER_CAPACITY);
+  data[LINE_READER_CAPACITY] = '\0';
+  feed(&reader, sockets, data);
+  cr_assert_eq(next_line(&reader, &line), LINE_TOO_LONG);
+
+  // The rest of the overlong line is thrown away, but the next line is kept.
+  feed(&reader, sockets, "xxxx\nhelp\n");
+  cr_assert_eq(next_line(&reader, &line), LINE_READY);
+  cr_assert_str_eq(line.data, "help", "Got line '%s'", line.data);
+
+  close(sockets[0]);
+  close(sockets[1]);
+}
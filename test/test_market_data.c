@@ -0,0 +1,120 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/market_data.h"
+
+// Run a writer against a memory stream and return what it wrote, which the
+// caller frees.
+static char* capture(feed_subscription* subscription, int item,
+                     int subscribe) {
+  char* text = NULL;
+  size_t size = 0;
+  FILE* out = open_memstream(&text, &size);
+  cr_assert_not_null(out);
+  if (subscribe) {
+    cr_assert_eq(subscribe_to_feed(subscription, item, out), 0);
+  } else {
+    cr_assert_neq(deliver_feed(subscription, out), -1);
+  }
+  (void)fclose(out);
+  return text;
+}
+
+Test(test_market_data, test_snapshot_lists_best_levels_first) {
+  record_book_change(COIN_BTC, BUY, 5.0, 3, 1);
+  record_book_change(COIN_BTC, BUY, 6.5, 1, 1);
+  record_book_change(COIN_BTC, BUY, 5.0, 2, 1);
+  record_book_change(COIN_BTC, SELL, 8.0, 4, 1);
+  record_book_change(COIN_BTC, SELL, 7.25, 1, 1);
+
+  feed_subscription subscription = {0};
+  char* text = capture(&subscription, COIN_BTC, 1);
+  cr_assert_str_eq(text,
+                   "SNAPSHOT BTC 5 2 2\r\n"
+                   "BID 6.50 1\r\n"
+                   "BID 5.00 5\r\n"
+                   "ASK 7.25 1\r\n"
+                   "ASK 8.00 4\r\n");
+  free(text);
+}
+
+Test(test_market_data, test_updates_follow_snapshot) {
+  feed_subscription subscription = {0};
+  free(capture(&subscription, COIN_ETH, 1));
+  char* text = capture(&subscription, COIN_ETH, 0);
+  cr_assert_str_eq(text, "");
+  free(text);
+
+  record_book_change(COIN_ETH, SELL, 2.0, 5, 1);
+  record_trade(COIN_ETH, 2.0, 2);
+  record_book_change(COIN_ETH, SELL, 2.0, -2, 0);
+  record_book_change(COIN_ETH, SELL, 2.0, -3, -1);
+  // Other coins' updates aren't sent.
+  record_book_change(COIN_BTC, BUY, 1.0, 1, 1);
+
+  text = capture(&subscription, COIN_ETH, 0);
+  cr_assert_str_eq(text,
+                   "UPDATE ETH 1 ASK ADD 2.00 5\r\n"
+                   "TRADE ETH 2 2.00 2\r\n"
+                   "UPDATE ETH 3 ASK CHANGE 2.00 3\r\n"
+                   "UPDATE ETH 4 ASK REMOVE 2.00 0\r\n");
+  free(text);
+  cr_assert_eq(count_feed_updates(), 5);
+}
+
+Test(test_market_data, test_lagging_subscriber_gets_snapshot) {
+  feed_subscription subscription = {0};
+  free(capture(&subscription, COIN_DOGE, 1));
+  for (int i = 0; i < FEED_LOG_SIZE + 1; ++i) {
+    record_book_change(COIN_DOGE, BUY, 1.0, 1, 1);
+  }
+
+  char* text = capture(&subscription, COIN_DOGE, 0);
+  cr_assert_str_eq(text, "SNAPSHOT DOGE 1025 1 0\r\nBID 1.00 1025\r\n");
+  free(text);
+}
+
+Test(test_market_data, test_unsubscribe_stops_updates) {
+  feed_subscription subscription = {0};
+  free(capture(&subscription, COIN_OMG, 1));
+  unsubscribe_from_feed(&subscription, COIN_OMG);
+  record_book_change(COIN_OMG, SELL, 3.0, 1, 1);
+
+  char* text = capture(&subscription, COIN_OMG, 0);
+  cr_assert_str_eq(text, "");
+  free(text);
+}
+
+Test(test_market_data, test_book_version_changes_with_orders) {
+  uint64_t version = get_book_version(COIN_DOGE);
+  record_trade(COIN_DOGE, 1.0, 1);
+  cr_assert_eq(get_book_version(COIN_DOGE), version);
+
+  record_book_change(COIN_DOGE, BUY, 1.0, 2, 1);
+  uint64_t changed = get_book_version(COIN_DOGE);
+  cr_assert_neq(changed, version);
+  // Other coins' versions stay put.
+  record_book_change(COIN_OMG, SELL, 1.0, 2, 1);
+  cr_assert_eq(get_book_version(COIN_DOGE), changed);
+}
+
+Test(test_market_data, test_depth_aggregates_orders_per_level) {
+  record_book_change(COIN_ETH, BUY, 3.0, 4, 1);
+  record_book_change(COIN_ETH, BUY, 3.0, 6, 1);
+  record_book_change(COIN_ETH, BUY, 3.5, 1, 1);
+  record_book_change(COIN_ETH, BUY, 2.0, 2, 1);
+  // Part of one order at 3.00 fills.
+  record_book_change(COIN_ETH, BUY, 3.0, -5, 0);
+
+  price_level levels[2];
+  cr_assert_eq(copy_book_depth(COIN_ETH, BUY, levels, 2), 2);
+  cr_assert_eq(levels[0].price, 350);
+  cr_assert_eq(levels[0].quantity, 1);
+  cr_assert_eq(levels[0].order_count, 1);
+  cr_assert_eq(levels[1].price, 300);
+  cr_assert_eq(levels[1].quantity, 5);
+  cr_assert_eq(levels[1].order_count, 2);
+  cr_assert_eq(copy_book_depth(COIN_ETH, SELL, levels, 2), 0);
+}
@@ -0,0 +1,71 @@
+#include <criterion/criterion.h>
+
+#include "../src/db.h"
+#include "../src/market_stats.h"
+
+// A time on a minute boundary, far from the epoch.
+static const int64_t start = 1700000040;
+
+Test(test_market_stats, test_no_trades) {
+  rolling_stats stats;
+  get_market_stats(COIN_BTC, start, &stats);
+  cr_assert_eq(stats.trade_count, 0);
+  cr_assert_eq(stats.volume, 0);
+  cr_assert_eq(stats.high, 0);
+}
+
+Test(test_market_stats, test_totals_and_vwap) {
+  record_stats_trade(COIN_BTC, 500, 2, start);
+  record_stats_trade(COIN_BTC, 700, 1, start + 30);
+  record_stats_trade(COIN_BTC, 400, 1, start + 3600);
+
+  rolling_stats stats;
+  get_market_stats(COIN_BTC, start + 3600, &stats);
+  cr_assert_eq(stats.trade_count, 3);
+  cr_assert_eq(stats.volume, 4);
+  cr_assert_float_eq(stats.vwap, 525.0, 1e-9);
+  cr_assert_eq(stats.high, 700);
+  cr_assert_eq(stats.low, 400);
+}
+
+Test(test_market_stats, test_trades_leave_window) {
+  record_stats_trade(COIN_ETH, 900, 5, start);
+  record_stats_trade(COIN_ETH, 100, 1, start + 60);
+  record_stats_trade(COIN_ETH, 300, 2, start + 7200);
+
+  rolling_stats stats;
+  // The first minute has just left the window, taking the high with it.
+  get_market_stats(COIN_ETH, start + STATS_WINDOW_SECONDS, &stats);
+  cr_assert_eq(stats.trade_count, 2);
+  cr_assert_eq(stats.volume, 3);
+  cr_assert_eq(stats.high, 300);
+  cr_assert_eq(stats.low, 100);
+
+  get_market_stats(COIN_ETH, start + STATS_WINDOW_SECONDS + 60, &stats);
+  cr_assert_eq(stats.trade_count, 1);
+  cr_assert_eq(stats.low, 300);
+
+  // A whole day later nothing is left.
+  get_market_stats(COIN_ETH, start + 3 * STATS_WINDOW_SECONDS, &stats);
+  cr_assert_eq(stats.trade_count, 0);
+}
+
+Test(test_market_stats, test_load_from_executions) {
+  sqlite3* database = NULL;
+  cr_assert_eq(sqlite3_open(":memory:", &database), SQLITE_OK);
+  cr_assert_eq(create_tables(database), SQLITE_OK);
+  execution old = {.item = COIN_DOGE, .price = 50, .quantity = 9,
+                   .executedAt = start - STATS_WINDOW_SECONDS - 60};
+  execution recent = {.item = COIN_DOGE, .price = 60, .quantity = 3,
+                      .executedAt = start - 60};
+  cr_assert_eq(insert_execution(database, &old), SQLITE_OK);
+  cr_assert_eq(insert_execution(database, &recent), SQLITE_OK);
+
+  cr_assert_eq(load_market_stats(database, start), 0);
+  rolling_stats stats;
+  get_market_stats(COIN_DOGE, start, &stats);
+  cr_assert_eq(stats.trade_count, 1);
+  cr_assert_eq(stats.volume, 3);
+  cr_assert_eq(stats.high, 60);
+  sqlite3_close(database);
+}
@@ -0,0 +1,87 @@
+#include <criterion/criterion.h>
+
+#include "../src/db.h"
+#include "../src/settlement.h"
+
+static sqlite3* open_market(void) {
+  sqlite3* database = NULL;
+  cr_assert_eq(sqlite3_open(":memory:", &database), SQLITE_OK);
+  cr_assert_eq(create_tables(database), SQLITE_OK);
+  cr_assert_eq(sqlite3_exec(database,
+                            "INSERT INTO users (username, password, name, "
+                            "OMG, DOGE, BTC, ETH) VALUES "
+                            "('maker', 'pw', 'Maker', 1000, 0, 50, 0), "
+                            "('a', 'pw', 'A', 100, 0, 0, 0), "
+                            "('b', 'pw', 'B', 100, 0, 0, 0);",
+                            0, 0, NULL),
+               SQLITE_OK);
+  return database;
+}
+
+static int get_balance(sqlite3* database, int userID, int coin) {
+  user usr = {.userID = userID};
+  cr_assert_eq(get_user_inventories(database, &usr), SQLITE_OK);
+  int balances[] = {usr.OMG, usr.DOGE, usr.BTC, usr.ETH};
+  return balances[coin];
+}
+
+Test(test_settlement, test_changes_are_written_straight_away) {
+  sqlite3* database = open_market();
+  cr_assert_eq(add_balance_change(database, 2, COIN_OMG, -30), SQLITE_OK);
+  cr_assert_eq(get_balance(database, 2, COIN_OMG), 70);
+  sqlite3_close(database);
+}
+
+Test(test_settlement, test_fills_are_netted) {
+  sqlite3* database = open_market();
+  start_netting();
+  // The maker sells one BTC at 10 to each of the others, twice over.
+  for (int i = 0; i < 2; ++i) {
+    for (int buyer = 2; buyer <= 3; ++buyer) {
+      cr_assert_eq(add_balance_change(database, buyer, COIN_OMG, -10),
+                   SQLITE_OK);
+      cr_assert_eq(add_balance_change(database, buyer, COIN_BTC, 1),
+                   SQLITE_OK);
+      cr_assert_eq(add_balance_change(database, 1, COIN_OMG, 10), SQLITE_OK);
+      cr_assert_eq(add_balance_change(database, 1, COIN_BTC, -1), SQLITE_OK);
+    }
+  }
+  cr_assert_eq(get_balance(database, 1, COIN_OMG), 1000);
+
+  int changes_before = sqlite3_total_changes(database);
+  cr_assert_eq(settle_balances(database), SQLITE_OK);
+  cr_assert_eq(sqlite3_total_changes(database) - changes_before, 3);
+  cr_assert_eq(get_balance(database, 1, COIN_OMG), 1040);
+  cr_assert_eq(get_balance(database, 1, COIN_BTC), 46);
+  cr_assert_eq(get_balance(database, 3, COIN_OMG), 80);
+  cr_assert_eq(get_balance(database, 3, COIN_BTC), 2);
+
+  // Nothing is written twice.
+  cr_assert_eq(settle_balances(database), SQLITE_OK);
+  cr_assert_eq(get_balance(database, 1, COIN_OMG), 1040);
+  cr_assert_eq(stop_netting(database), SQLITE_OK);
+  sqlite3_close(database);
+}
+
+Test(test_settlement, test_settling_one_user) {
+  sqlite3* database = open_market();
+  start_netting();
+  cr_assert_eq(add_balance_change(database, 1, COIN_OMG, 5), SQLITE_OK);
+  cr_assert_eq(add_balance_change(database, 2, COIN_OMG, 7), SQLITE_OK);
+  cr_assert_eq(add_balance_change(database, 3, COIN_OMG, 9), SQLITE_OK);
+
+  cr_assert_eq(settle_user(database, 1), SQLITE_OK);
+  cr_assert_eq(get_balance(database, 1, COIN_OMG), 1005);
+  cr_assert_eq(get_balance(database, 3, COIN_OMG), 100);
+
+  // A row rewritten in the meantime keeps the changes held for it.
+  cr_assert_eq(sqlite3_exec(database,
+                            "UPDATE users SET OMG = OMG - 50 WHERE userID = 3;",
+                            0, 0, NULL),
+               SQLITE_OK);
+  cr_assert_eq(stop_netting(database), SQLITE_OK);
+  cr_assert_eq(get_balance(database, 1, COIN_OMG), 1005);
+  cr_assert_eq(get_balance(database, 2, COIN_OMG), 107);
+  cr_assert_eq(get_balance(database, 3, COIN_OMG), 59);
+  sqlite3_close(database);
+}
@@ -0,0 +1,94 @@
+#include <criterion/criterion.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/shm_ring.h"
+
+// Rings are too large to comfortably put on the stack.
+static shm_ring* make_ring(void) {
+  shm_ring* ring = malloc(sizeof(shm_ring));
+  cr_assert_not_null(ring);
+  init_shm_ring(ring);
+  return ring;
+}
+
+Test(test_shm_ring, test_round_trip) {
+  shm_ring* ring = make_ring();
+  const char* data = NULL;
+  cr_assert_eq(peek_shm_ring(ring, &data), 0);
+
+  cr_assert_eq(write_shm_ring(ring, "buy btc 1 1\n", 12), 12);
+  cr_assert_eq(peek_shm_ring(ring, &data), 12);
+  cr_assert_eq(memcmp(data, "buy btc 1 1\n", 12), 0);
+  consume_shm_ring(ring, 4);
+  cr_assert_eq(peek_shm_ring(ring, &data), 8);
+  cr_assert_eq(memcmp(data, "btc 1 1\n", 8), 0);
+  consume_shm_ring(ring, 8);
+  cr_assert_eq(peek_shm_ring(ring, &data), 0);
+  free(ring);
+}
+
+Test(test_shm_ring, test_wraps_around) {
+  shm_ring* ring = make_ring();
+  // Move both positions to just before the end of the data.
+  static char filler[SHM_RING_CAPACITY - 3];
+  cr_assert_eq(write_shm_ring(ring, filler, sizeof(filler)),
+               (ssize_t)sizeof(filler));
+  consume_shm_ring(ring, sizeof(filler));
+
+  cr_assert_eq(write_shm_ring(ring, "abcdef", 6), 6);
+  const char* data = NULL;
+  cr_assert_eq(peek_shm_ring(ring, &data), 3);
+  cr_assert_eq(memcmp(data, "abc", 3), 0);
+  consume_shm_ring(ring, 3);
+  cr_assert_eq(peek_shm_ring(ring, &data), 3);
+  cr_assert_eq(data, ring->data);
+  cr_assert_eq(memcmp(data, "def", 3), 0);
+  free(ring);
+}
+
+Test(test_shm_ring, test_full_ring_parks_writer) {
+  shm_ring* ring = make_ring();
+  static char filler[SHM_RING_CAPACITY];
+  cr_assert_eq(write_shm_ring(ring, filler, sizeof(filler) - 1),
+               (ssize_t)sizeof(filler) - 1);
+  cr_assert_eq(write_shm_ring(ring, "xy", 2), 1);
+  cr_assert_eq(write_shm_ring(ring, "y", 1), 0);
+  cr_assert_eq(park_shm_writer(ring), 1);
+
+  // The reader makes room and owes the writer a wakeup, but only once.
+  consume_shm_ring(ring, 10);
+  cr_assert_eq(unpark_shm_writer(ring), 1);
+  cr_assert_eq(unpark_shm_writer(ring), 0);
+  cr_assert_eq(park_shm_writer(ring), 0);
+  cr_assert_eq(write_shm_ring(ring, "y", 1), 1);
+  free(ring);
+}
+
+Test(test_shm_ring, test_reader_parking) {
+  shm_ring* ring = make_ring();
+  // A new ring's reader waits for the first write.
+  cr_assert_eq(write_shm_ring(ring, "a", 1), 1);
+  cr_assert_eq(unpark_shm_reader(ring), 1);
+  cr_assert_eq(unpark_shm_reader(ring), 0);
+
+  // A reader can't park while data is waiting.
+  cr_assert_eq(park_shm_reader(ring), 0);
+  cr_assert_eq(unpark_shm_reader(ring), 0);
+  consume_shm_ring(ring, 1);
+  cr_assert_eq(park_shm_reader(ring), 1);
+  cr_assert_eq(write_shm_ring(ring, "b", 1), 1);
+  cr_assert_eq(unpark_shm_reader(ring), 1);
+  free(ring);
+}
+
+Test(test_shm_ring, test_head_out_of_range) {
+  shm_ring* ring = make_ring();
+  cr_assert_eq(write_shm_ring(ring, "abc", 3), 3);
+  // A reader that moves its head past the tail would make the ring look
+  // larger than it is.
+  atomic_store(&ring->head, 4);
+  cr_assert_eq(write_shm_ring(ring, "d", 1), -1);
+  cr_assert_eq(park_shm_writer(ring), -1);
+  free(ring);
+}
@@ -0,0 +1,119 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/db.h"
+#include "../src/state_snapshot.h"
+
+static const char* path = "test_state_snapshot.snap";
+
+static sqlite3* open_market(void) {
+  sqlite3* database = NULL;
+  cr_assert_eq(sqlite3_open(":memory:", &database), SQLITE_OK);
+  cr_assert_eq(create_tables(database), SQLITE_OK);
+  return database;
+}
+
+// Read a single number back from a query.
+static int64_t query_number(sqlite3* database, const char* sql) {
+  sqlite3_stmt* stmt = NULL;
+  cr_assert_eq(sqlite3_prepare_v2(database, sql, -1, &stmt, NULL), SQLITE_OK);
+  cr_assert_eq(sqlite3_step(stmt), SQLITE_ROW);
+  int64_t value = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+  return value;
+}
+
+Test(test_state_snapshot, test_missing_snapshot) {
+  (void)unlink(path);
+  sqlite3* database = open_market();
+  uint64_t sequence = 7;
+  cr_assert_eq(restore_state_snapshot(database, path, &sequence), 0);
+  cr_assert_eq(sequence, 0);
+  sqlite3_close(database);
+}
+
+Test(test_state_snapshot, test_round_trip) {
+  sqlite3* original = open_market();
+  // The third order was filled, so its ID is taken but it isn't open.
+  cr_assert_eq(sqlite3_exec(original,
+                            "INSERT INTO users (username, password, name, "
+                            "OMG, DOGE, BTC, ETH) VALUES "
+                            "('a', 'pa', 'Alice', 1, 2, 3, 4), "
+                            "('b', 'pb', 'Bob', 5, 6, 7, 8);"
+                            "INSERT INTO orders (item, buyOrSell, quantity, "
+                            "unitPrice, userID, created_at) VALUES "
+                            "(2, 0, 3, 12.34, 1, '2024-01-02 03:04:05'), "
+                            "(1, 1, 9, 0.05, 2, '2024-01-02 03:04:06'), "
+                            "(1, 1, 1, 1.0, 2, '2024-01-02 03:04:07');"
+                            "DELETE FROM orders WHERE orderID = 3;",
+                            0, 0, NULL),
+               SQLITE_OK);
+  (void)unlink(path);
+  cr_assert_eq(take_state_snapshot(original, 42, path), 0);
+  sqlite3_close(original);
+
+  sqlite3* restored = open_market();
+  uint64_t sequence = 0;
+  cr_assert_eq(restore_state_snapshot(restored, path, &sequence), 0);
+  cr_assert_eq(sequence, 42);
+
+  user bob = {0};
+  cr_assert_eq(get_user_by_username(restored, "b", &bob), SQLITE_OK);
+  cr_assert_eq(bob.userID, 2);
+  cr_assert_str_eq(bob.name, "Bob");
+  cr_assert_str_eq(bob.password, "pb");
+  cr_assert_eq(bob.OMG, 5);
+  cr_assert_eq(bob.ETH, 8);
+  free(bob.username);
+  free(bob.password);
+  free(bob.name);
+
+  order first = {0};
+  cr_assert_eq(get_order(restored, 1, &first), SQLITE_OK);
+  cr_assert_eq(first.item, 2);
+  cr_assert_eq(first.quantity, 3);
+  cr_assert_eq(first.unitPrice, 12.34);
+  cr_assert_str_eq(first.created_at, "2024-01-02 03:04:05");
+  free(first.created_at);
+  cr_assert_eq(query_number(restored, "SELECT COUNT(*) FROM orders;"), 2);
+
+  // New orders carry on after the filled one rather than reusing its ID.
+  cr_assert_eq(sqlite3_exec(restored,
+                            "INSERT INTO orders (item, buyOrSell, quantity, "
+                            "unitPrice, userID) VALUES (0, 0, 1, 1.0, 1);",
+                            0, 0, NULL),
+               SQLITE_OK);
+  cr_assert_eq(sqlite3_last_insert_rowid(restored), 4);
+  sqlite3_close(restored);
+  (void)unlink(path);
+}
+
+Test(test_state_snapshot, test_damaged_snapshot_is_refused) {
+  sqlite3* original = open_market();
+  cr_assert_eq(sqlite3_exec(original,
+                            "INSERT INTO users (username, password, name) "
+                            "VALUES ('a', 'pa', 'Alice');",
+                            0, 0, NULL),
+               SQLITE_OK);
+  (void)unlink(path);
+  cr_assert_eq(take_state_snapshot(original, 1, path), 0);
+  sqlite3_close(original);
+
+  // Flip a byte of the user's record.
+  FILE* file = fopen(path, "r+b");
+  cr_assert_not_null(file);
+  cr_assert_eq(fseek(file, (long)sizeof(snapshot_header) + 8, SEEK_SET), 0);
+  int byte = fgetc(file);
+  cr_assert_eq(fseek(file, -1, SEEK_CUR), 0);
+  cr_assert_neq(fputc(byte ^ 0xff, file), EOF);
+  (void)fclose(file);
+
+  sqlite3* restored = open_market();
+  uint64_t sequence = 0;
+  cr_assert_eq(restore_state_snapshot(restored, path, &sequence), -1);
+  cr_assert_eq(query_number(restored, "SELECT COUNT(*) FROM users;"), 0);
+  sqlite3_close(restored);
+  (void)unlink(path);
+}
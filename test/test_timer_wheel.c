@@ -0,0 +1,79 @@
+#include <criterion/criterion.h>
+#include <stdint.h>
+
+#include "../src/timer_wheel.h"
+
+// Record the tick at which each timer expired in the timer's data.
+static void record_expiry(timer* deadline, void* context) {
+  const timer_wheel* wheel = context;
+  *(uint64_t*)deadline->data = wheel->current;
+}
+
+Test(test_timer_wheel, test_expires_on_time) {
+  timer_wheel wheel;
+  init_timer_wheel(&wheel, 1000);
+  uint64_t expired_at = 0;
+  timer deadline;
+  init_timer(&deadline, &expired_at);
+  schedule_timer(&wheel, &deadline, 1005);
+
+  cr_assert_eq(advance_timer_wheel(&wheel, 1004, record_expiry, &wheel), 0);
+  cr_assert_eq(advance_timer_wheel(&wheel, 1010, record_expiry, &wheel), 1);
+  cr_assert_eq(expired_at, 1005, "Expected expiry at 1005, but got %llu",
+               (unsigned long long)expired_at);
+  cr_assert_eq(wheel.count, 0);
+}
+
+Test(test_timer_wheel, test_far_timers_cascade) {
+  timer_wheel wheel;
+  init_timer_wheel(&wheel, 7);
+  // Each of these lands on a different level of the wheel at first.
+  const uint64_t delays[] = {3, 100, 5000, 300000};
+  uint64_t expired_at[4] = {0};
+  timer deadlines[4];
+  for (size_t i = 0; i < 4; ++i) {
+    init_timer(&deadlines[i], &expired_at[i]);
+    schedule_timer(&wheel, &deadlines[i], 7 + delays[i]);
+  }
+
+  cr_assert_eq(advance_timer_wheel(&wheel, 7 + 300000, record_expiry, &wheel),
+               4);
+  for (size_t i = 0; i < 4; ++i) {
+    cr_assert_eq(expired_at[i], 7 + delays[i],
+                 "Expected timer %zu to expire at %llu, but got %llu", i,
+                 (unsigned long long)(7 + delays[i]),
+                 (unsigned long long)expired_at[i]);
+  }
+}
+
+Test(test_timer_wheel, test_cancel_and_reschedule) {
+  timer_wheel wheel;
+  init_timer_wheel(&wheel, 0);
+  uint64_t expired_at = 0;
+  timer deadline;
+  init_timer(&deadline, &expired_at);
+
+  schedule_timer(&wheel, &deadline, 10);
+  cancel_timer(&wheel, &deadline);
+  cr_assert_eq(wheel.count, 0);
+  cr_assert_eq(advance_timer_wheel(&wheel, 20, record_expiry, &wheel), 0);
+
+  // Rescheduling a pending timer moves it rather than adding it twice.
+  schedule_timer(&wheel, &deadline, 30);
+  schedule_timer(&wheel, &deadline, 90);
+  cr_assert_eq(wheel.count, 1);
+  cr_assert_eq(advance_timer_wheel(&wheel, 100, record_expiry, &wheel), 1);
+  cr_assert_eq(expired_at, 90, "Expected expiry at 90, but got %llu",
+               (unsigned long long)expired_at);
+}
+
+Test(test_timer_wheel, test_past_deadline_expires_next_tick) {
+  timer_wheel wheel;
+  init_timer_wheel(&wheel, 50);
+  uint64_t expired_at = 0;
+  timer deadline;
+  init_timer(&deadline, &expired_at);
+  schedule_timer(&wheel, &deadline, 40);
+  cr_assert_eq(advance_timer_wheel(&wheel, 51, record_expiry, &wheel), 1);
+  cr_assert_eq(expired_at, 51);
+}
@@ -0,0 +1,68 @@
+#include <criterion/criterion.h>
+
+#include "../src/trade_tape.h"
+
+// Open an empty database in memory with the executions table.
+static sqlite3* open_tape_database(void) {
+  sqlite3* database = NULL;
+  cr_assert_eq(sqlite3_open(":memory:", &database), SQLITE_OK);
+  cr_assert_eq(create_tables(database), SQLITE_OK);
+  cr_assert_eq(load_trade_tape(database), 0);
+  return database;
+}
+
+// Record a buyer taking a resting sell at a price.
+static void record_buy(sqlite3* database, int item, int64_t price,
+                       int quantity) {
+  execution fill = {.item = item,
+                    .price = price,
+                    .quantity = quantity,
+                    .aggressor = BUY,
+                    .buyerID = 1,
+                    .sellerID = 2,
+                    .executedAt = 1000};
+  cr_assert_eq(record_execution(database, &fill), SQLITE_OK);
+  cr_assert_gt(fill.executionID, 0);
+}
+
+Test(test_trade_tape, test_last_trade) {
+  sqlite3* database = open_tape_database();
+  execution fill;
+  cr_assert_eq(get_last_trade(COIN_BTC, &fill), 0);
+  record_buy(database, COIN_BTC, 500, 2);
+  record_buy(database, COIN_BTC, 525, 1);
+  record_buy(database, COIN_ETH, 100, 1);
+  cr_assert_eq(get_last_trade(COIN_BTC, &fill), 1);
+  cr_assert_eq(fill.price, 525);
+  cr_assert_eq(fill.quantity, 1);
+  sqlite3_close(database);
+}
+
+Test(test_trade_tape, test_recent_trades_newest_first) {
+  sqlite3* database = open_tape_database();
+  for (int i = 0; i < TRADE_TAPE_SIZE + 5; ++i) {
+    record_buy(database, COIN_DOGE, 100 + i, 1);
+  }
+  execution fills[3];
+  cr_assert_eq(copy_recent_trades(COIN_DOGE, fills, 3), 3);
+  cr_assert_eq(fills[0].price, 100 + TRADE_TAPE_SIZE + 4);
+  cr_assert_eq(fills[2].price, 100 + TRADE_TAPE_SIZE + 2);
+  cr_assert_eq(copy_recent_trades(COIN_OMG, fills, 3), 0);
+  sqlite3_close(database);
+}
+
+Test(test_trade_tape, test_reload_from_database) {
+  sqlite3* database = open_tape_database();
+  record_buy(database, COIN_ETH, 300, 4);
+  record_buy(database, COIN_ETH, 310, 5);
+
+  cr_assert_eq(load_trade_tape(database), 0);
+  execution fills[4];
+  cr_assert_eq(copy_recent_trades(COIN_ETH, fills, 4), 2);
+  cr_assert_eq(fills[0].price, 310);
+  cr_assert_eq(fills[0].buyerID, 1);
+  cr_assert_eq(fills[0].sellerID, 2);
+  cr_assert_eq(fills[1].price, 300);
+  cr_assert_eq(fills[1].executionID + 1, fills[0].executionID);
+  sqlite3_close(database);
+}
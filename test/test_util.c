@@ -0,0 +1,45 @@
+#include <criterion/criterion.h>
+#include <string.h>
+
+#include "../src/util.h"
+
+// Check that a token is a view of the expected text.
+static void assert_token(const token_view* token, const char* expected) {
+  size_t length = strlen(expected);
+  cr_assert_eq(token->length, length, "Expected length %zu, but got %zu",
+               length, token->length);
+  cr_assert_eq(strncmp(token->data, expected, length), 0,
+               "Expected '%s', but got '%.*s'", expected, (int)token->length,
+               token->data);
+}
+
+Test(test_util, test_tokens_point_into_line) {
+  const char* line = "  buy btc\t12.5  3 ";
+  token_array tokens;
+  tokenize_line(line, &tokens);
+
+  cr_assert_eq(tokens.size, 4, "Expected 4 tokens, but got %zu", tokens.size);
+  cr_assert_not(tokens.truncated);
+  assert_token(&tokens.tokens[0], "buy");
+  assert_token(&tokens.tokens[1], "btc");
+  assert_token(&tokens.tokens[2], "12.5");
+  assert_token(&tokens.tokens[3], "3");
+  // The tokens are views, not copies.
+  cr_assert_eq(tokens.tokens[0].data, line + 2);
+}
+
+Test(test_util, test_blank_line_has_no_tokens) {
+  token_array tokens;
+  tokenize_line(" \t ", &tokens);
+  cr_assert_eq(tokens.size, 0, "Expected no tokens, but got %zu", tokens.size);
+  tokenize_line("", &tokens);
+  cr_assert_eq(tokens.size, 0, "Expected no tokens, but got %zu", tokens.size);
+}
+
+Test(test_util, test_too_many_tokens_are_truncated) {
+  token_array tokens;
+  tokenize_line("a b c d e f g h i j", &tokens);
+  cr_assert_eq(tokens.size, MAX_TOKENS);
+  cr_assert(tokens.truncated);
+  assert_token(&tokens.tokens[MAX_TOKENS - 1], "h");
+}